@@ -21,7 +21,13 @@ void run_chat_interactive_mode(RagPipeline& pipeline, const Options& options)
             break;
 
         std::cout << "\nResponse:" << std::endl;
-        auto async_generation = pipeline.generate_async(query, RagInferenceSettings{.top_k = options.top_k},
+        const auto settings = RagInferenceSettings{.top_k = options.top_k,
+                                                   .min_score = options.min_score,
+                                                   .max_relative_score_gap = options.max_relative_score_gap,
+                                                   .max_context_tokens = options.max_context_tokens,
+                                                   .mmr = options.mmr,
+                                                   .hybrid = options.hybrid};
+        auto async_generation = pipeline.generate_async(query, settings,
                                                         [](const LlmAsyncOutput& output)
                                                         {
                                                             std::cout << output.answer;
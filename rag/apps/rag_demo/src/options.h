@@ -5,6 +5,9 @@
 #include <magic_enum/magic_enum.hpp>
 #include <string>
 
+#include "rag/document_retrieval.h"
+#include "rag/vector_database.h"
+
 #include <iostream>
 #include <optional>
 
@@ -19,8 +22,10 @@ enum class ProgramMode {
 struct Options
 {
     std::string embedding_model_path;
+    std::string embedding_cache_path;
     std::string database_input;
     std::string database_output;
+    std::string snapshot_output;
     std::string queries_input;
     std::string result_output;
 
@@ -30,7 +35,17 @@ struct Options
 
     int32_t embedding_threads;
     int32_t embedding_batch_size;
+    int32_t ingestion_threads;
+    int32_t embedding_contexts;
+    size_t query_cache_mb;
     uint32_t top_k;
+    std::optional<float> min_score;
+    std::optional<float> max_relative_score_gap;
+    std::optional<uint32_t> max_context_tokens;
+    std::optional<MmrSettings> mmr;
+    std::optional<HybridSearchSettings> hybrid;
+
+    VectorStoreParams vector_store_params;
 
     ProgramMode mode;
 };
@@ -46,25 +61,55 @@ class OptionParser
         po::options_description description("Utility application for creating the embeddings database dump");
 
         std::string mode;
+        std::string vector_index;
+        std::string vector_refine;
+        float min_score;
+        float max_relative_score_gap;
+        uint32_t max_context_tokens;
+        float mmr_lambda;
+        float duplicate_threshold;
+        float rrf_k;
 
         description.add_options()("help,h", "produce help message");
         description.add_options()("embedding_model,m",
             po::value<std::string>(&opts.embedding_model_path)->default_value("./gte-base-f32.gguf"),
             "Model used to generate the embeddings.");
         description.add_options()("database_output,o", po::value<std::string>(&opts.database_output),
-                                  "Path to an output file with calculated embeddings.");
+                                  "Path to an output file with calculated embeddings, binary unless it has the .json extension.");
         description.add_options()("queries_input,qi", po::value<std::string>(&opts.queries_input),
             "Input file containing the queries to run against. If provided interactive mode will be disabled.");
         description.add_options()("database_input,di", po::value<std::string>(&opts.database_input),
-                                  "Input file containing the previously dumped database.");
+                                  "Input file containing the previously dumped database, json or binary, or a snapshot directory.");
+        description.add_options()("snapshot_output", po::value<std::string>(&opts.snapshot_output),
+                                  "Output directory for the database snapshot with the serialized vector index.");
         description.add_options()("embedding_threads,t", po::value<int32_t>(&opts.embedding_threads)->default_value(1),
                                   "Number of threads to run the embeddings model.");
         description.add_options()("result_output,ro", po::value<std::string>(&opts.result_output),
                                   "Output file to log the retrieved chunks with the queries");
+        description.add_options()("embedding_cache", po::value<std::string>(&opts.embedding_cache_path),
+                                  "File caching the chunk embeddings, so the unchanged chunks are not embedded again.");
         description.add_options()("embedding_batch_size,b", po::value<int32_t>(&opts.embedding_batch_size)->default_value(512),
                                   "Maximum batch size of running the embeddings model. Must be set to a value greater than n_ctx of the model.");
+        description.add_options()("ingestion_threads", po::value<int32_t>(&opts.ingestion_threads)->default_value(1),
+                                  "Number of threads embedding the loaded chunks concurrently, each of them with its own embedding context.");
+        description.add_options()("embedding_contexts", po::value<int32_t>(&opts.embedding_contexts)->default_value(1),
+                                  "Number of embedding contexts sharing the model, the batches of a call are embedded on all the free ones. At least the ingestion threads.");
+        description.add_options()("query_cache_mb", po::value<size_t>(&opts.query_cache_mb)->default_value(0),
+                                  "Memory cap in MB of the cache of the query embeddings and the retrieved chunks of the repeated queries. Disabled when 0.");
         description.add_options()("top_k,tk", po::value<uint32_t>(&opts.top_k)->default_value(3),
                                   "Maximum value of the returned document chunks per query.");
+        description.add_options()("min_score", po::value<float>(&min_score),
+                                  "Minimum cosine similarity of the document chunks put into the prompt.");
+        description.add_options()("max_relative_score_gap", po::value<float>(&max_relative_score_gap),
+                                  "Chunks scoring lower than the best one by more than this fraction of its score are not put into the prompt.");
+        description.add_options()("max_context_tokens", po::value<uint32_t>(&max_context_tokens),
+                                  "Maximum number of the LLM tokens of all the document chunks put into the prompt.");
+        description.add_options()("mmr_lambda", po::value<float>(&mmr_lambda),
+                                  "Enables the maximal marginal relevance selection of the chunks put into the prompt. 1 ranks them by the relevance only, 0 by the diversity only.");
+        description.add_options()("duplicate_threshold", po::value<float>(&duplicate_threshold)->default_value(0.95f),
+                                  "Chunks with at least this similarity to an already selected one are skipped as duplicates, applies with --mmr_lambda.");
+        description.add_options()("rrf_k", po::value<float>(&rrf_k),
+                                  "Enables the hybrid retrieval fusing the vector and the BM25 keyword rankings by the reciprocal rank fusion with this rank constant, e.g. 60. Takes precedence over --mmr_lambda. The chunk scores stay the cosine similarities.");
         description.add_options()("mode", po::value<std::string>(&mode)->default_value("CHAT"),
                                   "Set the application mode. Allowed values: {CHAT, RETRIEVAL}.");
         description.add_options()("prompt_template_path", po::value<std::string>(&opts.prompt_template_path),
@@ -73,6 +118,22 @@ class OptionParser
                                   "A path to a LLM model in GGUF format.");
         description.add_options()("model_config_path", po::value<std::string>(&opts.model_config_path),
                                   "A path to a json LLM model configuration.");
+        description.add_options()("vector_index", po::value<std::string>(&vector_index)->default_value("FLAT"),
+                                  "Vector index used for the document retrieval. Allowed values: {FLAT, IVF_FLAT, HNSW, SQ8, SQ_FP16, PQ, BINARY, NATIVE_FLAT}.");
+        description.add_options()("ivf_nlist", po::value<size_t>(&opts.vector_store_params.ivf_nlist)->default_value(256),
+                                  "Number of inverted lists of the IVF_FLAT index.");
+        description.add_options()("ivf_nprobe", po::value<size_t>(&opts.vector_store_params.ivf_nprobe)->default_value(16),
+                                  "Number of inverted lists visited per query by the IVF_FLAT index.");
+        description.add_options()("hnsw_m", po::value<size_t>(&opts.vector_store_params.hnsw_m)->default_value(32),
+                                  "Number of neighbours per node in the HNSW graph.");
+        description.add_options()("hnsw_ef_search", po::value<size_t>(&opts.vector_store_params.hnsw_ef_search)->default_value(64),
+                                  "Breadth of the HNSW graph search, higher values trade speed for recall.");
+        description.add_options()("pq_m", po::value<size_t>(&opts.vector_store_params.pq_m)->default_value(64),
+                                  "Number of sub-quantizers of the PQ index, must divide the embedding rank.");
+        description.add_options()("vector_refine", po::value<std::string>(&vector_refine)->default_value("NONE"),
+                                  "Exact re-scoring of the compressed index candidates. Allowed values: {NONE, FP16, FP32}.");
+        description.add_options()("refine_k_factor", po::value<size_t>(&opts.vector_store_params.refine_k_factor)->default_value(4),
+                                  "Number of candidates re-scored by the refine step, as a multiple of top_k.");
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, description), vm);
         po::notify(vm);
@@ -89,6 +150,29 @@ class OptionParser
         }
         opts.mode = *mode_enum;
 
+        auto vector_index_enum = magic_enum::enum_cast<VectorIndexType>(vector_index);
+        if (!vector_index_enum) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "vector_index");
+        }
+        opts.vector_store_params.index_type = *vector_index_enum;
+
+        auto vector_refine_enum = magic_enum::enum_cast<VectorRefineType>(vector_refine);
+        if (!vector_refine_enum) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "vector_refine");
+        }
+        opts.vector_store_params.refine_type = *vector_refine_enum;
+
+        if(vm.count("min_score"))
+            opts.min_score = min_score;
+        if(vm.count("max_relative_score_gap"))
+            opts.max_relative_score_gap = max_relative_score_gap;
+        if(vm.count("max_context_tokens"))
+            opts.max_context_tokens = max_context_tokens;
+        if(vm.count("mmr_lambda"))
+            opts.mmr = MmrSettings{.lambda = mmr_lambda, .duplicate_threshold = duplicate_threshold};
+        if(vm.count("rrf_k"))
+            opts.hybrid = HybridSearchSettings{.rrf_k = rrf_k};
+
         return opts;
     }
 };
@@ -15,6 +15,7 @@ namespace ds
 {
 
 using RetrievalFn = std::vector<RetrievedDocumentChunk>(const std::string&);
+using BatchRetrievalFn = std::vector<std::vector<RetrievedDocumentChunk>>(const std::vector<std::string>&);
 
 void run_retrieval_interactive(const std::function<RetrievalFn>& retrieval_fn)
 {
@@ -49,10 +50,11 @@ void run_retrieval_interactive(const std::function<RetrievalFn>& retrieval_fn)
     }
 }
 
-void run_retrieval_non_interactive(const std::function<RetrievalFn>& retrieval_fn, const Options& options)
+void run_retrieval_non_interactive(const std::function<BatchRetrievalFn>& batch_retrieval_fn, const Options& options)
 {
 
     std::string query;
+    std::vector<std::string> queries;
     std::vector<RetrievalResult> results;
 
     std::ifstream file(options.queries_input, std::ios::in);
@@ -62,11 +64,17 @@ void run_retrieval_non_interactive(const std::function<RetrievalFn>& retrieval_f
 
     while(std::getline(file, query))
     {
-        const auto most_relevant = with_time_report("Document retrieval", retrieval_fn, query);
+        queries.push_back(query);
+    }
+
+    const auto most_relevant_per_query = with_time_report("Batch document retrieval", batch_retrieval_fn, queries);
+
+    for(size_t i = 0; i < queries.size(); i++)
+    {
         std::vector<std::string> chunk_contents;
-        std::ranges::transform(most_relevant, std::back_inserter(chunk_contents),
+        std::ranges::transform(most_relevant_per_query[i], std::back_inserter(chunk_contents),
                                [](const RetrievedDocumentChunk& doc) { return doc.content; });
-        results.push_back(RetrievalResult{query, chunk_contents});
+        results.push_back(RetrievalResult{queries[i], chunk_contents});
     }
 
     std::ofstream output_file(options.result_output, std::ios::out);
@@ -79,9 +87,11 @@ void run_retrieval_mode(std::shared_ptr<IDocumentChunkRetriever> retriever, cons
 {
     const auto document_retrieval_fn = [&retriever, &options](const std::string& query)
     { return retriever->retrieve(query, options.top_k); };
+    const auto batch_document_retrieval_fn = [&retriever, &options](const std::vector<std::string>& queries)
+    { return retriever->retrieve_batch(queries, options.top_k); };
     if(!options.queries_input.empty())
     {
-        run_retrieval_non_interactive(document_retrieval_fn, options);
+        run_retrieval_non_interactive(batch_document_retrieval_fn, options);
     }
     else
     {
@@ -2,7 +2,9 @@
 
 #include "llm/utils.h"
 #include "options.h"
+#include "rag/chunk_database.h"
 #include "rag/document_retrieval.h"
+#include <algorithm>
 #include <fstream>
 
 namespace ds
@@ -13,9 +15,25 @@ std::shared_ptr<IDocumentChunkRetriever> prepare_doc_chunk_retriever(const Optio
     auto retriever = create_document_chunk_retriever(DocumentChunkRetrieverParams{
         .embedding_calculator_params = EmbeddingCalculatorParams{.model_path = options.embedding_model_path,
                                                                  .n_threads = options.embedding_threads,
-                                                                 .batch_size = options.embedding_batch_size}});
+                                                                 .batch_size = options.embedding_batch_size,
+                                                                 .n_contexts = std::max(options.embedding_contexts,
+                                                                                        options.ingestion_threads),
+                                                                 .cache_path = options.embedding_cache_path},
+        .vector_store_params = options.vector_store_params,
+        .n_ingestion_threads = static_cast<size_t>(options.ingestion_threads),
+        .query_cache_bytes = options.query_cache_mb << 20});
 
-    if(!options.database_input.empty())
+    if(!options.database_input.empty() && std::filesystem::is_directory(options.database_input))
+    {
+        auto load_snapshot_fn = [&retriever, &options]() { retriever->load_snapshot(options.database_input); };
+        with_time_report("Document DB snapshot load", load_snapshot_fn);
+    }
+    else if(!options.database_input.empty() && MappedChunkDatabase::is_chunk_database(options.database_input))
+    {
+        auto load_binary_fn = [&retriever, &options]() { retriever->load_binary(options.database_input); };
+        with_time_report("Document DB binary load", load_binary_fn);
+    }
+    else if(!options.database_input.empty())
     {
         std::ifstream input_file(options.database_input, std::ios::in);
         auto load_db_fn = [&retriever, &input_file]() { retriever->load(input_file); };
@@ -27,10 +45,20 @@ std::shared_ptr<IDocumentChunkRetriever> prepare_doc_chunk_retriever(const Optio
 
 void dump_vector_db_if_requested(const IDocumentChunkRetriever& retriever, Options& options)
 {
-    if(!options.database_output.empty())
+    // The json format is kept for the exchange with the chunking scripts, the binary one loads faster.
+    if(!options.database_output.empty() && std::filesystem::path(options.database_output).extension() != ".json")
+    {
+        retriever.save_binary(options.database_output);
+    }
+    else if(!options.database_output.empty())
     {
         std::ofstream output_file(options.database_output, std::ios::out);
         retriever.dump(output_file);
     }
+
+    if(!options.snapshot_output.empty())
+    {
+        retriever.save_snapshot(options.snapshot_output);
+    }
 }
 } // namespace ds
\ No newline at end of file
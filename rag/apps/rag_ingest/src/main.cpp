@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "llm/utils.h"
+#include "options.h"
+#include "rag/document_retrieval.h"
+#include "rag/document_splitter.h"
+#include "rag/embedding_calculator.h"
+#include "rag/vector_database.h"
+
+namespace ds
+{
+// Splits the documents and streams their chunks into the retriever in batches, the splitting of the next documents
+// overlaps the embedding of the added ones. The batches are published at once at the end, so the index isn't
+// updated once per batch.
+void ingest_documents(IDocumentChunkRetriever& retriever, const IEmbeddingCalculator& embedding_calculator,
+                      const std::vector<std::filesystem::path>& paths, const Options& options)
+{
+    using namespace std::chrono;
+
+    auto splitter_params =
+        options.size_count_method == SizeCountMethod::TOKENS
+            ? token_budget_params(embedding_calculator, options.chunk_size, options.chunk_overlap)
+            : DocumentSplitterParams{.text_splitter_params = {.chunk_size = options.chunk_size,
+                                                              .chunk_overlap = options.chunk_overlap}};
+    splitter_params.markdown_separators = options.markdown_separators;
+    splitter_params.n_threads = options.split_threads;
+
+    size_t n_documents = 0;
+    size_t n_chunks = 0;
+    size_t n_bytes = 0;
+
+    const auto start = steady_clock::now();
+    const auto produce_chunks = [&](const IDocumentChunkRetriever::AddChunksFn& add_chunks)
+    {
+        std::vector<DocumentChunk> batch;
+        const auto add_batch = [&add_chunks, &batch, &n_chunks]()
+        {
+            add_chunks(batch);
+            n_chunks += batch.size();
+            batch.clear();
+        };
+
+        split_documents(paths, splitter_params,
+                        [&](std::vector<DocumentChunk>&& chunks)
+                        {
+                            n_bytes += std::filesystem::file_size(paths[n_documents++]);
+                            std::ranges::move(chunks, std::back_inserter(batch));
+                            if(batch.size() >= options.add_batch_size)
+                                add_batch();
+                        });
+        if(!batch.empty())
+            add_batch();
+    };
+    retriever.add_document_chunks(produce_chunks);
+
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    spdlog::info("Ingested {} chunks of {} documents ({:.1f} MB) in {:.2f} s: {:.1f} files/s, {:.2f} MB/s.", n_chunks,
+                 n_documents, n_bytes / 1e6, seconds, n_documents / seconds, n_bytes / 1e6 / seconds);
+}
+} // namespace ds
+
+int main(int argc, char* argv[])
+{
+    using namespace ds;
+
+    spdlog::set_level(spdlog::level::debug);
+
+    const auto options = OptionParser::parse_options(argc, argv);
+
+    // The splitter counts the tokens with the calculator embedding the chunks, which keeps their tokens.
+    auto embedding_calculator = embedding_calculator_factory(EmbeddingCalculatorParams{
+        .model_path = options.embedding_model_path,
+        .n_threads = options.embedding_threads,
+        .batch_size = options.embedding_batch_size,
+        .n_contexts = std::max(options.embedding_contexts, options.ingestion_threads),
+        .cache_path = options.embedding_cache_path});
+    const auto& calculator = *embedding_calculator;
+    auto vector_store = vector_store_factory(calculator.get_embedding_rank(), options.vector_store_params);
+    auto retriever = std::make_unique<SimpleDocumentChunkRetriever>(
+        std::move(embedding_calculator), std::move(vector_store), DEFAULT_COMPACTION_THRESHOLD,
+        static_cast<size_t>(options.ingestion_threads));
+
+    const auto paths = find_documents(options.documents_input);
+    spdlog::info("Found {} documents in {}.", paths.size(), options.documents_input);
+    with_time_report("Document ingestion", [&]() { ingest_documents(*retriever, calculator, paths, options); });
+
+    if(!options.database_output.empty() && std::filesystem::path(options.database_output).extension() != ".json")
+    {
+        retriever->save_binary(options.database_output);
+    }
+    else if(!options.database_output.empty())
+    {
+        std::ofstream output_file(options.database_output, std::ios::out);
+        retriever->dump(output_file);
+    }
+
+    if(!options.snapshot_output.empty())
+    {
+        retriever->save_snapshot(options.snapshot_output);
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <boost/program_options.hpp>
+#include <magic_enum/magic_enum.hpp>
+#include <string>
+
+#include "rag/vector_database.h"
+
+#include <iostream>
+
+namespace ds
+{
+
+enum class SizeCountMethod {
+    CHARACTERS,
+    TOKENS
+};
+
+struct Options
+{
+    std::string documents_input;
+    std::string embedding_model_path;
+    std::string embedding_cache_path;
+    std::string database_output;
+    std::string snapshot_output;
+
+    size_t chunk_size;
+    size_t chunk_overlap;
+    SizeCountMethod size_count_method;
+    bool markdown_separators;
+    size_t split_threads;
+    size_t add_batch_size;
+
+    int32_t embedding_threads;
+    int32_t embedding_batch_size;
+    int32_t ingestion_threads;
+    int32_t embedding_contexts;
+
+    VectorStoreParams vector_store_params;
+};
+
+class OptionParser
+{
+  public:
+    static Options parse_options(int argc, char* argv[])
+    {
+        Options opts;
+
+        namespace po = boost::program_options;
+        po::options_description description("Utility application splitting the documents and building the embeddings database");
+
+        std::string vector_index;
+        std::string size_count_method;
+
+        description.add_options()("help,h", "produce help message");
+        description.add_options()("documents_input,i", po::value<std::string>(&opts.documents_input)->required(),
+                                  "Directory with the .md and .txt documents, searched recursively, or a single document.");
+        description.add_options()("embedding_model,m",
+            po::value<std::string>(&opts.embedding_model_path)->default_value("./gte-base-f32.gguf"),
+            "Model used to generate the embeddings.");
+        description.add_options()("database_output,o", po::value<std::string>(&opts.database_output),
+                                  "Path to an output file with calculated embeddings, binary unless it has the .json extension.");
+        description.add_options()("snapshot_output", po::value<std::string>(&opts.snapshot_output),
+                                  "Output directory for the database snapshot with the serialized vector index.");
+        description.add_options()("chunk_size", po::value<size_t>(&opts.chunk_size)->default_value(512),
+                                  "Maximum length of a single chunk, in the units of the size count method.");
+        description.add_options()("chunk_overlap", po::value<size_t>(&opts.chunk_overlap)->default_value(0),
+                                  "Length the subsequent chunks share, in the units of the size count method.");
+        description.add_options()("size_count_method", po::value<std::string>(&size_count_method)->default_value("CHARACTERS"),
+                                  "Measures the chunks in the characters or in the tokens of the embedding model, the token chunks are capped to the model context. Allowed values: {CHARACTERS, TOKENS}.");
+        description.add_options()("markdown_separators", po::value<bool>(&opts.markdown_separators)->default_value(true),
+                                  "Splits the .md documents on the headings, code blocks and horizontal rules first.");
+        description.add_options()("split_threads", po::value<size_t>(&opts.split_threads)->default_value(1),
+                                  "Number of threads reading and splitting the documents.");
+        description.add_options()("add_batch_size", po::value<size_t>(&opts.add_batch_size)->default_value(4096),
+                                  "Number of the split chunks embedded at once, all of them are published at the end.");
+        description.add_options()("embedding_threads,t", po::value<int32_t>(&opts.embedding_threads)->default_value(1),
+                                  "Number of threads to run the embeddings model.");
+        description.add_options()("embedding_cache", po::value<std::string>(&opts.embedding_cache_path),
+                                  "File caching the chunk embeddings, so the unchanged chunks are not embedded again.");
+        description.add_options()("embedding_batch_size,b", po::value<int32_t>(&opts.embedding_batch_size)->default_value(512),
+                                  "Maximum batch size of running the embeddings model. Must be set to a value greater than n_ctx of the model.");
+        description.add_options()("ingestion_threads", po::value<int32_t>(&opts.ingestion_threads)->default_value(1),
+                                  "Number of threads embedding the split chunks concurrently, each of them with its own embedding context.");
+        description.add_options()("embedding_contexts", po::value<int32_t>(&opts.embedding_contexts)->default_value(1),
+                                  "Number of embedding contexts sharing the model, the batches of a call are embedded on all the free ones. At least the ingestion threads.");
+        description.add_options()("vector_index", po::value<std::string>(&vector_index)->default_value("FLAT"),
+                                  "Vector index of the snapshot. Allowed values: {FLAT, IVF_FLAT, HNSW, SQ8, SQ_FP16, PQ, BINARY, NATIVE_FLAT}.");
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, description), vm);
+
+        if(vm.count("help"))
+        {
+            std::cout << description << std::endl;
+            exit(1);
+        }
+        po::notify(vm);
+
+        auto vector_index_enum = magic_enum::enum_cast<VectorIndexType>(vector_index);
+        if (!vector_index_enum) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "vector_index");
+        }
+        opts.vector_store_params.index_type = *vector_index_enum;
+
+        auto size_count_method_enum = magic_enum::enum_cast<SizeCountMethod>(size_count_method);
+        if (!size_count_method_enum) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "size_count_method");
+        }
+        opts.size_count_method = *size_count_method_enum;
+
+        if(opts.add_batch_size == 0) {
+            throw po::validation_error(po::validation_error::invalid_option_value, "add_batch_size");
+        }
+
+        return opts;
+    }
+};
+} // namespace ds
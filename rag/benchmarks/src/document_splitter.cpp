@@ -0,0 +1,76 @@
+#include "rag/document_splitter.h"
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace ds
+{
+
+// Markdown documents of the words with a skewed frequency, in paragraphs under the headings, about 8 KB each.
+std::filesystem::path create_documents(size_t n_documents)
+{
+    const auto directory = std::filesystem::temp_directory_path() / "document_splitter_benchmark";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    std::mt19937 gen(42);
+    std::geometric_distribution<int> word_dist(0.002);
+    std::uniform_int_distribution<int> sentence_dist(3, 20);
+    for(size_t i = 0; i < n_documents; i++)
+    {
+        std::ofstream output(directory / ("document_" + std::to_string(i) + ".md"));
+        for(size_t section = 0; section < 4; section++)
+        {
+            output << "## Section " << section << "\n\n";
+            for(size_t paragraph = 0; paragraph < 4; paragraph++)
+            {
+                for(size_t sentence = 0; sentence < 8; sentence++)
+                {
+                    for(int word = sentence_dist(gen); word > 0; word--)
+                        output << "w" << word_dist(gen) << (word > 1 ? " " : ". ");
+                }
+                output << "\n\n";
+            }
+        }
+    }
+
+    return directory;
+}
+
+static void SplitDocuments(benchmark::State& state)
+{
+    const size_t n_threads = state.range(0);
+    const size_t n_documents = state.range(1);
+
+    const auto directory = create_documents(n_documents);
+    const auto paths = find_documents(directory);
+    size_t n_bytes = 0;
+    for(const auto& path : paths)
+        n_bytes += std::filesystem::file_size(path);
+
+    const DocumentSplitterParams params{.text_splitter_params = {.chunk_size = 512}, .n_threads = n_threads};
+    size_t n_chunks = 0;
+    for(auto _ : state)
+    {
+        n_chunks = 0;
+        split_documents(paths, params, [&n_chunks](std::vector<DocumentChunk>&& chunks) { n_chunks += chunks.size(); });
+    }
+
+    state.counters["chunks"] = n_chunks;
+    state.counters["files/s"] = benchmark::Counter(paths.size() * state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["MB/s"] = benchmark::Counter(n_bytes / 1e6 * state.iterations(), benchmark::Counter::kIsRate);
+
+    std::filesystem::remove_all(directory);
+}
+
+BENCHMARK(SplitDocuments)
+    ->ArgNames({"n_threads", "n_documents"})
+    ->ArgsProduct({{1, 4, 8}, {2000}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
+} // namespace ds
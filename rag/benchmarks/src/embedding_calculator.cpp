@@ -1,11 +1,21 @@
+#include "rag/batch_packing.h"
+#include "rag/document_retrieval.h"
+#include "rag/embedding_cache.h"
 #include "rag/embedding_calculator.h"
+#include "rag/text_splitter.h"
+#include "rag/vector_database.h"
 #include <benchmark/benchmark.h>
 
 #include "mem_usage.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <filesystem>
 #include <numeric>
+#include <random>
 #include <ranges>
+#include <sstream>
 
 namespace ds
 {
@@ -84,6 +94,355 @@ static void VectorEmbeddings(benchmark::State& state)
     state.counters["avg_tokens_per_second"] = total_tokens / duration;
 }
 
+// Ingests a large batch through the retriever, in a single add or in the batches of a bulk add, next to the size of
+// its embedding matrix. The blocks are indexed as they are embedded, so the peak RSS should grow by about one copy of
+// the matrix. The peak RSS is process wide, so the variants must be compared in separate runs, e.g. with
+// --benchmark_filter.
+static void IngestionPeakMemory(benchmark::State& state)
+{
+    constexpr size_t BULK_BATCH_SIZE = 1024;
+    const auto bulk_add = state.range(0) == 1;
+    const auto n_texts = state.range(1);
+    std::vector<DocumentChunk> chunks;
+    chunks.reserve(n_texts);
+    for(int64_t i = 0; i < n_texts; i++)
+    {
+        chunks.push_back(
+            DocumentChunk{TEXTS_TO_EMBED[0], DocumentChunkMetadata{"hello.pdf", static_cast<uint64_t>(i)}});
+    }
+
+    auto embedding_calculator = embedding_calculator_factory(EmbeddingCalculatorParams{
+        .model_path = get_embedding_model_path_from_env(), .n_threads = 4, .batch_size = get_batch_size_from_env()});
+    const auto embedding_rank = embedding_calculator->get_embedding_rank();
+    SimpleDocumentChunkRetriever retriever(std::move(embedding_calculator), vector_store_factory(embedding_rank));
+    const auto peak_before_gb = get_peak_process_mem_usage_gb();
+
+    for(auto _ : state)
+    {
+        if(!bulk_add)
+        {
+            retriever.add_document_chunks(chunks);
+            continue;
+        }
+
+        retriever.add_document_chunks(
+            [&chunks](const IDocumentChunkRetriever::AddChunksFn& add_chunks)
+            {
+                for(size_t batch_begin = 0; batch_begin < chunks.size(); batch_begin += BULK_BATCH_SIZE)
+                {
+                    const auto batch_end = chunks.begin() + std::min(batch_begin + BULK_BATCH_SIZE, chunks.size());
+                    add_chunks(std::vector<DocumentChunk>(chunks.begin() + batch_begin, batch_end));
+                }
+            });
+    }
+
+    state.counters["embedding_matrix_mb"] =
+        static_cast<double>(n_texts * embedding_rank * sizeof(float)) / (1024.0 * 1024.0);
+    state.counters["peak_rss_growth_mb"] = (get_peak_process_mem_usage_gb() - peak_before_gb) * 1024.0;
+}
+
+// Re-ingestion of all the chunks after editing the given percent of them, the first ingestion fills the cache. The
+// speedup is the ratio of the first ingestion time to the re-ingestion time.
+static void CachedReingestion(benchmark::State& state)
+{
+    using namespace std::chrono;
+    using namespace std::chrono_literals;
+
+    const auto changed_percent = state.range(0);
+    const auto n_texts = state.range(1);
+    std::vector<std::string> texts;
+    texts.reserve(n_texts);
+    for(int64_t i = 0; i < n_texts; i++)
+        texts.push_back(std::to_string(i) + " " + TEXTS_TO_EMBED[1]);
+
+    const auto cache_path = std::filesystem::temp_directory_path() / "embedding_cache_benchmark.bin";
+    std::filesystem::remove(cache_path);
+    const auto embedding_calculator = embedding_calculator_factory(
+        EmbeddingCalculatorParams{.model_path = get_embedding_model_path_from_env(),
+                                  .n_threads = 4,
+                                  .batch_size = get_batch_size_from_env(),
+                                  .cache_path = cache_path});
+    const auto& cache = dynamic_cast<const CachingEmbeddingCalculator&>(*embedding_calculator).cache();
+
+    const auto first_start = high_resolution_clock::now();
+    embedding_calculator->calc_batch_matrix(texts);
+    const auto first_duration = (high_resolution_clock::now() - first_start) / 1.0s;
+
+    for(int64_t i = 0; i < n_texts; i++)
+    {
+        if(i % 100 < changed_percent)
+            texts[i] += " Edited.";
+    }
+    const auto hits_before = cache.hits();
+
+    const auto start = high_resolution_clock::now();
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(embedding_calculator->calc_batch_matrix(texts));
+    }
+    const auto duration = (high_resolution_clock::now() - start) / 1.0s;
+
+    state.counters["hit_rate"] =
+        static_cast<double>(cache.hits() - hits_before) / static_cast<double>(n_texts * state.iterations());
+    state.counters["speedup"] = first_duration * static_cast<double>(state.iterations()) / duration;
+    std::filesystem::remove(cache_path);
+}
+
+// End-to-end ingestion of the chunks into the retriever, the model loading is excluded. Every ingestion thread embeds
+// with its own context, running the given number of the compute threads.
+static void IngestionThroughput(benchmark::State& state)
+{
+    const auto n_ingestion_threads = state.range(0);
+    const auto n_threads = state.range(1);
+    const auto n_texts = state.range(2);
+    std::vector<DocumentChunk> chunks;
+    chunks.reserve(n_texts);
+    for(int64_t i = 0; i < n_texts; i++)
+    {
+        chunks.push_back(DocumentChunk{std::to_string(i) + " " + TEXTS_TO_EMBED[1],
+                                       DocumentChunkMetadata{"lorem.pdf", static_cast<uint64_t>(i)}});
+    }
+
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        auto retriever = create_document_chunk_retriever(DocumentChunkRetrieverParams{
+            .embedding_calculator_params =
+                EmbeddingCalculatorParams{.model_path = get_embedding_model_path_from_env(),
+                                          .n_threads = static_cast<int32_t>(n_threads),
+                                          .batch_size = get_batch_size_from_env(),
+                                          .n_contexts = static_cast<int32_t>(n_ingestion_threads)},
+            .n_ingestion_threads = static_cast<size_t>(n_ingestion_threads)});
+        state.ResumeTiming();
+
+        retriever->add_document_chunks(chunks);
+    }
+    state.counters["chunks_per_second"] =
+        benchmark::Counter(static_cast<double>(n_texts), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Embedding of a document split into the 512 characters chunks or into the chunks of the model context tokens. The
+// character chunks take a fraction of the context, so the fuller token chunks need fewer sequences and batches for
+// the same text. The splitting is excluded, the counted tokens are reused by the embedding in both cases.
+static void TokenBudgetChunking(benchmark::State& state)
+{
+    const bool count_tokens = state.range(0);
+    const auto n_paragraphs = state.range(1);
+    const auto calculator = embedding_calculator_factory(EmbeddingCalculatorParams{
+        .model_path = get_embedding_model_path_from_env(), .n_threads = 4, .batch_size = get_batch_size_from_env()});
+
+    std::string document;
+    for(int64_t i = 0; i < n_paragraphs; i++)
+        document += std::to_string(i) + " " + TEXTS_TO_EMBED[1 + i % 2] + "\n\n";
+
+    TextSplitterParams splitter_params{.chunk_size = 512};
+    if(count_tokens)
+    {
+        splitter_params.chunk_size = calculator->max_text_tokens();
+        splitter_params.length_function = [&calculator](std::string_view text)
+        { return calculator->count_tokens(std::string(text)); };
+    }
+
+    size_t n_chunks = 0;
+    size_t n_tokens = 0;
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        const auto chunks = RecursiveTextSplitter(splitter_params, default_separators()).split(document);
+        n_chunks = chunks.size();
+        n_tokens = 0;
+        for(const auto& chunk : chunks)
+            n_tokens += calculator->tokenize_chunk(chunk);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(calculator->calc_batch_matrix(chunks));
+    }
+
+    state.counters["chunks"] = n_chunks;
+    state.counters["tokens_per_chunk"] = static_cast<double>(n_tokens) / n_chunks;
+    state.counters["context_fill"] = static_cast<double>(n_tokens) / (n_chunks * calculator->max_text_tokens());
+    state.counters["tokens_per_second"] =
+        benchmark::Counter(static_cast<double>(n_tokens), benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["MB_per_second"] =
+        benchmark::Counter(document.size() / 1e6, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Chunks of a long tailed length distribution, like the ones of the real documents split on the paragraphs: the
+// lognormal numbers of words with the median of 60, up to the model context.
+std::vector<std::string> create_mixed_length_texts(size_t n_texts)
+{
+    std::vector<std::string> words;
+    std::istringstream words_stream(TEXTS_TO_EMBED[2]);
+    for(std::string word; words_stream >> word;)
+        words.push_back(word);
+
+    std::mt19937 gen(42);
+    std::lognormal_distribution<double> length_dist(std::log(60.0), 0.8);
+    std::vector<std::string> texts(n_texts);
+    for(size_t i = 0; i < n_texts; i++)
+    {
+        texts[i] = std::to_string(i);
+        const auto n_words = std::clamp<size_t>(length_dist(gen), 1, 300);
+        for(size_t j = 0; j < n_words; j++)
+            texts[i] += " " + words[(i + j) % words.size()];
+    }
+
+    return texts;
+}
+
+// Mixed length chunks batched in their order, each batch embedded separately as before the packing, or packed by
+// the calculator. The fill is the share of the batch tokens taken by the sequences.
+static void BatchFill(benchmark::State& state)
+{
+    const bool packed = state.range(0);
+    const auto n_texts = state.range(1);
+    const size_t batch_size = get_batch_size_from_env();
+    const auto calculator = embedding_calculator_factory(EmbeddingCalculatorParams{
+        .model_path = get_embedding_model_path_from_env(), .n_threads = 4, .batch_size = get_batch_size_from_env()});
+    const auto texts = create_mixed_length_texts(n_texts);
+
+    // The sequences are truncated to the batch size, the special tokens are the ones of the empty text.
+    const size_t n_special_tokens = calculator->calc_batch({""})[0].n_tokens;
+    std::vector<size_t> lengths;
+    for(const auto& text : texts)
+        lengths.push_back(std::min(calculator->count_tokens(text) + n_special_tokens, batch_size));
+
+    std::vector<std::vector<std::string>> batches;
+    size_t n_batches = pack_sequences(lengths, batch_size, batch_size).size();
+    if(!packed)
+    {
+        size_t batch_tokens = batch_size;
+        for(size_t i = 0; i < texts.size(); i++)
+        {
+            if(batch_tokens + lengths[i] > batch_size)
+            {
+                batches.emplace_back();
+                batch_tokens = 0;
+            }
+            batches.back().push_back(texts[i]);
+            batch_tokens += lengths[i];
+        }
+        n_batches = batches.size();
+    }
+
+    for(auto _ : state)
+    {
+        if(packed)
+            benchmark::DoNotOptimize(calculator->calc_batch_matrix(texts));
+        for(const auto& batch : batches)
+            benchmark::DoNotOptimize(calculator->calc_batch_matrix(batch));
+    }
+
+    const size_t n_tokens = std::accumulate(lengths.begin(), lengths.end(), size_t{0});
+    state.counters["batches"] = n_batches;
+    state.counters["batch_fill"] = static_cast<double>(n_tokens) / (n_batches * batch_size);
+    state.counters["tokens_per_second"] =
+        benchmark::Counter(static_cast<double>(n_tokens), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// A single large call of the mixed length chunks, its packed batches are decoded on all the contexts at once. The
+// contexts times the threads per context should stay within the physical cores.
+static void EmbeddingContextsMatrix(benchmark::State& state)
+{
+    const auto n_contexts = state.range(0);
+    const auto n_threads = state.range(1);
+    const auto calculator = embedding_calculator_factory(
+        EmbeddingCalculatorParams{.model_path = get_embedding_model_path_from_env(),
+                                  .n_threads = static_cast<int32_t>(n_threads),
+                                  .batch_size = get_batch_size_from_env(),
+                                  .n_contexts = static_cast<int32_t>(n_contexts)});
+    const auto texts = create_mixed_length_texts(state.range(2));
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(calculator->calc_batch_matrix(texts));
+    }
+    state.counters["chunks_per_second"] =
+        benchmark::Counter(static_cast<double>(texts.size()), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Single query embeddings from all the benchmark threads, the calculator has a context for every one of them.
+static std::unique_ptr<IEmbeddingCalculator> concurrent_calculator;
+
+static void ConcurrentQueryEmbeddings(benchmark::State& state)
+{
+    if(state.thread_index() == 0)
+    {
+        concurrent_calculator = embedding_calculator_factory(
+            EmbeddingCalculatorParams{.model_path = get_embedding_model_path_from_env(),
+                                      .n_threads = 1,
+                                      .batch_size = get_batch_size_from_env(),
+                                      .n_contexts = state.threads()});
+    }
+
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(concurrent_calculator->calc(TEXTS_TO_EMBED[0]));
+    }
+    state.counters["queries_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+    if(state.thread_index() == 0)
+        concurrent_calculator.reset();
+}
+
+// Query log of the distinct questions with the Zipfian frequencies, a few of them asked most of the time as in the
+// real assistant logs. Every query is timed with the query cache of the retriever disabled or enabled, the counters are
+// the percentiles of the latency distribution. The chunks are added once before the log, so the results stay cached.
+static void ZipfianQueryLog(benchmark::State& state)
+{
+    using namespace std::chrono;
+
+    constexpr size_t N_QUERIES = 2000;
+    constexpr double ZIPF_EXPONENT = 1.0;
+    const size_t query_cache_bytes = state.range(0) ? 16 << 20 : 0;
+    const auto n_questions = state.range(1);
+
+    auto embedding_calculator = embedding_calculator_factory(EmbeddingCalculatorParams{
+        .model_path = get_embedding_model_path_from_env(), .n_threads = 4, .batch_size = get_batch_size_from_env()});
+    auto vector_store = vector_store_factory(embedding_calculator->get_embedding_rank());
+    SimpleDocumentChunkRetriever retriever(std::move(embedding_calculator), std::move(vector_store),
+                                           DEFAULT_COMPACTION_THRESHOLD, 1, query_cache_bytes);
+
+    std::vector<DocumentChunk> chunks;
+    for(auto& text : create_mixed_length_texts(1000))
+        chunks.push_back(DocumentChunk{.content = std::move(text), .metadata = {.chunk_id = chunks.size()}});
+    retriever.add_document_chunks(chunks);
+
+    std::vector<double> weights(n_questions);
+    for(int64_t rank = 0; rank < n_questions; rank++)
+        weights[rank] = 1.0 / std::pow(static_cast<double>(rank + 1), ZIPF_EXPONENT);
+    std::discrete_distribution<size_t> question_dist(weights.begin(), weights.end());
+    std::mt19937 gen(42);
+    std::vector<std::string> query_log(N_QUERIES);
+    std::ranges::generate(query_log, [&]()
+                          { return "What does the document " + std::to_string(question_dist(gen)) + " say?"; });
+
+    std::vector<double> latencies_ms;
+    for(auto _ : state)
+    {
+        for(const auto& query : query_log)
+        {
+            const auto start = high_resolution_clock::now();
+            benchmark::DoNotOptimize(retriever.retrieve(query, 5));
+            latencies_ms.push_back(duration<double, std::milli>(high_resolution_clock::now() - start).count());
+        }
+    }
+
+    std::ranges::sort(latencies_ms);
+    const auto percentile = [&latencies_ms](double p)
+    { return latencies_ms[static_cast<size_t>(p * static_cast<double>(latencies_ms.size() - 1))]; };
+    state.counters["p50_ms"] = percentile(0.5);
+    state.counters["p90_ms"] = percentile(0.9);
+    state.counters["p99_ms"] = percentile(0.99);
+    state.counters["max_ms"] = latencies_ms.back();
+    state.counters["mean_ms"] =
+        std::accumulate(latencies_ms.begin(), latencies_ms.end(), 0.0) / static_cast<double>(latencies_ms.size());
+
+    const auto stats = retriever.query_cache_stats();
+    state.counters["hit_rate"] = static_cast<double>(stats.result_hits) / static_cast<double>(latencies_ms.size());
+    state.counters["cache_mb"] = static_cast<double>(stats.memory_bytes) / (1 << 20);
+}
+
 static void MemSummary(benchmark::State& state)
 {
     // A dummy function to put the result of the peak memory usage
@@ -98,6 +457,49 @@ BENCHMARK(VectorEmbeddings)
     ->ArgsProduct({{0, 1, 2}, {1, 4, 8, 16}})
     ->Unit(benchmark::kMillisecond);
 
+BENCHMARK(ConcurrentQueryEmbeddings)->ThreadRange(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK(IngestionPeakMemory)
+    ->ArgNames({"bulk_add", "n_texts"})
+    ->ArgsProduct({{0, 1}, {30000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(IngestionThroughput)
+    ->ArgNames({"n_ingestion_threads", "n_threads", "n_texts"})
+    ->ArgsProduct({{1, 4, 8}, {1, 4}, {2000}})
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(CachedReingestion)
+    ->ArgNames({"changed_percent", "n_texts"})
+    ->ArgsProduct({{0, 5, 50}, {1000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(TokenBudgetChunking)
+    ->ArgNames({"count_tokens", "n_paragraphs"})
+    ->ArgsProduct({{0, 1}, {500}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BatchFill)
+    ->ArgNames({"packed", "n_texts"})
+    ->ArgsProduct({{0, 1}, {2000}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(EmbeddingContextsMatrix)
+    ->ArgNames({"n_contexts", "n_threads", "n_texts"})
+    ->ArgsProduct({{1, 2, 4, 8}, {1, 2, 4, 8}, {1000}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(ZipfianQueryLog)
+    ->ArgNames({"query_cache", "n_questions"})
+    ->ArgsProduct({{0, 1}, {100, 1000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK(MemSummary);
 
 BENCHMARK_MAIN();
@@ -1,4 +1,6 @@
+#include <fstream>
 #include <sys/resource.h>
+#include <unistd.h>
 namespace ds {
 
 double get_peak_process_mem_usage_gb() {
@@ -9,4 +11,25 @@ double get_peak_process_mem_usage_gb() {
     return peak_gb;
 }
 
-}
\ No newline at end of file
+double get_current_process_mem_usage_gb() {
+    // The second field of statm is the resident set size in pages.
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+
+    return resident_pages * static_cast<double>(sysconf(_SC_PAGESIZE)) / 1024.0 / 1024.0 / 1024.0;
+}
+
+double get_current_process_anon_mem_usage_gb() {
+    // The third field of statm is the resident memory backed by files, the clean pages of it can be reclaimed.
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    size_t shared_pages = 0;
+    statm >> total_pages >> resident_pages >> shared_pages;
+
+    return (resident_pages - shared_pages) * static_cast<double>(sysconf(_SC_PAGESIZE)) / 1024.0 / 1024.0 / 1024.0;
+}
+
+}
@@ -0,0 +1,129 @@
+#include "llm/llama_provider.h"
+#include "rag/document_retrieval.h"
+#include "rag/llm_prompt_composer.h"
+#include "rag/pipeline.h"
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ds
+{
+
+static std::string get_env_or(const char* name, const std::string& default_value)
+{
+    const auto val = std::getenv(name);
+    return val ? val : default_value;
+}
+
+// Embedded database dump created with the rag_demo --database_output option and a file with a query per line.
+const auto embedding_model_path = get_env_or("EMBEDDING_MODEL_PATH", "./gte-base-f32.gguf");
+const auto llm_model_path = get_env_or("LLM_TEST_MODEL_PATH", "./model.gguf");
+const auto prompt_template_path = get_env_or("PROMPT_TEMPLATE_PATH", "./prompt_template.mustache");
+const auto database_path = get_env_or("DATABASE_PATH", "./embedded_document_chunks.json");
+const auto queries_path = get_env_or("QUERIES_PATH", "./queries.txt");
+
+static std::vector<std::string> read_queries()
+{
+    std::ifstream file(queries_path, std::ios::in);
+    std::vector<std::string> queries;
+    for(std::string query; std::getline(file, query);)
+    {
+        if(!query.empty())
+            queries.push_back(query);
+    }
+
+    return queries;
+}
+
+// Passes the calls through, recording the number of the prompt tokens of the last generation.
+class PromptTokensRecorder : public ILlmProvider
+{
+  public:
+    explicit PromptTokensRecorder(std::shared_ptr<ILlmProvider> llm) : llm_(std::move(llm)) {}
+
+    LlmOutput generate(const LlmInput& input) override
+    {
+        last_prompt_tokens = llm_->count_tokens(input.prompt);
+        return llm_->generate(input);
+    }
+
+    std::unique_ptr<ILlmAsyncGeneration> generateAsync(const LlmInput& input,
+                                                       const std::function<LlmCallback>& callback) override
+    {
+        last_prompt_tokens = llm_->count_tokens(input.prompt);
+        return llm_->generateAsync(input, callback);
+    }
+
+    void clear_context() override { llm_->clear_context(); }
+
+    std::size_t count_tokens(const std::string& text) override { return llm_->count_tokens(text); }
+
+    std::size_t last_prompt_tokens = 0;
+
+  private:
+    std::shared_ptr<ILlmProvider> llm_;
+};
+
+// Time to the first generated token of the whole pipeline: the retrieval, the prompt composition and its prefill.
+// The fixed_top_k and adaptive variants are run over the same queries, their prompt_tokens and ttft_ms counters give
+// the prompt reduction and the TTFT delta of the cutoffs.
+static void RagTimeToFirstToken(benchmark::State& state, RagInferenceSettings settings)
+{
+    using namespace std::chrono;
+
+    auto retriever = create_document_chunk_retriever(DocumentChunkRetrieverParams{
+        .embedding_calculator_params =
+            EmbeddingCalculatorParams{.model_path = embedding_model_path, .n_threads = 4, .batch_size = 512}});
+    std::ifstream database_file(database_path, std::ios::in);
+    retriever->load(database_file);
+
+    const auto llm = std::make_shared<LlamaProvider>(
+        llm_model_path, LlamaParameters{.temp = 0.f, .max_tokens = 1, .context_size = 2048, .threads = 4, .seed = 0});
+    auto recorder = std::make_unique<PromptTokensRecorder>(llm);
+    auto* recorder_ptr = recorder.get();
+    RagPipeline pipeline(std::move(retriever), create_llm_prompt_composer(prompt_template_path), std::move(recorder));
+
+    const auto queries = read_queries();
+    if(queries.empty())
+    {
+        state.SkipWithError("No queries found, set the QUERIES_PATH.");
+        return;
+    }
+
+    std::size_t total_prompt_tokens = 0;
+    double total_ttft_seconds = 0.0;
+    std::size_t n_queries = 0;
+    for(auto _ : state)
+    {
+        const auto& query = queries[n_queries % queries.size()];
+
+        // A single token is generated, so the generation time is the time to the first token.
+        const auto start = high_resolution_clock::now();
+        benchmark::DoNotOptimize(pipeline.generate(query, settings));
+        total_ttft_seconds += duration<double>(high_resolution_clock::now() - start).count();
+
+        pipeline.clear_chat_context();
+        total_prompt_tokens += recorder_ptr->last_prompt_tokens;
+        n_queries++;
+    }
+
+    state.counters["prompt_tokens"] = static_cast<double>(total_prompt_tokens) / n_queries;
+    state.counters["ttft_ms"] = total_ttft_seconds * 1000.0 / n_queries;
+}
+
+BENCHMARK_CAPTURE(RagTimeToFirstToken, fixed_top_k, RagInferenceSettings{.top_k = 5})
+    ->Iterations(50)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(RagTimeToFirstToken, adaptive,
+                  RagInferenceSettings{
+                      .top_k = 5, .min_score = 0.75f, .max_relative_score_gap = 0.05f, .max_context_tokens = 512})
+    ->Iterations(50)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
+} // namespace ds
@@ -1,8 +1,16 @@
+#include "rag/bm25_index.h"
+#include "rag/document_retrieval.h"
+#include "rag/pipeline.h"
 #include "rag/vector_database.h"
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <random>
 #include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "mem_usage.h"
 
 namespace ds
@@ -28,7 +36,61 @@ std::vector<Embedding> create(size_t embedding_rank, size_t N)
     return chunks;
 }
 
-static void IndexingVector(benchmark::State& state)
+// Queries are the indexed vectors with a small noise added, so each one has a well defined neighbourhood.
+std::vector<Embedding> create_queries(const std::vector<Embedding>& chunks, size_t n_queries)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> chunk_dist(0, chunks.size() - 1);
+    std::normal_distribution<float> noise_dist(0.0f, 0.05f);
+
+    std::vector<Embedding> queries(n_queries);
+    for(auto& query : queries)
+    {
+        query = chunks[chunk_dist(gen)];
+        std::ranges::for_each(query, [&](float& value) { value += noise_dist(gen); });
+    }
+
+    return queries;
+}
+
+// Texts of the words with a skewed frequency, like the natural language, every one of them has a unique identifier too.
+std::vector<std::string> create_texts(size_t N, size_t n_words, std::mt19937& gen)
+{
+    std::geometric_distribution<int> word_dist(0.002);
+
+    std::vector<std::string> texts(N);
+    for(size_t i = 0; i < N; i++)
+    {
+        texts[i] = "id" + std::to_string(i);
+        for(size_t j = 0; j < n_words; j++)
+            texts[i] += " w" + std::to_string(word_dist(gen));
+    }
+
+    return texts;
+}
+
+double recall_at_k(const std::vector<std::vector<RetrievedIndex>>& expected,
+                   const std::vector<std::vector<RetrievedIndex>>& retrieved)
+{
+    size_t n_expected = 0;
+    size_t n_found = 0;
+
+    for(size_t i = 0; i < expected.size(); i++)
+    {
+        n_expected += expected[i].size();
+        n_found += std::ranges::count_if(expected[i],
+                                         [&](const RetrievedIndex& expected_index)
+                                         {
+                                             return std::ranges::any_of(retrieved[i],
+                                                                        [&](const RetrievedIndex& retrieved_index)
+                                                                        { return retrieved_index.index == expected_index.index; });
+                                         });
+    }
+
+    return n_expected ? static_cast<double>(n_found) / n_expected : 1.0;
+}
+
+static void IndexingVector(benchmark::State& state, VectorIndexType index_type)
 {
     const size_t embedding_rank = state.range(0);
     const size_t items = state.range(1);
@@ -37,18 +99,18 @@ static void IndexingVector(benchmark::State& state)
 
     for(auto _ : state)
     {
-        auto db = vector_store_factory(embedding_rank);
+        auto db = vector_store_factory(embedding_rank, VectorStoreParams{.index_type = index_type});
         db->add(chunks);
     }
 }
 
-static void DatabaseLookup(benchmark::State& state)
+static void DatabaseLookup(benchmark::State& state, VectorIndexType index_type)
 {
     const size_t embedding_rank = state.range(0);
     const size_t items = state.range(1);
-    const size_t top_k = state.range(1);
+    const size_t top_k = state.range(2);
 
-    auto db = vector_store_factory(embedding_rank);
+    auto db = vector_store_factory(embedding_rank, VectorStoreParams{.index_type = index_type});
     auto chunks = create(embedding_rank, items);
 
     db->add(chunks);
@@ -61,6 +123,512 @@ static void DatabaseLookup(benchmark::State& state)
     }
 }
 
+static void AnnLookup(benchmark::State& state)
+{
+    constexpr size_t N_QUERIES = 100;
+
+    const auto index_type = static_cast<VectorIndexType>(state.range(0));
+    const auto refine_type = static_cast<VectorRefineType>(state.range(1));
+    const size_t embedding_rank = state.range(2);
+    const size_t items = state.range(3);
+    const size_t top_k = state.range(4);
+
+    const auto chunks = create(embedding_rank, items);
+    const auto queries = create_queries(chunks, N_QUERIES);
+
+    auto exact_db = vector_store_factory(embedding_rank);
+    exact_db->add(chunks);
+    const auto expected = exact_db->retrieve_batch(queries, top_k);
+
+    auto db = vector_store_factory(embedding_rank,
+                                   VectorStoreParams{.index_type = index_type, .refine_type = refine_type});
+    db->add(chunks);
+
+    size_t query_idx = 0;
+    for(auto _ : state)
+    {
+        auto result = db->retrieve(queries[query_idx], top_k);
+        benchmark::DoNotOptimize(result);
+        query_idx = (query_idx + 1) % queries.size();
+    }
+
+    state.counters["QPS"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["recall@k"] = recall_at_k(expected, db->retrieve_batch(queries, top_k));
+    state.counters["bytes_per_vector"] = static_cast<double>(db->get_memory_usage_bytes()) / db->size();
+}
+
+static void StartupRebuild(benchmark::State& state)
+{
+    const auto index_type = static_cast<VectorIndexType>(state.range(0));
+    const size_t embedding_rank = state.range(1);
+    const size_t items = state.range(2);
+
+    const auto chunks = create(embedding_rank, items);
+
+    for(auto _ : state)
+    {
+        auto db = vector_store_factory(embedding_rank, VectorStoreParams{.index_type = index_type});
+        db->add(chunks);
+        benchmark::DoNotOptimize(db);
+    }
+}
+
+static void StartupLoad(benchmark::State& state)
+{
+    const auto index_type = static_cast<VectorIndexType>(state.range(0));
+    const size_t embedding_rank = state.range(1);
+    const size_t items = state.range(2);
+
+    const auto index_path = std::filesystem::temp_directory_path() / "vector_search_benchmark.index";
+    {
+        auto db = vector_store_factory(embedding_rank, VectorStoreParams{.index_type = index_type});
+        db->add(create(embedding_rank, items));
+        db->save(index_path);
+    }
+
+    for(auto _ : state)
+    {
+        auto db = vector_store_factory(embedding_rank, VectorStoreParams{.index_type = index_type});
+        db->load(index_path);
+        benchmark::DoNotOptimize(db);
+    }
+
+    std::filesystem::remove(index_path);
+}
+
+static void FilteredLookup(benchmark::State& state)
+{
+    constexpr size_t N_QUERIES = 100;
+
+    const auto index_type = static_cast<VectorIndexType>(state.range(0));
+    const size_t selectivity_percent = state.range(1);
+    const size_t embedding_rank = state.range(2);
+    const size_t items = state.range(3);
+    const size_t top_k = state.range(4);
+
+    const auto chunks = create(embedding_rank, items);
+    const auto queries = create_queries(chunks, N_QUERIES);
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> percent_dist(0, 99);
+    IndexBitmap filter(items);
+    for(size_t i = 0; i < items; i++)
+    {
+        if(percent_dist(gen) < selectivity_percent)
+            filter.set(i);
+    }
+
+    auto exact_db = vector_store_factory(embedding_rank);
+    exact_db->add(chunks);
+    auto db = vector_store_factory(embedding_rank, VectorStoreParams{.index_type = index_type});
+    db->add(chunks);
+
+    size_t query_idx = 0;
+    for(auto _ : state)
+    {
+        auto result = db->retrieve_filtered(queries[query_idx], top_k, filter);
+        benchmark::DoNotOptimize(result);
+        query_idx = (query_idx + 1) % queries.size();
+    }
+
+    std::vector<std::vector<RetrievedIndex>> expected;
+    std::vector<std::vector<RetrievedIndex>> retrieved;
+    for(const auto& query : queries)
+    {
+        expected.push_back(exact_db->retrieve_filtered(query, top_k, filter));
+        retrieved.push_back(db->retrieve_filtered(query, top_k, filter));
+    }
+
+    state.counters["QPS"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["recall@k"] = recall_at_k(expected, retrieved);
+}
+
+// Chunks come with precalculated embeddings, nothing is embedded.
+class PrecalculatedEmbeddingCalculator : public IEmbeddingCalculator
+{
+  public:
+    explicit PrecalculatedEmbeddingCalculator(size_t embedding_rank) : embedding_rank_(embedding_rank) {}
+
+    std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+    {
+        return std::vector<EmbeddingCalculationResult>(chunks.size(),
+                                                       EmbeddingCalculationResult{Embedding(embedding_rank_), 0});
+    }
+
+    size_t get_embedding_rank() const override { return embedding_rank_; }
+
+  private:
+    size_t embedding_rank_;
+};
+
+// Memory of the retriever holding the chunks and the index. The peak RSS is process wide, so the benchmark should be
+// run in a separate process, e.g. with --benchmark_filter.
+static void DocumentStoreMemory(benchmark::State& state)
+{
+    const size_t embedding_rank = state.range(0);
+    const size_t items = state.range(1);
+
+    const auto rss_before_gb = get_current_process_mem_usage_gb();
+    for(auto _ : state)
+    {
+        std::vector<DocumentChunk> chunks;
+        {
+            auto embeddings = create(embedding_rank, items);
+            chunks.reserve(items);
+            for(size_t i = 0; i < items; i++)
+                chunks.push_back(DocumentChunk{"Chunk content", DocumentChunkMetadata{"source.pdf", i},
+                                               std::move(embeddings[i])});
+        }
+
+        SimpleDocumentChunkRetriever retriever(std::make_unique<PrecalculatedEmbeddingCalculator>(embedding_rank),
+                                               vector_store_factory(embedding_rank));
+        retriever.add_document_chunks(chunks);
+        chunks.clear();
+        chunks.shrink_to_fit();
+
+        state.counters["steady_rss_growth_gb"] = get_current_process_mem_usage_gb() - rss_before_gb;
+    }
+    state.counters["peak_rss_gb"] = get_peak_process_mem_usage_gb();
+}
+
+// Replaces a single document in a growing corpus. The vector store is copied on every update, so the queries running
+// meanwhile are not blocked, it's the main cost for the larger corpora.
+static void DocumentUpsert(benchmark::State& state)
+{
+    constexpr size_t CHUNKS_PER_DOCUMENT = 20;
+
+    const size_t embedding_rank = state.range(0);
+    const size_t items = state.range(1);
+
+    SimpleDocumentChunkRetriever retriever(std::make_unique<PrecalculatedEmbeddingCalculator>(embedding_rank),
+                                           vector_store_factory(embedding_rank));
+    auto embeddings = create(embedding_rank, items);
+    std::vector<DocumentChunk> chunks;
+    chunks.reserve(items);
+    for(size_t i = 0; i < items; i++)
+    {
+        chunks.push_back(DocumentChunk{"Chunk content", DocumentChunkMetadata{std::to_string(i / CHUNKS_PER_DOCUMENT), i},
+                                       std::move(embeddings[i])});
+    }
+    retriever.add_document_chunks(chunks);
+
+    const auto document = std::vector<DocumentChunk>(chunks.begin(), chunks.begin() + CHUNKS_PER_DOCUMENT);
+    for(auto _ : state)
+    {
+        retriever.upsert_document_chunks(document);
+    }
+}
+
+// Shared by the threads of the ConcurrentRetrieval benchmark, created and destroyed by the first of them.
+static std::unique_ptr<SimpleDocumentChunkRetriever> concurrent_retriever;
+
+// Queries per second of a single retriever queried from all the benchmark threads. With the updates the first thread
+// keeps replacing a document instead of querying, so the query throughput shows whether the readers wait for it.
+static void ConcurrentRetrieval(benchmark::State& state, bool with_updates)
+{
+    constexpr size_t CHUNKS_PER_DOCUMENT = 20;
+
+    const size_t embedding_rank = state.range(0);
+    const size_t items = state.range(1);
+    const size_t top_k = state.range(2);
+
+    std::vector<DocumentChunk> document;
+    if(state.thread_index() == 0)
+    {
+        auto embeddings = create(embedding_rank, items);
+        std::vector<DocumentChunk> chunks;
+        chunks.reserve(items);
+        for(size_t i = 0; i < items; i++)
+        {
+            chunks.push_back(DocumentChunk{"Chunk content",
+                                           DocumentChunkMetadata{std::to_string(i / CHUNKS_PER_DOCUMENT), i},
+                                           std::move(embeddings[i])});
+        }
+
+        concurrent_retriever = std::make_unique<SimpleDocumentChunkRetriever>(
+            std::make_unique<PrecalculatedEmbeddingCalculator>(embedding_rank), vector_store_factory(embedding_rank));
+        concurrent_retriever->add_document_chunks(chunks);
+        document.assign(chunks.begin(), chunks.begin() + CHUNKS_PER_DOCUMENT);
+    }
+
+    const bool updating = with_updates && state.thread_index() == 0;
+    for(auto _ : state)
+    {
+        if(updating)
+            concurrent_retriever->upsert_document_chunks(document);
+        else
+            benchmark::DoNotOptimize(concurrent_retriever->retrieve("Question", top_k));
+    }
+
+    if(!updating)
+        state.counters["queries_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+
+    if(state.thread_index() == 0)
+        concurrent_retriever.reset();
+}
+
+// Questions are the indices of the precalculated query embeddings.
+class QueryEmbeddingCalculator : public IEmbeddingCalculator
+{
+  public:
+    explicit QueryEmbeddingCalculator(std::vector<Embedding> queries) : queries_(std::move(queries)) {}
+
+    std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+    {
+        std::vector<EmbeddingCalculationResult> results;
+        results.reserve(chunks.size());
+        std::ranges::transform(chunks, std::back_inserter(results), [this](const std::string& chunk)
+                               { return EmbeddingCalculationResult{queries_[std::stoul(chunk)], 0}; });
+        return results;
+    }
+
+    size_t get_embedding_rank() const override { return queries_.front().size(); }
+
+  private:
+    std::vector<Embedding> queries_;
+};
+
+// Every word of the chunks is a single token.
+static size_t count_words(const std::string& text)
+{
+    return std::ranges::count(text, ' ') + 1;
+}
+
+// A corpus where every topic is stored a few times with a small noise, like the boilerplate repeated across documents.
+// The retrieved chunks fill the same token budget of the context as in the pipeline, the tokens of the chunks whose
+// topic is already in the context are a wasted part of the prompt, the distinct topics are the useful context.
+static void ContextRedundancy(benchmark::State& state, bool use_mmr)
+{
+    constexpr size_t N_QUERIES = 100;
+
+    const size_t embedding_rank = state.range(0);
+    const size_t n_topics = state.range(1);
+    const size_t copies = state.range(2);
+    const size_t top_k = state.range(3);
+    const auto max_context_tokens = static_cast<uint32_t>(state.range(4));
+
+    const auto topics = create(embedding_rank, n_topics);
+    std::mt19937 gen(42);
+    std::normal_distribution<float> noise_dist(0.0f, 0.01f);
+    std::vector<DocumentChunk> chunks;
+    chunks.reserve(n_topics * copies);
+    for(size_t copy = 0; copy < copies; copy++)
+    {
+        for(size_t topic = 0; topic < n_topics; topic++)
+        {
+            auto embedding = topics[topic];
+            std::ranges::for_each(embedding, [&](float& value) { value += noise_dist(gen); });
+
+            // The topic id is the first word, the chunks of the topics have from 20 to 80 words.
+            std::string content = std::to_string(topic);
+            for(size_t word = 1; word < 20 + topic % 61; word++)
+                content += " word";
+            chunks.push_back(DocumentChunk{std::move(content), DocumentChunkMetadata{std::to_string(copy), topic},
+                                           std::move(embedding)});
+        }
+    }
+
+    auto embedding_calculator = std::make_unique<QueryEmbeddingCalculator>(create_queries(topics, N_QUERIES));
+    SimpleDocumentChunkRetriever retriever(std::move(embedding_calculator), vector_store_factory(embedding_rank));
+    retriever.add_document_chunks(chunks);
+
+    const RagInferenceSettings settings{.top_k = static_cast<uint32_t>(top_k),
+                                        .max_context_tokens = max_context_tokens};
+    size_t n_queries = 0;
+    size_t n_context_tokens = 0;
+    size_t n_redundant_tokens = 0;
+    size_t n_distinct_topics = 0;
+    for(auto _ : state)
+    {
+        const auto question = std::to_string(n_queries++ % N_QUERIES);
+        const auto retrieved = use_mmr ? retriever.retrieve_diverse(question, top_k, MmrSettings{})
+                                       : retriever.retrieve(question, top_k);
+        const auto context = select_context_chunks(retrieved, settings, count_words);
+
+        std::vector<std::string> seen_topics;
+        for(const auto& chunk : context)
+        {
+            const size_t n_tokens = count_words(chunk.content);
+            n_context_tokens += n_tokens;
+
+            const auto topic = chunk.content.substr(0, chunk.content.find(' '));
+            if(std::ranges::find(seen_topics, topic) != seen_topics.end())
+                n_redundant_tokens += n_tokens;
+            else
+                seen_topics.push_back(topic);
+        }
+        n_distinct_topics += seen_topics.size();
+    }
+
+    state.counters["context_tokens_per_query"] = static_cast<double>(n_context_tokens) / n_queries;
+    state.counters["redundant_tokens_per_query"] = static_cast<double>(n_redundant_tokens) / n_queries;
+    state.counters["distinct_topics_per_query"] = static_cast<double>(n_distinct_topics) / n_queries;
+}
+
+// BM25 top_k latency of the queries mixing the common words with an identifier, as the users ask about part numbers.
+static void LexicalLookup(benchmark::State& state)
+{
+    const size_t items = state.range(0);
+    const size_t words_per_query = state.range(1);
+    const size_t top_k = state.range(2);
+
+    std::mt19937 gen(42);
+    Bm25Index index;
+    index.add(create_texts(items, 200, gen));
+
+    std::uniform_int_distribution<size_t> id_dist(0, items - 1);
+    std::vector<std::string> queries = create_texts(100, words_per_query, gen);
+    std::ranges::for_each(queries, [&](std::string& query) { query += " id" + std::to_string(id_dist(gen)); });
+
+    size_t query_idx = 0;
+    for(auto _ : state)
+    {
+        benchmark::DoNotOptimize(index.retrieve(queries[query_idx++ % queries.size()], top_k));
+    }
+
+    state.counters["QPS"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["index_mb"] = static_cast<double>(index.get_memory_usage_bytes()) / (1024.0 * 1024.0);
+}
+
+enum class DatabaseFormat
+{
+    JSON,
+    BINARY
+};
+
+static void save_database(const SimpleDocumentChunkRetriever& retriever, DatabaseFormat format,
+                          const std::filesystem::path& path)
+{
+    if(format == DatabaseFormat::BINARY)
+    {
+        retriever.save_binary(path);
+        return;
+    }
+
+    std::ofstream output(path, std::ios::out);
+    retriever.dump(output);
+}
+
+// Chunks of a hundred words, grouped into documents of 20 chunks.
+static std::unique_ptr<SimpleDocumentChunkRetriever> create_text_retriever(size_t embedding_rank, size_t items)
+{
+    std::mt19937 gen(42);
+    auto texts = create_texts(items, 100, gen);
+    auto embeddings = create(embedding_rank, items);
+    std::vector<DocumentChunk> chunks;
+    chunks.reserve(items);
+    for(size_t i = 0; i < items; i++)
+    {
+        chunks.push_back(DocumentChunk{std::move(texts[i]), DocumentChunkMetadata{std::to_string(i / 20), i},
+                                       std::move(embeddings[i])});
+    }
+
+    auto retriever = std::make_unique<SimpleDocumentChunkRetriever>(
+        std::make_unique<PrecalculatedEmbeddingCalculator>(embedding_rank), vector_store_factory(embedding_rank));
+    retriever->add_document_chunks(chunks);
+    return retriever;
+}
+
+static void DatabaseDump(benchmark::State& state, DatabaseFormat format)
+{
+    const size_t embedding_rank = state.range(0);
+    const size_t items = state.range(1);
+
+    const auto retriever = create_text_retriever(embedding_rank, items);
+    const auto path = std::filesystem::temp_directory_path() / "vector_search_benchmark.db";
+    for(auto _ : state)
+    {
+        save_database(*retriever, format, path);
+    }
+
+    state.counters["file_mb"] = static_cast<double>(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+    std::filesystem::remove(path);
+}
+
+// Startup from the database file, the json one is parsed as a whole, the binary one is memory mapped. The RSS growth
+// is measured once the load completes, the peak RSS is process wide, so the formats should be run in separate
+// processes, e.g. with --benchmark_filter.
+static void DatabaseLoad(benchmark::State& state, DatabaseFormat format)
+{
+    const size_t embedding_rank = state.range(0);
+    const size_t items = state.range(1);
+
+    const auto path = std::filesystem::temp_directory_path() / "vector_search_benchmark.db";
+    save_database(*create_text_retriever(embedding_rank, items), format, path);
+
+    const auto rss_before_gb = get_current_process_mem_usage_gb();
+    for(auto _ : state)
+    {
+        SimpleDocumentChunkRetriever retriever(std::make_unique<PrecalculatedEmbeddingCalculator>(embedding_rank),
+                                               vector_store_factory(embedding_rank));
+        if(format == DatabaseFormat::BINARY)
+        {
+            retriever.load_binary(path);
+        }
+        else
+        {
+            std::ifstream input(path, std::ios::in);
+            retriever.load(input);
+        }
+
+        state.counters["loaded_rss_growth_gb"] = get_current_process_mem_usage_gb() - rss_before_gb;
+    }
+
+    state.counters["file_mb"] = static_cast<double>(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+    state.counters["peak_rss_gb"] = get_peak_process_mem_usage_gb();
+    std::filesystem::remove(path);
+}
+
+// Resident memory of the chunk contents after the load and after the queries. The json load keeps all of them in
+// memory, the binary one leaves them in the mapped file and reads the retrieved ones only. The RSS is process wide, so
+// the formats should be run in separate processes.
+static void ChunkContentMemory(benchmark::State& state, DatabaseFormat format)
+{
+    constexpr size_t N_QUERIES = 1000;
+
+    const size_t embedding_rank = state.range(0);
+    const size_t items = state.range(1);
+    const size_t top_k = state.range(2);
+
+    // The database is created by a child process, so the memory freed after it is not reused by the load.
+    const auto path = std::filesystem::temp_directory_path() / "vector_search_benchmark.db";
+    if(const pid_t pid = fork(); pid == 0)
+    {
+        save_database(*create_text_retriever(embedding_rank, items), format, path);
+        _exit(0);
+    }
+    else
+    {
+        waitpid(pid, nullptr, 0);
+    }
+
+    auto embedding_calculator = std::make_unique<QueryEmbeddingCalculator>(create(embedding_rank, N_QUERIES));
+    const auto rss_before_gb = get_current_process_mem_usage_gb();
+    const auto anon_rss_before_gb = get_current_process_anon_mem_usage_gb();
+    for(auto _ : state)
+    {
+        SimpleDocumentChunkRetriever retriever(std::move(embedding_calculator), vector_store_factory(embedding_rank));
+        if(format == DatabaseFormat::BINARY)
+        {
+            retriever.load_binary(path);
+        }
+        else
+        {
+            std::ifstream input(path, std::ios::in);
+            retriever.load(input);
+        }
+        state.counters["loaded_rss_growth_gb"] = get_current_process_mem_usage_gb() - rss_before_gb;
+
+        for(size_t i = 0; i < N_QUERIES; i++)
+            benchmark::DoNotOptimize(retriever.retrieve(std::to_string(i), top_k));
+        state.counters["queried_rss_growth_gb"] = get_current_process_mem_usage_gb() - rss_before_gb;
+        // The mapped pages are file backed, the kernel reclaims them under memory pressure.
+        state.counters["queried_anon_rss_growth_gb"] = get_current_process_anon_mem_usage_gb() - anon_rss_before_gb;
+    }
+
+    std::filesystem::remove(path);
+}
+
 static void MemSummary(benchmark::State& state) {
     // A dummy function to put the result of the peak memory usage
     for(auto _ : state) {}
@@ -68,16 +636,129 @@ static void MemSummary(benchmark::State& state) {
 }
 
 
-BENCHMARK(IndexingVector)
+// The faiss flat index and the native SIMD store are registered over the same grid for a head-to-head comparison.
+BENCHMARK_CAPTURE(IndexingVector, faiss, VectorIndexType::FLAT)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->ArgsProduct({{512, 768, 1024, 4096}, {100, 1000, 10000, 30000}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(IndexingVector, native, VectorIndexType::NATIVE_FLAT)
     ->ArgNames({"embedding_rank", "n_elements"})
     ->ArgsProduct({{512, 768, 1024, 4096}, {100, 1000, 10000, 30000}})
     ->Unit(benchmark::kMillisecond);
 
-BENCHMARK(DatabaseLookup)
+BENCHMARK_CAPTURE(DatabaseLookup, faiss, VectorIndexType::FLAT)
+    ->ArgNames({"embedding_rank", "n_elements", "top_k"})
+    ->ArgsProduct({{512, 768, 1024, 4096}, {100, 1000, 10000, 30000}, {1, 5, 10}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(DatabaseLookup, native, VectorIndexType::NATIVE_FLAT)
     ->ArgNames({"embedding_rank", "n_elements", "top_k"})
     ->ArgsProduct({{512, 768, 1024, 4096}, {100, 1000, 10000, 30000}, {1, 5, 10}})
     ->Unit(benchmark::kMillisecond);
 
+// index_type follows the VectorIndexType enum: 0 - FLAT, 1 - IVF_FLAT, 2 - HNSW, 3 - SQ8, 4 - SQ_FP16, 5 - PQ,
+// 6 - BINARY, 7 - NATIVE_FLAT.
+// refine_type follows the VectorRefineType enum: 0 - NONE, 1 - FP16, 2 - FP32.
+BENCHMARK(AnnLookup)
+    ->ArgNames({"index_type", "refine_type", "embedding_rank", "n_elements", "top_k"})
+    ->ArgsProduct({{0, 1, 2, 7}, {0}, {768, 1024}, {1000, 10000, 30000}, {1, 5, 10}})
+    ->ArgsProduct({{3, 4, 5}, {0, 1, 2}, {768, 1024}, {10000, 30000}, {10}})
+    ->ArgsProduct({{6}, {0, 1, 2}, {768, 1024}, {10000, 30000}, {1, 5, 10}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(StartupRebuild)
+    ->ArgNames({"index_type", "embedding_rank", "n_elements"})
+    ->ArgsProduct({{0, 1, 2}, {768}, {10000, 100000}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(StartupLoad)
+    ->ArgNames({"index_type", "embedding_rank", "n_elements"})
+    ->ArgsProduct({{0, 1, 2}, {768}, {10000, 100000}})
+    ->Unit(benchmark::kMillisecond);
+
+// index_type follows the VectorIndexType enum, as for the AnnLookup.
+BENCHMARK(FilteredLookup)
+    ->ArgNames({"index_type", "selectivity_percent", "embedding_rank", "n_elements", "top_k"})
+    ->ArgsProduct({{0, 1, 2, 3, 6, 7}, {1, 10, 50}, {768}, {30000}, {10}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(DocumentStoreMemory)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->Args({768, 30000})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(DocumentUpsert)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->ArgsProduct({{768}, {1000, 10000, 30000}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(ConcurrentRetrieval, queries_only, false)
+    ->ArgNames({"embedding_rank", "n_elements", "top_k"})
+    ->Args({768, 30000, 5})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(ConcurrentRetrieval, with_updates, true)
+    ->ArgNames({"embedding_rank", "n_elements", "top_k"})
+    ->Args({768, 30000, 5})
+    ->ThreadRange(2, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(ContextRedundancy, top_k, false)
+    ->ArgNames({"embedding_rank", "n_topics", "copies", "top_k", "max_context_tokens"})
+    ->ArgsProduct({{768}, {10000}, {1, 3}, {5, 10}, {256}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(ContextRedundancy, mmr, true)
+    ->ArgNames({"embedding_rank", "n_topics", "copies", "top_k", "max_context_tokens"})
+    ->ArgsProduct({{768}, {10000}, {1, 3}, {5, 10}, {256}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(LexicalLookup)
+    ->ArgNames({"n_elements", "words_per_query", "top_k"})
+    ->ArgsProduct({{1000, 10000, 30000}, {3, 10}, {5, 20}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_CAPTURE(DatabaseDump, json, DatabaseFormat::JSON)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->ArgsProduct({{768}, {10000, 100000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(DatabaseDump, binary, DatabaseFormat::BINARY)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->ArgsProduct({{768}, {10000, 100000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(DatabaseLoad, json, DatabaseFormat::JSON)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->ArgsProduct({{768}, {10000, 100000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(DatabaseLoad, binary, DatabaseFormat::BINARY)
+    ->ArgNames({"embedding_rank", "n_elements"})
+    ->ArgsProduct({{768}, {10000, 100000}})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(ChunkContentMemory, json, DatabaseFormat::JSON)
+    ->ArgNames({"embedding_rank", "n_elements", "top_k"})
+    ->Args({128, 100000, 5})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(ChunkContentMemory, binary, DatabaseFormat::BINARY)
+    ->ArgNames({"embedding_rank", "n_elements", "top_k"})
+    ->Args({128, 100000, 5})
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
 BENCHMARK(MemSummary); // That's a hack. We must call this in order to memory readout to take place.
 
 
@@ -27,6 +27,7 @@ class RagRecipe(ConanFile):
         self.requires("tabulate/1.5")
         self.requires("kainjow-mustache/4.1")
         self.requires("magic_enum/0.9.5")
+        self.requires("xxhash/0.8.2")
 
     def config_options(self):
         if self.settings.os == "Windows":
@@ -34,6 +34,7 @@ class LlamaProvider : public ILlmProvider
                                                        const std::function<LlmCallback>& callback) override;
 
     void clear_context() override;
+    std::size_t count_tokens(const std::string& text) override;
     ~LlamaProvider() override;
 
   private:
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
 #include <future>
 #include <memory>
@@ -57,6 +58,8 @@ class ILlmProvider
     virtual std::unique_ptr<ILlmAsyncGeneration> generateAsync(const LlmInput& input,
                                                                const std::function<LlmCallback>& callback) = 0;
     virtual void clear_context() = 0;
+    // Number of the model tokens of the text, without the BOS/EOS tokens.
+    virtual std::size_t count_tokens(const std::string& text) = 0;
     virtual ~ILlmProvider() = default;
 };
 
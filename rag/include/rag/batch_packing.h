@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace ds
+{
+// Groups the sequences of the given lengths into batches of up to max_tokens tokens and max_sequences sequences, as
+// full as possible, so the mixed length sequences take fewer decodes than when batched in their order. The sequences
+// are placed from the longest one, each into the batch with the least room left that it fits in (best fit
+// decreasing). Returns the indices of the sequences of every batch, the sequences longer than max_tokens throw.
+std::vector<std::vector<size_t>> pack_sequences(const std::vector<size_t>& lengths, size_t max_tokens,
+                                                size_t max_sequences);
+} // namespace ds
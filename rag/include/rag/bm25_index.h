@@ -0,0 +1,111 @@
+#pragma once
+#include "rag/index_bitmap.h"
+#include "rag/vector_database.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ds
+{
+struct Bm25Params
+{
+    // Saturation of the term frequency.
+    float k1 = 1.2f;
+    // Strength of the document length normalization.
+    float b = 0.75f;
+};
+
+// Inverted index of the chunk contents for the lexical retrieval, it finds the exact identifiers like part numbers,
+// error codes or API names that the embeddings blur. The documents are indexed in the same order as the vector store.
+//
+// Every posting list is a varint encoded sequence of the document id deltas and the term frequencies. The top_k
+// search is the MaxScore one: the lists whose score upper bounds can't lift a document above the current top_k
+// threshold are only probed for the documents found in the other lists.
+//
+// The documents are kept in segments, which the copies of the index share. A copy adds the documents to a new
+// segment of its own, the trailing segments of similar sizes are merged, so a copy and an addition cost as much as
+// the added documents, amortized. The statistics are global, the segments are searched one by one with a common
+// top_k threshold.
+class Bm25Index
+{
+  public:
+    explicit Bm25Index(Bm25Params params = {}) : params_(params) {}
+
+    // The documents get the consecutive indices following the already added ones.
+    void add(std::string_view document);
+    void add(const std::vector<std::string>& documents);
+    // Appends the documents of the other index, e.g. one built aside, after the own ones. Its segments are shared.
+    void append(const Bm25Index& other);
+
+    // Up to top_k documents sorted by the BM25 score, the ones without any of the query terms are not returned. The
+    // score is passed in the cosine_similarity field, so the results are handled as the vector store ones.
+    std::vector<RetrievedIndex> retrieve(const std::string& query, size_t top_k) const;
+    // Same as retrieve, considering the documents set in the bitmap only.
+    std::vector<RetrievedIndex> retrieve_filtered(const std::string& query, size_t top_k,
+                                                  const IndexBitmap& allowed) const;
+
+    // Index of the kept documents only, renumbered in the same order, in a single segment. The statistics are
+    // recalculated, until then the removed documents still count in the document frequencies and the average length.
+    Bm25Index compacted(const IndexBitmap& keep) const;
+
+    size_t size() const { return n_docs_; }
+    size_t get_memory_usage_bytes() const;
+
+    // The segments are saved merged, the loaded index has a single one.
+    void save(const std::filesystem::path& path) const;
+    void load(const std::filesystem::path& path);
+
+    // Lowercased runs of the ASCII letters, digits and underscores. The non-ASCII bytes are kept as the word
+    // characters, so the UTF-8 words are not split.
+    static std::vector<std::string> tokenize(std::string_view text);
+
+  private:
+    struct PostingList
+    {
+        std::vector<uint8_t> bytes;
+        uint32_t n_docs = 0;
+        uint32_t last_doc = 0;
+        // The score of a term grows with its frequency and falls with the document length, so these two bound
+        // the score within the list.
+        uint32_t max_tf = 0;
+        uint32_t min_doc_length = UINT32_MAX;
+
+        void append(uint32_t doc, uint32_t tf, uint32_t doc_length);
+        // Whether the bytes decode to increasing ids of the documents with the lengths, matching the statistics.
+        bool is_valid(const std::vector<uint32_t>& doc_lengths) const;
+    };
+
+    // Consecutive documents with their own ids, starting at 0.
+    struct Segment
+    {
+        std::unordered_map<std::string, PostingList> postings;
+        std::vector<uint32_t> doc_lengths;
+        uint64_t total_doc_length = 0;
+
+        // Appends the documents of the other segment, only the ones set in keep from keep_offset on, if given.
+        void append(const Segment& other, const IndexBitmap* keep = nullptr, size_t keep_offset = 0);
+    };
+
+    template <typename Allowed>
+    std::vector<RetrievedIndex> retrieve_(const std::string& query, size_t top_k, Allowed&& allowed) const;
+
+    Segment& writable_segment_();
+    void merge_trailing_segments_();
+    Segment merged_segments_(const IndexBitmap* keep = nullptr) const;
+    void reset_(Segment&& segment);
+
+    float idf_(uint32_t n_term_docs) const;
+    float term_score_(float idf, uint32_t tf, uint32_t doc_length, float avg_doc_length) const;
+
+    Bm25Params params_;
+    // A segment is modified only while it's not shared with another copy of the index.
+    std::vector<std::shared_ptr<Segment>> segments_;
+    size_t n_docs_ = 0;
+    uint64_t total_doc_length_ = 0;
+};
+} // namespace ds
@@ -0,0 +1,71 @@
+#pragma once
+#include "rag/document_chunk.h"
+#include "rag/vector_database.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace ds
+{
+constexpr uint32_t CHUNK_DATABASE_VERSION = 1;
+
+// Versioned binary file of the document chunks and their embeddings, in the native byte order. Every section is
+// a plain array, so the memory mapped file is used as is, without parsing:
+//  - the header with the counts and the section offsets,
+//  - the chunk contents in a single blob, with the table of their offsets,
+//  - the metadata columns: the chunk sources as indices into the table of the distinct sources, and the chunk ids,
+//  - the row-major embedding matrix aligned to 64 bytes, unless the file holds the chunks only.
+//
+// The embeddings are reconstructed from the vector store block by block, its rows must follow the chunks. Without
+// the store only the chunks are written. The file is written aside and renamed, so a mapping of the file it replaces
+// stays valid.
+void save_chunk_database(const std::filesystem::path& path, std::span<const DocumentChunkView> chunks,
+                         const IVectorStore* vector_store);
+
+// Read-only mapping of a chunk database file, the returned views point into the mapped pages. Only the header and
+// the offset tables are checked on opening, the pages of the contents and the embeddings are read when accessed.
+class MappedChunkDatabase
+{
+  public:
+    explicit MappedChunkDatabase(const std::filesystem::path& path);
+    ~MappedChunkDatabase();
+
+    MappedChunkDatabase(const MappedChunkDatabase&) = delete;
+    MappedChunkDatabase& operator=(const MappedChunkDatabase&) = delete;
+
+    size_t size() const { return n_chunks_; }
+    // 0 when the file holds the chunks only.
+    size_t embedding_rank() const { return embedding_rank_; }
+
+    std::string_view content(size_t idx) const;
+    std::string_view source(size_t idx) const;
+    uint64_t chunk_id(size_t idx) const { return chunk_ids_[idx]; }
+    // Row-major embeddings of all the chunks.
+    std::span<const float> embeddings() const { return {embeddings_, n_chunks_ * embedding_rank_}; }
+
+    // Drops the pages read so far from the resident memory, e.g. after a scan of all the contents, and disables the
+    // read-ahead for the later random accesses. The pages are read again from the page cache or the file when needed.
+    void release_resident_pages() const;
+
+    // Checks the file magic, so the other formats can be told apart.
+    static bool is_chunk_database(const std::filesystem::path& path);
+
+  private:
+    const uint8_t* data_ = nullptr;
+    size_t file_size_ = 0;
+
+    size_t n_chunks_ = 0;
+    size_t embedding_rank_ = 0;
+    const uint64_t* content_offsets_ = nullptr;
+    const char* contents_ = nullptr;
+    const uint64_t* source_offsets_ = nullptr;
+    const char* sources_ = nullptr;
+    const uint32_t* source_ids_ = nullptr;
+    const uint64_t* chunk_ids_ = nullptr;
+    const float* embeddings_ = nullptr;
+};
+} // namespace ds
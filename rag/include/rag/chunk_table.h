@@ -0,0 +1,115 @@
+#pragma once
+#include "rag/chunk_database.h"
+#include "rag/document_chunk.h"
+#include "rag/index_bitmap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ds
+{
+// Chunks held by the retriever without their embeddings, in the same order as the vector store.
+//
+// The chunks are kept in segments, which the copies of the table share, like the segments of the lexical index. The
+// added chunks are packed in a single buffer of the contents per segment, next to the chunk ids and the ids of the
+// sources, which are stored once per segment. The chunks of a chunk database file stay in its mapping, their segment
+// holds the mapping and the range of the chunks only, so only the pages of the retrieved ones become resident. Every
+// segment indexes the chunks of its sources, so filters on a few sources don't scan all the chunks.
+class ChunkTable
+{
+  public:
+    // The chunks get the consecutive indices following the already added ones.
+    void add(std::string_view content, std::string_view source, uint64_t chunk_id);
+    // Adds the chunks [begin, end) of the mapped database, they are not copied.
+    void add_mapped(std::shared_ptr<const MappedChunkDatabase> database, size_t begin, size_t end);
+    // Appends the chunks of the other table, e.g. one built aside, after the own ones. Its segments are shared.
+    void append(const ChunkTable& other);
+
+    // Table of the kept chunks only, renumbered in the same order.
+    ChunkTable compacted(const IndexBitmap& keep) const;
+
+    size_t size() const { return n_chunks_; }
+    bool empty() const { return n_chunks_ == 0; }
+
+    std::string_view content(size_t idx) const;
+    std::string_view source(size_t idx) const;
+    uint64_t chunk_id(size_t idx) const;
+    DocumentChunkView view(size_t idx) const;
+
+    // Calls fn with the index of every chunk of the source in increasing order, the removed ones included.
+    template <typename Fn>
+    void for_each_source_chunk(std::string_view source, Fn&& fn) const
+    {
+        const std::string source_name(source);
+        for(size_t segment_idx = 0; segment_idx < segments_.size(); segment_idx++)
+        {
+            const auto& segment = *segments_[segment_idx];
+            const auto source_id = segment.source_ids_by_name.find(source_name);
+            if(source_id == segment.source_ids_by_name.end())
+                continue;
+
+            const size_t segment_begin = segment_idx == 0 ? 0 : segment_ends_[segment_idx - 1];
+            for(const auto chunk_idx : segment.source_chunks[source_id->second])
+                fn(segment_begin + chunk_idx);
+        }
+    }
+
+  private:
+    // Consecutive chunks with their own indices, starting at 0. Either all of them are kept in memory, or all of them
+    // are in the database mapping.
+    struct Segment
+    {
+        size_t n_chunks = 0;
+
+        // Sources of all the chunks with the chunks of every source.
+        std::vector<std::string> sources;
+        std::unordered_map<std::string, uint32_t> source_ids_by_name;
+        std::vector<std::vector<uint32_t>> source_chunks;
+
+        // The chunks kept in memory.
+        std::string contents;
+        std::vector<size_t> content_ends;
+        std::vector<uint32_t> source_ids;
+        std::vector<uint64_t> chunk_ids;
+
+        // The mapped chunks, database_idxs when they aren't a contiguous range from database_begin.
+        std::shared_ptr<const MappedChunkDatabase> database;
+        size_t database_begin = 0;
+        std::vector<size_t> database_idxs;
+
+        bool is_mapped() const { return database != nullptr; }
+        size_t database_idx(size_t idx) const
+        {
+            return database_idxs.empty() ? database_begin + idx : database_idxs[idx];
+        }
+
+        std::string_view content(size_t idx) const;
+        std::string_view source(size_t idx) const;
+        uint64_t chunk_id(size_t idx) const;
+
+        // Adds the chunk at idx to the source index, returns the source id.
+        uint32_t index_source(std::string_view chunk_source, size_t idx);
+        void add(std::string_view chunk_content, std::string_view chunk_source, uint64_t id);
+        // Appends the chunks of the other in-memory segment, only the ones set in keep from keep_offset on, if given.
+        void append(const Segment& other, const IndexBitmap* keep = nullptr, size_t keep_offset = 0);
+    };
+
+    // Segment of the chunk and its index within the segment.
+    std::pair<const Segment*, size_t> locate_(size_t idx) const;
+
+    Segment& writable_segment_();
+    void merge_trailing_segments_();
+    void push_segment_(std::shared_ptr<Segment> segment);
+
+    // A segment is modified only while it's not shared with another copy of the table.
+    std::vector<std::shared_ptr<Segment>> segments_;
+    // Index following the last chunk of every segment.
+    std::vector<size_t> segment_ends_;
+    size_t n_chunks_ = 0;
+};
+} // namespace ds
@@ -0,0 +1,39 @@
+#pragma once
+#include "rag/embedding_matrix.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ds
+{
+struct DocumentChunkMetadata {
+    std::string source;
+    uint64_t chunk_id;
+};
+
+struct DocumentChunk
+{
+    std::string content;
+    DocumentChunkMetadata metadata;
+    std::optional<Embedding> embedding;
+};
+
+// Chunk without its embedding, pointing to the content and the source owned elsewhere.
+struct DocumentChunkView
+{
+    std::string_view content;
+    std::string_view source;
+    uint64_t chunk_id;
+};
+
+// Parses the {"chunks": [...]} json document incrementally, the chunks are passed to the consumer in batches of
+// batch_size (the last one may be smaller). Only a single batch is held in memory, instead of the whole document.
+void read_document_chunks(std::istream& input, size_t batch_size,
+                          const std::function<void(std::vector<DocumentChunk>&&)>& consume_batch);
+} // namespace ds
@@ -1,64 +1,241 @@
 #pragma once
+#include "rag/bm25_index.h"
+#include "rag/document_chunk.h"
 #include "rag/embedding_calculator.h"
+#include "rag/chunk_table.h"
 #include "rag/vector_database.h"
 
+#include <filesystem>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace ds
 {
+// Removed chunks are only marked as such, the index is compacted once their fraction exceeds the threshold.
+constexpr float DEFAULT_COMPACTION_THRESHOLD = 0.25f;
+
 struct DocumentChunkRetrieverParams
 {
     EmbeddingCalculatorParams embedding_calculator_params;
+    VectorStoreParams vector_store_params;
+    float compaction_threshold = DEFAULT_COMPACTION_THRESHOLD;
+    // Workers embedding the added chunks block by block while they are indexed, their blocks are decoded
+    // concurrently up to the number of the embedding contexts.
+    size_t n_ingestion_threads = 1;
+    // Memory cap of the cache of the query embeddings and the retrieval results of the recent questions, the cache is
+    // disabled when 0. Every update of the index invalidates the cached results.
+    size_t query_cache_bytes = 0;
 };
 
-struct DocumentChunkMetadata {
-    std::string source;
-    uint64_t chunk_id;
+// Restricts the retrieval to a subset of the chunks, a chunk must pass all the set conditions.
+struct RetrievalFilter
+{
+    // Chunks of any of the listed sources pass, an empty list accepts all of them.
+    std::vector<std::string> sources;
+    // Inclusive bounds of the chunk_id.
+    std::optional<uint64_t> min_chunk_id;
+    std::optional<uint64_t> max_chunk_id;
 };
 
-struct DocumentChunk
+// Maximal marginal relevance selection among the over-fetched candidates, it trades the relevance for the diversity
+// so the near-duplicate chunks don't take the place of the other relevant ones.
+struct MmrSettings
 {
-    std::string content;
-    DocumentChunkMetadata metadata;
-    std::optional<Embedding> embedding;
+    // 1 ranks the candidates by the relevance only, 0 by the dissimilarity to the selected ones only.
+    float lambda = 0.7f;
+    // Candidates with at least this cosine similarity to an already selected chunk are dropped as its duplicates.
+    float duplicate_threshold = 0.95f;
+    // Number of the candidates, as a multiple of top_k.
+    size_t fetch_factor = 4;
+};
+
+// Reciprocal rank fusion of the vector ranking and the BM25 one. The lexical ranking finds the exact identifiers the
+// embeddings miss, e.g. part numbers, error codes or API names.
+struct HybridSearchSettings
+{
+    // Number of the candidates taken from each of the rankings, as a multiple of top_k.
+    size_t fetch_factor = 4;
+    // Flattens the difference between the top ranks, 60 is the value proposed with the method.
+    float rrf_k = 60.f;
 };
 
 struct RetrievedDocumentChunk
 {
     std::string content;
     uint64_t chunk_id;
+    // Cosine similarity to the query.
     float score;
+    // RRF score of the hybrid retrieval, which orders its chunks.
+    std::optional<float> fused_score;
+};
+
+struct QueryCacheStats
+{
+    size_t embedding_hits = 0;
+    size_t embedding_misses = 0;
+    size_t result_hits = 0;
+    size_t result_misses = 0;
+    // Estimate of the memory taken by the cached entries.
+    size_t memory_bytes = 0;
 };
 
+class QueryCache;
+class SegmentedVectorStore;
+
 class IDocumentChunkRetriever
 {
   public:
     virtual ~IDocumentChunkRetriever() = default;
 
     virtual std::vector<RetrievedDocumentChunk> retrieve(const std::string& question, const size_t top_k) const = 0;
+    virtual std::vector<std::vector<RetrievedDocumentChunk>> retrieve_batch(const std::vector<std::string>& questions,
+                                                                            const size_t top_k) const = 0;
+    virtual std::vector<RetrievedDocumentChunk> retrieve_filtered(const std::string& question, const size_t top_k,
+                                                                  const RetrievalFilter& filter) const = 0;
+    // Up to top_k chunks picked with the MMR, in the order of the selection. The scores are the query similarities.
+    virtual std::vector<RetrievedDocumentChunk> retrieve_diverse(const std::string& question, const size_t top_k,
+                                                                 const MmrSettings& settings) const = 0;
+    // Up to top_k chunks sorted by the fused rank, which is in the fused_score. The scores are the cosine similarities,
+    // also of the chunks found by the lexical index only, so the score cutoffs work as with the other retrievals.
+    virtual std::vector<RetrievedDocumentChunk> retrieve_hybrid(const std::string& question, const size_t top_k,
+                                                                const HybridSearchSettings& settings) const = 0;
     virtual void add_document_chunks(const std::vector<DocumentChunk>& chunks) = 0;
+    using AddChunksFn = std::function<void(const std::vector<DocumentChunk>& chunks)>;
+    // Bulk addition: produce_chunks passes the chunks to add_chunks batch by batch, every batch is embedded and indexed
+    // on the call, and all of them are published at once when produce_chunks returns. So the index is updated a single
+    // time, instead of once per batch.
+    virtual void add_document_chunks(const std::function<void(const AddChunksFn& add_chunks)>& produce_chunks) = 0;
+    // Replaces the chunks with the same source and chunk_id, the remaining ones are added.
+    virtual void upsert_document_chunks(const std::vector<DocumentChunk>& chunks) = 0;
+    // Removes all the chunks of the source, returns their number.
+    virtual size_t remove_document(const std::string& source) = 0;
+    // Json interchange format of the chunks with their embeddings, e.g. for the Python chunking scripts. The embeddings
+    // are left null when the vector store keeps only their compressed approximations, they are calculated on load.
     virtual void dump(std::ostream& output) const = 0;
     virtual void load(std::istream& input) = 0;
+    // Binary chunk database file with the embeddings, loading it maps the file instead of parsing it. A file without
+    // the embeddings, also written when the vector store compresses them, gets them calculated.
+    virtual void save_binary(const std::filesystem::path& path) const = 0;
+    virtual void load_binary(const std::filesystem::path& path) = 0;
+
+    // Snapshot directory with the chunks, the native vector index and the lexical index, loading it skips the index
+    // rebuild.
+    virtual void save_snapshot(const std::filesystem::path& directory) const = 0;
+    virtual void load_snapshot(const std::filesystem::path& directory) = 0;
 };
 
 std::unique_ptr<IDocumentChunkRetriever> create_document_chunk_retriever(const DocumentChunkRetrieverParams& params);
 
+// The queries run concurrently with each other and with the updates. The added chunks are embedded and indexed block
+// by block, as a pipeline, aside from the published index and without blocking the other updates. The updates are
+// then serialized, every one of them builds a new version of the index on top of the current one and publishes it at
+// once, the queries keep using the version they started with. The versions share the segments of the vector store and
+// of the lexical index, the added chunks go to the new ones, which are merged once they make up a part of the index.
+// The chunks themselves are shared between the versions. The contents of the chunks loaded from a chunk database file
+// stay in its mapping until retrieved. With the query cache, the repeated questions skip the embedding, and the vector
+// search too until the index is updated.
 class SimpleDocumentChunkRetriever : public IDocumentChunkRetriever
 {
   public:
     explicit SimpleDocumentChunkRetriever(std::unique_ptr<IEmbeddingCalculator>&& embedding_calculator,
-                                          std::unique_ptr<IVectorStore>&& vector_store);
+                                          std::unique_ptr<IVectorStore>&& vector_store,
+                                          float compaction_threshold = DEFAULT_COMPACTION_THRESHOLD,
+                                          size_t n_ingestion_threads = 1, size_t query_cache_bytes = 0);
+    ~SimpleDocumentChunkRetriever() override;
 
     std::vector<RetrievedDocumentChunk> retrieve(const std::string& question, const size_t top_k) const override;
+    std::vector<std::vector<RetrievedDocumentChunk>> retrieve_batch(const std::vector<std::string>& questions,
+                                                                    const size_t top_k) const override;
+    std::vector<RetrievedDocumentChunk> retrieve_filtered(const std::string& question, const size_t top_k,
+                                                          const RetrievalFilter& filter) const override;
+    std::vector<RetrievedDocumentChunk> retrieve_diverse(const std::string& question, const size_t top_k,
+                                                         const MmrSettings& settings) const override;
+    std::vector<RetrievedDocumentChunk> retrieve_hybrid(const std::string& question, const size_t top_k,
+                                                        const HybridSearchSettings& settings) const override;
     void add_document_chunks(const std::vector<DocumentChunk>& chunks) override;
+    void add_document_chunks(const std::function<void(const AddChunksFn& add_chunks)>& produce_chunks) override;
+    void upsert_document_chunks(const std::vector<DocumentChunk>& chunks) override;
+    size_t remove_document(const std::string& source) override;
     void dump(std::ostream& output) const override;
     void load(std::istream& input) override;
+    void save_binary(const std::filesystem::path& path) const override;
+    void load_binary(const std::filesystem::path& path) override;
+    void save_snapshot(const std::filesystem::path& directory) const override;
+    void load_snapshot(const std::filesystem::path& directory) override;
+
+    // Drops the removed chunks from the indices, it's O(number of chunks). The compacted indices are built aside,
+    // blocking neither the queries nor the updates, and the updates made meanwhile are replayed on them before they
+    // are published. The updates start it on a background thread once the removed fraction exceeds the threshold.
+    void compact();
+
+    // Counters of the query cache, all zero when it's disabled.
+    QueryCacheStats query_cache_stats() const;
 
   private:
+    // A published state is never modified. The copies share the segments of the indices, the chunk table and the
+    // pages of the live bitmap, so a copy costs as much as the segments and the pages, not the chunks.
+    struct State
+    {
+        std::shared_ptr<const SegmentedVectorStore> vector_store;
+        // BM25 index of the chunk contents, in the same order as the vector store.
+        std::shared_ptr<const Bm25Index> lexical_index = std::make_shared<const Bm25Index>();
+        // Indexed in the same order as the vector store, with the chunks of every source.
+        ChunkTable document_chunks;
+        // Removed chunks stay in the vector store until the compaction, the searches skip them.
+        PagedIndexBitmap live_chunks;
+        size_t n_removed_chunks = 0;
+        // Incremented by every published state, the cached results are keyed by it.
+        uint64_t epoch = 0;
+    };
+
+    // Chunks embedded and indexed aside, without blocking the other updates, then appended to the current state.
+    // Every block is added to the private indices as soon as it's embedded, their segments are shared at the append.
+    struct PreparedChunks
+    {
+        std::unique_ptr<SegmentedVectorStore> vector_store;
+        Bm25Index lexical_index;
+        ChunkTable document_chunks;
+    };
+
+    std::shared_ptr<const State> load_state_() const;
+    void publish_state_(std::shared_ptr<State> state);
+
+    Embedding embed_query_(const std::string& question) const;
+    std::vector<RetrievedIndex> retrieve_live_(const State& state, const Embedding& query_embedding,
+                                               size_t top_k) const;
+    std::vector<RetrievedDocumentChunk> to_document_chunks_(const State& state,
+                                                            const std::vector<RetrievedIndex>& retrieved_indices) const;
+    IndexBitmap to_index_bitmap_(const State& state, const RetrievalFilter& filter) const;
+    PreparedChunks empty_prepared_chunks_() const;
+    // Embeds the chunks block by block on the ingestion threads, indexing every block into the prepared indices.
+    void prepare_chunks_(const std::vector<DocumentChunk>& chunks, PreparedChunks& prepared) const;
+    void append_chunks_(State& state, PreparedChunks&& prepared) const;
+    void index_chunks_(State& state, size_t first_chunk) const;
+    void reset_chunk_indices_(State& state) const;
+    void compact_(State& state) const;
+    void replay_updates_(State& compacted_state, const State& compacted_from, const State& current_state) const;
+    void compact_if_needed_();
+    std::vector<DocumentChunkView> live_document_chunks_(const State& state) const;
+
     std::unique_ptr<IEmbeddingCalculator> embedding_calculator_;
-    std::unique_ptr<IVectorStore> vector_store_;
-    std::vector<DocumentChunk> document_chunks_;
+    // Accessed with the atomic shared_ptr operations only.
+    std::shared_ptr<const State> state_;
+    std::mutex writer_mutex_;
+    // Incremented by the loaded snapshots, which replace the state instead of updating it. Guarded by writer_mutex_.
+    uint64_t n_replaced_states_ = 0;
+    // Held by the running compaction.
+    std::mutex compaction_mutex_;
+    // Started by the updates, guarded by writer_mutex_.
+    std::future<void> background_compaction_;
+    float compaction_threshold_;
+    size_t n_ingestion_threads_;
+    // Null when disabled.
+    std::unique_ptr<QueryCache> query_cache_;
 };
 } // namespace ds
\ No newline at end of file
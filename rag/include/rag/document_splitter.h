@@ -0,0 +1,48 @@
+#pragma once
+
+#include "rag/document_chunk.h"
+#include "rag/embedding_calculator.h"
+#include "rag/text_splitter.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ds
+{
+struct DocumentSplitterParams
+{
+    TextSplitterParams text_splitter_params;
+    // Splits the .md documents with the markdown separators, the other ones with the default separators.
+    bool markdown_separators = true;
+    // Number of threads reading and splitting the documents.
+    size_t n_threads = 1;
+    // Measures every chunk as a whole once more, the splitter only sums the lengths of its pieces. The chunks
+    // longer than the chunk size are logged, with the token budget they may be truncated by the embedding.
+    bool measure_chunks = false;
+    // Measures the chunks instead of the length function, e.g. keeping their tokens for the embedding.
+    std::function<size_t(const std::string&)> measure_chunk;
+};
+
+// Splits the documents by the tokens of the embedding model instead of the characters, into chunks of up to
+// chunk_tokens, no longer than the model embeds whole. The pieces are only counted, the chunks are measured with
+// tokenize_chunk, so their tokens are kept by the calculator and are not tokenized again when embedded.
+DocumentSplitterParams token_budget_params(const IEmbeddingCalculator& embedding_calculator, size_t chunk_tokens,
+                                           size_t chunk_overlap);
+
+// The .md and .txt documents of the directory and its subdirectories, sorted by the path, or the single document.
+std::vector<std::filesystem::path> find_documents(const std::filesystem::path& input);
+
+// Chunks of a single document, with the chunk ids numbered from first_chunk_id.
+std::vector<DocumentChunk> split_document(const std::filesystem::path& path, const DocumentSplitterParams& params,
+                                          uint64_t first_chunk_id = 0);
+
+// Reads and splits the documents on the worker threads, the chunks of every document are passed to the consumer on
+// the calling thread, in the order of the documents. The chunk ids run through all the documents, like the ones of
+// the Python splitter. Only a few documents per thread are split ahead of the consumer, so the whole corpus is never
+// held in memory.
+void split_documents(const std::vector<std::filesystem::path>& paths, const DocumentSplitterParams& params,
+                     const std::function<void(std::vector<DocumentChunk>&&)>& consume_chunks);
+} // namespace ds
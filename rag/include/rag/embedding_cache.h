@@ -0,0 +1,94 @@
+#pragma once
+#include "rag/embedding_calculator.h"
+#include "rag/text_hash.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ds
+{
+// Persistent cache of the chunk embeddings, so the unchanged chunks are not embedded again on the re-ingestion.
+// The file is an append-only log of the records keyed by the model identity and the 128-bit xxHash of the text.
+// The records of the other models are kept in the file but not indexed. Every record has a checksum, verified on
+// opening, so the records cut off or zero-filled by a crash are dropped. Only the index of the file offsets is held in
+// memory, the embeddings are read on lookup.
+class EmbeddingCache
+{
+  public:
+    // The model identity must change whenever the embeddings of the same text may change, e.g. with the model file.
+    EmbeddingCache(const std::filesystem::path& path, std::string_view model_identity, size_t embedding_rank);
+    // The identity is the content hash of the model file with the parameters changing its embeddings. The hash is kept
+    // in the file header, so the model is only hashed again when its path, size or modification time change.
+    EmbeddingCache(const std::filesystem::path& path, const std::filesystem::path& model_path,
+                   std::string_view model_parameters, size_t embedding_rank);
+    ~EmbeddingCache();
+
+    EmbeddingCache(const EmbeddingCache&) = delete;
+    EmbeddingCache& operator=(const EmbeddingCache&) = delete;
+
+    // Copies the cached embedding of the text to the output, returns whether it was found.
+    bool get(std::string_view text, std::span<float> output) const;
+    // Appends the record unless the text is cached already.
+    void put(std::string_view text, std::span<const float> embedding);
+
+    size_t size() const;
+    size_t embedding_rank() const { return embedding_rank_; }
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+  private:
+    int fd_ = -1;
+    uint64_t model_hash_ = 0;
+    size_t embedding_rank_;
+    uint64_t file_size_ = 0;
+
+    mutable std::mutex mutex_;
+    // Offsets of the embeddings of the current model records.
+    std::unordered_map<TextHash, uint64_t, TextHashHasher> offsets_;
+    mutable std::atomic<size_t> hits_ = 0;
+    mutable std::atomic<size_t> misses_ = 0;
+
+    // Opens the file and checks or writes its header, the delegating constructors index the records.
+    EmbeddingCache(const std::filesystem::path& path, size_t embedding_rank);
+
+    uint64_t model_content_hash_(const std::filesystem::path& path, const std::filesystem::path& model_path);
+    void read_index_(const std::filesystem::path& path);
+};
+
+// XXH3 of the file content, e.g. of the model, so the identity doesn't depend on the file name.
+uint64_t hash_file_content(const std::filesystem::path& path);
+
+// Embeds the chunks through the cache, only the texts missing from it are passed to the calculator, once each. The
+// calc_batch results carry the token counts, which are not cached, so the queries are passed through.
+class CachingEmbeddingCalculator : public IEmbeddingCalculator
+{
+  public:
+    CachingEmbeddingCalculator(std::unique_ptr<IEmbeddingCalculator>&& embedding_calculator,
+                               std::unique_ptr<EmbeddingCache>&& cache);
+
+    std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override;
+    EmbeddingMatrix calc_batch_matrix(const std::vector<std::string>& chunks) const override;
+    size_t get_embedding_rank() const override { return embedding_calculator_->get_embedding_rank(); }
+    size_t count_tokens(const std::string& text) const override { return embedding_calculator_->count_tokens(text); }
+    size_t tokenize_chunk(const std::string& chunk) const override
+    {
+        return embedding_calculator_->tokenize_chunk(chunk);
+    }
+    size_t max_text_tokens() const override { return embedding_calculator_->max_text_tokens(); }
+
+    const EmbeddingCache& cache() const { return *cache_; }
+
+  private:
+    std::unique_ptr<IEmbeddingCalculator> embedding_calculator_;
+    std::unique_ptr<EmbeddingCache> cache_;
+};
+} // namespace ds
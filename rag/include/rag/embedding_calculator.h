@@ -1,5 +1,7 @@
 #pragma once
 
+#include "rag/embedding_matrix.h"
+
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -13,15 +15,21 @@ struct EmbeddingCalculatorParams
     std::filesystem::path model_path;
     int32_t n_threads;
     int32_t batch_size;
+    // Contexts sharing the loaded model, every one of them embeds a single batch at a time on its own decoding thread.
+    // The calls queue their batches, taken by the idle contexts in the order of the calls, each running n_threads.
+    // Each context allocates its own compute buffers, so more of them trade memory for the throughput of both the
+    // large and the concurrent calls.
+    int32_t n_contexts = 1;
+    // Persistent cache of the chunk embeddings, see EmbeddingCache. Disabled when empty.
+    std::filesystem::path cache_path;
 };
 
-using Embedding = std::vector<float>;
-
 struct EmbeddingCalculationResult {
   Embedding embedding;
   size_t n_tokens;
 };
 
+// The calculations may be called concurrently, implementations synchronize the access to their resources.
 class IEmbeddingCalculator
 {
   public:
@@ -29,7 +37,19 @@ class IEmbeddingCalculator
 
     virtual EmbeddingCalculationResult calc(const std::string& chunk) const;
     virtual std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const = 0;
+    // Embeddings of all the chunks in a single buffer, the default implementation copies the calc_batch results.
+    virtual EmbeddingMatrix calc_batch_matrix(const std::vector<std::string>& chunks) const;
     virtual size_t get_embedding_rank() const = 0;
+
+    // Number of the model tokens of the text, without the special ones added to every embedded sequence, so the
+    // counts of the consecutive pieces of a text add up. The default implementations throw, for the calculators
+    // without a tokenizer.
+    virtual size_t count_tokens(const std::string& text) const;
+    // Counts the tokens of a chunk to be embedded, the calculator may keep them, so it isn't tokenized again when
+    // embedded. The default implementation only counts them.
+    virtual size_t tokenize_chunk(const std::string& chunk) const;
+    // Maximum number of the tokens of an embedded text, counted as above. The longer texts are truncated.
+    virtual size_t max_text_tokens() const;
 };
 
 std::unique_ptr<IEmbeddingCalculator> embedding_calculator_factory(const EmbeddingCalculatorParams& params);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace ds
+{
+using Embedding = std::vector<float>;
+
+// Contiguous row-major batch of embeddings. It's moved from the embedding calculator down to the vector store,
+// so a batch is never split into per-row allocations on the way.
+class EmbeddingMatrix
+{
+  public:
+    EmbeddingMatrix() = default;
+    EmbeddingMatrix(size_t n_rows, size_t rank);
+    EmbeddingMatrix(std::vector<float>&& values, size_t rank);
+
+    // Copies the rows into a single buffer, all of them must have the same size.
+    static EmbeddingMatrix from_rows(const std::vector<Embedding>& rows);
+
+    size_t rows() const { return n_rows_; }
+    size_t rank() const { return rank_; }
+    bool empty() const { return n_rows_ == 0; }
+
+    float* data() { return values_.data(); }
+    const float* data() const { return values_.data(); }
+
+    std::span<float> row(size_t idx) { return std::span<float>(values_).subspan(idx * rank_, rank_); }
+    std::span<const float> row(size_t idx) const
+    {
+        return std::span<const float>(values_).subspan(idx * rank_, rank_);
+    }
+
+    // Copies the given values into the row, throws when their size doesn't match the rank.
+    void set_row(size_t idx, std::span<const float> values);
+
+  private:
+    size_t n_rows_ = 0;
+    size_t rank_ = 0;
+    std::vector<float> values_;
+};
+} // namespace ds
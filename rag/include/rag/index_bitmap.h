@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace ds
+{
+// Set of vector store indices with a bit per index. The layout matches faiss::IDSelectorBitmap, so it's passed to
+// the faiss search as is.
+class IndexBitmap
+{
+  public:
+    explicit IndexBitmap(size_t size) : size_(size), bits_((size + 7) / 8, 0) {}
+
+    void set(size_t idx) { bits_[idx / 8] |= static_cast<uint8_t>(1u << (idx % 8)); }
+    void reset(size_t idx) { bits_[idx / 8] &= static_cast<uint8_t>(~(1u << (idx % 8))); }
+    bool test(size_t idx) const { return idx < size_ && (bits_[idx / 8] >> (idx % 8)) & 1u; }
+
+    size_t size() const { return size_; }
+    // Growing keeps the new indices unset.
+    void resize(size_t size)
+    {
+        for(size_t idx = size; idx < std::min(size_, bits_.size() * 8); idx++)
+            reset(idx);
+
+        size_ = size;
+        bits_.resize((size + 7) / 8, 0);
+    }
+    size_t count() const
+    {
+        return std::accumulate(bits_.begin(), bits_.end(), size_t{0},
+                               [](size_t sum, uint8_t byte) { return sum + std::popcount(byte); });
+    }
+
+    // Indices [first, first + n) renumbered from 0, the ones beyond the size are unset.
+    IndexBitmap slice(size_t first, size_t n) const
+    {
+        IndexBitmap sliced(n);
+        const size_t byte_begin = first / 8;
+        const size_t shift = first % 8;
+        for(size_t byte_idx = 0; byte_idx < sliced.bits_.size(); byte_idx++)
+        {
+            const uint8_t low = byte_begin + byte_idx < bits_.size() ? bits_[byte_begin + byte_idx] : 0;
+            const uint8_t high = byte_begin + byte_idx + 1 < bits_.size() ? bits_[byte_begin + byte_idx + 1] : 0;
+            sliced.bits_[byte_idx] = static_cast<uint8_t>(low >> shift | (shift > 0 ? high << (8 - shift) : 0));
+        }
+        if(n % 8 != 0)
+            sliced.bits_.back() &= static_cast<uint8_t>((1u << (n % 8)) - 1);
+
+        return sliced;
+    }
+
+    const std::vector<uint8_t>& bytes() const { return bits_; }
+
+    // Calls fn for every set index in increasing order, skipping the empty bytes.
+    template <typename Fn>
+    void for_each_set(Fn&& fn) const
+    {
+        for(size_t byte_idx = 0; byte_idx < bits_.size(); byte_idx++)
+        {
+            for(uint8_t byte = bits_[byte_idx]; byte != 0; byte &= static_cast<uint8_t>(byte - 1))
+                fn(byte_idx * 8 + std::countr_zero(byte));
+        }
+    }
+
+  private:
+    friend class PagedIndexBitmap;
+
+    size_t size_;
+    std::vector<uint8_t> bits_;
+};
+
+// Index bitmap split in pages, which the copies of the bitmap share, so a copy costs a pointer per page. A shared
+// page is copied on its first modification. The flat bitmap the searches take is built once per modified copy.
+class PagedIndexBitmap
+{
+  public:
+    explicit PagedIndexBitmap(size_t size = 0) { resize(size); }
+    // The flat bitmap is not copied, the copy is the one modified.
+    PagedIndexBitmap(const PagedIndexBitmap& other) : size_(other.size_), pages_(other.pages_) {}
+    PagedIndexBitmap& operator=(const PagedIndexBitmap& other)
+    {
+        size_ = other.size_;
+        pages_ = other.pages_;
+        flat_.reset();
+        return *this;
+    }
+
+    void set(size_t idx) { writable_page_(idx)[idx % PAGE_BITS / 8] |= static_cast<uint8_t>(1u << (idx % 8)); }
+    void reset(size_t idx) { writable_page_(idx)[idx % PAGE_BITS / 8] &= static_cast<uint8_t>(~(1u << (idx % 8))); }
+    bool test(size_t idx) const
+    {
+        return idx < size_ && ((*pages_[idx / PAGE_BITS])[idx % PAGE_BITS / 8] >> (idx % 8)) & 1u;
+    }
+
+    size_t size() const { return size_; }
+    // Growing keeps the new indices unset.
+    void resize(size_t size)
+    {
+        for(size_t idx = size; idx < size_; idx++)
+            reset(idx);
+
+        size_ = size;
+        const size_t n_pages = (size + PAGE_BITS - 1) / PAGE_BITS;
+        pages_.reserve(n_pages);
+        while(pages_.size() < n_pages)
+            pages_.push_back(std::make_shared<Page>());
+        pages_.resize(n_pages);
+        flat_.reset();
+    }
+
+    // Calls fn for every set index in increasing order, skipping the empty bytes.
+    template <typename Fn>
+    void for_each_set(Fn&& fn) const
+    {
+        for(size_t page_idx = 0; page_idx < pages_.size(); page_idx++)
+        {
+            const auto& page = *pages_[page_idx];
+            for(size_t byte_idx = 0; byte_idx < page.size(); byte_idx++)
+            {
+                for(uint8_t byte = page[byte_idx]; byte != 0; byte &= static_cast<uint8_t>(byte - 1))
+                    fn(page_idx * PAGE_BITS + byte_idx * 8 + std::countr_zero(byte));
+            }
+        }
+    }
+
+    // Calls fn(idx, rank) for every index set in the earlier bitmap and unset in this one, which is a modified copy
+    // of it, rank being the number of the indices set in the earlier bitmap below idx. The pages still shared with
+    // the earlier bitmap are only counted.
+    template <typename Fn>
+    void for_each_unset_since(const PagedIndexBitmap& earlier, Fn&& fn) const
+    {
+        size_t rank = 0;
+        for(size_t page_idx = 0; page_idx < earlier.pages_.size(); page_idx++)
+        {
+            const auto& earlier_page = *earlier.pages_[page_idx];
+            const bool shared_page = pages_[page_idx] == earlier.pages_[page_idx];
+            for(size_t byte_idx = 0; byte_idx < PAGE_BYTES; byte_idx++)
+            {
+                const uint8_t earlier_byte = earlier_page[byte_idx];
+                const uint8_t unset_bits = shared_page ? 0 : earlier_byte & ~(*pages_[page_idx])[byte_idx];
+                for(uint8_t byte = unset_bits; byte != 0; byte &= static_cast<uint8_t>(byte - 1))
+                {
+                    const int bit = std::countr_zero(byte);
+                    fn(page_idx * PAGE_BITS + byte_idx * 8 + bit,
+                       rank + std::popcount(static_cast<uint8_t>(earlier_byte & ((1u << bit) - 1))));
+                }
+                rank += std::popcount(earlier_byte);
+            }
+        }
+    }
+
+    // Safe to call from concurrent readers of an unmodified bitmap, it's built by the first of them.
+    std::shared_ptr<const IndexBitmap> flat() const
+    {
+        if(auto flat = std::atomic_load(&flat_))
+            return flat;
+
+        IndexBitmap flat(size_);
+        for(size_t page_idx = 0; page_idx < pages_.size(); page_idx++)
+        {
+            const size_t page_begin = page_idx * PAGE_BYTES;
+            std::memcpy(flat.bits_.data() + page_begin, pages_[page_idx]->data(),
+                        std::min(PAGE_BYTES, flat.bits_.size() - page_begin));
+        }
+
+        auto shared_flat = std::make_shared<const IndexBitmap>(std::move(flat));
+        std::atomic_store(&flat_, shared_flat);
+        return shared_flat;
+    }
+
+  private:
+    static constexpr size_t PAGE_BITS = size_t{1} << 16;
+    static constexpr size_t PAGE_BYTES = PAGE_BITS / 8;
+    using Page = std::array<uint8_t, PAGE_BYTES>;
+
+    Page& writable_page_(size_t idx)
+    {
+        auto& page = pages_[idx / PAGE_BITS];
+        if(page.use_count() != 1)
+            page = std::make_shared<Page>(*page);
+
+        flat_.reset();
+        return *page;
+    }
+
+    size_t size_ = 0;
+    // The bits beyond the size are unset.
+    std::vector<std::shared_ptr<Page>> pages_;
+    mutable std::shared_ptr<const IndexBitmap> flat_;
+};
+} // namespace ds
@@ -4,18 +4,43 @@
 #include "rag/document_retrieval.h"
 #include "rag/llm_prompt_composer.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace ds
 {
 
+// The top_k retrieved chunks are narrowed down by the optional cutoffs below, so the prompt holds the relevant
+// context only and its prefill is shorter.
 struct RagInferenceSettings
 {
     std::uint32_t top_k;
+    // Chunks with a lower cosine similarity are dropped.
+    std::optional<float> min_score;
+    // Chunks scoring lower than the best one by more than this fraction of its score are dropped, e.g. 0.1 keeps the
+    // chunks within 90% of the best score.
+    std::optional<float> max_relative_score_gap;
+    // Budget of the LLM tokens of all the context chunks, the chunks are taken in the retrieval order until the next
+    // one doesn't fit.
+    std::optional<std::uint32_t> max_context_tokens;
+    // Picks diverse chunks among the over-fetched candidates instead of the top_k most similar ones.
+    std::optional<MmrSettings> mmr;
+    // Fuses the vector ranking with the BM25 one, it takes precedence over the mmr. The chunks are in the fused order,
+    // their scores stay the cosine similarities the cutoffs apply to.
+    std::optional<HybridSearchSettings> hybrid;
 };
 
+// Applies the cutoffs of the settings to the chunks given in the order of preference, the token budget is filled in
+// that order. The token counter is called only when max_context_tokens is set.
+std::vector<RetrievedDocumentChunk>
+select_context_chunks(const std::vector<RetrievedDocumentChunk>& chunks, const RagInferenceSettings& settings,
+                      const std::function<std::size_t(const std::string&)>& count_tokens);
+
 class RagPipeline
 {
   public:
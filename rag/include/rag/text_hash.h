@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ds
+{
+// 128-bit xxHash of a text, the key of the cached embeddings. The collisions are negligible, so the texts themselves
+// are not stored.
+struct TextHash
+{
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const TextHash&) const = default;
+};
+
+struct TextHashHasher
+{
+    size_t operator()(const TextHash& hash) const { return hash.low; }
+};
+
+TextHash hash_text(std::string_view text);
+} // namespace ds
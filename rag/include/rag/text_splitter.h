@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ds
+{
+// Matches a prefix, a run of a repeated character and a suffix, e.g. "\n", 1 to 6 of "#" and " " for the markdown
+// headings. The plain separators have neither the run nor the suffix.
+struct TextSeparator
+{
+    std::string prefix;
+    char run_char = '\0';
+    size_t min_run = 0;
+    size_t max_run = 0;
+    std::string suffix;
+};
+
+// Paragraphs, lines, words and the single characters.
+std::vector<TextSeparator> default_separators();
+// Headings, code blocks and horizontal rules before the default separators.
+std::vector<TextSeparator> markdown_separators();
+
+// Length of the text in the unicode code points.
+size_t utf8_length(std::string_view text);
+
+struct TextSplitterParams
+{
+    // Maximum length of a chunk, a chunk is only longer when a single character doesn't fit.
+    size_t chunk_size = 512;
+    // Length of the tail of a chunk repeated at the beginning of the next one.
+    size_t chunk_overlap = 0;
+    // Measures the chunks against the chunk size, code points by default.
+    std::function<size_t(std::string_view)> length_function = utf8_length;
+};
+
+// Same algorithm as the LangChain RecursiveCharacterTextSplitter, so the chunks match the ones of the Python
+// splitter: the text is split with the first of the separators found in it, the pieces still too long are split
+// recursively with the following separators, and the neighbouring pieces are merged up to the chunk size. The
+// separators are kept at the beginning of the pieces following them, the chunks are stripped of the whitespace.
+class RecursiveTextSplitter
+{
+  public:
+    RecursiveTextSplitter(TextSplitterParams params, std::vector<TextSeparator> separators);
+
+    std::vector<std::string> split(std::string_view text) const;
+
+  private:
+    TextSplitterParams params_;
+    std::vector<TextSeparator> separators_;
+
+    void split_(std::string_view text, size_t first_separator, std::vector<std::string>& chunks) const;
+    void merge_(const std::vector<std::string_view>& splits, std::vector<std::string>& chunks) const;
+};
+} // namespace ds
@@ -1,13 +1,59 @@
 #pragma once
 
+#include "rag/embedding_matrix.h"
+#include "rag/index_bitmap.h"
+
 #include <cstdint>
+#include <filesystem>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace ds
 {
-using Embedding = std::vector<float>;
+enum class VectorIndexType
+{
+    FLAT,
+    IVF_FLAT,
+    HNSW,
+    SQ8,
+    SQ_FP16,
+    PQ,
+    BINARY,
+    // Exhaustive search with the built-in SIMD kernels, without faiss. The refine settings don't apply.
+    NATIVE_FLAT
+};
+
+enum class VectorRefineType
+{
+    NONE,
+    FP16,
+    FP32
+};
+
+struct VectorStoreParams
+{
+    VectorIndexType index_type = VectorIndexType::FLAT;
+
+    // IVF: number of inverted lists and number of lists visited per query.
+    // The index is trained on add, once enough vectors were collected, until then it's searched exhaustively.
+    size_t ivf_nlist = 256;
+    size_t ivf_nprobe = 16;
+
+    // HNSW: number of graph neighbours per node and the breadth of the search/construction.
+    size_t hnsw_m = 32;
+    size_t hnsw_ef_search = 64;
+    size_t hnsw_ef_construction = 40;
+
+    // PQ: number of sub-quantizers (must divide the embedding rank), each encoded with 8 bits.
+    size_t pq_m = 64;
+
+    // Optional exact re-scoring of the top_k * refine_k_factor candidates of a compressed index against
+    // fp16/fp32 copies of the vectors, so the returned similarities are not affected by the compression.
+    // Ignored for the FLAT index. For the BINARY index it re-ranks the Hamming distance shortlist.
+    VectorRefineType refine_type = VectorRefineType::NONE;
+    size_t refine_k_factor = 4;
+};
 
 struct RetrievedIndex
 {
@@ -15,14 +61,45 @@ struct RetrievedIndex
     float cosine_similarity;
 };
 
+// The const methods may be called concurrently from many threads, the other ones need exclusive access.
 class IVectorStore
 {
   public:
     virtual ~IVectorStore() = default;
 
-    virtual void add(const std::vector<Embedding>& chunks) = 0;
-    virtual std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) = 0;
+    // The matrix is taken by value, so the store can normalize it in place instead of copying it.
+    virtual void add(EmbeddingMatrix embeddings) = 0;
+    void add(const std::vector<Embedding>& embeddings) { add(EmbeddingMatrix::from_rows(embeddings)); }
+
+    virtual std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) const = 0;
+    virtual std::vector<std::vector<RetrievedIndex>> retrieve_batch(const std::vector<Embedding>& values,
+                                                                    uint32_t top_k) const = 0;
+    // Only the indices set in the filter are considered. Indices beyond the store size are ignored.
+    virtual std::vector<RetrievedIndex> retrieve_filtered(const std::vector<float>& values, uint32_t top_k,
+                                                          const IndexBitmap& filter) const = 0;
+
+    // Vectors [first, first + n) as they are stored: L2 normalized, and approximated for the compressed indices
+    // (without a refine index). Throws std::out_of_range when the range exceeds the store size.
+    virtual EmbeddingMatrix reconstruct(size_t first, size_t n) const = 0;
+    // Whether reconstruct returns the added vectors (L2 normalized) rather than their compressed approximations, so
+    // they may be saved in place of the original embeddings.
+    virtual bool reconstructs_exactly() const = 0;
+
+    // A new store with the vectors set in `keep` only, renumbered in the same order. The filter size must match the
+    // store size. The current store is left intact, so it can be still searched while the copy is built.
+    virtual std::unique_ptr<IVectorStore> compacted(const IndexBitmap& keep) const = 0;
+    // An independent copy, the additions to it are not visible in the current store.
+    virtual std::unique_ptr<IVectorStore> clone() const = 0;
+    // An empty store with the same index type and parameters, e.g. to load a saved index into.
+    virtual std::unique_ptr<IVectorStore> empty_like() const = 0;
+
+    virtual size_t size() const = 0;
+    virtual size_t get_memory_usage_bytes() const = 0;
+
+    // Native index serialization, loading replaces the current content of the store.
+    virtual void save(const std::filesystem::path& path) const = 0;
+    virtual void load(const std::filesystem::path& path) = 0;
 };
 
-std::unique_ptr<IVectorStore> vector_store_factory(size_t embedding_rank);
+std::unique_ptr<IVectorStore> vector_store_factory(size_t embedding_rank, const VectorStoreParams& params = {});
 } // namespace ds
\ No newline at end of file
@@ -92,6 +92,7 @@ class LlamaContext
                        uint32_t max_tokens = std::numeric_limits<uint32_t>::max());
 
     void clear_context();
+    std::size_t count_tokens(const std::string& text);
 
   private:
     std::vector<llama_token> tokenize(const std::string& text, bool special);
@@ -136,6 +137,7 @@ class LlamaProvider::LlamaProviderPimpl
                                                        const std::function<LlmCallback>& callback);
 
     void clear_context();
+    std::size_t count_tokens(const std::string& text);
     ~LlamaProviderPimpl();
 
   private:
@@ -216,6 +218,15 @@ void LlamaContext::clear_context()
     n_past = 0;
 }
 
+std::size_t LlamaContext::count_tokens(const std::string& text)
+{
+    // Without the output buffer llama_tokenize returns the negated number of the tokens.
+    const int num_of_tokens =
+        llama_tokenize(model_->get_llama_model(), text.data(), text.length(), nullptr, 0, false, false);
+
+    return static_cast<std::size_t>(num_of_tokens < 0 ? -num_of_tokens : num_of_tokens);
+}
+
 std::vector<llama_token> LlamaContext::tokenize(const std::string& text, bool special)
 {
     const int add_bos_int = llama_add_bos_token(model_->get_llama_model());
@@ -350,6 +361,11 @@ void LlamaProvider::LlamaProviderPimpl::clear_context()
     return context_->clear_context();
 }
 
+std::size_t LlamaProvider::LlamaProviderPimpl::count_tokens(const std::string& text)
+{
+    return context_->count_tokens(text);
+}
+
 LlamaProvider::LlamaProviderPimpl::~LlamaProviderPimpl()
 {
     context_.reset();
@@ -398,6 +414,11 @@ void LlamaProvider::clear_context()
     pimpl->clear_context();
 }
 
+std::size_t LlamaProvider::count_tokens(const std::string& text)
+{
+    return pimpl->count_tokens(text);
+}
+
 LlamaProvider::LlamaProvider(const std::filesystem::path& model_path, const LlamaParameters& params)
     : pimpl{std::make_unique<LlamaProviderPimpl>(model_path, params)}
 {
@@ -0,0 +1,52 @@
+#include "rag/batch_packing.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+
+namespace ds
+{
+std::vector<std::vector<size_t>> pack_sequences(const std::vector<size_t>& lengths, size_t max_tokens,
+                                                size_t max_sequences)
+{
+    if(max_sequences == 0)
+        throw std::logic_error("A batch must fit at least one sequence.");
+
+    std::vector<size_t> order(lengths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&lengths](size_t a, size_t b) { return lengths[a] > lengths[b]; });
+
+    std::vector<std::vector<size_t>> batches;
+    // Open batches by the room left, the full ones are dropped.
+    std::multimap<size_t, size_t> open_batches;
+    for(const auto idx : order)
+    {
+        if(lengths[idx] > max_tokens)
+        {
+            throw std::logic_error(
+                fmt::format("The sequence of {} tokens doesn't fit the batch of {}.", lengths[idx], max_tokens));
+        }
+
+        size_t batch = batches.size();
+        size_t room = max_tokens;
+        if(const auto it = open_batches.lower_bound(lengths[idx]); it != open_batches.end())
+        {
+            std::tie(room, batch) = *it;
+            open_batches.erase(it);
+        }
+        else
+        {
+            batches.emplace_back();
+        }
+
+        batches[batch].push_back(idx);
+        room -= lengths[idx];
+        if(room > 0 && batches[batch].size() < max_sequences)
+            open_batches.emplace(room, batch);
+    }
+
+    return batches;
+}
+} // namespace ds
@@ -0,0 +1,538 @@
+#include "rag/bm25_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+
+namespace ds
+{
+constexpr uint64_t BM25_INDEX_MAGIC = 0x35324d42; // "BM25"
+constexpr uint32_t END_OF_POSTINGS = UINT32_MAX;
+// The trailing segment is merged into the previous one unless that one is more than this many times larger.
+constexpr size_t SEGMENT_MERGE_FACTOR = 2;
+
+static void write_varint(std::vector<uint8_t>& bytes, uint32_t value)
+{
+    while(value >= 0x80)
+    {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t read_varint(const uint8_t*& pos)
+{
+    uint32_t value = 0;
+    for(uint32_t shift = 0;; shift += 7)
+    {
+        const uint8_t byte = *pos++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return value;
+    }
+}
+
+// Reads a varint of the loaded bytes, which may be corrupted, fails when it runs past the end or the 32 bits.
+static bool read_checked_varint(const uint8_t*& pos, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for(uint32_t shift = 0; shift < 32 && pos != end; shift += 7)
+    {
+        const uint8_t byte = *pos++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return shift < 28 || byte < 0x10;
+    }
+    return false;
+}
+
+// Decodes a posting list in the document order, past its end the document is END_OF_POSTINGS.
+class PostingCursor
+{
+  public:
+    explicit PostingCursor(const std::vector<uint8_t>& bytes) : pos_(bytes.data()), end_(bytes.data() + bytes.size())
+    {
+        next();
+    }
+
+    uint32_t doc() const { return doc_; }
+    uint32_t tf() const { return tf_; }
+
+    void next()
+    {
+        if(pos_ == end_)
+        {
+            doc_ = END_OF_POSTINGS;
+            return;
+        }
+
+        doc_ += read_varint(pos_);
+        tf_ = read_varint(pos_);
+    }
+
+    void advance_to(uint32_t doc)
+    {
+        while(doc_ < doc)
+            next();
+    }
+
+  private:
+    const uint8_t* pos_;
+    const uint8_t* end_;
+    uint32_t doc_ = 0;
+    uint32_t tf_ = 0;
+};
+
+void Bm25Index::PostingList::append(uint32_t doc, uint32_t tf, uint32_t doc_length)
+{
+    write_varint(bytes, n_docs == 0 ? doc : doc - last_doc);
+    write_varint(bytes, tf);
+    n_docs++;
+    last_doc = doc;
+    max_tf = std::max(max_tf, tf);
+    min_doc_length = std::min(min_doc_length, doc_length);
+}
+
+bool Bm25Index::PostingList::is_valid(const std::vector<uint32_t>& doc_lengths) const
+{
+    const uint8_t* pos = bytes.data();
+    const uint8_t* end = pos + bytes.size();
+    uint64_t doc = 0;
+    PostingList decoded;
+    while(pos != end)
+    {
+        uint32_t doc_delta = 0;
+        uint32_t tf = 0;
+        if(!read_checked_varint(pos, end, doc_delta) || !read_checked_varint(pos, end, tf))
+            return false;
+        if(decoded.n_docs > 0 && doc_delta == 0)
+            return false;
+
+        doc += doc_delta;
+        if(doc >= doc_lengths.size() || tf == 0 || tf > doc_lengths[doc])
+            return false;
+
+        decoded.n_docs++;
+        decoded.max_tf = std::max(decoded.max_tf, tf);
+        decoded.min_doc_length = std::min(decoded.min_doc_length, doc_lengths[doc]);
+    }
+
+    return decoded.n_docs > 0 && decoded.n_docs == n_docs && doc == last_doc && decoded.max_tf == max_tf &&
+           decoded.min_doc_length == min_doc_length;
+}
+
+std::vector<std::string> Bm25Index::tokenize(std::string_view text)
+{
+    std::vector<std::string> tokens;
+    std::string token;
+    for(const char c : text)
+    {
+        const auto byte = static_cast<unsigned char>(c);
+        if(byte >= 'A' && byte <= 'Z')
+        {
+            token.push_back(static_cast<char>(byte - 'A' + 'a'));
+        }
+        else if((byte >= 'a' && byte <= 'z') || (byte >= '0' && byte <= '9') || byte == '_' || byte >= 0x80)
+        {
+            token.push_back(c);
+        }
+        else if(!token.empty())
+        {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    }
+
+    if(!token.empty())
+        tokens.push_back(std::move(token));
+
+    return tokens;
+}
+
+void Bm25Index::Segment::append(const Segment& other, const IndexBitmap* keep, size_t keep_offset)
+{
+    std::vector<uint32_t> docs(other.doc_lengths.size(), END_OF_POSTINGS);
+    for(size_t doc = 0; doc < other.doc_lengths.size(); doc++)
+    {
+        if(keep && !keep->test(keep_offset + doc))
+            continue;
+
+        docs[doc] = static_cast<uint32_t>(doc_lengths.size());
+        doc_lengths.push_back(other.doc_lengths[doc]);
+        total_doc_length += other.doc_lengths[doc];
+    }
+
+    for(const auto& [term, other_postings] : other.postings)
+    {
+        // Created with the first kept document, so the terms of the removed documents only are dropped.
+        PostingList* term_postings = nullptr;
+        for(PostingCursor cursor(other_postings.bytes); cursor.doc() != END_OF_POSTINGS; cursor.next())
+        {
+            const auto doc = docs[cursor.doc()];
+            if(doc == END_OF_POSTINGS)
+                continue;
+
+            if(!term_postings)
+                term_postings = &postings[term];
+            term_postings->append(doc, cursor.tf(), doc_lengths[doc]);
+        }
+    }
+}
+
+Bm25Index::Segment& Bm25Index::writable_segment_()
+{
+    if(!segments_.empty() && segments_.back().use_count() == 1)
+        return *segments_.back();
+
+    // The last segment is shared with another copy of the index, a new one is started.
+    merge_trailing_segments_();
+    if(segments_.empty() || segments_.back().use_count() != 1)
+        segments_.push_back(std::make_shared<Segment>());
+
+    return *segments_.back();
+}
+
+// The trailing segments of similar sizes are merged into a copy, so there are only logarithmically many of them.
+void Bm25Index::merge_trailing_segments_()
+{
+    while(segments_.size() >= 2 && segments_[segments_.size() - 2]->doc_lengths.size() <=
+                                       SEGMENT_MERGE_FACTOR * segments_.back()->doc_lengths.size())
+    {
+        auto merged_segment = std::make_shared<Segment>(*segments_[segments_.size() - 2]);
+        merged_segment->append(*segments_.back());
+        segments_.pop_back();
+        segments_.back() = std::move(merged_segment);
+    }
+}
+
+Bm25Index::Segment Bm25Index::merged_segments_(const IndexBitmap* keep) const
+{
+    Segment merged_segment;
+    size_t offset = 0;
+    for(const auto& segment : segments_)
+    {
+        merged_segment.append(*segment, keep, offset);
+        offset += segment->doc_lengths.size();
+    }
+
+    return merged_segment;
+}
+
+void Bm25Index::reset_(Segment&& segment)
+{
+    n_docs_ = segment.doc_lengths.size();
+    total_doc_length_ = segment.total_doc_length;
+    segments_.clear();
+    if(n_docs_ > 0)
+        segments_.push_back(std::make_shared<Segment>(std::move(segment)));
+}
+
+void Bm25Index::add(std::string_view document)
+{
+    if(n_docs_ + 1 >= END_OF_POSTINGS)
+        throw std::runtime_error(fmt::format("Lexical index can't hold more than {} documents.", size()));
+
+    auto& segment = writable_segment_();
+    const auto doc = static_cast<uint32_t>(segment.doc_lengths.size());
+    const auto terms = tokenize(document);
+    const auto doc_length = static_cast<uint32_t>(terms.size());
+
+    std::unordered_map<std::string, uint32_t> term_frequencies;
+    for(const auto& term : terms)
+        term_frequencies[term]++;
+    for(const auto& [term, tf] : term_frequencies)
+        segment.postings[term].append(doc, tf, doc_length);
+
+    segment.doc_lengths.push_back(doc_length);
+    segment.total_doc_length += doc_length;
+    n_docs_++;
+    total_doc_length_ += doc_length;
+}
+
+void Bm25Index::add(const std::vector<std::string>& documents)
+{
+    if(documents.empty())
+        return;
+
+    auto& doc_lengths = writable_segment_().doc_lengths;
+    doc_lengths.reserve(doc_lengths.size() + documents.size());
+    std::ranges::for_each(documents, [this](const std::string& document) { add(std::string_view(document)); });
+}
+
+void Bm25Index::append(const Bm25Index& other)
+{
+    if(n_docs_ + other.n_docs_ >= END_OF_POSTINGS)
+        throw std::runtime_error(fmt::format("Lexical index can't hold more than {} documents.", size()));
+
+    segments_.insert(segments_.end(), other.segments_.begin(), other.segments_.end());
+    n_docs_ += other.n_docs_;
+    total_doc_length_ += other.total_doc_length_;
+    merge_trailing_segments_();
+}
+
+float Bm25Index::idf_(uint32_t n_term_docs) const
+{
+    // The Lucene variant, it stays positive for the terms present in most of the documents.
+    const auto n_docs = static_cast<float>(n_docs_);
+    const auto df = static_cast<float>(n_term_docs);
+    return std::log(1.f + (n_docs - df + 0.5f) / (df + 0.5f));
+}
+
+float Bm25Index::term_score_(float idf, uint32_t tf, uint32_t doc_length, float avg_doc_length) const
+{
+    const auto frequency = static_cast<float>(tf);
+    const float length_norm = 1.f - params_.b + params_.b * static_cast<float>(doc_length) / avg_doc_length;
+    return idf * frequency * (params_.k1 + 1.f) / (frequency + params_.k1 * length_norm);
+}
+
+template <typename Allowed>
+std::vector<RetrievedIndex> Bm25Index::retrieve_(const std::string& query, size_t top_k, Allowed&& allowed) const
+{
+    if(top_k == 0 || total_doc_length_ == 0)
+        return {};
+
+    const float avg_doc_length = static_cast<float>(total_doc_length_) / static_cast<float>(n_docs_);
+
+    struct QueryTerm
+    {
+        PostingCursor cursor;
+        float idf;
+        float upper_bound;
+    };
+
+    auto terms = tokenize(query);
+    std::ranges::sort(terms);
+    const auto [duplicates_begin, duplicates_end] = std::ranges::unique(terms);
+    terms.erase(duplicates_begin, duplicates_end);
+
+    // The document frequencies are summed over the segments, so the scores don't depend on the segmentation.
+    std::vector<std::pair<std::string, float>> term_idfs;
+    for(auto& term : terms)
+    {
+        uint32_t n_term_docs = 0;
+        for(const auto& segment : segments_)
+        {
+            const auto postings = segment->postings.find(term);
+            if(postings != segment->postings.end())
+                n_term_docs += postings->second.n_docs;
+        }
+
+        if(n_term_docs > 0)
+            term_idfs.emplace_back(std::move(term), idf_(n_term_docs));
+    }
+
+    const auto worse_score = [](const RetrievedIndex& lhs, const RetrievedIndex& rhs)
+    { return lhs.cosine_similarity > rhs.cosine_similarity; };
+    std::vector<RetrievedIndex> top_docs;
+    top_docs.reserve(top_k);
+    float threshold = 0.f;
+
+    size_t segment_offset = 0;
+    for(const auto& segment : segments_)
+    {
+        const auto& doc_lengths = segment->doc_lengths;
+        std::vector<QueryTerm> query_terms;
+        for(const auto& [term, idf] : term_idfs)
+        {
+            const auto postings = segment->postings.find(term);
+            if(postings == segment->postings.end())
+                continue;
+
+            query_terms.push_back(QueryTerm{
+                PostingCursor(postings->second.bytes), idf,
+                term_score_(idf, postings->second.max_tf, postings->second.min_doc_length, avg_doc_length)});
+        }
+
+        // The lists are ordered by their upper bounds, the first ones summing up to at most the top_k threshold are
+        // the non-essential ones: a document present in those only can't make it to the top_k.
+        std::ranges::sort(query_terms, {}, &QueryTerm::upper_bound);
+        std::vector<float> upper_bound_sums(query_terms.size());
+        std::transform_inclusive_scan(query_terms.begin(), query_terms.end(), upper_bound_sums.begin(),
+                                      std::plus<>(), [](const QueryTerm& query_term) { return query_term.upper_bound; });
+
+        // The threshold reached in the previous segments holds in this one too.
+        size_t first_essential = 0;
+        while(top_docs.size() == top_k && first_essential < query_terms.size() &&
+              upper_bound_sums[first_essential] <= threshold)
+            first_essential++;
+
+        while(first_essential < query_terms.size())
+        {
+            uint32_t doc = END_OF_POSTINGS;
+            for(size_t i = first_essential; i < query_terms.size(); i++)
+                doc = std::min(doc, query_terms[i].cursor.doc());
+            if(doc == END_OF_POSTINGS)
+                break;
+
+            const bool is_allowed = allowed(segment_offset + doc);
+            float score = 0.f;
+            for(size_t i = first_essential; i < query_terms.size(); i++)
+            {
+                auto& query_term = query_terms[i];
+                if(query_term.cursor.doc() != doc)
+                    continue;
+
+                if(is_allowed)
+                    score += term_score_(query_term.idf, query_term.cursor.tf(), doc_lengths[doc], avg_doc_length);
+                query_term.cursor.next();
+            }
+            if(!is_allowed)
+                continue;
+
+            for(size_t i = first_essential; i-- > 0 && score + upper_bound_sums[i] > threshold;)
+            {
+                auto& query_term = query_terms[i];
+                query_term.cursor.advance_to(doc);
+                if(query_term.cursor.doc() == doc)
+                    score += term_score_(query_term.idf, query_term.cursor.tf(), doc_lengths[doc], avg_doc_length);
+            }
+
+            if(top_docs.size() == top_k)
+            {
+                if(score <= threshold)
+                    continue;
+
+                std::ranges::pop_heap(top_docs, worse_score);
+                top_docs.pop_back();
+            }
+            top_docs.push_back(RetrievedIndex{segment_offset + doc, score});
+            std::ranges::push_heap(top_docs, worse_score);
+
+            if(top_docs.size() == top_k)
+            {
+                threshold = top_docs.front().cosine_similarity;
+                while(first_essential < query_terms.size() && upper_bound_sums[first_essential] <= threshold)
+                    first_essential++;
+            }
+        }
+
+        segment_offset += doc_lengths.size();
+    }
+
+    std::ranges::sort_heap(top_docs, worse_score);
+    return top_docs;
+}
+
+std::vector<RetrievedIndex> Bm25Index::retrieve(const std::string& query, size_t top_k) const
+{
+    return retrieve_(query, top_k, [](size_t) { return true; });
+}
+
+std::vector<RetrievedIndex> Bm25Index::retrieve_filtered(const std::string& query, size_t top_k,
+                                                         const IndexBitmap& allowed) const
+{
+    return retrieve_(query, top_k, [&allowed](size_t doc) { return allowed.test(doc); });
+}
+
+Bm25Index Bm25Index::compacted(const IndexBitmap& keep) const
+{
+    Bm25Index compacted_index(params_);
+    compacted_index.reset_(merged_segments_(&keep));
+
+    return compacted_index;
+}
+
+size_t Bm25Index::get_memory_usage_bytes() const
+{
+    size_t memory_usage_bytes = 0;
+    for(const auto& segment : segments_)
+    {
+        memory_usage_bytes += segment->doc_lengths.size() * sizeof(uint32_t);
+        for(const auto& [term, postings] : segment->postings)
+            memory_usage_bytes += term.size() + sizeof(PostingList) + postings.bytes.size();
+    }
+
+    return memory_usage_bytes;
+}
+
+void Bm25Index::save(const std::filesystem::path& path) const
+{
+    const auto merged_segment = segments_.size() == 1 ? nullptr : std::make_unique<Segment>(merged_segments_());
+    const auto& segment = merged_segment ? *merged_segment : *segments_.front();
+
+    std::ofstream output(path, std::ios::out | std::ios::binary);
+    const uint64_t header[] = {BM25_INDEX_MAGIC, segment.doc_lengths.size(), segment.postings.size()};
+    output.write(reinterpret_cast<const char*>(header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(segment.doc_lengths.data()),
+                 static_cast<std::streamsize>(segment.doc_lengths.size() * sizeof(uint32_t)));
+
+    for(const auto& [term, postings] : segment.postings)
+    {
+        const uint64_t sizes[] = {term.size(), postings.bytes.size()};
+        const uint32_t statistics[] = {postings.n_docs, postings.last_doc, postings.max_tf, postings.min_doc_length};
+        output.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        output.write(reinterpret_cast<const char*>(statistics), sizeof(statistics));
+        output.write(term.data(), static_cast<std::streamsize>(term.size()));
+        output.write(reinterpret_cast<const char*>(postings.bytes.data()),
+                     static_cast<std::streamsize>(postings.bytes.size()));
+    }
+
+    if(!output)
+        throw std::runtime_error(fmt::format("Could not write the lexical index file: {}", path.c_str()));
+}
+
+void Bm25Index::load(const std::filesystem::path& path)
+{
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    uint64_t header[3] = {};
+    input.read(reinterpret_cast<char*>(header), sizeof(header));
+    if(!input || header[0] != BM25_INDEX_MAGIC)
+        throw std::runtime_error(fmt::format("File: {} is not a lexical index", path.c_str()));
+
+    // The sizes are checked against the file and the postings against the documents, so a corrupted file can't make
+    // the index allocate or read past them.
+    const auto corrupted = [&path]()
+    { return std::runtime_error(fmt::format("Lexical index file: {} is corrupted", path.c_str())); };
+    uint64_t remaining_size = std::filesystem::file_size(path) - sizeof(header);
+    if(header[1] >= END_OF_POSTINGS || header[1] > remaining_size / sizeof(uint32_t))
+        throw corrupted();
+    remaining_size -= header[1] * sizeof(uint32_t);
+
+    std::vector<uint32_t> doc_lengths(header[1]);
+    input.read(reinterpret_cast<char*>(doc_lengths.data()),
+               static_cast<std::streamsize>(doc_lengths.size() * sizeof(uint32_t)));
+
+    std::unordered_map<std::string, PostingList> postings;
+    constexpr uint64_t POSTINGS_HEADER_SIZE = 2 * sizeof(uint64_t) + 4 * sizeof(uint32_t);
+    postings.reserve(std::min(header[2], remaining_size / POSTINGS_HEADER_SIZE));
+    for(uint64_t i = 0; i < header[2] && input; i++)
+    {
+        uint64_t sizes[2] = {};
+        uint32_t statistics[4] = {};
+        input.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+        input.read(reinterpret_cast<char*>(statistics), sizeof(statistics));
+        if(!input)
+            break;
+
+        remaining_size -= POSTINGS_HEADER_SIZE;
+        if(sizes[0] > remaining_size || sizes[1] > remaining_size - sizes[0])
+            throw corrupted();
+        remaining_size -= sizes[0] + sizes[1];
+
+        std::string term(sizes[0], '\0');
+        PostingList term_postings{.bytes = std::vector<uint8_t>(sizes[1]),
+                                  .n_docs = statistics[0],
+                                  .last_doc = statistics[1],
+                                  .max_tf = statistics[2],
+                                  .min_doc_length = statistics[3]};
+        input.read(term.data(), static_cast<std::streamsize>(term.size()));
+        input.read(reinterpret_cast<char*>(term_postings.bytes.data()),
+                   static_cast<std::streamsize>(term_postings.bytes.size()));
+        if(input && !term_postings.is_valid(doc_lengths))
+            throw corrupted();
+        postings.emplace(std::move(term), std::move(term_postings));
+    }
+
+    if(!input)
+        throw std::runtime_error(fmt::format("Lexical index file: {} is truncated", path.c_str()));
+
+    Segment segment{.postings = std::move(postings), .doc_lengths = std::move(doc_lengths)};
+    segment.total_doc_length = std::accumulate(segment.doc_lengths.begin(), segment.doc_lengths.end(), uint64_t{0});
+    reset_(std::move(segment));
+}
+} // namespace ds
@@ -0,0 +1,261 @@
+#include "rag/chunk_database.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace ds
+{
+constexpr uint32_t CHUNK_DATABASE_MAGIC = 0x48435344; // "DSCH"
+constexpr size_t EMBEDDINGS_ALIGNMENT = 64;
+constexpr size_t SAVE_BLOCK_SIZE = 1024;
+
+// Offsets are in bytes from the beginning of the file.
+struct ChunkDatabaseHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t n_chunks;
+    uint64_t n_sources;
+    uint64_t embedding_rank;
+    uint64_t content_offsets;
+    uint64_t contents;
+    uint64_t source_offsets;
+    uint64_t sources;
+    uint64_t source_ids;
+    uint64_t chunk_ids;
+    uint64_t embeddings;
+    uint64_t file_size;
+};
+static_assert(std::is_trivially_copyable_v<ChunkDatabaseHeader>);
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Writes the sections in the file order, padding the gaps between them.
+class SectionWriter
+{
+  public:
+    explicit SectionWriter(const std::filesystem::path& path) : output_(path, std::ios::out | std::ios::binary) {}
+
+    void write_at(uint64_t offset, const void* data, size_t size)
+    {
+        static constexpr char PADDING[EMBEDDINGS_ALIGNMENT] = {};
+        while(position_ < offset)
+        {
+            const auto padding = std::min<uint64_t>(offset - position_, sizeof(PADDING));
+            output_.write(PADDING, static_cast<std::streamsize>(padding));
+            position_ += padding;
+        }
+
+        output_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        position_ += size;
+    }
+
+    void append(const void* data, size_t size) { write_at(position_, data, size); }
+
+    // Returns whether all the writes succeeded.
+    bool close()
+    {
+        output_.close();
+        return !output_.fail();
+    }
+
+  private:
+    std::ofstream output_;
+    uint64_t position_ = 0;
+};
+
+void save_chunk_database(const std::filesystem::path& path, std::span<const DocumentChunkView> chunks,
+                         const IVectorStore* vector_store)
+{
+    if(vector_store && vector_store->size() != chunks.size())
+    {
+        throw std::logic_error(fmt::format("Cannot save {} chunks with {} vectors.", chunks.size(),
+                                           vector_store->size()));
+    }
+
+    std::unordered_map<std::string_view, uint32_t> source_ids;
+    std::vector<std::string_view> sources;
+    std::vector<uint64_t> content_offsets{0};
+    std::vector<uint32_t> chunk_source_ids;
+    std::vector<uint64_t> chunk_ids;
+    content_offsets.reserve(chunks.size() + 1);
+    chunk_source_ids.reserve(chunks.size());
+    chunk_ids.reserve(chunks.size());
+    for(const auto& chunk : chunks)
+    {
+        const auto [source_id, inserted] = source_ids.try_emplace(chunk.source, static_cast<uint32_t>(sources.size()));
+        if(inserted)
+            sources.push_back(chunk.source);
+
+        content_offsets.push_back(content_offsets.back() + chunk.content.size());
+        chunk_source_ids.push_back(source_id->second);
+        chunk_ids.push_back(chunk.chunk_id);
+    }
+
+    std::vector<uint64_t> source_offsets{0};
+    source_offsets.reserve(sources.size() + 1);
+    std::ranges::for_each(sources, [&source_offsets](std::string_view source)
+                          { source_offsets.push_back(source_offsets.back() + source.size()); });
+
+    // The store doesn't expose its rank, it's taken from a reconstructed vector.
+    const bool with_embeddings = vector_store && !chunks.empty();
+    ChunkDatabaseHeader header{.magic = CHUNK_DATABASE_MAGIC,
+                               .version = CHUNK_DATABASE_VERSION,
+                               .n_chunks = chunks.size(),
+                               .n_sources = sources.size(),
+                               .embedding_rank = with_embeddings ? vector_store->reconstruct(0, 1).rank() : 0};
+    header.content_offsets = align_up(sizeof(ChunkDatabaseHeader), sizeof(uint64_t));
+    header.contents = header.content_offsets + content_offsets.size() * sizeof(uint64_t);
+    header.source_offsets = align_up(header.contents + content_offsets.back(), sizeof(uint64_t));
+    header.sources = header.source_offsets + source_offsets.size() * sizeof(uint64_t);
+    header.source_ids = align_up(header.sources + source_offsets.back(), sizeof(uint64_t));
+    header.chunk_ids = align_up(header.source_ids + chunk_source_ids.size() * sizeof(uint32_t), sizeof(uint64_t));
+    header.embeddings = align_up(header.chunk_ids + chunk_ids.size() * sizeof(uint64_t), EMBEDDINGS_ALIGNMENT);
+    header.file_size = header.embeddings + header.n_chunks * header.embedding_rank * sizeof(float);
+
+    auto temporary_path = path;
+    temporary_path += ".tmp";
+    SectionWriter writer(temporary_path);
+    writer.write_at(0, &header, sizeof(header));
+    writer.write_at(header.content_offsets, content_offsets.data(), content_offsets.size() * sizeof(uint64_t));
+    std::ranges::for_each(chunks, [&writer](const DocumentChunkView& chunk)
+                          { writer.append(chunk.content.data(), chunk.content.size()); });
+    writer.write_at(header.source_offsets, source_offsets.data(), source_offsets.size() * sizeof(uint64_t));
+    std::ranges::for_each(sources, [&writer](std::string_view source) { writer.append(source.data(), source.size()); });
+    writer.write_at(header.source_ids, chunk_source_ids.data(), chunk_source_ids.size() * sizeof(uint32_t));
+    writer.write_at(header.chunk_ids, chunk_ids.data(), chunk_ids.size() * sizeof(uint64_t));
+
+    for(size_t block_begin = 0; with_embeddings && block_begin < chunks.size(); block_begin += SAVE_BLOCK_SIZE)
+    {
+        const size_t block_size = std::min(SAVE_BLOCK_SIZE, chunks.size() - block_begin);
+        const auto embeddings = vector_store->reconstruct(block_begin, block_size);
+        writer.write_at(header.embeddings + block_begin * header.embedding_rank * sizeof(float), embeddings.data(),
+                        block_size * header.embedding_rank * sizeof(float));
+    }
+    // The file ends with the sections, even with no embeddings written.
+    writer.write_at(header.file_size, nullptr, 0);
+
+    if(!writer.close())
+    {
+        std::filesystem::remove(temporary_path);
+        throw std::runtime_error(fmt::format("Could not write the chunk database file: {}", path.c_str()));
+    }
+    std::filesystem::rename(temporary_path, path);
+}
+
+MappedChunkDatabase::MappedChunkDatabase(const std::filesystem::path& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error(fmt::format("Could not open the chunk database file: {}", path.c_str()));
+
+    struct stat file_stat = {};
+    void* data = MAP_FAILED;
+    if(::fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= sizeof(ChunkDatabaseHeader))
+    {
+        file_size_ = static_cast<size_t>(file_stat.st_size);
+        data = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    if(data == MAP_FAILED)
+        throw std::runtime_error(fmt::format("Could not map the chunk database file: {}", path.c_str()));
+    data_ = static_cast<const uint8_t*>(data);
+
+    const auto invalid_file = [this, &path](std::string_view reason)
+    {
+        ::munmap(const_cast<uint8_t*>(data_), file_size_);
+        return std::runtime_error(fmt::format("Invalid chunk database file: {}, {}", path.c_str(), reason));
+    };
+
+    const auto* header = reinterpret_cast<const ChunkDatabaseHeader*>(data_);
+    if(header->magic != CHUNK_DATABASE_MAGIC)
+        throw invalid_file("not a chunk database");
+    if(header->version != CHUNK_DATABASE_VERSION)
+        throw invalid_file(fmt::format("unsupported version {}", header->version));
+    if(header->file_size != file_size_)
+        throw invalid_file("truncated");
+
+    // The counts are bounded by the file size first, so the section sizes computed from them don't overflow.
+    uint64_t n_embedding_values = 0;
+    if(header->n_chunks >= file_size_ || header->n_sources >= file_size_ ||
+       __builtin_mul_overflow(header->n_chunks, header->embedding_rank, &n_embedding_values))
+        throw invalid_file("counts out of bounds");
+
+    const auto section_fits = [this](uint64_t offset, uint64_t n_items, uint64_t item_size)
+    { return offset <= file_size_ && n_items <= (file_size_ - offset) / item_size; };
+    if(!section_fits(header->content_offsets, header->n_chunks + 1, sizeof(uint64_t)) ||
+       !section_fits(header->source_offsets, header->n_sources + 1, sizeof(uint64_t)) ||
+       !section_fits(header->source_ids, header->n_chunks, sizeof(uint32_t)) ||
+       !section_fits(header->chunk_ids, header->n_chunks, sizeof(uint64_t)) ||
+       header->embeddings % EMBEDDINGS_ALIGNMENT != 0 ||
+       !section_fits(header->embeddings, n_embedding_values, sizeof(float)))
+        throw invalid_file("sections out of bounds");
+
+    n_chunks_ = header->n_chunks;
+    embedding_rank_ = header->embedding_rank;
+    content_offsets_ = reinterpret_cast<const uint64_t*>(data_ + header->content_offsets);
+    contents_ = reinterpret_cast<const char*>(data_ + header->contents);
+    source_offsets_ = reinterpret_cast<const uint64_t*>(data_ + header->source_offsets);
+    sources_ = reinterpret_cast<const char*>(data_ + header->sources);
+    source_ids_ = reinterpret_cast<const uint32_t*>(data_ + header->source_ids);
+    chunk_ids_ = reinterpret_cast<const uint64_t*>(data_ + header->chunk_ids);
+    embeddings_ = reinterpret_cast<const float*>(data_ + header->embeddings);
+
+    // The views are not checked on access, so the offsets must not point past the blobs.
+    const auto offsets_valid = [this](const uint64_t* offsets, size_t n_items, uint64_t blob, uint64_t blob_end)
+    {
+        return offsets[0] == 0 && std::is_sorted(offsets, offsets + n_items + 1) && blob <= blob_end &&
+               offsets[n_items] <= blob_end - blob;
+    };
+    if(!offsets_valid(content_offsets_, header->n_chunks, header->contents, header->source_offsets) ||
+       !offsets_valid(source_offsets_, header->n_sources, header->sources, header->source_ids) ||
+       std::any_of(source_ids_, source_ids_ + n_chunks_,
+                   [header](uint32_t source_id) { return source_id >= header->n_sources; }))
+        throw invalid_file("offsets out of bounds");
+}
+
+MappedChunkDatabase::~MappedChunkDatabase()
+{
+    ::munmap(const_cast<uint8_t*>(data_), file_size_);
+}
+
+void MappedChunkDatabase::release_resident_pages() const
+{
+    ::madvise(const_cast<uint8_t*>(data_), file_size_, MADV_DONTNEED);
+    // The retrieved chunks are spread over the file, reading ahead of them would only fill the memory.
+    ::madvise(const_cast<uint8_t*>(data_), file_size_, MADV_RANDOM);
+}
+
+std::string_view MappedChunkDatabase::content(size_t idx) const
+{
+    return std::string_view(contents_ + content_offsets_[idx], content_offsets_[idx + 1] - content_offsets_[idx]);
+}
+
+std::string_view MappedChunkDatabase::source(size_t idx) const
+{
+    const auto source_id = source_ids_[idx];
+    return std::string_view(sources_ + source_offsets_[source_id],
+                            source_offsets_[source_id + 1] - source_offsets_[source_id]);
+}
+
+bool MappedChunkDatabase::is_chunk_database(const std::filesystem::path& path)
+{
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    uint32_t magic = 0;
+    input.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    return input && magic == CHUNK_DATABASE_MAGIC;
+}
+} // namespace ds
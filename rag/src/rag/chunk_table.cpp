@@ -0,0 +1,212 @@
+#include "rag/chunk_table.h"
+
+#include <algorithm>
+
+namespace ds
+{
+// The trailing segment is merged into the previous one unless that one is more than this many times larger.
+constexpr size_t SEGMENT_MERGE_FACTOR = 2;
+
+std::string_view ChunkTable::Segment::content(size_t idx) const
+{
+    if(is_mapped())
+        return database->content(database_idx(idx));
+
+    const size_t begin = idx == 0 ? 0 : content_ends[idx - 1];
+    return std::string_view(contents).substr(begin, content_ends[idx] - begin);
+}
+
+std::string_view ChunkTable::Segment::source(size_t idx) const
+{
+    return is_mapped() ? database->source(database_idx(idx)) : sources[source_ids[idx]];
+}
+
+uint64_t ChunkTable::Segment::chunk_id(size_t idx) const
+{
+    return is_mapped() ? database->chunk_id(database_idx(idx)) : chunk_ids[idx];
+}
+
+uint32_t ChunkTable::Segment::index_source(std::string_view chunk_source, size_t idx)
+{
+    const auto [source_id, inserted] =
+        source_ids_by_name.try_emplace(std::string(chunk_source), static_cast<uint32_t>(sources.size()));
+    if(inserted)
+    {
+        sources.emplace_back(chunk_source);
+        source_chunks.emplace_back();
+    }
+    source_chunks[source_id->second].push_back(static_cast<uint32_t>(idx));
+
+    return source_id->second;
+}
+
+void ChunkTable::Segment::add(std::string_view chunk_content, std::string_view chunk_source, uint64_t id)
+{
+    contents.append(chunk_content);
+    content_ends.push_back(contents.size());
+    source_ids.push_back(index_source(chunk_source, n_chunks));
+    chunk_ids.push_back(id);
+    n_chunks++;
+}
+
+void ChunkTable::Segment::append(const Segment& other, const IndexBitmap* keep, size_t keep_offset)
+{
+    for(size_t i = 0; i < other.n_chunks; i++)
+    {
+        if(!keep || keep->test(keep_offset + i))
+            add(other.content(i), other.source(i), other.chunk_id(i));
+    }
+}
+
+void ChunkTable::add(std::string_view content, std::string_view source, uint64_t chunk_id)
+{
+    writable_segment_().add(content, source, chunk_id);
+    n_chunks_++;
+    segment_ends_.back() = n_chunks_;
+}
+
+void ChunkTable::add_mapped(std::shared_ptr<const MappedChunkDatabase> database, size_t begin, size_t end)
+{
+    if(begin == end)
+        return;
+
+    // The blocks of a database added one by one extend its range.
+    if(!segments_.empty() && segments_.back().use_count() == 1)
+    {
+        auto& last_segment = *segments_.back();
+        if(last_segment.database == database && last_segment.database_idxs.empty() &&
+           last_segment.database_begin + last_segment.n_chunks == begin)
+        {
+            for(size_t i = begin; i < end; i++)
+                last_segment.index_source(database->source(i), last_segment.n_chunks++);
+            n_chunks_ += end - begin;
+            segment_ends_.back() = n_chunks_;
+            return;
+        }
+    }
+
+    auto segment = std::make_shared<Segment>();
+    segment->database = std::move(database);
+    segment->database_begin = begin;
+    for(size_t i = begin; i < end; i++)
+        segment->index_source(segment->database->source(i), segment->n_chunks++);
+    push_segment_(std::move(segment));
+}
+
+void ChunkTable::append(const ChunkTable& other)
+{
+    for(const auto& segment : other.segments_)
+        push_segment_(segment);
+    merge_trailing_segments_();
+}
+
+ChunkTable ChunkTable::compacted(const IndexBitmap& keep) const
+{
+    ChunkTable compacted_table;
+    size_t offset = 0;
+    for(const auto& segment : segments_)
+    {
+        if(!segment->is_mapped())
+        {
+            auto& kept_segment = compacted_table.writable_segment_();
+            const size_t n_kept_before = kept_segment.n_chunks;
+            kept_segment.append(*segment, &keep, offset);
+            compacted_table.n_chunks_ += kept_segment.n_chunks - n_kept_before;
+            compacted_table.segment_ends_.back() = compacted_table.n_chunks_;
+        }
+        else
+        {
+            auto kept_segment = std::make_shared<Segment>();
+            kept_segment->database = segment->database;
+            for(size_t i = 0; i < segment->n_chunks; i++)
+            {
+                if(!keep.test(offset + i))
+                    continue;
+
+                kept_segment->database_idxs.push_back(segment->database_idx(i));
+                kept_segment->index_source(segment->source(i), kept_segment->n_chunks++);
+            }
+            if(kept_segment->n_chunks == segment->n_chunks)
+                compacted_table.push_segment_(segment);
+            else if(kept_segment->n_chunks != 0)
+                compacted_table.push_segment_(std::move(kept_segment));
+        }
+        offset += segment->n_chunks;
+    }
+
+    return compacted_table;
+}
+
+std::string_view ChunkTable::content(size_t idx) const
+{
+    const auto [segment, segment_idx] = locate_(idx);
+    return segment->content(segment_idx);
+}
+
+std::string_view ChunkTable::source(size_t idx) const
+{
+    const auto [segment, segment_idx] = locate_(idx);
+    return segment->source(segment_idx);
+}
+
+uint64_t ChunkTable::chunk_id(size_t idx) const
+{
+    const auto [segment, segment_idx] = locate_(idx);
+    return segment->chunk_id(segment_idx);
+}
+
+DocumentChunkView ChunkTable::view(size_t idx) const
+{
+    const auto [segment, segment_idx] = locate_(idx);
+    return DocumentChunkView{segment->content(segment_idx), segment->source(segment_idx),
+                             segment->chunk_id(segment_idx)};
+}
+
+std::pair<const ChunkTable::Segment*, size_t> ChunkTable::locate_(size_t idx) const
+{
+    const auto segment_end = std::ranges::upper_bound(segment_ends_, idx);
+    const auto segment_idx = static_cast<size_t>(segment_end - segment_ends_.begin());
+    const size_t segment_begin = segment_idx == 0 ? 0 : segment_ends_[segment_idx - 1];
+    return {segments_[segment_idx].get(), idx - segment_begin};
+}
+
+ChunkTable::Segment& ChunkTable::writable_segment_()
+{
+    if(!segments_.empty() && segments_.back().use_count() == 1 && !segments_.back()->is_mapped())
+        return *segments_.back();
+
+    // The last segment is mapped or shared with another copy of the table, a new one is started.
+    merge_trailing_segments_();
+    if(segments_.empty() || segments_.back().use_count() != 1 || segments_.back()->is_mapped())
+        push_segment_(std::make_shared<Segment>());
+
+    return *segments_.back();
+}
+
+// The trailing in-memory segments of similar sizes are merged into a copy, so there are only logarithmically many
+// of them. The mapped segments are never copied.
+void ChunkTable::merge_trailing_segments_()
+{
+    while(segments_.size() >= 2)
+    {
+        const auto& previous_segment = *segments_[segments_.size() - 2];
+        const auto& last_segment = *segments_.back();
+        if(previous_segment.is_mapped() || last_segment.is_mapped() ||
+           previous_segment.n_chunks > SEGMENT_MERGE_FACTOR * last_segment.n_chunks)
+            return;
+
+        auto merged_segment = std::make_shared<Segment>(previous_segment);
+        merged_segment->append(last_segment);
+        segments_.pop_back();
+        segments_.back() = std::move(merged_segment);
+        segment_ends_.erase(segment_ends_.end() - 2);
+    }
+}
+
+void ChunkTable::push_segment_(std::shared_ptr<Segment> segment)
+{
+    n_chunks_ += segment->n_chunks;
+    segments_.push_back(std::move(segment));
+    segment_ends_.push_back(n_chunks_);
+}
+} // namespace ds
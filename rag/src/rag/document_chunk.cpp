@@ -0,0 +1,193 @@
+#include "document_chunk_json.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace ds
+{
+void from_json(const nlohmann::json& j, DocumentChunkMetadata& d)
+{
+    j.at("source").get_to(d.source);
+    j.at("chunk_id").get_to(d.chunk_id);
+}
+
+void to_json(nlohmann::json& j, const DocumentChunkMetadata& d)
+{
+    j = nlohmann::json{{"source", d.source}, {"chunk_id", d.chunk_id}};
+}
+
+void from_json(const nlohmann::json& j, DocumentChunk& d)
+{
+    j.at("content").get_to(d.content);
+    j.at("metadata").get_to(d.metadata);
+
+    if(j.count("embedding") && j.at("embedding") != nullptr)
+    {
+        d.embedding = std::vector<float>();
+        j.at("embedding").get_to(*d.embedding);
+    }
+}
+
+void to_json(nlohmann::json& j, const DocumentChunk& d)
+{
+    j = nlohmann::json{{"content", d.content}, {"metadata", d.metadata}};
+    if(d.embedding)
+        j["embedding"] = *d.embedding;
+    else
+        j["embedding"] = nullptr;
+}
+
+// Builds a json value of a single element of the "chunks" array at a time, the events outside of the array are only
+// tracked for the nesting depth.
+class DocumentChunkSaxHandler : public nlohmann::json_sax<nlohmann::json>
+{
+  public:
+    DocumentChunkSaxHandler(size_t batch_size, const std::function<void(std::vector<DocumentChunk>&&)>& consume_batch)
+        : batch_size_(std::max<size_t>(batch_size, 1)), consume_batch_(consume_batch)
+    {
+        batch_.reserve(batch_size_);
+    }
+
+    bool null() override { return add_value_(nullptr); }
+    bool boolean(bool val) override { return add_value_(val); }
+    bool number_integer(number_integer_t val) override { return add_value_(val); }
+    bool number_unsigned(number_unsigned_t val) override { return add_value_(val); }
+    bool number_float(number_float_t val, const string_t&) override { return add_value_(val); }
+    bool string(string_t& val) override { return add_value_(std::move(val)); }
+    bool binary(binary_t& val) override { return add_value_(std::move(val)); }
+
+    bool start_object(size_t) override
+    {
+        if(in_chunks_ && chunk_stack_.empty())
+        {
+            chunk_ = nlohmann::json::object();
+            chunk_stack_.push_back(&chunk_);
+        }
+        else if(!chunk_stack_.empty())
+        {
+            chunk_stack_.push_back(add_to_chunk_(nlohmann::json::object()));
+        }
+
+        depth_++;
+        return true;
+    }
+
+    bool key(string_t& val) override
+    {
+        if(chunk_stack_.empty() && depth_ == 1)
+            top_level_key_ = val;
+        else
+            key_ = std::move(val);
+
+        return true;
+    }
+
+    bool end_object() override { return end_container_(); }
+
+    bool start_array(size_t) override
+    {
+        if(chunk_stack_.empty() && depth_ == 1 && top_level_key_ == "chunks")
+        {
+            in_chunks_ = true;
+            found_chunks_ = true;
+        }
+        else if(!chunk_stack_.empty())
+        {
+            chunk_stack_.push_back(add_to_chunk_(nlohmann::json::array()));
+        }
+
+        depth_++;
+        return true;
+    }
+
+    bool end_array() override
+    {
+        if(chunk_stack_.empty() && in_chunks_ && depth_ == 2)
+            in_chunks_ = false;
+
+        return end_container_();
+    }
+
+    bool parse_error(size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        throw std::runtime_error(fmt::format("Could not parse the document chunks: {}", ex.what()));
+    }
+
+    void finish()
+    {
+        if(!found_chunks_)
+            throw std::runtime_error("Could not find the document chunks, the \"chunks\" array is missing.");
+
+        flush_();
+    }
+
+  private:
+    size_t batch_size_;
+    const std::function<void(std::vector<DocumentChunk>&&)>& consume_batch_;
+    std::vector<DocumentChunk> batch_;
+
+    size_t depth_ = 0;
+    std::string top_level_key_;
+    bool in_chunks_ = false;
+    bool found_chunks_ = false;
+    // The chunk under construction and its open containers, the last one receives the values.
+    nlohmann::json chunk_;
+    std::vector<nlohmann::json*> chunk_stack_;
+    std::string key_;
+
+    template <typename T> bool add_value_(T&& val)
+    {
+        if(!chunk_stack_.empty())
+            add_to_chunk_(nlohmann::json(std::forward<T>(val)));
+
+        return true;
+    }
+
+    nlohmann::json* add_to_chunk_(nlohmann::json&& val)
+    {
+        auto& parent = *chunk_stack_.back();
+        if(parent.is_object())
+            return &(parent[key_] = std::move(val));
+
+        parent.push_back(std::move(val));
+        return &parent.back();
+    }
+
+    bool end_container_()
+    {
+        depth_--;
+        if(chunk_stack_.empty())
+            return true;
+
+        chunk_stack_.pop_back();
+        if(chunk_stack_.empty())
+        {
+            batch_.push_back(chunk_.get<DocumentChunk>());
+            chunk_ = nullptr;
+            if(batch_.size() == batch_size_)
+                flush_();
+        }
+
+        return true;
+    }
+
+    void flush_()
+    {
+        if(batch_.empty())
+            return;
+
+        consume_batch_(std::move(batch_));
+        batch_.clear();
+        batch_.reserve(batch_size_);
+    }
+};
+
+void read_document_chunks(std::istream& input, size_t batch_size,
+                          const std::function<void(std::vector<DocumentChunk>&&)>& consume_batch)
+{
+    DocumentChunkSaxHandler handler(batch_size, consume_batch);
+    nlohmann::json::sax_parse(input, &handler);
+    handler.finish();
+}
+} // namespace ds
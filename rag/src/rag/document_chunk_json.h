@@ -0,0 +1,12 @@
+#pragma once
+#include "rag/document_chunk.h"
+
+#include <nlohmann/json.hpp>
+
+namespace ds
+{
+void from_json(const nlohmann::json& j, DocumentChunkMetadata& d);
+void to_json(nlohmann::json& j, const DocumentChunkMetadata& d);
+void from_json(const nlohmann::json& j, DocumentChunk& d);
+void to_json(nlohmann::json& j, const DocumentChunk& d);
+} // namespace ds
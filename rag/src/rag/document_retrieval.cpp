@@ -1,168 +1,914 @@
 #include "rag/document_retrieval.h"
+#include "document_chunk_json.h"
+#include "ingestion_pipeline.h"
 #include "llm/utils.h"
+#include "query_cache.h"
+#include "rag/chunk_database.h"
+#include "segmented_vector_store.h"
 
 #include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+#include <fstream>
 #include <functional>
 #include <nlohmann/json.hpp>
+#include <numeric>
 #include <ranges>
+#include <span>
 #include <spdlog/spdlog.h>
+#include <unordered_set>
 
 namespace ds
 {
+const std::filesystem::path SNAPSHOT_CHUNKS_FILE = "chunks.bin";
+const std::filesystem::path SNAPSHOT_VECTORS_FILE = "vectors.index";
+const std::filesystem::path SNAPSHOT_LEXICAL_FILE = "lexical.index";
+// The chunks are dumped and loaded in blocks of this size.
+constexpr size_t DUMP_BLOCK_SIZE = 1024;
+
 std::unique_ptr<IDocumentChunkRetriever> create_document_chunk_retriever(const DocumentChunkRetrieverParams& params)
 {
     auto embedding_calculator = embedding_calculator_factory(params.embedding_calculator_params);
-    auto vector_store = vector_store_factory(embedding_calculator->get_embedding_rank());
+    auto vector_store =
+        vector_store_factory(embedding_calculator->get_embedding_rank(), params.vector_store_params);
 
-    return std::make_unique<SimpleDocumentChunkRetriever>(std::move(embedding_calculator), std::move(vector_store));
+    return std::make_unique<SimpleDocumentChunkRetriever>(std::move(embedding_calculator), std::move(vector_store),
+                                                          params.compaction_threshold, params.n_ingestion_threads,
+                                                          params.query_cache_bytes);
 };
 
 SimpleDocumentChunkRetriever::SimpleDocumentChunkRetriever(std::unique_ptr<IEmbeddingCalculator>&& embedding_calculator,
-                                                           std::unique_ptr<IVectorStore>&& vector_store)
-    : embedding_calculator_(std::move(embedding_calculator)), vector_store_(std::move(vector_store))
+                                                           std::unique_ptr<IVectorStore>&& vector_store,
+                                                           float compaction_threshold, size_t n_ingestion_threads,
+                                                           size_t query_cache_bytes)
+    : embedding_calculator_(std::move(embedding_calculator)),
+      state_(std::make_shared<const State>(
+          State{.vector_store = std::make_shared<const SegmentedVectorStore>(std::move(vector_store))})),
+      compaction_threshold_(compaction_threshold), n_ingestion_threads_(n_ingestion_threads),
+      query_cache_(query_cache_bytes > 0 ? std::make_unique<QueryCache>(query_cache_bytes) : nullptr)
+{
+}
+
+SimpleDocumentChunkRetriever::~SimpleDocumentChunkRetriever()
+{
+    if(background_compaction_.valid())
+        background_compaction_.wait();
+}
+
+QueryCacheStats SimpleDocumentChunkRetriever::query_cache_stats() const
+{
+    return query_cache_ ? query_cache_->stats() : QueryCacheStats{};
+}
+
+std::shared_ptr<const SimpleDocumentChunkRetriever::State> SimpleDocumentChunkRetriever::load_state_() const
+{
+    return std::atomic_load(&state_);
+}
+
+// Called by the writers only, so the epochs of the published states are consecutive.
+void SimpleDocumentChunkRetriever::publish_state_(std::shared_ptr<State> state)
+{
+    state->epoch = load_state_()->epoch + 1;
+    std::atomic_store(&state_, std::shared_ptr<const State>(std::move(state)));
+}
+
+Embedding SimpleDocumentChunkRetriever::embed_query_(const std::string& question) const
 {
+    if(query_cache_)
+    {
+        if(auto embedding = query_cache_->find_embedding(question))
+            return std::move(*embedding);
+    }
+
+    const auto embedding_calculator_fn = [this, &question]() { return embedding_calculator_->calc(question); };
+    auto embedding = with_time_report("Query embedding", embedding_calculator_fn).embedding;
+    if(query_cache_)
+        query_cache_->put_embedding(question, embedding);
+
+    return embedding;
 }
 
 std::vector<RetrievedDocumentChunk> SimpleDocumentChunkRetriever::retrieve(const std::string& question,
                                                                            const size_t top_k) const
 {
-    const auto embedding_calculator_fn = [this, &question]() { return embedding_calculator_->calc(question); };
-    const auto embedding_result = with_time_report("Query embedding", embedding_calculator_fn);
+    const auto query_embedding = embed_query_(question);
 
-    const auto retrieve_indices_fn = [this, &embedding_result, &top_k]()
-    { return vector_store_->retrieve(embedding_result.embedding, top_k); };
+    const auto state = load_state_();
+    std::optional<QueryCache::ResultKey> result_key;
+    if(query_cache_)
+    {
+        result_key = QueryCache::ResultKey{QueryCache::hash_query(query_embedding), top_k, state->epoch};
+        if(auto results = query_cache_->find_results(*result_key))
+            return std::move(*results);
+    }
+
+    const auto retrieve_indices_fn = [this, &state, &query_embedding, &top_k]()
+    { return retrieve_live_(*state, query_embedding, top_k); };
 
     const auto retrieved_indices = with_time_report("Querying vector DB", retrieve_indices_fn);
 
+    auto results = to_document_chunks_(*state, retrieved_indices);
+    if(result_key)
+        query_cache_->put_results(*result_key, results);
+
+    return results;
+}
+
+std::vector<RetrievedIndex> SimpleDocumentChunkRetriever::retrieve_live_(const State& state,
+                                                                         const Embedding& query_embedding,
+                                                                         size_t top_k) const
+{
+    if(state.n_removed_chunks > 0)
+        return state.vector_store->retrieve_filtered(query_embedding, top_k, *state.live_chunks.flat());
+
+    return state.vector_store->retrieve(query_embedding, top_k);
+}
+
+// Greedy MMR: every step takes the candidate with the best trade-off between its query similarity and the highest
+// similarity to the already selected ones. The stored vectors are normalized, so their dot product is the cosine.
+static std::vector<RetrievedIndex> select_mmr(const IVectorStore& vector_store,
+                                              const std::vector<RetrievedIndex>& candidates, size_t top_k,
+                                              const MmrSettings& settings)
+{
+    std::vector<EmbeddingMatrix> candidate_embeddings;
+    candidate_embeddings.reserve(candidates.size());
+    std::ranges::transform(candidates, std::back_inserter(candidate_embeddings),
+                           [&vector_store](const RetrievedIndex& candidate)
+                           { return vector_store.reconstruct(candidate.index, 1); });
+
+    std::vector<float> max_selected_similarity(candidates.size(), 0.f);
+    std::vector<bool> available(candidates.size(), true);
+    std::vector<RetrievedIndex> selected;
+    while(selected.size() < top_k)
+    {
+        std::optional<size_t> best_candidate;
+        float best_mmr_score = 0.f;
+        for(size_t i = 0; i < candidates.size(); i++)
+        {
+            if(!available[i])
+                continue;
+
+            const float mmr_score = settings.lambda * candidates[i].cosine_similarity -
+                                    (1.f - settings.lambda) * max_selected_similarity[i];
+            if(!best_candidate || mmr_score > best_mmr_score)
+            {
+                best_candidate = i;
+                best_mmr_score = mmr_score;
+            }
+        }
+
+        if(!best_candidate)
+            break;
+
+        available[*best_candidate] = false;
+        selected.push_back(candidates[*best_candidate]);
+
+        const auto selected_embedding = candidate_embeddings[*best_candidate].row(0);
+        for(size_t i = 0; i < candidates.size(); i++)
+        {
+            if(!available[i])
+                continue;
+
+            const auto candidate_embedding = candidate_embeddings[i].row(0);
+            const float similarity = std::inner_product(candidate_embedding.begin(), candidate_embedding.end(),
+                                                        selected_embedding.begin(), 0.f);
+            max_selected_similarity[i] = std::max(max_selected_similarity[i], similarity);
+            if(similarity >= settings.duplicate_threshold)
+                available[i] = false;
+        }
+    }
+
+    return selected;
+}
+
+std::vector<RetrievedDocumentChunk> SimpleDocumentChunkRetriever::retrieve_diverse(const std::string& question,
+                                                                                   const size_t top_k,
+                                                                                   const MmrSettings& settings) const
+{
+    const auto query_embedding = embed_query_(question);
+
+    const auto state = load_state_();
+    const size_t n_candidates = top_k * std::max<size_t>(settings.fetch_factor, 1);
+    const auto retrieve_candidates_fn = [this, &state, &query_embedding, &n_candidates]()
+    { return retrieve_live_(*state, query_embedding, n_candidates); };
+    const auto candidates = with_time_report("Querying vector DB for MMR candidates", retrieve_candidates_fn);
+
+    const auto select_fn = [&state, &candidates, &top_k, &settings]()
+    { return select_mmr(*state->vector_store, candidates, top_k, settings); };
+    const auto selected_indices = with_time_report("MMR selection", select_fn);
+
+    return to_document_chunks_(*state, selected_indices);
+}
+
+// Reciprocal rank fusion: a chunk scores the sum of 1 / (rrf_k + rank) over the rankings it's found in. Only the ranks
+// matter, so the cosine similarities and the BM25 scores need no calibration against each other.
+static std::vector<RetrievedIndex> fuse_ranks(const std::vector<std::vector<RetrievedIndex>>& rankings, size_t top_k,
+                                              float rrf_k)
+{
+    std::unordered_map<size_t, float> fused_scores;
+    for(const auto& ranking : rankings)
+    {
+        for(size_t rank = 0; rank < ranking.size(); rank++)
+            fused_scores[ranking[rank].index] += 1.f / (rrf_k + static_cast<float>(rank + 1));
+    }
+
+    std::vector<RetrievedIndex> fused;
+    fused.reserve(fused_scores.size());
+    std::ranges::transform(fused_scores, std::back_inserter(fused), [](const auto& fused_score)
+                           { return RetrievedIndex{fused_score.first, fused_score.second}; });
+
+    const auto better = [](const RetrievedIndex& lhs, const RetrievedIndex& rhs)
+    {
+        return lhs.cosine_similarity > rhs.cosine_similarity ||
+               (lhs.cosine_similarity == rhs.cosine_similarity && lhs.index < rhs.index);
+    };
+    const auto fused_top_k = fused.begin() + static_cast<std::ptrdiff_t>(std::min(top_k, fused.size()));
+    std::partial_sort(fused.begin(), fused_top_k, fused.end(), better);
+    fused.erase(fused_top_k, fused.end());
+
+    return fused;
+}
+
+// The stored vectors are normalized, so the cosine is their dot product with the normalized query.
+static float stored_similarity(const IVectorStore& vector_store, size_t index, const Embedding& query_embedding)
+{
+    const auto stored_embedding = vector_store.reconstruct(index, 1);
+    const auto row = stored_embedding.row(0);
+    const float dot_product = std::inner_product(row.begin(), row.end(), query_embedding.begin(), 0.f);
+    const float query_norm =
+        std::sqrt(std::inner_product(query_embedding.begin(), query_embedding.end(), query_embedding.begin(), 0.f));
+
+    return query_norm > 0.f ? dot_product / query_norm : 0.f;
+}
+
+std::vector<RetrievedDocumentChunk>
+SimpleDocumentChunkRetriever::retrieve_hybrid(const std::string& question, const size_t top_k,
+                                              const HybridSearchSettings& settings) const
+{
+    const auto query_embedding = embed_query_(question);
+
+    const auto state = load_state_();
+    const size_t n_candidates = top_k * std::max<size_t>(settings.fetch_factor, 1);
+    const auto retrieve_vector_candidates_fn = [this, &state, &query_embedding, &n_candidates]()
+    { return retrieve_live_(*state, query_embedding, n_candidates); };
+    auto vector_candidates =
+        with_time_report("Querying vector DB for hybrid candidates", retrieve_vector_candidates_fn);
+    std::unordered_map<size_t, float> similarities;
+    std::ranges::for_each(vector_candidates, [&similarities](const RetrievedIndex& candidate)
+                          { similarities.emplace(candidate.index, candidate.cosine_similarity); });
+
+    const auto retrieve_lexical_candidates_fn = [&state, &question, &n_candidates]()
+    {
+        if(state->n_removed_chunks > 0)
+            return state->lexical_index->retrieve_filtered(question, n_candidates, *state->live_chunks.flat());
+
+        return state->lexical_index->retrieve(question, n_candidates);
+    };
+    auto lexical_candidates = with_time_report("Querying lexical index", retrieve_lexical_candidates_fn);
+
+    const auto fused_indices =
+        fuse_ranks({std::move(vector_candidates), std::move(lexical_candidates)}, top_k, settings.rrf_k);
+
+    // The chunks found by the lexical index only get their cosine similarities from the stored vectors.
+    std::vector<RetrievedIndex> scored_indices;
+    scored_indices.reserve(fused_indices.size());
+    std::ranges::transform(fused_indices, std::back_inserter(scored_indices),
+                           [&state, &query_embedding, &similarities](const RetrievedIndex& fused_index)
+                           {
+                               const auto similarity = similarities.find(fused_index.index);
+                               return RetrievedIndex{fused_index.index,
+                                                     similarity != similarities.end()
+                                                         ? similarity->second
+                                                         : stored_similarity(*state->vector_store, fused_index.index,
+                                                                             query_embedding)};
+                           });
+
+    auto results = to_document_chunks_(*state, scored_indices);
+    for(size_t i = 0; i < results.size(); i++)
+        results[i].fused_score = fused_indices[i].cosine_similarity;
+
+    return results;
+}
+
+std::vector<std::vector<RetrievedDocumentChunk>>
+SimpleDocumentChunkRetriever::retrieve_batch(const std::vector<std::string>& questions, const size_t top_k) const
+{
+    // The questions missing from the query cache are embedded in a single call.
+    std::vector<Embedding> query_embeddings(questions.size());
+    std::vector<size_t> embedded_questions;
+    for(size_t i = 0; i < questions.size(); i++)
+    {
+        auto cached_embedding = query_cache_ ? query_cache_->find_embedding(questions[i]) : std::nullopt;
+        if(cached_embedding)
+            query_embeddings[i] = std::move(*cached_embedding);
+        else
+            embedded_questions.push_back(i);
+    }
+
+    if(!embedded_questions.empty())
+    {
+        std::vector<std::string> texts;
+        texts.reserve(embedded_questions.size());
+        std::ranges::transform(embedded_questions, std::back_inserter(texts),
+                               [&questions](size_t i) { return questions[i]; });
+
+        const auto embedding_calculator_fn = [this, &texts]() { return embedding_calculator_->calc_batch(texts); };
+        auto embedding_results = with_time_report("Batch query embedding", embedding_calculator_fn);
+        for(size_t j = 0; j < embedded_questions.size(); j++)
+        {
+            if(query_cache_)
+                query_cache_->put_embedding(texts[j], embedding_results[j].embedding);
+            query_embeddings[embedded_questions[j]] = std::move(embedding_results[j].embedding);
+        }
+    }
+
+    // Only the questions without the cached results of the current index are searched.
+    const auto state = load_state_();
+    std::vector<std::vector<RetrievedDocumentChunk>> output(questions.size());
+    std::vector<std::optional<QueryCache::ResultKey>> result_keys(questions.size());
+    std::vector<size_t> searched_questions;
+    std::vector<Embedding> searched_embeddings;
+    for(size_t i = 0; i < questions.size(); i++)
+    {
+        if(query_cache_)
+        {
+            result_keys[i] = QueryCache::ResultKey{QueryCache::hash_query(query_embeddings[i]), top_k, state->epoch};
+            if(auto results = query_cache_->find_results(*result_keys[i]))
+            {
+                output[i] = std::move(*results);
+                continue;
+            }
+        }
+        searched_questions.push_back(i);
+        searched_embeddings.push_back(std::move(query_embeddings[i]));
+    }
+
+    const auto retrieve_indices_fn = [&state, &searched_embeddings, &top_k]()
+    {
+        if(state->n_removed_chunks == 0)
+            return state->vector_store->retrieve_batch(searched_embeddings, top_k);
+
+        const auto live_chunks = state->live_chunks.flat();
+        std::vector<std::vector<RetrievedIndex>> retrieved_indices;
+        retrieved_indices.reserve(searched_embeddings.size());
+        std::ranges::transform(
+            searched_embeddings, std::back_inserter(retrieved_indices),
+            [&state, &top_k, &live_chunks](const Embedding& query_embedding)
+            { return state->vector_store->retrieve_filtered(query_embedding, top_k, *live_chunks); });
+        return retrieved_indices;
+    };
+
+    const auto retrieved_indices = searched_embeddings.empty()
+                                       ? std::vector<std::vector<RetrievedIndex>>{}
+                                       : with_time_report("Batch querying vector DB", retrieve_indices_fn);
+
+    for(size_t j = 0; j < searched_questions.size(); j++)
+    {
+        const size_t i = searched_questions[j];
+        output[i] = to_document_chunks_(*state, retrieved_indices[j]);
+        if(result_keys[i])
+            query_cache_->put_results(*result_keys[i], output[i]);
+    }
+
+    return output;
+}
+
+std::vector<RetrievedDocumentChunk> SimpleDocumentChunkRetriever::retrieve_filtered(const std::string& question,
+                                                                                    const size_t top_k,
+                                                                                    const RetrievalFilter& filter) const
+{
+    const auto state = load_state_();
+    const auto index_bitmap = to_index_bitmap_(*state, filter);
+    if(index_bitmap.count() == 0)
+        return {};
+
+    const auto query_embedding = embed_query_(question);
+
+    const auto retrieve_indices_fn = [&state, &query_embedding, &top_k, &index_bitmap]()
+    { return state->vector_store->retrieve_filtered(query_embedding, top_k, index_bitmap); };
+
+    const auto retrieved_indices = with_time_report("Querying vector DB with filter", retrieve_indices_fn);
+
+    return to_document_chunks_(*state, retrieved_indices);
+}
+
+IndexBitmap SimpleDocumentChunkRetriever::to_index_bitmap_(const State& state, const RetrievalFilter& filter) const
+{
+    const auto in_chunk_id_range = [&filter, &state](size_t chunk_idx)
+    {
+        const uint64_t chunk_id = state.document_chunks.chunk_id(chunk_idx);
+        return (!filter.min_chunk_id || chunk_id >= *filter.min_chunk_id) &&
+               (!filter.max_chunk_id || chunk_id <= *filter.max_chunk_id);
+    };
+
+    IndexBitmap index_bitmap(state.document_chunks.size());
+    if(filter.sources.empty())
+    {
+        for(size_t i = 0; i < state.document_chunks.size(); i++)
+        {
+            if(state.live_chunks.test(i) && in_chunk_id_range(i))
+                index_bitmap.set(i);
+        }
+
+        return index_bitmap;
+    }
+
+    for(const auto& source : filter.sources)
+    {
+        state.document_chunks.for_each_source_chunk(source,
+                                                    [&](size_t chunk_idx)
+                                                    {
+                                                        if(state.live_chunks.test(chunk_idx) &&
+                                                           in_chunk_id_range(chunk_idx))
+                                                            index_bitmap.set(chunk_idx);
+                                                    });
+    }
+
+    return index_bitmap;
+}
+
+void SimpleDocumentChunkRetriever::index_chunks_(State& state, size_t first_chunk) const
+{
+    state.live_chunks.resize(state.document_chunks.size());
+    for(size_t i = first_chunk; i < state.document_chunks.size(); i++)
+        state.live_chunks.set(i);
+}
+
+void SimpleDocumentChunkRetriever::reset_chunk_indices_(State& state) const
+{
+    state.live_chunks = PagedIndexBitmap();
+    state.n_removed_chunks = 0;
+    index_chunks_(state, 0);
+}
+
+std::vector<RetrievedDocumentChunk>
+SimpleDocumentChunkRetriever::to_document_chunks_(const State& state,
+                                                  const std::vector<RetrievedIndex>& retrieved_indices) const
+{
     std::vector<RetrievedDocumentChunk> output;
-    output.reserve(top_k);
+    output.reserve(retrieved_indices.size());
     std::transform(retrieved_indices.begin(), retrieved_indices.end(), std::back_inserter(output),
-                   [this](const RetrievedIndex& retrieved_index) -> RetrievedDocumentChunk
+                   [&state](const RetrievedIndex& retrieved_index) -> RetrievedDocumentChunk
                    {
-                       return RetrievedDocumentChunk{document_chunks_[retrieved_index.index].content,
-                                                     document_chunks_[retrieved_index.index].metadata.chunk_id,
+                       // The only copies of the contents, the chunk table keeps them packed or mapped.
+                       const auto chunk = state.document_chunks.view(retrieved_index.index);
+                       return RetrievedDocumentChunk{std::string(chunk.content), chunk.chunk_id,
                                                      retrieved_index.cosine_similarity};
                    });
 
     return output;
 }
 
-struct DocumentChunksSplit
+// Builds the matrix of all the chunk embeddings, calculating the missing ones in a single batch. When none of them
+// were precalculated the calculator output is used as is, without another copy.
+static EmbeddingMatrix collect_embeddings(const IEmbeddingCalculator& embedding_calculator,
+                                          std::span<const DocumentChunk> chunks)
 {
-    std::vector<DocumentChunk*> with_embeddings;
-    std::vector<DocumentChunk*> without_embeddings;
-
-    DocumentChunksSplit(size_t max_size)
+    std::vector<std::string> missing_contents;
+    std::ranges::for_each(chunks,
+                          [&missing_contents](const DocumentChunk& chunk)
+                          {
+                              if(!chunk.embedding)
+                                  missing_contents.push_back(chunk.content);
+                          });
+
+    auto calculated_embeddings = embedding_calculator.calc_batch_matrix(missing_contents);
+    if(missing_contents.size() == chunks.size())
+        return calculated_embeddings;
+
+    EmbeddingMatrix embeddings(chunks.size(), embedding_calculator.get_embedding_rank());
+    size_t calculated_idx = 0;
+    for(size_t i = 0; i < chunks.size(); i++)
     {
-        with_embeddings.reserve(max_size);
-        without_embeddings.reserve(max_size);
+        if(chunks[i].embedding)
+            embeddings.set_row(i, *chunks[i].embedding);
+        else
+            embeddings.set_row(i, calculated_embeddings.row(calculated_idx++));
     }
-};
 
-DocumentChunksSplit split_document_chunks(std::vector<DocumentChunk>& chunks)
+    return embeddings;
+}
+
+SimpleDocumentChunkRetriever::PreparedChunks SimpleDocumentChunkRetriever::empty_prepared_chunks_() const
 {
-    DocumentChunksSplit split(chunks.size());
-    std::ranges::for_each(chunks, [&split](DocumentChunk &chunk) -> void{
-        if (chunk.embedding) {
-            split.with_embeddings.push_back(&chunk);
-        } else {
-            split.without_embeddings.push_back(&chunk);
+    return PreparedChunks{.vector_store = load_state_()->vector_store->empty_copy()};
+}
+
+void SimpleDocumentChunkRetriever::prepare_chunks_(const std::vector<DocumentChunk>& chunks,
+                                                   PreparedChunks& prepared) const
+{
+    const auto embed_block = [this, &chunks](size_t block_begin, size_t block_size)
+    { return collect_embeddings(*embedding_calculator_, std::span(chunks).subspan(block_begin, block_size)); };
+    const auto index_block = [&prepared, &chunks](size_t block_begin, size_t block_size, EmbeddingMatrix&& embeddings)
+    {
+        prepared.vector_store->add(std::move(embeddings));
+        for(const auto& chunk : std::span(chunks).subspan(block_begin, block_size))
+        {
+            prepared.lexical_index.add(chunk.content);
+            prepared.document_chunks.add(chunk.content, chunk.metadata.source, chunk.metadata.chunk_id);
         }
-    });
-    return split;
+    };
+    run_ingestion_pipeline(chunks.size(), n_ingestion_threads_, embed_block, index_block);
 }
 
-void calculate_missing_embeddings(const IEmbeddingCalculator& embedding_calculator, DocumentChunksSplit& split) {
-    auto& with_embeddings = split.with_embeddings;
-    auto& without_embeddings = split.without_embeddings;
+void SimpleDocumentChunkRetriever::append_chunks_(State& state, PreparedChunks&& prepared) const
+{
+    const size_t first_chunk = state.document_chunks.size();
+    if(!prepared.document_chunks.empty())
+    {
+        // The published indices may be searched right now, the prepared ones are appended to their copies. The copies
+        // share the segments of the published and the prepared indices.
+        auto vector_store = std::make_shared<SegmentedVectorStore>(*state.vector_store);
+        vector_store->append(*prepared.vector_store);
+        auto lexical_index = std::make_shared<Bm25Index>(*state.lexical_index);
+        lexical_index->append(prepared.lexical_index);
+
+        state.vector_store = std::move(vector_store);
+        state.lexical_index = std::move(lexical_index);
+        state.document_chunks.append(prepared.document_chunks);
+    }
+    index_chunks_(state, first_chunk);
+}
 
-    std::vector<std::string> chunks_to_calculate_embeddings;
-    std::ranges::transform(without_embeddings, std::back_inserter(chunks_to_calculate_embeddings),
-                           [](const DocumentChunk* const chunk) { return chunk->content; });
+void SimpleDocumentChunkRetriever::add_document_chunks(const std::vector<DocumentChunk>& chunks)
+{
+    auto prepared = empty_prepared_chunks_();
+    prepare_chunks_(chunks, prepared);
 
-    const auto calculated_embeddings = embedding_calculator.calc_batch(chunks_to_calculate_embeddings);
+    std::lock_guard lock(writer_mutex_);
+    auto state = std::make_shared<State>(*load_state_());
+    append_chunks_(*state, std::move(prepared));
+    publish_state_(std::move(state));
+}
 
-    for(size_t i = 0; i < calculated_embeddings.size(); i++)
+void SimpleDocumentChunkRetriever::add_document_chunks(
+    const std::function<void(const AddChunksFn& add_chunks)>& produce_chunks)
+{
+    // Every batch is indexed into the same prepared indices, block by block.
+    auto prepared = empty_prepared_chunks_();
+    produce_chunks([this, &prepared](const std::vector<DocumentChunk>& chunks) { prepare_chunks_(chunks, prepared); });
+
+    std::lock_guard lock(writer_mutex_);
+    auto state = std::make_shared<State>(*load_state_());
+    append_chunks_(*state, std::move(prepared));
+    publish_state_(std::move(state));
+}
+
+void SimpleDocumentChunkRetriever::upsert_document_chunks(const std::vector<DocumentChunk>& chunks)
+{
+    std::unordered_map<std::string, std::unordered_set<uint64_t>> upserted_chunk_ids;
+    for(const auto& chunk : chunks)
+        upserted_chunk_ids[chunk.metadata.source].insert(chunk.metadata.chunk_id);
+
+    auto prepared = empty_prepared_chunks_();
+    prepare_chunks_(chunks, prepared);
+
+    // The replaced chunks are removed in the same state the new ones are added to, so the queries see either of them.
+    // They are looked up in the state current at the moment, including the chunks added meanwhile.
+    std::lock_guard lock(writer_mutex_);
+    auto state = std::make_shared<State>(*load_state_());
+    const size_t first_new_chunk = state->document_chunks.size();
+    append_chunks_(*state, std::move(prepared));
+
+    for(const auto& [source, chunk_ids] : upserted_chunk_ids)
     {
-        auto& document_chunk = *without_embeddings[i];
-        document_chunk.embedding = calculated_embeddings[i].embedding;
+        state->document_chunks.for_each_source_chunk(
+            source,
+            [&](size_t chunk_idx)
+            {
+                if(chunk_idx < first_new_chunk && state->live_chunks.test(chunk_idx) &&
+                   chunk_ids.contains(state->document_chunks.chunk_id(chunk_idx)))
+                {
+                    state->live_chunks.reset(chunk_idx);
+                    state->n_removed_chunks++;
+                }
+            });
     }
 
-    with_embeddings.insert(with_embeddings.end(), without_embeddings.begin(), without_embeddings.end());
-    without_embeddings.clear();
+    publish_state_(std::move(state));
+    compact_if_needed_();
 }
 
-void SimpleDocumentChunkRetriever::add_document_chunks(const std::vector<DocumentChunk>& chunks)
+size_t SimpleDocumentChunkRetriever::remove_document(const std::string& source)
 {
-    auto chunks_cpy = chunks;
-    auto splitted_chunks = split_document_chunks(chunks_cpy);
+    std::lock_guard lock(writer_mutex_);
+    const auto current_state = load_state_();
+    std::vector<size_t> removed_chunks;
+    current_state->document_chunks.for_each_source_chunk(source,
+                                                         [&current_state, &removed_chunks](size_t chunk_idx)
+                                                         {
+                                                             if(current_state->live_chunks.test(chunk_idx))
+                                                                 removed_chunks.push_back(chunk_idx);
+                                                         });
+    if(removed_chunks.empty())
+        return 0;
+
+    // Only the pages of the bitmap holding the removed chunks are copied.
+    auto state = std::make_shared<State>(*current_state);
+    std::ranges::for_each(removed_chunks, [&state](size_t chunk_idx) { state->live_chunks.reset(chunk_idx); });
+    state->n_removed_chunks += removed_chunks.size();
+
+    publish_state_(std::move(state));
+    compact_if_needed_();
+    return removed_chunks.size();
+}
+
+void SimpleDocumentChunkRetriever::compact()
+{
+    std::lock_guard compaction_lock(compaction_mutex_);
+    std::shared_ptr<const State> compacted_from;
+    uint64_t n_replaced_states = 0;
+    {
+        std::lock_guard lock(writer_mutex_);
+        compacted_from = load_state_();
+        n_replaced_states = n_replaced_states_;
+    }
+    if(compacted_from->n_removed_chunks == 0)
+        return;
 
-    calculate_missing_embeddings(*embedding_calculator_, splitted_chunks);
+    // The compacted indices are built without the writer lock, the updates published meanwhile are replayed on them.
+    auto state = std::make_shared<State>(*compacted_from);
+    compact_(*state);
 
-    std::vector<Embedding> embeddings_to_index;
-    std::vector<DocumentChunk> chunks_to_add;
+    std::lock_guard lock(writer_mutex_);
+    if(n_replaced_states != n_replaced_states_)
+        return;
 
-    embeddings_to_index.reserve(chunks.size());
-    chunks_to_add.reserve(chunks.size());
+    replay_updates_(*state, *compacted_from, *load_state_());
+    publish_state_(std::move(state));
+}
 
-    std::ranges::transform(splitted_chunks.with_embeddings, std::back_inserter(embeddings_to_index), [](const DocumentChunk* chunk) {
-        return *chunk->embedding;
-    });
+void SimpleDocumentChunkRetriever::compact_(State& state) const
+{
+    spdlog::debug("Compacting the document chunks, removing {} of {}.", state.n_removed_chunks,
+                  state.document_chunks.size());
+
+    const auto live_chunks = state.live_chunks.flat();
+    auto compacted_vector_store = state.vector_store->compacted_copy(*live_chunks);
+    auto compacted_lexical_index = std::make_shared<const Bm25Index>(state.lexical_index->compacted(*live_chunks));
+    auto compacted_document_chunks = state.document_chunks.compacted(*live_chunks);
+
+    state.vector_store = std::move(compacted_vector_store);
+    state.lexical_index = std::move(compacted_lexical_index);
+    state.document_chunks = std::move(compacted_document_chunks);
+    reset_chunk_indices_(state);
+}
 
-    std::ranges::transform(splitted_chunks.with_embeddings, std::back_inserter(chunks_to_add), [](const DocumentChunk* chunk) {
-        return *chunk;
-    });
+// The updates only append chunks and remove them, so the current state is the state the compaction started from,
+// with more chunks removed and the new ones appended after its chunks.
+void SimpleDocumentChunkRetriever::replay_updates_(State& compacted_state, const State& compacted_from,
+                                                   const State& current_state) const
+{
+    current_state.live_chunks.for_each_unset_since(compacted_from.live_chunks,
+                                                   [&compacted_state](size_t, size_t compacted_idx)
+                                                   {
+                                                       compacted_state.live_chunks.reset(compacted_idx);
+                                                       compacted_state.n_removed_chunks++;
+                                                   });
+
+    const size_t first_appended = compacted_from.document_chunks.size();
+    const size_t n_appended = current_state.document_chunks.size() - first_appended;
+    if(n_appended == 0)
+        return;
+
+    auto vector_store = std::make_shared<SegmentedVectorStore>(*compacted_state.vector_store);
+    vector_store->add(current_state.vector_store->reconstruct(first_appended, n_appended));
+    auto lexical_index = std::make_shared<Bm25Index>(*compacted_state.lexical_index);
+    const size_t first_chunk = compacted_state.document_chunks.size();
+    compacted_state.live_chunks.resize(first_chunk + n_appended);
+    for(size_t i = 0; i < n_appended; i++)
+    {
+        const auto chunk = current_state.document_chunks.view(first_appended + i);
+        lexical_index->add(chunk.content);
+        compacted_state.document_chunks.add(chunk.content, chunk.source, chunk.chunk_id);
+        if(current_state.live_chunks.test(first_appended + i))
+            compacted_state.live_chunks.set(first_chunk + i);
+        else
+            compacted_state.n_removed_chunks++;
+    }
 
-    vector_store_->add(embeddings_to_index);
-    document_chunks_.insert(document_chunks_.end(), chunks_to_add.begin(), chunks_to_add.end());
+    compacted_state.vector_store = std::move(vector_store);
+    compacted_state.lexical_index = std::move(lexical_index);
 }
 
-void from_json(const nlohmann::json& j, DocumentChunkMetadata& d)
+// Called with the writer lock held, after an update is published.
+void SimpleDocumentChunkRetriever::compact_if_needed_()
 {
-    j.at("source").get_to(d.source);
-    j.at("chunk_id").get_to(d.chunk_id);
+    const auto state = load_state_();
+    if(static_cast<float>(state->n_removed_chunks) <=
+       compaction_threshold_ * static_cast<float>(state->document_chunks.size()))
+        return;
+
+    // A single background compaction at a time, the one still running leaves the later removals for the next one.
+    if(background_compaction_.valid() &&
+       background_compaction_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    background_compaction_ = std::async(std::launch::async,
+                                        [this]()
+                                        {
+                                            try
+                                            {
+                                                compact();
+                                            }
+                                            catch(const std::exception& e)
+                                            {
+                                                spdlog::error("Background compaction failed: {}", e.what());
+                                            }
+                                        });
 }
 
-void to_json(nlohmann::json& j, const DocumentChunkMetadata& d)
+std::vector<DocumentChunkView> SimpleDocumentChunkRetriever::live_document_chunks_(const State& state) const
 {
-    j = nlohmann::json{{"source", d.source}, {"chunk_id", d.chunk_id}};
+    std::vector<DocumentChunkView> live_chunks;
+    live_chunks.reserve(state.document_chunks.size() - state.n_removed_chunks);
+    state.live_chunks.for_each_set([&state, &live_chunks](size_t chunk_idx)
+                                   { live_chunks.push_back(state.document_chunks.view(chunk_idx)); });
+
+    return live_chunks;
 }
 
-void from_json(const nlohmann::json& j, DocumentChunk& d)
+void SimpleDocumentChunkRetriever::dump(std::ostream& output) const
 {
-    j.at("content").get_to(d.content);
-    j.at("metadata").get_to(d.metadata);
+    const auto state = load_state_();
+
+    // The approximations of a compressed index would be loaded back as if they were the calculated embeddings.
+    const bool with_embeddings = state->vector_store->reconstructs_exactly();
+    if(!with_embeddings)
+        spdlog::warn("The vector store compresses the embeddings, they are dumped without them.");
+
+    // The embeddings are reconstructed from the vector store block by block, so only a single block of them is
+    // held in memory next to the index.
+    output << R"({"chunks":[)";
+    bool first_chunk = true;
+    for(size_t block_begin = 0; block_begin < state->document_chunks.size(); block_begin += DUMP_BLOCK_SIZE)
+    {
+        const size_t block_size = std::min(DUMP_BLOCK_SIZE, state->document_chunks.size() - block_begin);
+        const auto embeddings =
+            with_embeddings ? state->vector_store->reconstruct(block_begin, block_size) : EmbeddingMatrix();
+
+        for(size_t i = 0; i < block_size; i++)
+        {
+            if(!state->live_chunks.test(block_begin + i))
+                continue;
+
+            const auto chunk = state->document_chunks.view(block_begin + i);
+            if(!first_chunk)
+                output << ',';
+            first_chunk = false;
+
+            nlohmann::json embedding = nullptr;
+            if(with_embeddings)
+            {
+                const auto row = embeddings.row(i);
+                embedding = Embedding(row.begin(), row.end());
+            }
+            output << nlohmann::json{{"content", chunk.content},
+                                     {"metadata", {{"source", chunk.source}, {"chunk_id", chunk.chunk_id}}},
+                                     {"embedding", std::move(embedding)}}
+                          .dump();
+        }
+    }
+    output << "]}";
+}
+
+void SimpleDocumentChunkRetriever::load(std::istream& input)
+{
+    // The chunks are parsed in batches, so the json document is never held in memory as a whole. Every batch goes
+    // through the ingestion pipeline into the same prepared indices, aside, without blocking the other updates, then
+    // all of them are appended and published at once. A batch has a few blocks per ingestion thread, so the threads
+    // wait for the parsing of the next batch only once per batch.
+    auto prepared = empty_prepared_chunks_();
+    read_document_chunks(input, DUMP_BLOCK_SIZE * std::max<size_t>(n_ingestion_threads_, 1),
+                         [this, &prepared](std::vector<DocumentChunk>&& chunks) { prepare_chunks_(chunks, prepared); });
+
+    std::lock_guard lock(writer_mutex_);
+    auto state = std::make_shared<State>(*load_state_());
+    append_chunks_(*state, std::move(prepared));
+    publish_state_(std::move(state));
+}
 
-    if(j.count("embedding") && j.at("embedding") != nullptr)
+void SimpleDocumentChunkRetriever::save_binary(const std::filesystem::path& path) const
+{
+    const auto state = load_state_();
+    if(!state->vector_store->reconstructs_exactly())
     {
-        d.embedding = std::vector<float>();
-        j.at("embedding").get_to(*d.embedding);
+        spdlog::warn("The vector store compresses the embeddings, the chunk database is saved without them.");
+        save_chunk_database(path, live_document_chunks_(*state), nullptr);
+        return;
     }
+    if(state->n_removed_chunks == 0)
+    {
+        save_chunk_database(path, live_document_chunks_(*state), state->vector_store.get());
+        return;
+    }
+
+    const auto compacted_vector_store = state->vector_store->compacted(*state->live_chunks.flat());
+    save_chunk_database(path, live_document_chunks_(*state), compacted_vector_store.get());
 }
 
-void to_json(nlohmann::json& j, const DocumentChunk& d)
+void SimpleDocumentChunkRetriever::load_binary(const std::filesystem::path& path)
 {
-    j = nlohmann::json{{"content", d.content}, {"metadata", d.metadata}};
-    if(d.embedding)
-        j["embedding"] = *d.embedding;
-    else
-        j["embedding"] = nullptr;
+    // The loaded chunks keep the file mapped, their contents are not copied.
+    const auto database = std::make_shared<const MappedChunkDatabase>(path);
+    const size_t embedding_rank = embedding_calculator_->get_embedding_rank();
+    if(database->embedding_rank() != 0 && database->embedding_rank() != embedding_rank)
+    {
+        throw std::runtime_error(fmt::format("Chunk database [{}] has embeddings of rank {}, expected {}.",
+                                             path.c_str(), database->embedding_rank(), embedding_rank));
+    }
+
+    // The chunks are embedded and indexed aside, without blocking the other updates, then appended at once.
+    auto prepared = empty_prepared_chunks_();
+
+    // The embeddings are copied from the mapped file, or calculated when it has none, block by block.
+    const auto embed_block = [this, &database, embedding_rank](size_t block_begin, size_t block_size)
+    {
+        if(database->embedding_rank() == 0)
+        {
+            std::vector<std::string> contents;
+            contents.reserve(block_size);
+            for(size_t i = block_begin; i < block_begin + block_size; i++)
+                contents.emplace_back(database->content(i));
+            return embedding_calculator_->calc_batch_matrix(contents);
+        }
+
+        const auto embeddings = database->embeddings().subspan(block_begin * embedding_rank,
+                                                               block_size * embedding_rank);
+        return EmbeddingMatrix(std::vector<float>(embeddings.begin(), embeddings.end()), embedding_rank);
+    };
+    const auto index_block = [&prepared, &database](size_t block_begin, size_t block_size, EmbeddingMatrix&& embeddings)
+    {
+        prepared.vector_store->add(std::move(embeddings));
+        for(size_t i = block_begin; i < block_begin + block_size; i++)
+            prepared.lexical_index.add(database->content(i));
+        prepared.document_chunks.add_mapped(database, block_begin, block_begin + block_size);
+    };
+    run_ingestion_pipeline(database->size(), n_ingestion_threads_, embed_block, index_block);
+    // All the contents were read for the lexical index, only the retrieved ones are needed from now on.
+    database->release_resident_pages();
+
+    std::lock_guard lock(writer_mutex_);
+    auto state = std::make_shared<State>(*load_state_());
+    append_chunks_(*state, std::move(prepared));
+    publish_state_(std::move(state));
 }
 
-void SimpleDocumentChunkRetriever::dump(std::ostream& output) const
+void SimpleDocumentChunkRetriever::save_snapshot(const std::filesystem::path& directory) const
 {
-    using namespace nlohmann;
-    auto object = nlohmann::json{{"chunks", document_chunks_}};
+    const auto state = load_state_();
+    std::filesystem::create_directories(directory);
 
-    output << object.dump();
+    // The embeddings are stored by the vector index, the chunk database has the chunks only. The removed chunks
+    // are not persisted, a compacted copy of the store is saved instead.
+    save_chunk_database(directory / SNAPSHOT_CHUNKS_FILE, live_document_chunks_(*state), nullptr);
+    if(state->n_removed_chunks == 0)
+    {
+        state->vector_store->save(directory / SNAPSHOT_VECTORS_FILE);
+        state->lexical_index->save(directory / SNAPSHOT_LEXICAL_FILE);
+    }
+    else
+    {
+        const auto live_chunks = state->live_chunks.flat();
+        state->vector_store->compacted(*live_chunks)->save(directory / SNAPSHOT_VECTORS_FILE);
+        state->lexical_index->compacted(*live_chunks).save(directory / SNAPSHOT_LEXICAL_FILE);
+    }
 }
 
-void SimpleDocumentChunkRetriever::load(std::istream& input)
+void SimpleDocumentChunkRetriever::load_snapshot(const std::filesystem::path& directory)
 {
-    using namespace nlohmann;
-    const auto json_object = json::parse(input);
-    std::vector<DocumentChunk> chunks = json_object.at("chunks");
+    // The snapshot chunks stay in the mapped file.
+    const auto database = std::make_shared<const MappedChunkDatabase>(directory / SNAPSHOT_CHUNKS_FILE);
+    ChunkTable chunks;
+    chunks.add_mapped(database, 0, database->size());
+
+    // The snapshot replaces the current state, the lock is only needed to publish it.
+    auto vector_store = load_state_()->vector_store->empty_copy();
+    vector_store->load(directory / SNAPSHOT_VECTORS_FILE);
+
+    if(vector_store->size() != chunks.size())
+    {
+        throw std::runtime_error(fmt::format("Snapshot in [{}] is inconsistent: {} chunks and {} vectors.",
+                                             directory.c_str(), chunks.size(), vector_store->size()));
+    }
+
+    auto lexical_index = std::make_shared<Bm25Index>();
+    lexical_index->load(directory / SNAPSHOT_LEXICAL_FILE);
+
+    if(lexical_index->size() != chunks.size())
+    {
+        throw std::runtime_error(fmt::format("Snapshot in [{}] is inconsistent: {} chunks and {} indexed contents.",
+                                             directory.c_str(), chunks.size(), lexical_index->size()));
+    }
+
+    auto state = std::make_shared<State>();
+    state->vector_store = std::move(vector_store);
+    state->lexical_index = std::move(lexical_index);
+    state->document_chunks = std::move(chunks);
+    reset_chunk_indices_(*state);
 
-    this->add_document_chunks(chunks);
+    std::lock_guard lock(writer_mutex_);
+    n_replaced_states_++;
+    publish_state_(std::move(state));
 }
-} // namespace ds
\ No newline at end of file
+} // namespace ds
@@ -0,0 +1,123 @@
+#include "rag/document_splitter.h"
+
+#include "ordered_pipeline.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace ds
+{
+constexpr size_t PENDING_DOCUMENTS_PER_THREAD = 4;
+
+static bool is_supported_document(const std::filesystem::path& path)
+{
+    return path.extension() == ".md" || path.extension() == ".txt";
+}
+
+DocumentSplitterParams token_budget_params(const IEmbeddingCalculator& embedding_calculator, size_t chunk_tokens,
+                                           size_t chunk_overlap)
+{
+    return DocumentSplitterParams{
+        .text_splitter_params = {.chunk_size = std::min(chunk_tokens, embedding_calculator.max_text_tokens()),
+                                 .chunk_overlap = chunk_overlap,
+                                 .length_function = [&embedding_calculator](std::string_view text)
+                                 { return embedding_calculator.count_tokens(std::string(text)); }},
+        .measure_chunks = true,
+        .measure_chunk = [&embedding_calculator](const std::string& chunk)
+        { return embedding_calculator.tokenize_chunk(chunk); }};
+}
+
+std::vector<std::filesystem::path> find_documents(const std::filesystem::path& input)
+{
+    if(!std::filesystem::is_directory(input))
+    {
+        if(!is_supported_document(input))
+            throw std::runtime_error(fmt::format("Not supported document extension: {}", input.string()));
+
+        return {input};
+    }
+
+    std::vector<std::filesystem::path> paths;
+    for(const auto& entry : std::filesystem::recursive_directory_iterator(input))
+    {
+        if(!entry.is_regular_file())
+            continue;
+
+        if(is_supported_document(entry.path()))
+            paths.push_back(entry.path());
+        else
+            spdlog::debug("Skipping the not supported document {}.", entry.path().string());
+    }
+    std::ranges::sort(paths);
+
+    return paths;
+}
+
+// Reads the document with the line endings translated to "\n", as the text mode of Python does.
+static std::string read_document(const std::filesystem::path& path)
+{
+    std::ifstream input(path, std::ios::binary);
+    if(!input)
+        throw std::runtime_error(fmt::format("Failed to open the document {}", path.string()));
+
+    std::string text(std::istreambuf_iterator<char>(input), {});
+    size_t out = 0;
+    for(size_t in = 0; in < text.size(); in++)
+    {
+        if(text[in] != '\r')
+            text[out++] = text[in];
+        else if(in + 1 == text.size() || text[in + 1] != '\n')
+            text[out++] = '\n';
+    }
+    text.resize(out);
+
+    return text;
+}
+
+std::vector<DocumentChunk> split_document(const std::filesystem::path& path, const DocumentSplitterParams& params,
+                                          uint64_t first_chunk_id)
+{
+    const bool is_markdown = params.markdown_separators && path.extension() == ".md";
+    const RecursiveTextSplitter splitter(params.text_splitter_params,
+                                         is_markdown ? markdown_separators() : default_separators());
+
+    const auto source = path.generic_string();
+    std::vector<DocumentChunk> chunks;
+    for(auto& content : splitter.split(read_document(path)))
+    {
+        if(params.measure_chunks)
+        {
+            const auto length = params.measure_chunk ? params.measure_chunk(content)
+                                                     : params.text_splitter_params.length_function(content);
+            if(length > params.text_splitter_params.chunk_size)
+            {
+                spdlog::warn("Chunk {} of {} has the length {}, above the chunk size {}.", chunks.size(), source,
+                             length, params.text_splitter_params.chunk_size);
+            }
+        }
+        chunks.push_back(DocumentChunk{.content = std::move(content),
+                                       .metadata = {.source = source, .chunk_id = first_chunk_id + chunks.size()}});
+    }
+
+    return chunks;
+}
+
+void split_documents(const std::vector<std::filesystem::path>& paths, const DocumentSplitterParams& params,
+                     const std::function<void(std::vector<DocumentChunk>&&)>& consume_chunks)
+{
+    uint64_t next_chunk_id = 0;
+    run_ordered_pipeline<std::vector<DocumentChunk>>(
+        paths.size(), params.n_threads, params.n_threads * PENDING_DOCUMENTS_PER_THREAD,
+        [&paths, &params](size_t document) { return split_document(paths[document], params); },
+        [&next_chunk_id, &consume_chunks](size_t, std::vector<DocumentChunk>&& chunks)
+        {
+            for(auto& chunk : chunks)
+                chunk.metadata.chunk_id = next_chunk_id++;
+            consume_chunks(std::move(chunks));
+        });
+}
+} // namespace ds
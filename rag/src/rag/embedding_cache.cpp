@@ -0,0 +1,310 @@
+#include "rag/embedding_cache.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <type_traits>
+#include <unistd.h>
+#include <xxhash.h>
+
+namespace ds
+{
+constexpr uint32_t EMBEDDING_CACHE_MAGIC = 0x43455344; // "DSEC"
+constexpr uint32_t EMBEDDING_CACHE_VERSION = 3;
+
+struct EmbeddingCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // Content hash of the last model file, it's only hashed again when the path, the size or the modification time of
+    // the file change.
+    uint64_t model_path_hash;
+    uint64_t model_size;
+    int64_t model_mtime;
+    uint64_t model_content_hash;
+};
+static_assert(std::is_trivially_copyable_v<EmbeddingCacheHeader>);
+
+// Followed by the embedding of the given rank.
+struct EmbeddingCacheRecord
+{
+    uint64_t model_hash;
+    uint64_t text_hash_low;
+    uint64_t text_hash_high;
+    uint32_t embedding_rank;
+    // Of the record with a zero checksum and of its embedding.
+    uint32_t checksum;
+};
+static_assert(std::is_trivially_copyable_v<EmbeddingCacheRecord>);
+
+static uint32_t record_checksum(EmbeddingCacheRecord record, const void* embedding, size_t n_bytes)
+{
+    record.checksum = 0;
+    const auto record_hash = XXH3_64bits(&record, sizeof(record));
+    return static_cast<uint32_t>(XXH3_64bits_withSeed(embedding, n_bytes, record_hash));
+}
+
+uint64_t hash_file_content(const std::filesystem::path& path)
+{
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    if(!input)
+        throw std::runtime_error(fmt::format("Could not open the file: {}", path.c_str()));
+
+    const auto state = std::unique_ptr<XXH3_state_t, decltype(&XXH3_freeState)>(XXH3_createState(), XXH3_freeState);
+    XXH3_64bits_reset(state.get());
+    std::vector<char> buffer(1 << 20);
+    while(input.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || input.gcount() > 0)
+        XXH3_64bits_update(state.get(), buffer.data(), static_cast<size_t>(input.gcount()));
+
+    if(!input.eof())
+        throw std::runtime_error(fmt::format("Could not read the file: {}", path.c_str()));
+    return XXH3_64bits_digest(state.get());
+}
+
+static std::runtime_error invalid_cache(const std::filesystem::path& path, std::string_view reason)
+{
+    return std::runtime_error(fmt::format("Invalid embedding cache file: {}, {}", path.c_str(), reason));
+}
+
+EmbeddingCache::EmbeddingCache(const std::filesystem::path& path, size_t embedding_rank)
+    : embedding_rank_(embedding_rank)
+{
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd_ < 0)
+        throw std::runtime_error(fmt::format("Could not open the embedding cache file: {}", path.c_str()));
+
+    // The index isn't shared, so a second writer would append over the records of the first one.
+    if(::flock(fd_, LOCK_EX | LOCK_NB) != 0)
+    {
+        ::close(fd_);
+        throw std::runtime_error(
+            fmt::format("The embedding cache file is used by another process: {}", path.c_str()));
+    }
+
+    EmbeddingCacheHeader header{.magic = EMBEDDING_CACHE_MAGIC, .version = EMBEDDING_CACHE_VERSION};
+    const auto file_size = static_cast<uint64_t>(::lseek(fd_, 0, SEEK_END));
+    std::optional<std::string> error;
+    if(file_size == 0)
+    {
+        if(::pwrite(fd_, &header, sizeof(header), 0) != sizeof(header))
+            error = "could not write the header";
+    }
+    else if(::pread(fd_, &header, sizeof(header), 0) != sizeof(header) || header.magic != EMBEDDING_CACHE_MAGIC)
+    {
+        error = "not an embedding cache";
+    }
+    else if(header.version != EMBEDDING_CACHE_VERSION)
+    {
+        error = fmt::format("unsupported version {}", header.version);
+    }
+
+    if(error)
+    {
+        ::close(fd_);
+        throw invalid_cache(path, *error);
+    }
+}
+
+EmbeddingCache::EmbeddingCache(const std::filesystem::path& path, std::string_view model_identity,
+                               size_t embedding_rank)
+    : EmbeddingCache(path, embedding_rank)
+{
+    model_hash_ = XXH3_64bits(model_identity.data(), model_identity.size());
+    read_index_(path);
+}
+
+EmbeddingCache::EmbeddingCache(const std::filesystem::path& path, const std::filesystem::path& model_path,
+                               std::string_view model_parameters, size_t embedding_rank)
+    : EmbeddingCache(path, embedding_rank)
+{
+    const auto model_identity = fmt::format("{:016x}:{}", model_content_hash_(path, model_path), model_parameters);
+    model_hash_ = XXH3_64bits(model_identity.data(), model_identity.size());
+    read_index_(path);
+}
+
+EmbeddingCache::~EmbeddingCache()
+{
+    ::close(fd_);
+}
+
+uint64_t EmbeddingCache::model_content_hash_(const std::filesystem::path& path, const std::filesystem::path& model_path)
+{
+    EmbeddingCacheHeader header{};
+    if(::pread(fd_, &header, sizeof(header), 0) != sizeof(header))
+        throw invalid_cache(path, "could not read the header");
+
+    const auto model_path_string = std::filesystem::absolute(model_path).string();
+    const auto model_path_hash = XXH3_64bits(model_path_string.data(), model_path_string.size());
+    const auto model_size = std::filesystem::file_size(model_path);
+    const auto model_mtime =
+        static_cast<int64_t>(std::filesystem::last_write_time(model_path).time_since_epoch().count());
+    if(header.model_path_hash == model_path_hash && header.model_size == model_size &&
+       header.model_mtime == model_mtime)
+        return header.model_content_hash;
+
+    header.model_path_hash = model_path_hash;
+    header.model_size = model_size;
+    header.model_mtime = model_mtime;
+    header.model_content_hash = hash_file_content(model_path);
+    if(::pwrite(fd_, &header, sizeof(header), 0) != sizeof(header))
+        throw invalid_cache(path, "could not write the header");
+
+    return header.model_content_hash;
+}
+
+void EmbeddingCache::read_index_(const std::filesystem::path& path)
+{
+    // The records are scanned with a buffered stream, the embeddings are read to verify the checksums only.
+    const auto file_size = static_cast<uint64_t>(::lseek(fd_, 0, SEEK_END));
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    input.seekg(sizeof(EmbeddingCacheHeader));
+    uint64_t offset = sizeof(EmbeddingCacheHeader);
+    EmbeddingCacheRecord record{};
+    std::vector<char> embedding;
+    while(offset + sizeof(record) <= file_size && input.read(reinterpret_cast<char*>(&record), sizeof(record)))
+    {
+        const uint64_t embedding_size = uint64_t{record.embedding_rank} * sizeof(float);
+        const uint64_t record_end = offset + sizeof(record) + embedding_size;
+        if(record_end > file_size)
+            break;
+
+        embedding.resize(embedding_size);
+        if(!input.read(embedding.data(), static_cast<std::streamsize>(embedding_size)) ||
+           record_checksum(record, embedding.data(), embedding_size) != record.checksum)
+            break;
+
+        if(record.model_hash == model_hash_ && record.embedding_rank == embedding_rank_)
+            offsets_[TextHash{record.text_hash_low, record.text_hash_high}] = offset + sizeof(record);
+
+        offset = record_end;
+    }
+
+    // The records past a corrupted one can't be located, they are dropped with it.
+    if(offset != file_size)
+    {
+        spdlog::warn("Dropping {} bytes of an incomplete or corrupted embedding cache record.", file_size - offset);
+        if(::ftruncate(fd_, static_cast<off_t>(offset)) != 0)
+            throw invalid_cache(path, "could not drop the incomplete record");
+    }
+    file_size_ = offset;
+}
+
+bool EmbeddingCache::get(std::string_view text, std::span<float> output) const
+{
+    const auto hash = hash_text(text);
+    uint64_t offset = 0;
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = offsets_.find(hash);
+        if(it == offsets_.end())
+        {
+            misses_++;
+            return false;
+        }
+        offset = it->second;
+    }
+
+    // The records are never rewritten, so they are read without the lock.
+    const auto n_bytes = embedding_rank_ * sizeof(float);
+    if(::pread(fd_, output.data(), n_bytes, static_cast<off_t>(offset)) != static_cast<ssize_t>(n_bytes))
+        throw std::runtime_error("Could not read the cached embedding.");
+
+    hits_++;
+    return true;
+}
+
+void EmbeddingCache::put(std::string_view text, std::span<const float> embedding)
+{
+    if(embedding.size() != embedding_rank_)
+    {
+        throw std::logic_error(fmt::format("Cannot cache an embedding of rank {} in the cache of rank {}.",
+                                           embedding.size(), embedding_rank_));
+    }
+
+    const auto hash = hash_text(text);
+    EmbeddingCacheRecord record{.model_hash = model_hash_,
+                                .text_hash_low = hash.low,
+                                .text_hash_high = hash.high,
+                                .embedding_rank = static_cast<uint32_t>(embedding_rank_),
+                                .checksum = 0};
+    record.checksum = record_checksum(record, embedding.data(), embedding.size_bytes());
+    std::vector<char> buffer(sizeof(record) + embedding.size_bytes());
+    std::memcpy(buffer.data(), &record, sizeof(record));
+    std::memcpy(buffer.data() + sizeof(record), embedding.data(), embedding.size_bytes());
+
+    std::lock_guard lock(mutex_);
+    if(offsets_.contains(hash))
+        return;
+
+    // A failed write leaves the file size as it was, so the next record overwrites its leftovers.
+    if(::pwrite(fd_, buffer.data(), buffer.size(), static_cast<off_t>(file_size_)) !=
+       static_cast<ssize_t>(buffer.size()))
+        throw std::runtime_error("Could not write the embedding cache record.");
+
+    offsets_.emplace(hash, file_size_ + sizeof(record));
+    file_size_ += buffer.size();
+}
+
+size_t EmbeddingCache::size() const
+{
+    std::lock_guard lock(mutex_);
+    return offsets_.size();
+}
+
+CachingEmbeddingCalculator::CachingEmbeddingCalculator(std::unique_ptr<IEmbeddingCalculator>&& embedding_calculator,
+                                                       std::unique_ptr<EmbeddingCache>&& cache)
+    : embedding_calculator_(std::move(embedding_calculator)), cache_(std::move(cache))
+{
+    if(cache_->embedding_rank() != embedding_calculator_->get_embedding_rank())
+    {
+        throw std::logic_error(fmt::format("The embedding cache rank {} doesn't match the calculator rank {}.",
+                                           cache_->embedding_rank(), embedding_calculator_->get_embedding_rank()));
+    }
+}
+
+std::vector<EmbeddingCalculationResult>
+CachingEmbeddingCalculator::calc_batch(const std::vector<std::string>& chunks) const
+{
+    return embedding_calculator_->calc_batch(chunks);
+}
+
+EmbeddingMatrix CachingEmbeddingCalculator::calc_batch_matrix(const std::vector<std::string>& chunks) const
+{
+    EmbeddingMatrix embeddings(chunks.size(), get_embedding_rank());
+
+    // Rows of the missed chunks with their indices in the deduplicated batch.
+    std::vector<std::string> missing_chunks;
+    std::unordered_map<std::string_view, size_t> missing_idxs;
+    std::vector<std::pair<size_t, size_t>> missing_rows;
+    for(size_t i = 0; i < chunks.size(); i++)
+    {
+        if(cache_->get(chunks[i], embeddings.row(i)))
+            continue;
+
+        const auto [missing_idx, inserted] = missing_idxs.try_emplace(chunks[i], missing_chunks.size());
+        if(inserted)
+            missing_chunks.push_back(chunks[i]);
+        missing_rows.emplace_back(i, missing_idx->second);
+    }
+
+    if(missing_chunks.empty())
+        return embeddings;
+
+    spdlog::info("Embedding cache: {} of {} chunks found, calculating {} distinct chunks.",
+                 chunks.size() - missing_rows.size(), chunks.size(), missing_chunks.size());
+
+    const auto calculated_embeddings = embedding_calculator_->calc_batch_matrix(missing_chunks);
+    for(size_t i = 0; i < missing_chunks.size(); i++)
+        cache_->put(missing_chunks[i], calculated_embeddings.row(i));
+    for(const auto& [row, missing_idx] : missing_rows)
+        embeddings.set_row(row, calculated_embeddings.row(missing_idx));
+
+    return embeddings;
+}
+} // namespace ds
@@ -1,9 +1,37 @@
 #include "rag/embedding_calculator.h"
 
+#include <stdexcept>
+
 namespace ds
 {
 EmbeddingCalculationResult IEmbeddingCalculator::calc(const std::string& chunk) const
 {
     return calc_batch({chunk})[0];
 }
+
+EmbeddingMatrix IEmbeddingCalculator::calc_batch_matrix(const std::vector<std::string>& chunks) const
+{
+    const auto results = calc_batch(chunks);
+
+    EmbeddingMatrix matrix(results.size(), get_embedding_rank());
+    for(size_t i = 0; i < results.size(); i++)
+        matrix.set_row(i, results[i].embedding);
+
+    return matrix;
+}
+
+size_t IEmbeddingCalculator::count_tokens(const std::string&) const
+{
+    throw std::logic_error("The embedding calculator doesn't count the tokens.");
+}
+
+size_t IEmbeddingCalculator::tokenize_chunk(const std::string& chunk) const
+{
+    return count_tokens(chunk);
+}
+
+size_t IEmbeddingCalculator::max_text_tokens() const
+{
+    throw std::logic_error("The embedding calculator doesn't count the tokens.");
+}
 } // namespace ds
\ No newline at end of file
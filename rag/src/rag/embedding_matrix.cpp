@@ -0,0 +1,44 @@
+#include "rag/embedding_matrix.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace ds
+{
+EmbeddingMatrix::EmbeddingMatrix(size_t n_rows, size_t rank) : n_rows_(n_rows), rank_(rank), values_(n_rows * rank)
+{
+}
+
+EmbeddingMatrix::EmbeddingMatrix(std::vector<float>&& values, size_t rank)
+    : n_rows_(rank ? values.size() / rank : 0), rank_(rank), values_(std::move(values))
+{
+    if(n_rows_ * rank_ != values_.size())
+    {
+        throw std::logic_error(
+            fmt::format("Embedding matrix values size: {} is not a multiple of the rank: {}", values_.size(), rank_));
+    }
+}
+
+EmbeddingMatrix EmbeddingMatrix::from_rows(const std::vector<Embedding>& rows)
+{
+    if(rows.empty())
+        return EmbeddingMatrix();
+
+    EmbeddingMatrix matrix(rows.size(), rows.front().size());
+    for(size_t i = 0; i < rows.size(); i++)
+        matrix.set_row(i, rows[i]);
+
+    return matrix;
+}
+
+void EmbeddingMatrix::set_row(size_t idx, std::span<const float> values)
+{
+    if(values.size() != rank_)
+    {
+        throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", rank_));
+    }
+
+    std::ranges::copy(values, row(idx).begin());
+}
+} // namespace ds
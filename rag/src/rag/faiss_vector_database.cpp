@@ -1,86 +1,865 @@
 #include "rag/vector_database.h"
+#include "native_vector_database.h"
+#include "top_k.h"
 
 #include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+#include <span>
 #include <vector>
+#include <faiss/IndexBinaryFlat.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexRefine.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/invlists/OnDiskInvertedLists.h>
 #include <faiss/utils/distances.h>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
 namespace ds
 {
+// faiss k-means warns below 39 training points per centroid, we follow the same rule of thumb.
+constexpr size_t TRAINING_POINTS_PER_CENTROID = 39;
+constexpr size_t PQ_NBITS = 8;
+// SQ8 training only estimates the value range of every dimension, a small sample is enough.
+constexpr size_t SQ8_MIN_TRAINING_SIZE = 1000;
+// Filters selecting less than 1 / SELECTIVE_FILTER_RATIO of the store are scored exhaustively over the selected
+// vectors only. It's cheaper than a filtered index scan, and the approximate indices could miss them otherwise.
+constexpr size_t SELECTIVE_FILTER_RATIO = 20;
+// Indices without IDSelector support search for more candidates than requested when filtered, growing by this factor
+// until enough of them pass the filter.
+constexpr size_t FILTER_OVERFETCH_FACTOR = 4;
+constexpr size_t COMPACTION_BLOCK_SIZE = 4096;
+
+static std::unique_ptr<faiss::Index> create_base_faiss_index(size_t embedding_rank, const VectorStoreParams& params)
+{
+    const auto dim = static_cast<faiss::idx_t>(embedding_rank);
+
+    switch(params.index_type)
+    {
+        case VectorIndexType::FLAT:
+            return std::make_unique<faiss::IndexFlatIP>(dim);
+        case VectorIndexType::IVF_FLAT:
+        {
+            auto index = std::make_unique<faiss::IndexIVFFlat>(new faiss::IndexFlatIP(dim), embedding_rank,
+                                                               params.ivf_nlist, faiss::METRIC_INNER_PRODUCT);
+            index->own_fields = true;
+            index->nprobe = std::min(params.ivf_nprobe, params.ivf_nlist);
+            return index;
+        }
+        case VectorIndexType::HNSW:
+        {
+            auto index = std::make_unique<faiss::IndexHNSWFlat>(static_cast<int>(embedding_rank),
+                                                                static_cast<int>(params.hnsw_m),
+                                                                faiss::METRIC_INNER_PRODUCT);
+            index->hnsw.efSearch = static_cast<int>(params.hnsw_ef_search);
+            index->hnsw.efConstruction = static_cast<int>(params.hnsw_ef_construction);
+            return index;
+        }
+        case VectorIndexType::SQ8:
+            return std::make_unique<faiss::IndexScalarQuantizer>(
+                static_cast<int>(embedding_rank), faiss::ScalarQuantizer::QT_8bit, faiss::METRIC_INNER_PRODUCT);
+        case VectorIndexType::SQ_FP16:
+            return std::make_unique<faiss::IndexScalarQuantizer>(
+                static_cast<int>(embedding_rank), faiss::ScalarQuantizer::QT_fp16, faiss::METRIC_INNER_PRODUCT);
+        case VectorIndexType::PQ:
+            if(params.pq_m == 0 || embedding_rank % params.pq_m != 0)
+            {
+                throw std::logic_error(fmt::format("PQ sub-quantizers count: {} must divide the embedding rank: {}",
+                                                   params.pq_m, embedding_rank));
+            }
+            return std::make_unique<faiss::IndexPQ>(static_cast<int>(embedding_rank), params.pq_m, PQ_NBITS,
+                                                    faiss::METRIC_INNER_PRODUCT);
+        case VectorIndexType::BINARY:
+        case VectorIndexType::NATIVE_FLAT:
+            break;
+    }
+
+    throw std::logic_error("Unsupported vector index type.");
+}
+
+static std::unique_ptr<faiss::Index> create_refine_index(size_t embedding_rank, VectorRefineType refine_type)
+{
+    switch(refine_type)
+    {
+        case VectorRefineType::NONE:
+            return nullptr;
+        case VectorRefineType::FP16:
+            return std::make_unique<faiss::IndexScalarQuantizer>(
+                static_cast<int>(embedding_rank), faiss::ScalarQuantizer::QT_fp16, faiss::METRIC_INNER_PRODUCT);
+        case VectorRefineType::FP32:
+            return std::make_unique<faiss::IndexFlatIP>(static_cast<faiss::idx_t>(embedding_rank));
+    }
+
+    throw std::logic_error("Unsupported vector refine type.");
+}
+
+static std::unique_ptr<faiss::Index> create_faiss_index(size_t embedding_rank, const VectorStoreParams& params)
+{
+    auto base_index = create_base_faiss_index(embedding_rank, params);
+    if(params.index_type == VectorIndexType::FLAT)
+        return base_index;
+
+    auto refine_index = create_refine_index(embedding_rank, params.refine_type);
+    if(!refine_index)
+        return base_index;
+
+    auto index = std::make_unique<faiss::IndexRefine>(base_index.release(), refine_index.release());
+    index->own_fields = true;
+    index->own_refine_index = true;
+    index->k_factor = static_cast<float>(params.refine_k_factor);
+    return index;
+}
+
+// The reconstructed vectors come from the refine copies when there are any, otherwise from the base index.
+static bool reconstructs_exactly(const VectorStoreParams& params)
+{
+    if(params.index_type == VectorIndexType::FLAT)
+        return true;
+
+    switch(params.refine_type)
+    {
+        case VectorRefineType::FP32:
+            return true;
+        case VectorRefineType::FP16:
+            return false;
+        case VectorRefineType::NONE:
+            break;
+    }
+
+    return params.index_type == VectorIndexType::IVF_FLAT || params.index_type == VectorIndexType::HNSW;
+}
+
+static size_t get_min_training_size(const VectorStoreParams& params)
+{
+    switch(params.index_type)
+    {
+        case VectorIndexType::IVF_FLAT:
+            return params.ivf_nlist * TRAINING_POINTS_PER_CENTROID;
+        case VectorIndexType::PQ:
+            return (size_t{1} << PQ_NBITS) * TRAINING_POINTS_PER_CENTROID;
+        case VectorIndexType::SQ8:
+            return SQ8_MIN_TRAINING_SIZE;
+        default:
+            return 0;
+    }
+}
+
+// Checks the embeddings rank and copies them into a single L2 normalized row-major buffer.
+static std::vector<float> flatten_normalized(const std::vector<Embedding>& embeddings, size_t embedding_rank)
+{
+    const bool valid_rank = std::all_of(embeddings.begin(), embeddings.end(), [embedding_rank](const auto& embedding)
+                                        { return embedding.size() == embedding_rank; });
+    if(!valid_rank)
+    {
+        throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", embedding_rank));
+    }
+
+    std::vector<float> embeddings_flattened;
+    embeddings_flattened.reserve(embeddings.size() * embedding_rank);
+    std::for_each(embeddings.begin(), embeddings.end(),
+                  [&embeddings_flattened](const auto& embedding)
+                  { embeddings_flattened.insert(embeddings_flattened.end(), embedding.begin(), embedding.end()); });
+
+    // L2 norm all vector embeddings in batch.
+    faiss::fvec_renorm_L2(embedding_rank, embeddings.size(), embeddings_flattened.data());
+
+    return embeddings_flattened;
+}
+
+static void check_reconstruct_range(size_t first, size_t n, size_t size)
+{
+    if(first + n > size)
+    {
+        throw std::out_of_range(
+            fmt::format("Cannot reconstruct vectors [{}, {}), the store holds {} vectors", first, first + n, size));
+    }
+}
+
+static void check_keep_size(const IndexBitmap& keep, size_t size)
+{
+    if(keep.size() != size)
+    {
+        throw std::logic_error(
+            fmt::format("Compaction filter size: {} does not match the store size: {}", keep.size(), size));
+    }
+}
+
+// Checks the embeddings rank and L2 normalizes the matrix in place.
+static void normalize_in_place(EmbeddingMatrix& embeddings, size_t embedding_rank)
+{
+    if(!embeddings.empty() && embeddings.rank() != embedding_rank)
+    {
+        throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", embedding_rank));
+    }
+
+    faiss::fvec_renorm_L2(embedding_rank, embeddings.rows(), embeddings.data());
+}
+
+// In-memory copy of the (memory mapped) inverted lists.
+static std::unique_ptr<faiss::ArrayInvertedLists> copy_to_array_lists(const faiss::InvertedLists& source_lists)
+{
+    auto lists = std::make_unique<faiss::ArrayInvertedLists>(source_lists.nlist, source_lists.code_size);
+    for(size_t list_no = 0; list_no < source_lists.nlist; list_no++)
+    {
+        faiss::InvertedLists::ScopedIds ids(&source_lists, list_no);
+        faiss::InvertedLists::ScopedCodes codes(&source_lists, list_no);
+        lists->add_entries(list_no, source_lists.list_size(list_no), ids.get(), codes.get());
+    }
+
+    return lists;
+}
+
+// faiss::clone_index supports the in-memory inverted lists only, the memory mapped ones are copied into the clone.
+static std::unique_ptr<faiss::Index> clone_faiss_index(const faiss::Index& index)
+{
+    if(const auto* refine_index = dynamic_cast<const faiss::IndexRefine*>(&index))
+    {
+        auto base_index = clone_faiss_index(*refine_index->base_index);
+        std::unique_ptr<faiss::Index> refine_vectors(faiss::clone_index(refine_index->refine_index));
+
+        auto cloned_index = std::make_unique<faiss::IndexRefine>(*refine_index);
+        cloned_index->base_index = base_index.release();
+        cloned_index->refine_index = refine_vectors.release();
+        cloned_index->own_fields = true;
+        cloned_index->own_refine_index = true;
+        return cloned_index;
+    }
+
+    const auto* ivf_index = dynamic_cast<const faiss::IndexIVFFlat*>(&index);
+    if(ivf_index == nullptr || dynamic_cast<const faiss::OnDiskInvertedLists*>(ivf_index->invlists) == nullptr)
+        return std::unique_ptr<faiss::Index>(faiss::clone_index(&index));
+
+    std::unique_ptr<faiss::Index> quantizer(faiss::clone_index(ivf_index->quantizer));
+    auto lists = copy_to_array_lists(*ivf_index->invlists);
+
+    auto cloned_index = std::make_unique<faiss::IndexIVFFlat>(*ivf_index);
+    cloned_index->quantizer = quantizer.release();
+    cloned_index->own_fields = true;
+    cloned_index->invlists = lists.release();
+    cloned_index->own_invlists = true;
+    return cloned_index;
+}
+
 class FaissIndexDatabase : public IVectorStore
 {
   public:
-    explicit FaissIndexDatabase(size_t embedding_rank) : embedding_rank_(embedding_rank), index_(embedding_rank) {}
+    explicit FaissIndexDatabase(size_t embedding_rank, const VectorStoreParams& params)
+        : embedding_rank_(embedding_rank), params_(params), min_training_size_(get_min_training_size(params)),
+          index_(create_faiss_index(embedding_rank, params)),
+          staging_index_(std::make_unique<faiss::IndexFlatIP>(static_cast<faiss::idx_t>(embedding_rank)))
+    {
+    }
 
-    void add(const std::vector<Embedding>& embeddings) override
+    using IVectorStore::add;
+
+    void add(EmbeddingMatrix embeddings) override
     {
-        if(!check_embeddings_size_(embeddings))
+        normalize_in_place(embeddings, embedding_rank_);
+
+        const float* data_to_add = embeddings.data();
+        const auto num_vectors_to_add = static_cast<faiss::idx_t>(embeddings.rows());
+
+        if(index_->is_trained)
         {
-            throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", embedding_rank_));
+            materialize_mapped_lists_();
+            index_->add(num_vectors_to_add, data_to_add);
+            return;
         }
 
-        std::vector<float> embeddings_flattened;
-        embeddings_flattened.reserve(embeddings.size() * embedding_rank_);
-        std::for_each(embeddings.begin(), embeddings.end(),
-                      [&embeddings_flattened](const auto& embedding)
-                      { embeddings_flattened.insert(embeddings_flattened.end(), embedding.begin(), embedding.end()); });
+        // The index requires training, keep the vectors in an exhaustive index until there is enough of them.
+        staging_index_->add(num_vectors_to_add, data_to_add);
+        train_if_possible_();
+    }
 
-        float* data_to_add = embeddings_flattened.data();
-        size_t num_vectors_to_add = embeddings.size();
+    std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) const override
+    {
+        // Copy the vector, we must L2 normalize the vector before performing search.
+        const auto query = flatten_normalized({values}, embedding_rank_);
 
-        // L2 norm all vector embeddings in batch.
-        faiss::fvec_renorm_L2(embedding_rank_, num_vectors_to_add, data_to_add);
-        index_.add(num_vectors_to_add, data_to_add);
+        return search_(query, 1, top_k)[0];
     }
 
-    std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) override
+    std::vector<std::vector<RetrievedIndex>> retrieve_batch(const std::vector<Embedding>& values,
+                                                            uint32_t top_k) const override
     {
-        if(values.size() != embedding_rank_)
+        const auto queries = flatten_normalized(values, embedding_rank_);
+        if(values.empty())
+            return {};
+
+        return search_(queries, values.size(), top_k);
+    }
+
+    std::vector<RetrievedIndex> retrieve_filtered(const std::vector<float>& values, uint32_t top_k,
+                                                  const IndexBitmap& filter) const override
+    {
+        const auto query = flatten_normalized({values}, embedding_rank_);
+
+        const auto& index = active_index_();
+        const auto search_params = create_search_params_(index);
+        if(filter.count() * SELECTIVE_FILTER_RATIO < size())
+            return scan_filtered_(index, query, top_k, filter);
+        if(!search_params)
+            return search_overfetched_(query, top_k, filter);
+
+        faiss::IDSelectorBitmap selector(filter.bytes().size(), filter.bytes().data());
+        search_params->sel = &selector;
+        return search_(query, 1, top_k, search_params.get())[0];
+    }
+
+    EmbeddingMatrix reconstruct(size_t first, size_t n) const override
+    {
+        check_reconstruct_range(first, n, size());
+
+        EmbeddingMatrix embeddings(n, embedding_rank_);
+        if(n > 0)
+            active_index_().reconstruct_n(static_cast<faiss::idx_t>(first), static_cast<faiss::idx_t>(n),
+                                          embeddings.data());
+
+        return embeddings;
+    }
+
+    // Until the index is trained the vectors are kept in the exhaustive staging index.
+    bool reconstructs_exactly() const override { return !index_->is_trained || ds::reconstructs_exactly(params_); }
+
+    std::unique_ptr<IVectorStore> compacted(const IndexBitmap& keep) const override
+    {
+        check_keep_size(keep, size());
+        auto compacted_store = std::make_unique<FaissIndexDatabase>(embedding_rank_, params_);
+
+        // The exhaustive and the quantized indices remove the vectors in place, keeping the codes and the training.
+        if(dynamic_cast<const faiss::IndexFlatCodes*>(index_.get()) != nullptr)
         {
-            throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", embedding_rank_));
+            const faiss::IDSelectorBitmap keep_selector(keep.bytes().size(), keep.bytes().data());
+            const faiss::IDSelectorNot remove_selector(&keep_selector);
+
+            compacted_store->index_.reset(faiss::clone_index(index_.get()));
+            compacted_store->index_->remove_ids(remove_selector);
+            compacted_store->staging_index_.reset(
+                dynamic_cast<faiss::IndexFlat*>(faiss::clone_index(staging_index_.get())));
+            compacted_store->staging_index_->remove_ids(remove_selector);
+            return compacted_store;
         }
 
-        std::vector<RetrievedIndex> retrieved_indices;
-        retrieved_indices.reserve(top_k);
-        std::vector<float> distances(top_k);
-        std::vector<faiss::idx_t> labels(top_k);
+        // IVF and HNSW don't renumber on removal, their exact vectors (or the refine ones) are indexed again instead.
+        std::vector<size_t> kept_indices;
+        keep.for_each_set([&kept_indices](size_t idx) { kept_indices.push_back(idx); });
 
-        // Copy the vector, we must L2 normalize the vector before performing search.
-        std::vector<float> embeddings_cpy(values);
-
-        // The magic "1" is just to indicate the API that we're launching lookup for only one values vector
-        // The faiss API can also lookup for multiple embeddings at the same call (in batch basically).
-        // But it's not our case yet.
-        faiss::fvec_renorm_L2(embedding_rank_, 1, embeddings_cpy.data());
-        index_.search(1, embeddings_cpy.data(), static_cast<faiss::idx_t>(top_k), distances.data(), labels.data());
-
-        // last step - retrieval of the actual chunks.
-        std::transform(labels.begin(), labels.end(), distances.begin(), std::back_inserter(retrieved_indices),
-                       [this](const faiss::idx_t& label, const float& distance) -> RetrievedIndex
-                       {
-                           const auto idx = static_cast<size_t>(label);
-                           return RetrievedIndex{idx, distance};
-                       });
+        const auto& index = active_index_();
+        for(size_t block_begin = 0; block_begin < kept_indices.size(); block_begin += COMPACTION_BLOCK_SIZE)
+        {
+            const size_t block_size = std::min(COMPACTION_BLOCK_SIZE, kept_indices.size() - block_begin);
+            EmbeddingMatrix embeddings(block_size, embedding_rank_);
+            for(size_t i = 0; i < block_size; i++)
+                index.reconstruct(static_cast<faiss::idx_t>(kept_indices[block_begin + i]), embeddings.row(i).data());
+
+            compacted_store->add(std::move(embeddings));
+        }
+
+        return compacted_store;
+    }
+
+    std::unique_ptr<IVectorStore> clone() const override
+    {
+        auto cloned_store = std::make_unique<FaissIndexDatabase>(embedding_rank_, params_);
+        cloned_store->index_ = clone_faiss_index(*index_);
+        cloned_store->staging_index_.reset(dynamic_cast<faiss::IndexFlat*>(faiss::clone_index(staging_index_.get())));
+
+        return cloned_store;
+    }
+
+    std::unique_ptr<IVectorStore> empty_like() const override
+    {
+        return std::make_unique<FaissIndexDatabase>(embedding_rank_, params_);
+    }
+
+    size_t size() const override { return static_cast<size_t>(index_->ntotal + staging_index_->ntotal); }
+
+    size_t get_memory_usage_bytes() const override
+    {
+        // faiss has no memory accounting, the serialized size of the indices is a close approximation.
+        faiss::VectorIOWriter writer;
+        faiss::write_index(index_.get(), &writer);
+        faiss::write_index(staging_index_.get(), &writer);
+
+        return writer.data.size();
+    }
+
+    void save(const std::filesystem::path& path) const override
+    {
+        faiss::FileIOWriter writer(path.c_str());
+        faiss::write_index(staging_index_.get(), &writer);
+        faiss::write_index(index_.get(), &writer);
+    }
+
+    void load(const std::filesystem::path& path) override
+    {
+        faiss::FileIOReader reader(path.c_str());
+
+        std::unique_ptr<faiss::Index> staging_index(faiss::read_index(&reader));
+        // The inverted lists of IVF indices are memory mapped straight from the file, other index types ignore it.
+        std::unique_ptr<faiss::Index> index(faiss::read_index(&reader, faiss::IO_FLAG_MMAP | faiss::IO_FLAG_READ_ONLY));
+
+        auto* staging_flat_index = dynamic_cast<faiss::IndexFlat*>(staging_index.get());
+        if(staging_flat_index == nullptr || index->d != static_cast<int>(embedding_rank_) ||
+           staging_index->d != static_cast<int>(embedding_rank_))
+        {
+            throw std::runtime_error(
+                fmt::format("Vector index file: {} does not match the expected rank: {}", path.c_str(), embedding_rank_));
+        }
+
+        staging_index.release();
+        staging_index_.reset(staging_flat_index);
+        index_ = std::move(index);
+        ensure_direct_map_();
+    }
+
+  private:
+    size_t embedding_rank_;
+    VectorStoreParams params_;
+    size_t min_training_size_;
+    std::unique_ptr<faiss::Index> index_;
+    std::unique_ptr<faiss::IndexFlat> staging_index_;
+
+    void train_if_possible_()
+    {
+        const auto n_staged = static_cast<size_t>(staging_index_->ntotal);
+        if(n_staged < min_training_size_)
+            return;
+
+        spdlog::debug("Training the vector index on {} vectors.", n_staged);
+
+        const float* staged_vectors = staging_index_->get_xb();
+        materialize_mapped_lists_();
+        index_->train(staging_index_->ntotal, staged_vectors);
+        ensure_direct_map_();
+        index_->add(staging_index_->ntotal, staged_vectors);
+        staging_index_->reset();
+    }
+
+    const faiss::Index& active_index_() const
+    {
+        if(index_->is_trained)
+            return *index_;
+
+        return *staging_index_;
+    }
+
+    faiss::IndexIVF* ivf_index_() const
+    {
+        auto* index = index_.get();
+        if(auto* refine_index = dynamic_cast<faiss::IndexRefine*>(index))
+            index = refine_index->base_index;
+
+        return dynamic_cast<faiss::IndexIVF*>(index);
+    }
+
+    // IVF indices reconstruct single vectors through the id to inverted list mapping.
+    void ensure_direct_map_()
+    {
+        auto* ivf_index = ivf_index_();
+        if(ivf_index != nullptr && ivf_index->is_trained && ivf_index->direct_map.no())
+            ivf_index->make_direct_map(true);
+    }
+
+    // Memory mapped inverted lists are read only, they are copied to memory before the first addition.
+    void materialize_mapped_lists_()
+    {
+        auto* ivf_index = ivf_index_();
+        if(ivf_index == nullptr || dynamic_cast<faiss::OnDiskInvertedLists*>(ivf_index->invlists) == nullptr)
+            return;
+
+        ivf_index->replace_invlists(copy_to_array_lists(*ivf_index->invlists).release(), true);
+    }
+
+    // Search parameters with the current settings of the index, the IDSelector is supported only by the exhaustive,
+    // IVF and HNSW indices. Returns nullptr for the other ones.
+    static std::unique_ptr<faiss::SearchParameters> create_search_params_(const faiss::Index& index)
+    {
+        if(const auto* ivf_index = dynamic_cast<const faiss::IndexIVF*>(&index))
+        {
+            auto params = std::make_unique<faiss::SearchParametersIVF>();
+            params->nprobe = ivf_index->nprobe;
+            return params;
+        }
+        if(const auto* hnsw_index = dynamic_cast<const faiss::IndexHNSW*>(&index))
+        {
+            auto params = std::make_unique<faiss::SearchParametersHNSW>();
+            params->efSearch = hnsw_index->hnsw.efSearch;
+            return params;
+        }
+        if(dynamic_cast<const faiss::IndexFlat*>(&index) != nullptr)
+            return std::make_unique<faiss::SearchParameters>();
+
+        return nullptr;
+    }
+
+    std::vector<RetrievedIndex> search_overfetched_(const std::vector<float>& query, uint32_t top_k,
+                                                    const IndexBitmap& filter) const
+    {
+        for(size_t n_candidates = static_cast<size_t>(top_k) * FILTER_OVERFETCH_FACTOR;;
+            n_candidates *= FILTER_OVERFETCH_FACTOR)
+        {
+            const bool exhaustive = n_candidates >= size();
+            auto candidates = search_(query, 1, static_cast<uint32_t>(std::min(n_candidates, size())))[0];
+            std::erase_if(candidates, [&filter](const RetrievedIndex& candidate) { return !filter.test(candidate.index); });
+
+            if(candidates.size() >= top_k || exhaustive)
+            {
+                if(candidates.size() > top_k)
+                    candidates.resize(top_k);
+                return candidates;
+            }
+        }
+    }
+
+    std::vector<RetrievedIndex> scan_filtered_(const faiss::Index& index, const std::vector<float>& query,
+                                               uint32_t top_k, const IndexBitmap& filter) const
+    {
+        std::vector<RetrievedIndex> candidates;
+        std::vector<float> candidate(embedding_rank_);
+        filter.for_each_set(
+            [&](size_t idx)
+            {
+                if(idx >= size())
+                    return;
+
+                index.reconstruct(static_cast<faiss::idx_t>(idx), candidate.data());
+                candidates.push_back(
+                    RetrievedIndex{idx, faiss::fvec_inner_product(query.data(), candidate.data(), embedding_rank_)});
+            });
+
+        keep_top_k(candidates, top_k);
+        return candidates;
+    }
+
+    // Searches all the normalized queries stored row by row in the `queries` buffer with a single faiss call.
+    std::vector<std::vector<RetrievedIndex>> search_(const std::vector<float>& queries, size_t n_queries,
+                                                     uint32_t top_k,
+                                                     const faiss::SearchParameters* params = nullptr) const
+    {
+        std::vector<float> distances(n_queries * top_k);
+        std::vector<faiss::idx_t> labels(n_queries * top_k);
+
+        active_index_().search(static_cast<faiss::idx_t>(n_queries), queries.data(),
+                               static_cast<faiss::idx_t>(top_k), distances.data(), labels.data(), params);
+
+        std::vector<std::vector<RetrievedIndex>> retrieved_indices(n_queries);
+        for(size_t query_idx = 0; query_idx < n_queries; query_idx++)
+        {
+            auto& query_result = retrieved_indices[query_idx];
+            query_result.reserve(top_k);
+
+            for(size_t i = query_idx * top_k; i < (query_idx + 1) * top_k; i++)
+            {
+                // faiss pads the result with -1 labels when there are less than top_k vectors indexed.
+                if(labels[i] < 0)
+                    break;
+
+                query_result.push_back(RetrievedIndex{static_cast<size_t>(labels[i]), distances[i]});
+            }
+        }
 
         return retrieved_indices;
     }
+};
+
+// Sign quantized index, every embedding dimension is stored as a single bit. The Hamming distance scan shortlists
+// top_k * refine_k_factor candidates, which are re-ranked by the cosine similarity against fp16/fp32 copies of the
+// vectors. Without the refine store the similarity is estimated from the Hamming distance.
+class BinaryFaissIndexDatabase : public IVectorStore
+{
+  public:
+    explicit BinaryFaissIndexDatabase(size_t embedding_rank, const VectorStoreParams& params)
+        : embedding_rank_(embedding_rank), params_(params), code_bits_((embedding_rank + 7) / 8 * 8),
+          refine_k_factor_(std::max<size_t>(params.refine_k_factor, 1)),
+          binary_index_(std::make_unique<faiss::IndexBinaryFlat>(static_cast<faiss::idx_t>(code_bits_))),
+          refine_index_(create_refine_index(embedding_rank, params.refine_type))
+    {
+    }
+
+    using IVectorStore::add;
+
+    void add(EmbeddingMatrix embeddings) override
+    {
+        normalize_in_place(embeddings, embedding_rank_);
+        const auto n_embeddings = static_cast<faiss::idx_t>(embeddings.rows());
+        const auto codes = binarize_(std::span<const float>(embeddings.data(), embeddings.rows() * embedding_rank_),
+                                     embeddings.rows());
+
+        binary_index_->add(n_embeddings, codes.data());
+        if(refine_index_)
+            refine_index_->add(n_embeddings, embeddings.data());
+    }
+
+    std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) const override
+    {
+        const auto query = flatten_normalized({values}, embedding_rank_);
+
+        return search_(query, 1, top_k)[0];
+    }
+
+    std::vector<std::vector<RetrievedIndex>> retrieve_batch(const std::vector<Embedding>& values,
+                                                            uint32_t top_k) const override
+    {
+        const auto queries = flatten_normalized(values, embedding_rank_);
+        if(values.empty())
+            return {};
+
+        return search_(queries, values.size(), top_k);
+    }
+
+    std::vector<RetrievedIndex> retrieve_filtered(const std::vector<float>& values, uint32_t top_k,
+                                                  const IndexBitmap& filter) const override
+    {
+        const auto query = flatten_normalized({values}, embedding_rank_);
+
+        return search_filtered_(query, top_k, filter);
+    }
+
+    EmbeddingMatrix reconstruct(size_t first, size_t n) const override
+    {
+        check_reconstruct_range(first, n, size());
+
+        EmbeddingMatrix embeddings(n, embedding_rank_);
+        if(n == 0)
+            return embeddings;
+
+        if(refine_index_)
+        {
+            refine_index_->reconstruct_n(static_cast<faiss::idx_t>(first), static_cast<faiss::idx_t>(n),
+                                         embeddings.data());
+            return embeddings;
+        }
+
+        // Only the signs are stored, the closest normalized vector has all the values of the same magnitude.
+        const float magnitude = 1.f / std::sqrt(static_cast<float>(embedding_rank_));
+        std::vector<uint8_t> code(code_bits_ / 8);
+        for(size_t i = 0; i < n; i++)
+        {
+            binary_index_->reconstruct(static_cast<faiss::idx_t>(first + i), code.data());
+            auto embedding = embeddings.row(i);
+            for(size_t dim = 0; dim < embedding_rank_; dim++)
+                embedding[dim] = (code[dim / 8] >> (dim % 8)) & 1 ? magnitude : -magnitude;
+        }
+
+        return embeddings;
+    }
+
+    bool reconstructs_exactly() const override { return params_.refine_type == VectorRefineType::FP32; }
+
+    std::unique_ptr<IVectorStore> compacted(const IndexBitmap& keep) const override
+    {
+        check_keep_size(keep, size());
+        auto compacted_store = std::make_unique<BinaryFaissIndexDatabase>(embedding_rank_, params_);
+
+        const size_t code_size = code_bits_ / 8;
+        std::vector<uint8_t> codes;
+        std::vector<float> refine_vectors;
+        std::vector<float> refine_vector(embedding_rank_);
+        keep.for_each_set(
+            [&](size_t idx)
+            {
+                const auto code = binary_index_->xb.begin() + static_cast<std::ptrdiff_t>(idx * code_size);
+                codes.insert(codes.end(), code, code + static_cast<std::ptrdiff_t>(code_size));
+                if(refine_index_)
+                {
+                    refine_index_->reconstruct(static_cast<faiss::idx_t>(idx), refine_vector.data());
+                    refine_vectors.insert(refine_vectors.end(), refine_vector.begin(), refine_vector.end());
+                }
+            });
+
+        const auto n_kept = static_cast<faiss::idx_t>(codes.size() / code_size);
+        compacted_store->binary_index_->add(n_kept, codes.data());
+        if(refine_index_)
+            compacted_store->refine_index_->add(n_kept, refine_vectors.data());
+
+        return compacted_store;
+    }
+
+    std::unique_ptr<IVectorStore> clone() const override
+    {
+        auto cloned_store = std::make_unique<BinaryFaissIndexDatabase>(embedding_rank_, params_);
+        cloned_store->binary_index_ = std::make_unique<faiss::IndexBinaryFlat>(*binary_index_);
+        if(refine_index_)
+            cloned_store->refine_index_.reset(faiss::clone_index(refine_index_.get()));
+
+        return cloned_store;
+    }
+
+    std::unique_ptr<IVectorStore> empty_like() const override
+    {
+        return std::make_unique<BinaryFaissIndexDatabase>(embedding_rank_, params_);
+    }
+
+    size_t size() const override { return static_cast<size_t>(binary_index_->ntotal); }
+
+    size_t get_memory_usage_bytes() const override
+    {
+        faiss::VectorIOWriter writer;
+        faiss::write_index_binary(binary_index_.get(), &writer);
+        if(refine_index_)
+            faiss::write_index(refine_index_.get(), &writer);
+
+        return writer.data.size();
+    }
+
+    void save(const std::filesystem::path& path) const override
+    {
+        faiss::FileIOWriter writer(path.c_str());
+        faiss::write_index_binary(binary_index_.get(), &writer);
+        if(refine_index_)
+            faiss::write_index(refine_index_.get(), &writer);
+    }
+
+    void load(const std::filesystem::path& path) override
+    {
+        faiss::FileIOReader reader(path.c_str());
+
+        std::unique_ptr<faiss::IndexBinary> binary_index(faiss::read_index_binary(&reader));
+        auto* binary_flat_index = dynamic_cast<faiss::IndexBinaryFlat*>(binary_index.get());
+        if(binary_flat_index == nullptr || binary_flat_index->d != static_cast<int>(code_bits_))
+        {
+            throw std::runtime_error(
+                fmt::format("Vector index file: {} does not match the expected rank: {}", path.c_str(), embedding_rank_));
+        }
+
+        if(refine_index_)
+            refine_index_.reset(faiss::read_index(&reader));
+
+        binary_index.release();
+        binary_index_.reset(binary_flat_index);
+    }
 
   private:
     size_t embedding_rank_;
-    faiss::IndexFlatIP index_;
+    VectorStoreParams params_;
+    size_t code_bits_;
+    size_t refine_k_factor_;
+    std::unique_ptr<faiss::IndexBinaryFlat> binary_index_;
+    std::unique_ptr<faiss::Index> refine_index_;
+
+    // Packs the sign of every dimension into bits, the padding bits up to the byte boundary stay zeroed.
+    std::vector<uint8_t> binarize_(std::span<const float> embeddings, size_t n_embeddings) const
+    {
+        const size_t code_size = code_bits_ / 8;
+        std::vector<uint8_t> codes(n_embeddings * code_size, 0);
+
+        for(size_t i = 0; i < n_embeddings; i++)
+        {
+            const float* embedding = embeddings.data() + i * embedding_rank_;
+            uint8_t* code = codes.data() + i * code_size;
+            for(size_t dim = 0; dim < embedding_rank_; dim++)
+            {
+                if(embedding[dim] > 0.f)
+                    code[dim / 8] |= static_cast<uint8_t>(1u << (dim % 8));
+            }
+        }
+
+        return codes;
+    }
+
+    float estimate_similarity_(int32_t hamming_distance) const
+    {
+        // For random hyperplanes the probability of a differing sign is angle / pi.
+        return std::cos(std::numbers::pi_v<float> * static_cast<float>(hamming_distance) / embedding_rank_);
+    }
+
+    std::vector<std::vector<RetrievedIndex>> search_(const std::vector<float>& queries, size_t n_queries,
+                                                     uint32_t top_k) const
+    {
+        const size_t n_candidates = refine_index_ ? top_k * refine_k_factor_ : top_k;
+        const auto codes = binarize_(queries, n_queries);
+
+        std::vector<int32_t> distances(n_queries * n_candidates);
+        std::vector<faiss::idx_t> labels(n_queries * n_candidates);
+        binary_index_->search(static_cast<faiss::idx_t>(n_queries), codes.data(),
+                             static_cast<faiss::idx_t>(n_candidates), distances.data(), labels.data());
+
+        std::vector<std::vector<RetrievedIndex>> retrieved_indices(n_queries);
+        for(size_t query_idx = 0; query_idx < n_queries; query_idx++)
+        {
+            auto& query_result = retrieved_indices[query_idx];
+            query_result.reserve(n_candidates);
+
+            for(size_t i = query_idx * n_candidates; i < (query_idx + 1) * n_candidates; i++)
+            {
+                if(labels[i] < 0)
+                    break;
 
-    bool check_embeddings_size_(const std::vector<Embedding>& embeddings) const
+                query_result.push_back(
+                    RetrievedIndex{static_cast<size_t>(labels[i]), estimate_similarity_(distances[i])});
+            }
+
+            rerank_(queries.data() + query_idx * embedding_rank_, query_result, top_k);
+        }
+
+        return retrieved_indices;
+    }
+
+    // The IndexBinaryFlat search doesn't take an IDSelector, the selected codes are compared directly.
+    std::vector<RetrievedIndex> search_filtered_(const std::vector<float>& query, uint32_t top_k,
+                                                 const IndexBitmap& filter) const
     {
-        return std::all_of(embeddings.begin(), embeddings.end(),
-                           [this](const auto& embedding) -> bool { return embedding.size() == embedding_rank_; });
+        const size_t code_size = code_bits_ / 8;
+        const auto query_code = binarize_(query, 1);
+
+        std::vector<RetrievedIndex> candidates;
+        filter.for_each_set(
+            [&](size_t idx)
+            {
+                if(idx >= size())
+                    return;
+
+                const uint8_t* code = binary_index_->xb.data() + idx * code_size;
+                int32_t hamming_distance = 0;
+                for(size_t byte = 0; byte < code_size; byte++)
+                    hamming_distance += std::popcount(static_cast<uint8_t>(code[byte] ^ query_code[byte]));
+
+                candidates.push_back(RetrievedIndex{idx, estimate_similarity_(hamming_distance)});
+            });
+
+        keep_top_k(candidates, refine_index_ ? top_k * refine_k_factor_ : top_k);
+        rerank_(query.data(), candidates, top_k);
+        return candidates;
+    }
+
+    // Re-scores the Hamming shortlist against the refine index, when there is one, and keeps the best top_k.
+    void rerank_(const float* query, std::vector<RetrievedIndex>& candidates, uint32_t top_k) const
+    {
+        if(refine_index_)
+        {
+            std::vector<float> candidate(embedding_rank_);
+            for(auto& retrieved_index : candidates)
+            {
+                refine_index_->reconstruct(static_cast<faiss::idx_t>(retrieved_index.index), candidate.data());
+                retrieved_index.cosine_similarity = faiss::fvec_inner_product(query, candidate.data(), embedding_rank_);
+            }
+        }
+
+        std::ranges::stable_sort(candidates, std::ranges::greater{}, &RetrievedIndex::cosine_similarity);
+        if(candidates.size() > top_k)
+            candidates.resize(top_k);
     }
 };
 
-std::unique_ptr<IVectorStore> vector_store_factory(size_t embedding_rank)
+std::unique_ptr<IVectorStore> vector_store_factory(size_t embedding_rank, const VectorStoreParams& params)
 {
-    return std::make_unique<FaissIndexDatabase>(embedding_rank);
+    if(params.index_type == VectorIndexType::BINARY)
+        return std::make_unique<BinaryFaissIndexDatabase>(embedding_rank, params);
+    if(params.index_type == VectorIndexType::NATIVE_FLAT)
+        return create_native_vector_store(embedding_rank);
+
+    return std::make_unique<FaissIndexDatabase>(embedding_rank, params);
 }
 
 } // namespace ds
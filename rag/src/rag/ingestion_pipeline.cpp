@@ -0,0 +1,57 @@
+#include "ingestion_pipeline.h"
+
+#include "ordered_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <spdlog/spdlog.h>
+
+namespace ds
+{
+constexpr size_t PENDING_BLOCKS_PER_THREAD = 2;
+constexpr auto PROGRESS_REPORT_INTERVAL = std::chrono::seconds(1);
+
+void run_ingestion_pipeline(size_t n_chunks, size_t n_threads, const EmbedBlockFn& embed_block,
+                            const IndexBlockFn& index_block)
+{
+    using namespace std::chrono;
+
+    const size_t n_blocks = (n_chunks + INGESTION_BLOCK_SIZE - 1) / INGESTION_BLOCK_SIZE;
+    n_threads = std::clamp<size_t>(n_threads, 1, std::max<size_t>(n_blocks, 1));
+    const auto block_range = [n_chunks](size_t block)
+    {
+        const size_t block_begin = block * INGESTION_BLOCK_SIZE;
+        return std::pair{block_begin, std::min(INGESTION_BLOCK_SIZE, n_chunks - block_begin)};
+    };
+
+    const auto start = steady_clock::now();
+    auto last_report = start;
+    run_ordered_pipeline<EmbeddingMatrix>(
+        n_blocks, n_threads, n_threads * PENDING_BLOCKS_PER_THREAD,
+        [&embed_block, &block_range](size_t block)
+        {
+            const auto [block_begin, block_size] = block_range(block);
+            return embed_block(block_begin, block_size);
+        },
+        [&](size_t block, EmbeddingMatrix&& embeddings)
+        {
+            const auto [block_begin, block_size] = block_range(block);
+            index_block(block_begin, block_size, std::move(embeddings));
+
+            const auto now = steady_clock::now();
+            if(now - last_report >= PROGRESS_REPORT_INTERVAL)
+            {
+                const size_t n_indexed = block_begin + block_size;
+                spdlog::info("Ingested {} of {} chunks, {:.1f} chunks/s.", n_indexed, n_chunks,
+                             n_indexed / duration<double>(now - start).count());
+                last_report = now;
+            }
+        });
+
+    if(n_chunks > 0)
+    {
+        spdlog::debug("Ingested {} chunks on {} threads, {:.1f} chunks/s.", n_chunks, n_threads,
+                      n_chunks / duration<double>(steady_clock::now() - start).count());
+    }
+}
+} // namespace ds
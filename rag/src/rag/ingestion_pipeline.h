@@ -0,0 +1,23 @@
+#pragma once
+
+#include "rag/embedding_matrix.h"
+
+#include <cstddef>
+#include <functional>
+
+namespace ds
+{
+// The chunks are split into blocks of this size, so the indexing of a block overlaps the embedding of the next ones.
+constexpr size_t INGESTION_BLOCK_SIZE = 128;
+
+using EmbedBlockFn = std::function<EmbeddingMatrix(size_t block_begin, size_t block_size)>;
+using IndexBlockFn = std::function<void(size_t block_begin, size_t block_size, EmbeddingMatrix&& embeddings)>;
+
+// Embeds the blocks of the chunks on n_threads workers, the calling thread indexes the embedded blocks as they
+// complete, in the order of the chunks. The workers tokenize their blocks outside of the embedding contexts, so
+// with fewer contexts than workers the tokenization of the next blocks overlaps the decoding. At most two blocks per
+// worker are embedded ahead of the indexing, which bounds the memory of the pending embeddings. The progress is
+// logged with the throughput. The first error of either stage stops the workers and is rethrown.
+void run_ingestion_pipeline(size_t n_chunks, size_t n_threads, const EmbedBlockFn& embed_block,
+                            const IndexBlockFn& index_block);
+} // namespace ds
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "llamacpp/llama.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace ds
+{
+template <typename T>
+using unique_ptr_with_deleter = std::unique_ptr<T, std::function<void(T*)>>;
+
+using LlamaCtxUniquePtr = unique_ptr_with_deleter<llama_context>;
+
+class LlamaBackendManager
+{
+  public:
+    static LlamaBackendManager& get_instance()
+    {
+        static LlamaBackendManager instance;
+        return instance;
+    }
+
+    LlamaBackendManager(const LlamaBackendManager&) = delete;
+    LlamaBackendManager& operator=(const LlamaBackendManager&) = delete;
+    LlamaBackendManager(LlamaBackendManager&&) = delete;
+    LlamaBackendManager& operator=(LlamaBackendManager&&) = delete;
+    ~LlamaBackendManager() { llama_backend_free(); }
+
+  private:
+    LlamaBackendManager() { llama_backend_init(); }
+};
+
+// Decoding thread per context, kept for the lifetime of the contexts, with its own batch of max_batch tokens. The calls
+// queue their batches and wait for them, the idle workers take the batches of the oldest call first, so a single call
+// is spread over all the idle contexts without starting any threads.
+class LlamaDecodeWorkers
+{
+  public:
+    // Fills the batch with the given batch of the call and decodes it on the context.
+    using DecodeFn = std::function<void(llama_context* ctx, llama_batch& batch, size_t batch_idx)>;
+
+    LlamaDecodeWorkers(std::vector<LlamaCtxUniquePtr>&& contexts, int32_t max_batch) : contexts_(std::move(contexts))
+    {
+        workers_.reserve(contexts_.size());
+        for(const auto& ctx : contexts_)
+            workers_.emplace_back([this, ctx = ctx.get(), max_batch]() { work_(ctx, max_batch); });
+    }
+
+    LlamaDecodeWorkers(const LlamaDecodeWorkers&) = delete;
+    LlamaDecodeWorkers& operator=(const LlamaDecodeWorkers&) = delete;
+
+    ~LlamaDecodeWorkers()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        work_available_.notify_all();
+        for(auto& worker : workers_)
+            worker.join();
+    }
+
+    size_t size() const { return contexts_.size(); }
+
+    // Returns the number of the contexts that decoded the batches, rethrows the first error of the decoding.
+    size_t run(size_t n_batches, const DecodeFn& decode_fn)
+    {
+        if(n_batches == 0)
+            return 0;
+
+        std::unique_lock lock(mutex_);
+        Call call{.id = next_call_id_++, .decode_fn = decode_fn, .n_batches = n_batches};
+        calls_.push_back(&call);
+        work_available_.notify_all();
+        call.done.wait(lock, [&call]() { return call.n_finished == call.n_batches; });
+
+        if(call.error)
+            std::rethrow_exception(call.error);
+        return call.n_workers;
+    }
+
+  private:
+    struct Call
+    {
+        uint64_t id;
+        const DecodeFn& decode_fn;
+        size_t n_batches;
+        size_t next_batch = 0;
+        size_t n_finished = 0;
+        size_t n_workers = 0;
+        std::exception_ptr error;
+        std::condition_variable done;
+    };
+
+    std::vector<LlamaCtxUniquePtr> contexts_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    // The calls with batches not taken yet, the oldest first.
+    std::deque<Call*> calls_;
+    uint64_t next_call_id_ = 0;
+    bool stopping_ = false;
+
+    void work_(llama_context* ctx, int32_t max_batch)
+    {
+        auto batch = llama_batch_init(max_batch, 0, 1); // The 0 and 1 values were taken from example.
+        const auto batch_guard =
+            unique_ptr_with_deleter<llama_batch>(&batch, [](llama_batch* b) { llama_batch_free(*b); });
+
+        std::optional<uint64_t> last_call_id;
+        std::unique_lock lock(mutex_);
+        while(true)
+        {
+            work_available_.wait(lock, [this]() { return stopping_ || !calls_.empty(); });
+            if(stopping_)
+                return;
+
+            auto& call = *calls_.front();
+            const size_t batch_idx = call.next_batch++;
+            if(call.next_batch == call.n_batches)
+                calls_.pop_front();
+            if(last_call_id != call.id)
+            {
+                call.n_workers++;
+                last_call_id = call.id;
+            }
+
+            lock.unlock();
+            std::exception_ptr error;
+            try
+            {
+                call.decode_fn(ctx, batch, batch_idx);
+            }
+            catch(...)
+            {
+                error = std::current_exception();
+            }
+            lock.lock();
+
+            // The batches of a failed call that are not taken yet are skipped.
+            if(error && !call.error)
+            {
+                call.error = error;
+                if(call.next_batch < call.n_batches)
+                {
+                    call.n_finished += call.n_batches - call.next_batch;
+                    call.next_batch = call.n_batches;
+                    std::erase(calls_, &call);
+                }
+            }
+            if(++call.n_finished == call.n_batches)
+                call.done.notify_one();
+        }
+    }
+};
+} // namespace ds
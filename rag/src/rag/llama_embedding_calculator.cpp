@@ -1,4 +1,7 @@
+#include "llama_common.h"
 #include "llm/utils.h"
+#include "rag/batch_packing.h"
+#include "rag/embedding_cache.h"
 #include "rag/embedding_calculator.h"
 
 #include "llamacpp/common.h"
@@ -6,39 +9,19 @@
 
 #include <algorithm>
 #include <fmt/format.h>
-#include <functional>
+#include <list>
+#include <mutex>
 #include <numeric>
+#include <optional>
 #include <ranges>
 #include <span>
 #include <spdlog/spdlog.h>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace ds
 {
-template <typename T>
-using unique_ptr_with_deleter = std::unique_ptr<T, std::function<void(T*)>>;
-
-using LlamaCtxUniquePtr = unique_ptr_with_deleter<llama_context>;
-
-class LlamaBackendManager
-{
-  public:
-    static LlamaBackendManager& get_instance()
-    {
-        static LlamaBackendManager instance;
-        return instance;
-    }
-
-    LlamaBackendManager(const LlamaBackendManager&) = delete;
-    LlamaBackendManager& operator=(const LlamaBackendManager&) = delete;
-    LlamaBackendManager(LlamaBackendManager&&) = delete;
-    LlamaBackendManager& operator=(LlamaBackendManager&&) = delete;
-    ~LlamaBackendManager() { llama_backend_free(); }
-
-  private:
-    LlamaBackendManager() { llama_backend_init(); }
-};
-
 static void normalize(std::span<const float> vec, std::span<float> out)
 {
     float norm = std::accumulate(vec.begin(), vec.end(), 0.f,
@@ -57,10 +40,98 @@ static void batch_add_seq(llama_batch& batch, const std::vector<int32_t>& tokens
 
 using TokenizedSequence = std::vector<std::int32_t>;
 
+// The repeated sequences of a batch, e.g. the boilerplate chunks of the documents, are embedded once.
+struct DistinctSequences
+{
+    // Indices of the first occurrences of the distinct sequences.
+    std::vector<size_t> first_idxs;
+    // Index of the distinct sequence of every sequence.
+    std::vector<size_t> distinct_idxs;
+};
+
+static DistinctSequences find_distinct_sequences(const std::vector<std::string>& sequences)
+{
+    DistinctSequences distinct;
+    distinct.distinct_idxs.reserve(sequences.size());
+
+    std::unordered_map<std::string_view, size_t> distinct_idxs;
+    for(size_t i = 0; i < sequences.size(); i++)
+    {
+        const auto [distinct_idx, inserted] = distinct_idxs.try_emplace(sequences[i], distinct.first_idxs.size());
+        if(inserted)
+            distinct.first_idxs.push_back(i);
+        distinct.distinct_idxs.push_back(distinct_idx->second);
+    }
+
+    return distinct;
+}
+
+// Tokens of the chunks kept until the chunks are embedded, e.g. the ones measured by the token budget splitting. The
+// oldest ones are dropped over the capacity in bytes, a dropped chunk is just tokenized again.
+class TokenCache
+{
+  public:
+    explicit TokenCache(size_t capacity_bytes) : capacity_bytes_(capacity_bytes) {}
+
+    void put(const std::string& text, const TokenizedSequence& tokens)
+    {
+        std::lock_guard lock(mutex_);
+        if(index_.contains(text))
+            return;
+
+        entries_.emplace_back(text, tokens);
+        index_.emplace(entries_.back().first, std::prev(entries_.end()));
+        n_bytes_ += entry_bytes_(entries_.back());
+        while(n_bytes_ > capacity_bytes_)
+            erase_(entries_.begin());
+    }
+
+    std::optional<TokenizedSequence> take(const std::string& text)
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = index_.find(text);
+        if(it == index_.end())
+            return std::nullopt;
+
+        return erase_(it->second);
+    }
+
+  private:
+    using Entries = std::list<std::pair<std::string, TokenizedSequence>>;
+    // The list node with the entry and the hash map node with its key, roughly.
+    static constexpr size_t ENTRY_OVERHEAD_BYTES =
+        sizeof(Entries::value_type) + sizeof(std::pair<std::string_view, Entries::iterator>) + 5 * sizeof(void*);
+
+    const size_t capacity_bytes_;
+    std::mutex mutex_;
+    Entries entries_;
+    std::unordered_map<std::string_view, Entries::iterator> index_;
+    size_t n_bytes_ = 0;
+
+    static size_t entry_bytes_(const Entries::value_type& entry)
+    {
+        return entry.first.capacity() + entry.second.capacity() * sizeof(TokenizedSequence::value_type) +
+               ENTRY_OVERHEAD_BYTES;
+    }
+
+    TokenizedSequence erase_(Entries::iterator entry)
+    {
+        n_bytes_ -= entry_bytes_(*entry);
+        auto tokens = std::move(entry->second);
+        index_.erase(entry->first);
+        entries_.erase(entry);
+        return tokens;
+    }
+};
+
+// 32 MB of the chunks with their tokens, a few thousand of the chunks waiting for the embedding.
+constexpr size_t TOKEN_CACHE_CAPACITY_BYTES = 1 << 25;
+
 class LLamaEmbeddingCalculator : public IEmbeddingCalculator
 {
   public:
-    explicit LLamaEmbeddingCalculator(const EmbeddingCalculatorParams& params) : max_batch_(params.batch_size)
+    explicit LLamaEmbeddingCalculator(const EmbeddingCalculatorParams& params)
+        : max_batch_(params.batch_size), token_cache_(TOKEN_CACHE_CAPACITY_BYTES)
     {
         gpt_params_.embedding = true;
         gpt_params_.model = params.model_path;
@@ -69,50 +140,88 @@ class LLamaEmbeddingCalculator : public IEmbeddingCalculator
 
         LlamaBackendManager::get_instance();
 
+        llama_context* ctx = nullptr;
         std::tie(model, ctx) = llama_init_from_gpt_params(gpt_params_);
 
         if(model == nullptr || ctx == nullptr)
         {
+            if(ctx)
+                llama_free(ctx);
             free_llama_pointers();
             throw std::runtime_error(fmt::format("Could not load model from file: {}", params.model_path.c_str()));
         }
+        // The contexts are freed before the model on the errors.
+        std::vector<LlamaCtxUniquePtr> contexts;
+        contexts.push_back(LlamaCtxUniquePtr(ctx, llama_free));
 
         const auto n_ctx = llama_n_ctx(ctx);
         if(max_batch_ < n_ctx)
         {
+            contexts.clear();
             free_llama_pointers();
             throw std::runtime_error(
                 fmt::format("Cannot create embeddings model. The Batch size is smaller than context. Got: {} and {}",
                             max_batch_, n_ctx));
         }
 
+        // The model weights are shared, the additional contexts hold their own KV cache and compute buffers only.
+        for(int32_t i = 1; i < params.n_contexts; i++)
+        {
+            auto* extra_ctx = llama_new_context_with_model(model, llama_context_params_from_gpt_params(gpt_params_));
+            if(extra_ctx == nullptr)
+            {
+                contexts.clear();
+                free_llama_pointers();
+                throw std::runtime_error(
+                    fmt::format("Could not create the embedding context {} of {}", i + 1, params.n_contexts));
+            }
+            contexts.push_back(LlamaCtxUniquePtr(extra_ctx, llama_free));
+        }
+        workers_ = std::make_unique<LlamaDecodeWorkers>(std::move(contexts), max_batch_);
+
         embedding_rank_ = llama_n_embd(model);
+        // E.g. the [CLS] and [SEP] tokens of the BERT models.
+        n_special_tokens_ = ::llama_tokenize(model, "", true).size();
+        max_text_tokens_ = std::min<size_t>(max_batch_, n_ctx) - n_special_tokens_;
     }
 
     ~LLamaEmbeddingCalculator() { free_llama_pointers(); }
 
     std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override;
+    EmbeddingMatrix calc_batch_matrix(const std::vector<std::string>& chunks) const override;
 
     size_t get_embedding_rank() const override { return embedding_rank_; }
+    size_t count_tokens(const std::string& text) const override;
+    size_t tokenize_chunk(const std::string& chunk) const override;
+    size_t max_text_tokens() const override { return max_text_tokens_; }
 
   private:
     gpt_params gpt_params_;
     llama_model* model;
-    llama_context* ctx;
+    // Own the contexts, the const calculations queue their batches to them, so they can run concurrently.
+    std::unique_ptr<LlamaDecodeWorkers> workers_;
 
     size_t embedding_rank_;
     size_t max_batch_;
-
-    std::vector<TokenizedSequence> tokenized_sequences_(const std::vector<std::string>& chunks) const;
-    void batch_decode_(llama_batch& batch, std::span<float> output) const;
-    void copy_and_normalize_embeddings_(llama_batch& batch, std::span<float> output) const;
-    std::optional<std::span<const float>> get_raw_embedding_(llama_batch& batch, int batch_idx) const;
-    std::vector<float> calc_in_fitting_batches_(const std::vector<TokenizedSequence>& tokenized_sequences) const;
+    size_t n_special_tokens_;
+    size_t max_text_tokens_;
+    mutable TokenCache token_cache_;
+
+    std::vector<TokenizedSequence> tokenized_sequences_(const std::vector<std::string>& chunks,
+                                                        const std::vector<size_t>& idxs) const;
+    void batch_decode_(llama_context* ctx, llama_batch& batch, EmbeddingMatrix& output,
+                       const std::vector<size_t>& output_rows) const;
+    void copy_and_normalize_embeddings_(llama_context* ctx, llama_batch& batch, EmbeddingMatrix& output,
+                                        const std::vector<size_t>& output_rows) const;
+    std::optional<std::span<const float>> get_raw_embedding_(llama_context* ctx, llama_batch& batch,
+                                                             int batch_idx) const;
+    EmbeddingMatrix calc_in_fitting_batches_(const std::vector<TokenizedSequence>& tokenized_sequences) const;
 
     void free_llama_pointers();
 };
 
-void LLamaEmbeddingCalculator::batch_decode_(llama_batch& batch, std::span<float> output) const
+void LLamaEmbeddingCalculator::batch_decode_(llama_context* ctx, llama_batch& batch, EmbeddingMatrix& output,
+                                             const std::vector<size_t>& output_rows) const
 {
     llama_kv_cache_clear(ctx);
 
@@ -122,10 +231,12 @@ void LLamaEmbeddingCalculator::batch_decode_(llama_batch& batch, std::span<float
         throw std::runtime_error("Embedding calculation failed - llama_decode.");
     }
 
-    copy_and_normalize_embeddings_(batch, output);
+    copy_and_normalize_embeddings_(ctx, batch, output, output_rows);
 }
 
-void LLamaEmbeddingCalculator::copy_and_normalize_embeddings_(llama_batch& batch, std::span<float> output) const
+void LLamaEmbeddingCalculator::copy_and_normalize_embeddings_(llama_context* ctx, llama_batch& batch,
+                                                              EmbeddingMatrix& output,
+                                                              const std::vector<size_t>& output_rows) const
 {
     for(int i = 0; i < batch.n_tokens; i++)
     {
@@ -134,36 +245,63 @@ void LLamaEmbeddingCalculator::copy_and_normalize_embeddings_(llama_batch& batch
             continue;
         }
         const auto batch_seq_id = batch.seq_id[i][0];
-        auto raw_embedding = get_raw_embedding_(batch, i);
+        auto raw_embedding = get_raw_embedding_(ctx, batch, i);
         if(!raw_embedding)
         {
             throw std::runtime_error("Could not retrieve raw embeddings buffer.");
         }
 
-        auto normalized_embedding = output.subspan(batch_seq_id * embedding_rank_, embedding_rank_);
-        normalize(*raw_embedding, normalized_embedding);
+        normalize(*raw_embedding, output.row(output_rows[batch_seq_id]));
     }
 }
 
+size_t LLamaEmbeddingCalculator::count_tokens(const std::string& text) const
+{
+    // The vocabulary is read only, so the tokenization doesn't take a context.
+    return ::llama_tokenize(model, text, true).size() - n_special_tokens_;
+}
+
+size_t LLamaEmbeddingCalculator::tokenize_chunk(const std::string& chunk) const
+{
+    const auto tokens = ::llama_tokenize(model, chunk, true);
+    token_cache_.put(chunk, tokens);
+    return tokens.size() - n_special_tokens_;
+}
+
 std::vector<TokenizedSequence>
-LLamaEmbeddingCalculator::tokenized_sequences_(const std::vector<std::string>& sequences) const
+LLamaEmbeddingCalculator::tokenized_sequences_(const std::vector<std::string>& sequences,
+                                               const std::vector<size_t>& idxs) const
 {
     std::vector<TokenizedSequence> tokenized_sequences;
-    tokenized_sequences.reserve(sequences.size());
+    tokenized_sequences.reserve(idxs.size());
 
-    std::ranges::transform(sequences, std::back_inserter(tokenized_sequences),
-                           [this](const std::string& sequence)
+    size_t n_truncated = 0;
+    std::ranges::transform(idxs, std::back_inserter(tokenized_sequences),
+                           [this, &sequences, &n_truncated](size_t idx)
                            {
-                               auto tokens = ::llama_tokenize(ctx, sequence, true);
-                               if(tokens.size() > max_batch_)
-                                   tokens.resize(max_batch_);
-                               return tokens;
+                               auto tokens = token_cache_.take(sequences[idx]);
+                               if(!tokens)
+                                   tokens = ::llama_tokenize(model, sequences[idx], true);
+                               if(tokens->size() > max_batch_)
+                               {
+                                   tokens->resize(max_batch_);
+                                   n_truncated++;
+                               }
+                               return std::move(*tokens);
                            });
 
+    if(n_truncated > 0)
+    {
+        spdlog::warn("Truncated {} of {} sequences to {} tokens, split the chunks by the token budget to embed them "
+                     "whole.",
+                     n_truncated, idxs.size(), max_batch_);
+    }
+
     return tokenized_sequences;
 }
 
-std::optional<std::span<const float>> LLamaEmbeddingCalculator::get_raw_embedding_(llama_batch& batch,
+std::optional<std::span<const float>> LLamaEmbeddingCalculator::get_raw_embedding_(llama_context* ctx,
+                                                                                   llama_batch& batch,
                                                                                    int batch_idx) const
 {
     // the whole fallback mechanism was adapted directly from llama.cpp examples.
@@ -188,71 +326,76 @@ LLamaEmbeddingCalculator::calc_batch(const std::vector<std::string>& sequences)
     if (n_sequences == 0)
         return {};
 
-    const auto tokenized_sequences = tokenized_sequences_(sequences);
+    const auto distinct = find_distinct_sequences(sequences);
+    const auto tokenized_sequences = tokenized_sequences_(sequences, distinct.first_idxs);
     const auto embeddings = calc_in_fitting_batches_(tokenized_sequences);
 
     std::vector<EmbeddingCalculationResult> result;
     result.reserve(n_sequences);
 
-    for(size_t i = 0; i < n_sequences; i++)
+    for(const auto distinct_idx : distinct.distinct_idxs)
     {
-        result.emplace_back(
-            EmbeddingCalculationResult{.embedding = Embedding(embeddings.begin() + i * embedding_rank_,
-                                                              embeddings.begin() + (i + 1) * embedding_rank_),
-                                       .n_tokens = tokenized_sequences[i].size()});
+        const auto embedding = embeddings.row(distinct_idx);
+        result.emplace_back(EmbeddingCalculationResult{.embedding = Embedding(embedding.begin(), embedding.end()),
+                                                       .n_tokens = tokenized_sequences[distinct_idx].size()});
     }
 
     return result;
 }
 
-std::vector<float>
-LLamaEmbeddingCalculator::calc_in_fitting_batches_(const std::vector<TokenizedSequence>& tokenized_sequences) const
+EmbeddingMatrix LLamaEmbeddingCalculator::calc_batch_matrix(const std::vector<std::string>& sequences) const
 {
-    const int n_sequences = tokenized_sequences.size();
-    auto batch = llama_batch_init(max_batch_, 0,
-                                  1); // The 0 and 1 values were taken from example. It was also a subject for fix.
+    if(sequences.empty())
+        return EmbeddingMatrix(0, embedding_rank_);
 
-    std::vector<float> embeddings(n_sequences * embedding_rank_, 0);
+    const auto distinct = find_distinct_sequences(sequences);
+    auto embeddings = calc_in_fitting_batches_(tokenized_sequences_(sequences, distinct.first_idxs));
+    if(distinct.first_idxs.size() == sequences.size())
+        return embeddings;
 
-    int processed_sequences = 0;
-    int sequences_in_current_batch = 0;
+    EmbeddingMatrix expanded_embeddings(sequences.size(), embedding_rank_);
+    for(size_t i = 0; i < sequences.size(); i++)
+        expanded_embeddings.set_row(i, embeddings.row(distinct.distinct_idxs[i]));
 
-    auto get_next_output_span = [&embeddings, &processed_sequences, this]()
-    { return std::span<float>(embeddings.begin() + processed_sequences * embedding_rank_, embedding_rank_); };
+    return expanded_embeddings;
+}
 
-    for(int k = 0; k < n_sequences; k++)
+EmbeddingMatrix
+LLamaEmbeddingCalculator::calc_in_fitting_batches_(const std::vector<TokenizedSequence>& tokenized_sequences) const
+{
+    // The sequences are packed by their lengths, so the mixed length chunks don't leave the batches half empty. The
+    // sequence ids of the batch are bounded by its tokens, as every sequence has at least one.
+    std::vector<size_t> lengths(tokenized_sequences.size());
+    std::ranges::transform(tokenized_sequences, lengths.begin(), [](const auto& tokens) { return tokens.size(); });
+    const auto batches = pack_sequences(lengths, max_batch_, max_batch_);
+
+    // The decoded embeddings are normalized straight into the output matrix rows of their sequences, the rows of
+    // the batches are disjoint.
+    EmbeddingMatrix embeddings(tokenized_sequences.size(), embedding_rank_);
+    const auto decode_batch =
+        [this, &batches, &tokenized_sequences, &embeddings](llama_context* ctx, llama_batch& batch, size_t batch_idx)
     {
-        const auto& tokens = tokenized_sequences[k];
-        const uint64_t n_toks = tokens.size();
-
-        if(batch.n_tokens + n_toks > max_batch_)
-        {
-            batch_decode_(batch, get_next_output_span());
-            llama_batch_clear(batch);
-            processed_sequences += sequences_in_current_batch;
-            sequences_in_current_batch = 0;
-        }
-
-        for(size_t i = 0; i < tokens.size(); i++)
-        {
-            llama_batch_add(batch, tokens[i], i, {sequences_in_current_batch},
-                            i == tokens.size() - 1); // the last condition was taken directly from sample
-        }
-        sequences_in_current_batch++;
+        llama_batch_clear(batch);
+        for(size_t seq_id = 0; seq_id < batches[batch_idx].size(); seq_id++)
+            batch_add_seq(batch, tokenized_sequences[batches[batch_idx][seq_id]], seq_id);
+        batch_decode_(ctx, batch, embeddings, batches[batch_idx]);
+    };
+    const size_t n_used_contexts = workers_->run(batches.size(), decode_batch);
+
+    if(batches.size() > 1)
+    {
+        const size_t n_tokens = std::accumulate(lengths.begin(), lengths.end(), size_t{0});
+        spdlog::debug("Embedded {} sequences in {} batches on {} contexts, {:.1f}% of the batch tokens filled.",
+                      lengths.size(), batches.size(), n_used_contexts,
+                      100.0 * n_tokens / (batches.size() * max_batch_));
     }
 
-    batch_decode_(batch, get_next_output_span());
-
     return embeddings;
 }
 
 void LLamaEmbeddingCalculator::free_llama_pointers()
 {
-    if(ctx)
-    {
-        llama_free(ctx);
-        ctx = nullptr;
-    }
+    workers_.reset();
     if(model)
     {
         llama_free_model(model);
@@ -262,7 +405,15 @@ void LLamaEmbeddingCalculator::free_llama_pointers()
 
 std::unique_ptr<IEmbeddingCalculator> embedding_calculator_factory(const EmbeddingCalculatorParams& params)
 {
-    return std::make_unique<LLamaEmbeddingCalculator>(params);
+    auto embedding_calculator = std::make_unique<LLamaEmbeddingCalculator>(params);
+    if(params.cache_path.empty())
+        return embedding_calculator;
+
+    // The sequences are cut to the batch size, so it changes the embeddings of the long chunks as the model does.
+    auto cache = std::make_unique<EmbeddingCache>(params.cache_path, params.model_path,
+                                                  std::to_string(params.batch_size),
+                                                  embedding_calculator->get_embedding_rank());
+    return std::make_unique<CachingEmbeddingCalculator>(std::move(embedding_calculator), std::move(cache));
 }
 
 } // namespace ds
\ No newline at end of file
@@ -0,0 +1,291 @@
+#include "native_vector_database.h"
+#include "simd_kernels.h"
+#include "top_k.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <span>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace ds
+{
+constexpr uint32_t NATIVE_INDEX_MAGIC = 0x5644534e; // "NSDV"
+// Rows are scored in blocks against all the queries of a batch, so every block is read from memory only once.
+constexpr size_t ROW_BLOCK_SIZE = 64;
+
+template <typename T, size_t Alignment>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&)
+    {
+    }
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{Alignment})); }
+    void deallocate(T* ptr, size_t) { ::operator delete(ptr, std::align_val_t{Alignment}); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const
+    {
+        return true;
+    }
+};
+
+using AlignedFloats = std::vector<float, AlignedAllocator<float, SIMD_ALIGNMENT>>;
+
+// Keeps the top_k best scored rows with the worst of them on the top of the heap, so it's replaced in O(log k).
+class TopKHeap
+{
+  public:
+    explicit TopKHeap(size_t top_k) : top_k_(top_k) { heap_.reserve(top_k); }
+
+    void push(size_t index, float score)
+    {
+        const RetrievedIndex candidate{index, score};
+        if(heap_.size() < top_k_)
+        {
+            heap_.push_back(candidate);
+            std::push_heap(heap_.begin(), heap_.end(), is_better_retrieved);
+        }
+        else if(top_k_ > 0 && is_better_retrieved(candidate, heap_.front()))
+        {
+            std::pop_heap(heap_.begin(), heap_.end(), is_better_retrieved);
+            heap_.back() = candidate;
+            std::push_heap(heap_.begin(), heap_.end(), is_better_retrieved);
+        }
+    }
+
+    std::vector<RetrievedIndex> take_sorted()
+    {
+        std::sort_heap(heap_.begin(), heap_.end(), is_better_retrieved);
+        return std::move(heap_);
+    }
+
+  private:
+    size_t top_k_;
+    std::vector<RetrievedIndex> heap_;
+};
+
+// Row-major matrix of the L2 normalized embeddings, every row zero padded to the SIMD block size.
+class NativeVectorDatabase : public IVectorStore
+{
+  public:
+    explicit NativeVectorDatabase(size_t embedding_rank)
+        : embedding_rank_(embedding_rank),
+          row_stride_((embedding_rank + SIMD_BLOCK_FLOATS - 1) / SIMD_BLOCK_FLOATS * SIMD_BLOCK_FLOATS),
+          kernel_(get_dot_product_kernel())
+    {
+        spdlog::debug("Native vector store uses the {} dot product kernel.", kernel_.name);
+    }
+
+    using IVectorStore::add;
+
+    void add(EmbeddingMatrix embeddings) override
+    {
+        if(!embeddings.empty() && embeddings.rank() != embedding_rank_)
+        {
+            throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", embedding_rank_));
+        }
+
+        rows_.resize((n_rows_ + embeddings.rows()) * row_stride_, 0.f);
+        for(size_t i = 0; i < embeddings.rows(); i++)
+            copy_normalized_(embeddings.row(i), rows_.data() + n_rows_++ * row_stride_);
+    }
+
+    std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) const override
+    {
+        return retrieve_batch({values}, top_k).front();
+    }
+
+    std::vector<std::vector<RetrievedIndex>> retrieve_batch(const std::vector<Embedding>& values,
+                                                            uint32_t top_k) const override
+    {
+        check_rank_(values);
+
+        AlignedFloats queries(values.size() * row_stride_, 0.f);
+        for(size_t i = 0; i < values.size(); i++)
+            copy_normalized_(values[i], queries.data() + i * row_stride_);
+
+        std::vector<TopKHeap> heaps(values.size(), TopKHeap(std::min<size_t>(top_k, n_rows_)));
+        for(size_t block_begin = 0; block_begin < n_rows_; block_begin += ROW_BLOCK_SIZE)
+        {
+            const size_t block_end = std::min(block_begin + ROW_BLOCK_SIZE, n_rows_);
+            for(size_t query_idx = 0; query_idx < values.size(); query_idx++)
+            {
+                const float* query = queries.data() + query_idx * row_stride_;
+                for(size_t row = block_begin; row < block_end; row++)
+                {
+                    const float score = kernel_.dot_product(query, rows_.data() + row * row_stride_, row_stride_);
+                    heaps[query_idx].push(row, score);
+                }
+            }
+        }
+
+        std::vector<std::vector<RetrievedIndex>> results;
+        results.reserve(heaps.size());
+        std::ranges::transform(heaps, std::back_inserter(results), [](TopKHeap& heap) { return heap.take_sorted(); });
+        return results;
+    }
+
+    std::vector<RetrievedIndex> retrieve_filtered(const std::vector<float>& values, uint32_t top_k,
+                                                  const IndexBitmap& filter) const override
+    {
+        check_rank_({values});
+
+        AlignedFloats query(row_stride_, 0.f);
+        copy_normalized_(values, query.data());
+
+        TopKHeap heap(std::min<size_t>(top_k, n_rows_));
+        filter.for_each_set(
+            [&](size_t row)
+            {
+                if(row < n_rows_)
+                    heap.push(row, kernel_.dot_product(query.data(), rows_.data() + row * row_stride_, row_stride_));
+            });
+
+        return heap.take_sorted();
+    }
+
+    EmbeddingMatrix reconstruct(size_t first, size_t n) const override
+    {
+        if(first + n > n_rows_)
+        {
+            throw std::out_of_range(
+                fmt::format("Cannot reconstruct vectors [{}, {}), the store holds {} vectors", first, first + n, n_rows_));
+        }
+
+        EmbeddingMatrix embeddings(n, embedding_rank_);
+        for(size_t i = 0; i < n; i++)
+            embeddings.set_row(i, std::span<const float>(rows_.data() + (first + i) * row_stride_, embedding_rank_));
+
+        return embeddings;
+    }
+
+    bool reconstructs_exactly() const override { return true; }
+
+    std::unique_ptr<IVectorStore> compacted(const IndexBitmap& keep) const override
+    {
+        if(keep.size() != n_rows_)
+        {
+            throw std::logic_error(
+                fmt::format("Compaction filter size: {} does not match the store size: {}", keep.size(), n_rows_));
+        }
+
+        auto compacted_store = std::make_unique<NativeVectorDatabase>(embedding_rank_);
+        compacted_store->rows_.reserve(keep.count() * row_stride_);
+        keep.for_each_set(
+            [&](size_t row)
+            {
+                const auto row_begin = rows_.begin() + static_cast<std::ptrdiff_t>(row * row_stride_);
+                compacted_store->rows_.insert(compacted_store->rows_.end(), row_begin,
+                                              row_begin + static_cast<std::ptrdiff_t>(row_stride_));
+                compacted_store->n_rows_++;
+            });
+
+        return compacted_store;
+    }
+
+    std::unique_ptr<IVectorStore> clone() const override { return std::make_unique<NativeVectorDatabase>(*this); }
+
+    std::unique_ptr<IVectorStore> empty_like() const override
+    {
+        return std::make_unique<NativeVectorDatabase>(embedding_rank_);
+    }
+
+    size_t size() const override { return n_rows_; }
+
+    size_t get_memory_usage_bytes() const override { return rows_.size() * sizeof(float); }
+
+    void save(const std::filesystem::path& path) const override
+    {
+        std::ofstream output(path, std::ios::out | std::ios::binary);
+        const uint64_t header[] = {NATIVE_INDEX_MAGIC, embedding_rank_, n_rows_};
+        output.write(reinterpret_cast<const char*>(header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(rows_.data()),
+                     static_cast<std::streamsize>(rows_.size() * sizeof(float)));
+
+        if(!output)
+            throw std::runtime_error(fmt::format("Could not write the vector index file: {}", path.c_str()));
+    }
+
+    void load(const std::filesystem::path& path) override
+    {
+        std::ifstream input(path, std::ios::in | std::ios::binary);
+        uint64_t header[3] = {};
+        input.read(reinterpret_cast<char*>(header), sizeof(header));
+        if(!input || header[0] != NATIVE_INDEX_MAGIC || header[1] != embedding_rank_)
+        {
+            throw std::runtime_error(
+                fmt::format("Vector index file: {} does not match the expected rank: {}", path.c_str(), embedding_rank_));
+        }
+
+        // The row count is checked against the file, so a corrupted header can't make the store allocate past it.
+        uint64_t n_values = 0;
+        uint64_t n_bytes = 0;
+        if(__builtin_mul_overflow(header[2], row_stride_, &n_values) ||
+           __builtin_mul_overflow(n_values, sizeof(float), &n_bytes) ||
+           n_bytes > std::filesystem::file_size(path) - sizeof(header))
+        {
+            throw std::runtime_error(fmt::format("Vector index file: {} is truncated", path.c_str()));
+        }
+
+        AlignedFloats rows(n_values);
+        input.read(reinterpret_cast<char*>(rows.data()), static_cast<std::streamsize>(n_bytes));
+        if(!input)
+            throw std::runtime_error(fmt::format("Vector index file: {} is truncated", path.c_str()));
+
+        rows_ = std::move(rows);
+        n_rows_ = header[2];
+    }
+
+  private:
+    size_t embedding_rank_;
+    size_t row_stride_;
+    const DotProductKernel& kernel_;
+    size_t n_rows_ = 0;
+    AlignedFloats rows_;
+
+    void check_rank_(const std::vector<Embedding>& embeddings) const
+    {
+        const bool valid_rank = std::ranges::all_of(
+            embeddings, [this](const auto& embedding) { return embedding.size() == embedding_rank_; });
+        if(!valid_rank)
+        {
+            throw std::logic_error(fmt::format("Invalid values size, expected rank: {}", embedding_rank_));
+        }
+    }
+
+    // The padding of the destination row is expected to be zeroed already.
+    void copy_normalized_(std::span<const float> embedding, float* row) const
+    {
+        float norm = 0.f;
+        for(const float value : embedding)
+            norm += value * value;
+        norm = std::sqrt(norm);
+
+        // Same as faiss, zero vectors are left as they are.
+        const float scale = norm > 0.f ? 1.f / norm : 1.f;
+        std::ranges::transform(embedding, row, [scale](float value) { return value * scale; });
+    }
+};
+
+std::unique_ptr<IVectorStore> create_native_vector_store(size_t embedding_rank)
+{
+    return std::make_unique<NativeVectorDatabase>(embedding_rank);
+}
+} // namespace ds
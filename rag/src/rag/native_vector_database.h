@@ -0,0 +1,10 @@
+#pragma once
+
+#include "rag/vector_database.h"
+
+namespace ds
+{
+// Exhaustive inner product search without faiss, meant for small corpora where the faiss/OpenMP overhead
+// dominates the query latency.
+std::unique_ptr<IVectorStore> create_native_vector_store(size_t embedding_rank);
+} // namespace ds
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace ds
+{
+// Bounded reorder buffer between the producing workers and the consuming thread. The items are handed out in their
+// order, a worker waits before taking an item further than the window ahead of the next one to consume. So the
+// consumer never waits for an item that can't be started.
+template <typename T> class OrderedResults
+{
+  public:
+    OrderedResults(size_t n_items, size_t window) : n_items_(n_items), window_(window) {}
+
+    // Returns the next item to produce, or nothing once all of them were taken or the pipeline was stopped.
+    std::optional<size_t> take_item()
+    {
+        std::unique_lock lock(mutex_);
+        item_taken_.wait(lock, [this]()
+                         { return stopped_ || next_item_ == n_items_ || next_item_ < next_to_consume_ + window_; });
+        if(stopped_ || next_item_ == n_items_)
+            return std::nullopt;
+
+        return next_item_++;
+    }
+
+    void put_result(size_t item, T&& result)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            results_.emplace(item, std::move(result));
+        }
+        result_put_.notify_all();
+    }
+
+    // Returns the result of the next item in order, or nothing when the pipeline was stopped.
+    std::optional<T> take_next_result()
+    {
+        std::unique_lock lock(mutex_);
+        result_put_.wait(lock, [this]() { return stopped_ || results_.contains(next_to_consume_); });
+        if(stopped_)
+            return std::nullopt;
+
+        auto result = std::move(results_.extract(next_to_consume_).mapped());
+        next_to_consume_++;
+        lock.unlock();
+        item_taken_.notify_all();
+
+        return result;
+    }
+
+    void stop(std::exception_ptr error)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            if(!error_)
+                error_ = error;
+            stopped_ = true;
+        }
+        item_taken_.notify_all();
+        result_put_.notify_all();
+    }
+
+    std::exception_ptr error() const
+    {
+        std::lock_guard lock(mutex_);
+        return error_;
+    }
+
+  private:
+    const size_t n_items_;
+    const size_t window_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable item_taken_;
+    std::condition_variable result_put_;
+    size_t next_item_ = 0;
+    size_t next_to_consume_ = 0;
+    std::map<size_t, T> results_;
+    bool stopped_ = false;
+    std::exception_ptr error_;
+};
+
+// Produces the results of the items on n_threads workers, the calling thread consumes them as they complete, in the
+// order of the items. At most max_pending results are produced ahead of the consumption. The first error of either
+// side stops the workers and is rethrown.
+template <typename T>
+void run_ordered_pipeline(size_t n_items, size_t n_threads, size_t max_pending,
+                          const std::function<T(size_t item)>& produce,
+                          const std::function<void(size_t item, T&& result)>& consume)
+{
+    n_threads = std::clamp<size_t>(n_threads, 1, std::max<size_t>(n_items, 1));
+    OrderedResults<T> results(n_items, std::max(max_pending, n_threads));
+
+    std::vector<std::thread> workers;
+    workers.reserve(n_threads);
+    for(size_t i = 0; i < n_threads; i++)
+    {
+        workers.emplace_back(
+            [&results, &produce]()
+            {
+                try
+                {
+                    while(const auto item = results.take_item())
+                        results.put_result(*item, produce(*item));
+                }
+                catch(...)
+                {
+                    results.stop(std::current_exception());
+                }
+            });
+    }
+
+    try
+    {
+        for(size_t item = 0; item < n_items; item++)
+        {
+            auto result = results.take_next_result();
+            if(!result)
+                break;
+
+            consume(item, std::move(*result));
+        }
+    }
+    catch(...)
+    {
+        results.stop(std::current_exception());
+    }
+
+    results.stop(nullptr);
+    std::ranges::for_each(workers, [](std::thread& worker) { worker.join(); });
+    if(const auto error = results.error())
+        std::rethrow_exception(error);
+}
+} // namespace ds
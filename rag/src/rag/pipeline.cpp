@@ -1,8 +1,44 @@
 #include "rag/pipeline.h"
+
+#include <algorithm>
+#include <cmath>
 #include <spdlog/spdlog.h>
+
 namespace ds
 {
 
+std::vector<RetrievedDocumentChunk>
+select_context_chunks(const std::vector<RetrievedDocumentChunk>& chunks, const RagInferenceSettings& settings,
+                      const std::function<std::size_t(const std::string&)>& count_tokens)
+{
+    std::vector<RetrievedDocumentChunk> selected_chunks;
+    if(chunks.empty())
+        return selected_chunks;
+
+    // The MMR selection and the hybrid fused orders are not sorted by the score.
+    const float best_score = std::ranges::max(chunks, {}, &RetrievedDocumentChunk::score).score;
+    std::size_t n_context_tokens = 0;
+    for(const auto& chunk : chunks)
+    {
+        if(settings.min_score && chunk.score < *settings.min_score)
+            continue;
+        if(settings.max_relative_score_gap &&
+           best_score - chunk.score > *settings.max_relative_score_gap * std::abs(best_score))
+            continue;
+
+        if(settings.max_context_tokens)
+        {
+            n_context_tokens += count_tokens(chunk.content);
+            if(n_context_tokens > *settings.max_context_tokens)
+                break;
+        }
+
+        selected_chunks.push_back(chunk);
+    }
+
+    return selected_chunks;
+}
+
 LlmOutput RagPipeline::generate(const std::string& query, const RagInferenceSettings& settings)
 {
     const auto inference_prompt = prepare_inference_prompt_(query, settings);
@@ -24,7 +60,20 @@ std::unique_ptr<ILlmAsyncGeneration> RagPipeline::generate_async(const std::stri
 
 LlmInput RagPipeline::prepare_inference_prompt_(const std::string& query, const RagInferenceSettings& settings)
 {
-    const auto contexts = document_retriever_->retrieve(query, settings.top_k);
+    const auto retrieve_chunks = [this, &query, &settings]()
+    {
+        if(settings.hybrid)
+            return document_retriever_->retrieve_hybrid(query, settings.top_k, *settings.hybrid);
+        if(settings.mmr)
+            return document_retriever_->retrieve_diverse(query, settings.top_k, *settings.mmr);
+
+        return document_retriever_->retrieve(query, settings.top_k);
+    };
+    const auto retrieved_chunks = retrieve_chunks();
+    const auto contexts = select_context_chunks(retrieved_chunks, settings, [this](const std::string& text)
+                                                { return llm_provider_->count_tokens(text); });
+    spdlog::debug("Using {} of {} retrieved chunks as the context.", contexts.size(), retrieved_chunks.size());
+
     const auto prompt = prompt_composer_->create(query, contexts);
 
     return LlmInput{.prompt = prompt};
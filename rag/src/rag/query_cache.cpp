@@ -0,0 +1,92 @@
+#include "query_cache.h"
+
+#include <xxhash.h>
+
+namespace ds
+{
+// Estimate of the list and hash map nodes of an entry, next to its key and value.
+constexpr size_t ENTRY_OVERHEAD_BYTES = 128;
+
+static size_t embedding_bytes(const Embedding& embedding)
+{
+    return ENTRY_OVERHEAD_BYTES + sizeof(Embedding) + embedding.size() * sizeof(float);
+}
+
+static size_t results_bytes(const std::vector<RetrievedDocumentChunk>& results)
+{
+    size_t bytes = ENTRY_OVERHEAD_BYTES + sizeof(results) + results.size() * sizeof(RetrievedDocumentChunk);
+    for(const auto& result : results)
+        bytes += result.content.size();
+
+    return bytes;
+}
+
+QueryCache::QueryCache(size_t max_memory_bytes) : embeddings_(max_memory_bytes / 2), results_(max_memory_bytes / 2)
+{
+}
+
+size_t QueryCache::ResultKeyHasher::operator()(const ResultKey& key) const
+{
+    return key.query_hash ^ (key.top_k * 0x9e3779b97f4a7c15ull) ^ (key.epoch << 32);
+}
+
+uint64_t QueryCache::hash_query(const Embedding& embedding)
+{
+    return XXH3_64bits(embedding.data(), embedding.size() * sizeof(float));
+}
+
+std::optional<Embedding> QueryCache::find_embedding(std::string_view question)
+{
+    const auto hash = hash_text(question);
+    std::lock_guard lock(mutex_);
+    const auto* embedding = embeddings_.find(hash);
+    if(!embedding)
+    {
+        stats_.embedding_misses++;
+        return std::nullopt;
+    }
+
+    stats_.embedding_hits++;
+    return *embedding;
+}
+
+void QueryCache::put_embedding(std::string_view question, const Embedding& embedding)
+{
+    const auto hash = hash_text(question);
+    const auto bytes = embedding_bytes(embedding);
+    auto value = embedding;
+    std::lock_guard lock(mutex_);
+    embeddings_.put(hash, std::move(value), bytes);
+}
+
+std::optional<std::vector<RetrievedDocumentChunk>> QueryCache::find_results(const ResultKey& key)
+{
+    std::lock_guard lock(mutex_);
+    const auto* results = results_.find(key);
+    if(!results)
+    {
+        stats_.result_misses++;
+        return std::nullopt;
+    }
+
+    stats_.result_hits++;
+    return *results;
+}
+
+void QueryCache::put_results(const ResultKey& key, const std::vector<RetrievedDocumentChunk>& results)
+{
+    const auto bytes = results_bytes(results);
+    auto value = results;
+    std::lock_guard lock(mutex_);
+    results_.put(key, std::move(value), bytes);
+}
+
+QueryCacheStats QueryCache::stats() const
+{
+    std::lock_guard lock(mutex_);
+    auto stats = stats_;
+    stats.memory_bytes = embeddings_.bytes() + results_.bytes();
+
+    return stats;
+}
+} // namespace ds
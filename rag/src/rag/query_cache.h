@@ -0,0 +1,112 @@
+#pragma once
+
+#include "rag/document_retrieval.h"
+#include "rag/text_hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ds
+{
+// Least recently used entries taking up to max_bytes in total, the sizes of the entries are estimated by the caller.
+template <typename Key, typename Value, typename Hash> class LruCache
+{
+  public:
+    explicit LruCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    // The found entry becomes the most recently used one.
+    const Value* find(const Key& key)
+    {
+        const auto found = index_.find(key);
+        if(found == index_.end())
+            return nullptr;
+
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return &found->second->value;
+    }
+
+    // Evicts the least recently used entries until the new one fits, an entry larger than the cap is not cached.
+    void put(const Key& key, Value&& value, size_t bytes)
+    {
+        if(const auto found = index_.find(key); found != index_.end())
+            erase_(found->second);
+        if(bytes > max_bytes_)
+            return;
+
+        while(bytes_ + bytes > max_bytes_)
+            erase_(std::prev(entries_.end()));
+
+        entries_.push_front(Entry{key, std::move(value), bytes});
+        index_.emplace(key, entries_.begin());
+        bytes_ += bytes;
+    }
+
+    size_t bytes() const { return bytes_; }
+
+  private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        size_t bytes;
+    };
+
+    void erase_(typename std::list<Entry>::iterator entry)
+    {
+        bytes_ -= entry->bytes;
+        index_.erase(entry->key);
+        entries_.erase(entry);
+    }
+
+    const size_t max_bytes_;
+    size_t bytes_ = 0;
+    // The most recently used entries first.
+    std::list<Entry> entries_;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index_;
+};
+
+// Embeddings and retrieval results of the recent questions, each of the two caches takes up to a half of the memory.
+// The questions are keyed by the 128-bit xxHash of their text. The results are keyed by the hash of the query
+// embedding and the epoch of the index, so the results of its previous versions are never hit and just age out.
+class QueryCache
+{
+  public:
+    struct ResultKey
+    {
+        uint64_t query_hash;
+        size_t top_k;
+        uint64_t epoch;
+
+        bool operator==(const ResultKey&) const = default;
+    };
+
+    explicit QueryCache(size_t max_memory_bytes);
+
+    std::optional<Embedding> find_embedding(std::string_view question);
+    void put_embedding(std::string_view question, const Embedding& embedding);
+    std::optional<std::vector<RetrievedDocumentChunk>> find_results(const ResultKey& key);
+    void put_results(const ResultKey& key, const std::vector<RetrievedDocumentChunk>& results);
+
+    // Hash of the query embedding, the results only depend on it.
+    static uint64_t hash_query(const Embedding& embedding);
+
+    QueryCacheStats stats() const;
+
+  private:
+    struct ResultKeyHasher
+    {
+        size_t operator()(const ResultKey& key) const;
+    };
+
+    mutable std::mutex mutex_;
+    LruCache<TextHash, Embedding, TextHashHasher> embeddings_;
+    LruCache<ResultKey, std::vector<RetrievedDocumentChunk>, ResultKeyHasher> results_;
+    QueryCacheStats stats_;
+};
+} // namespace ds
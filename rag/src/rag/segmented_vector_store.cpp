@@ -0,0 +1,278 @@
+#include "segmented_vector_store.h"
+#include "native_vector_database.h"
+#include "top_k.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace ds
+{
+// The delta segments are merged into the main store once they hold this fraction of its size, so the main store is
+// copied after its size grows by the fraction, and every vector is copied a constant number of times on average.
+constexpr size_t MAIN_MERGE_DIVISOR = 4;
+// A delta segment is merged into the previous one unless that one is more than this many times larger, so there
+// are only logarithmically many of them to search.
+constexpr size_t DELTA_MERGE_FACTOR = 2;
+
+static void append_with_offset(std::vector<RetrievedIndex>& retrieved, const std::vector<RetrievedIndex>& segment,
+                               size_t offset)
+{
+    for(const auto& retrieved_index : segment)
+        retrieved.push_back(RetrievedIndex{retrieved_index.index + offset, retrieved_index.cosine_similarity});
+}
+
+// The main store has the configured index type, the delta segments are native flat stores. These keep the vectors
+// as added, so merging them loses nothing, and they are searched exhaustively while they are small. The appended
+// segments of another store keep its types. The segments are never modified once shared, a merge builds a new one.
+SegmentedVectorStore::SegmentedVectorStore(std::shared_ptr<IVectorStore> main_store) : main_(std::move(main_store))
+{
+    update_embedding_rank_();
+}
+
+template <typename Fn>
+void SegmentedVectorStore::for_each_segment_(Fn&& fn) const
+{
+    fn(*main_);
+    std::ranges::for_each(deltas_, [&fn](const std::shared_ptr<const IVectorStore>& delta) { fn(*delta); });
+}
+
+void SegmentedVectorStore::add(EmbeddingMatrix embeddings)
+{
+    if(embeddings.empty())
+        return;
+
+    if(deltas_.empty() && (main_->size() == 0 || main_.use_count() == 1))
+    {
+        writable_main_().add(std::move(embeddings));
+        update_embedding_rank_();
+        return;
+    }
+
+    auto delta = create_native_vector_store(embedding_rank_);
+    delta->add(std::move(embeddings));
+    deltas_.push_back(std::move(delta));
+    merge_deltas_();
+}
+
+void SegmentedVectorStore::append(const SegmentedVectorStore& other)
+{
+    if(other.size() == 0)
+        return;
+
+    if(size() == 0)
+    {
+        main_ = other.main_;
+        deltas_ = other.deltas_;
+        embedding_rank_ = other.embedding_rank_;
+        return;
+    }
+
+    if(other.main_->size() > 0)
+        deltas_.push_back(other.main_);
+    deltas_.insert(deltas_.end(), other.deltas_.begin(), other.deltas_.end());
+    merge_deltas_();
+}
+
+std::vector<RetrievedIndex> SegmentedVectorStore::retrieve(const std::vector<float>& values, uint32_t top_k) const
+{
+    auto retrieved = main_->retrieve(values, top_k);
+    if(deltas_.empty())
+        return retrieved;
+
+    size_t offset = main_->size();
+    for(const auto& delta : deltas_)
+    {
+        append_with_offset(retrieved, delta->retrieve(values, top_k), offset);
+        offset += delta->size();
+    }
+    keep_top_k(retrieved, top_k);
+
+    return retrieved;
+}
+
+std::vector<std::vector<RetrievedIndex>> SegmentedVectorStore::retrieve_batch(const std::vector<Embedding>& values,
+                                                                              uint32_t top_k) const
+{
+    auto retrieved = main_->retrieve_batch(values, top_k);
+    if(deltas_.empty())
+        return retrieved;
+
+    size_t offset = main_->size();
+    for(const auto& delta : deltas_)
+    {
+        const auto delta_retrieved = delta->retrieve_batch(values, top_k);
+        for(size_t i = 0; i < retrieved.size(); i++)
+            append_with_offset(retrieved[i], delta_retrieved[i], offset);
+        offset += delta->size();
+    }
+    std::ranges::for_each(retrieved, [top_k](std::vector<RetrievedIndex>& query_retrieved)
+                          { keep_top_k(query_retrieved, top_k); });
+
+    return retrieved;
+}
+
+std::vector<RetrievedIndex> SegmentedVectorStore::retrieve_filtered(const std::vector<float>& values, uint32_t top_k,
+                                                                    const IndexBitmap& filter) const
+{
+    if(deltas_.empty())
+        return main_->retrieve_filtered(values, top_k, filter);
+
+    auto retrieved = main_->retrieve_filtered(values, top_k, filter.slice(0, main_->size()));
+    size_t offset = main_->size();
+    for(const auto& delta : deltas_)
+    {
+        const auto delta_filter = filter.slice(offset, delta->size());
+        if(delta_filter.count() > 0)
+            append_with_offset(retrieved, delta->retrieve_filtered(values, top_k, delta_filter), offset);
+        offset += delta->size();
+    }
+    keep_top_k(retrieved, top_k);
+
+    return retrieved;
+}
+
+EmbeddingMatrix SegmentedVectorStore::reconstruct(size_t first, size_t n) const
+{
+    if(deltas_.empty())
+        return main_->reconstruct(first, n);
+    if(first + n > size())
+    {
+        throw std::out_of_range(fmt::format("Cannot reconstruct vectors [{}, {}), the store holds {} vectors", first,
+                                            first + n, size()));
+    }
+
+    EmbeddingMatrix embeddings(n, embedding_rank_);
+    size_t segment_begin = 0;
+    for_each_segment_(
+        [&](const IVectorStore& segment)
+        {
+            const size_t copy_begin = std::max(first, segment_begin);
+            const size_t copy_end = std::min(first + n, segment_begin + segment.size());
+            if(copy_begin < copy_end)
+            {
+                const auto segment_embeddings = segment.reconstruct(copy_begin - segment_begin, copy_end - copy_begin);
+                for(size_t i = 0; i < segment_embeddings.rows(); i++)
+                    embeddings.set_row(copy_begin - first + i, segment_embeddings.row(i));
+            }
+            segment_begin += segment.size();
+        });
+
+    return embeddings;
+}
+
+bool SegmentedVectorStore::reconstructs_exactly() const
+{
+    bool exactly = true;
+    for_each_segment_([&exactly](const IVectorStore& segment) { exactly = exactly && segment.reconstructs_exactly(); });
+
+    return exactly;
+}
+
+std::unique_ptr<SegmentedVectorStore> SegmentedVectorStore::compacted_copy(const IndexBitmap& keep) const
+{
+    if(keep.size() != size())
+    {
+        throw std::logic_error(
+            fmt::format("Compaction filter size: {} does not match the store size: {}", keep.size(), size()));
+    }
+
+    // The kept delta vectors are merged into the compacted main store.
+    std::shared_ptr<IVectorStore> main_store = main_->compacted(deltas_.empty() ? keep : keep.slice(0, main_->size()));
+    size_t offset = main_->size();
+    for(const auto& delta : deltas_)
+    {
+        const auto kept_delta = delta->compacted(keep.slice(offset, delta->size()));
+        if(kept_delta->size() > 0)
+            main_store->add(kept_delta->reconstruct(0, kept_delta->size()));
+        offset += delta->size();
+    }
+
+    return std::make_unique<SegmentedVectorStore>(std::move(main_store));
+}
+
+std::unique_ptr<SegmentedVectorStore> SegmentedVectorStore::empty_copy() const
+{
+    return std::make_unique<SegmentedVectorStore>(main_->empty_like());
+}
+
+size_t SegmentedVectorStore::size() const
+{
+    size_t size = 0;
+    for_each_segment_([&size](const IVectorStore& segment) { size += segment.size(); });
+
+    return size;
+}
+
+size_t SegmentedVectorStore::get_memory_usage_bytes() const
+{
+    size_t memory_usage_bytes = 0;
+    for_each_segment_([&memory_usage_bytes](const IVectorStore& segment)
+                      { memory_usage_bytes += segment.get_memory_usage_bytes(); });
+
+    return memory_usage_bytes;
+}
+
+void SegmentedVectorStore::save(const std::filesystem::path& path) const
+{
+    if(deltas_.empty())
+    {
+        main_->save(path);
+        return;
+    }
+
+    merged_main_()->save(path);
+}
+
+void SegmentedVectorStore::load(const std::filesystem::path& path)
+{
+    std::shared_ptr<IVectorStore> main_store = main_->empty_like();
+    main_store->load(path);
+    main_ = std::move(main_store);
+    deltas_.clear();
+    update_embedding_rank_();
+}
+
+void SegmentedVectorStore::update_embedding_rank_()
+{
+    if(main_->size() > 0)
+        embedding_rank_ = main_->reconstruct(0, 1).rank();
+}
+
+IVectorStore& SegmentedVectorStore::writable_main_()
+{
+    if(main_.use_count() != 1)
+        main_ = main_->clone();
+
+    return *main_;
+}
+
+std::unique_ptr<IVectorStore> SegmentedVectorStore::merged_main_() const
+{
+    auto main_store = main_->clone();
+    for(const auto& delta : deltas_)
+        main_store->add(delta->reconstruct(0, delta->size()));
+
+    return main_store;
+}
+
+void SegmentedVectorStore::merge_deltas_()
+{
+    while(deltas_.size() >= 2 && deltas_[deltas_.size() - 2]->size() <= DELTA_MERGE_FACTOR * deltas_.back()->size())
+    {
+        auto merged_delta = deltas_[deltas_.size() - 2]->clone();
+        merged_delta->add(deltas_.back()->reconstruct(0, deltas_.back()->size()));
+        deltas_.pop_back();
+        deltas_.back() = std::move(merged_delta);
+    }
+
+    const size_t deltas_size = size() - main_->size();
+    if(deltas_size * MAIN_MERGE_DIVISOR >= main_->size())
+    {
+        auto& main_store = writable_main_();
+        for(const auto& delta : deltas_)
+            main_store.add(delta->reconstruct(0, delta->size()));
+        deltas_.clear();
+    }
+}
+} // namespace ds
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "rag/vector_database.h"
+
+#include <memory>
+#include <vector>
+
+namespace ds
+{
+// Copy-on-write wrapper of a vector store: the copies share the main store and the delta segments, the additions
+// go to new exact segments, which are merged into the main store once they make up a part of it. So copying the
+// store and adding to the copy are proportional to the added vectors, amortized. A store whose main store isn't
+// shared, e.g. one built aside, adds to it in place.
+class SegmentedVectorStore : public IVectorStore
+{
+  public:
+    explicit SegmentedVectorStore(std::shared_ptr<IVectorStore> main_store);
+
+    using IVectorStore::add;
+
+    void add(EmbeddingMatrix embeddings) override;
+    // Appends the vectors of the other store, e.g. one built aside, after the own ones. Its segments are shared.
+    void append(const SegmentedVectorStore& other);
+
+    std::vector<RetrievedIndex> retrieve(const std::vector<float>& values, uint32_t top_k) const override;
+    std::vector<std::vector<RetrievedIndex>> retrieve_batch(const std::vector<Embedding>& values,
+                                                            uint32_t top_k) const override;
+    std::vector<RetrievedIndex> retrieve_filtered(const std::vector<float>& values, uint32_t top_k,
+                                                  const IndexBitmap& filter) const override;
+
+    EmbeddingMatrix reconstruct(size_t first, size_t n) const override;
+    bool reconstructs_exactly() const override;
+
+    std::unique_ptr<IVectorStore> compacted(const IndexBitmap& keep) const override { return compacted_copy(keep); }
+    // The segments are immutable, so the copy shares them.
+    std::unique_ptr<IVectorStore> clone() const override { return std::make_unique<SegmentedVectorStore>(*this); }
+    std::unique_ptr<IVectorStore> empty_like() const override { return empty_copy(); }
+    // Same as compacted and empty_like, keeping the type.
+    std::unique_ptr<SegmentedVectorStore> compacted_copy(const IndexBitmap& keep) const;
+    std::unique_ptr<SegmentedVectorStore> empty_copy() const;
+
+    size_t size() const override;
+    size_t get_memory_usage_bytes() const override;
+
+    // The saved index is the single merged store of the configured type.
+    void save(const std::filesystem::path& path) const override;
+    void load(const std::filesystem::path& path) override;
+
+  private:
+    // Modified in place only while no copy of the store shares it.
+    std::shared_ptr<IVectorStore> main_;
+    // In the order of the indices, after the main store.
+    std::vector<std::shared_ptr<const IVectorStore>> deltas_;
+    // The store doesn't expose its rank, it's taken from a reconstructed vector once there is one.
+    size_t embedding_rank_ = 0;
+
+    template <typename Fn>
+    void for_each_segment_(Fn&& fn) const;
+
+    void update_embedding_rank_();
+    IVectorStore& writable_main_();
+    std::unique_ptr<IVectorStore> merged_main_() const;
+    void merge_deltas_();
+};
+} // namespace ds
@@ -0,0 +1,91 @@
+#include "simd_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DS_X86_KERNELS
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define DS_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace ds
+{
+static float dot_product_scalar(const float* lhs, const float* rhs, size_t n)
+{
+    float sum = 0.f;
+    for(size_t i = 0; i < n; i++)
+        sum += lhs[i] * rhs[i];
+
+    return sum;
+}
+
+#if defined(DS_X86_KERNELS)
+// The x86 kernels are compiled with target attributes, so the library itself doesn't require AVX to run.
+__attribute__((target("avx2,fma"))) static float dot_product_avx2(const float* lhs, const float* rhs, size_t n)
+{
+    // Two accumulators hide the latency of the dependent fma chain.
+    __m256 acc_lo = _mm256_setzero_ps();
+    __m256 acc_hi = _mm256_setzero_ps();
+    for(size_t i = 0; i < n; i += SIMD_BLOCK_FLOATS)
+    {
+        acc_lo = _mm256_fmadd_ps(_mm256_load_ps(lhs + i), _mm256_load_ps(rhs + i), acc_lo);
+        acc_hi = _mm256_fmadd_ps(_mm256_load_ps(lhs + i + 8), _mm256_load_ps(rhs + i + 8), acc_hi);
+    }
+
+    const __m256 acc = _mm256_add_ps(acc_lo, acc_hi);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx512f"))) static float dot_product_avx512(const float* lhs, const float* rhs, size_t n)
+{
+    __m512 acc = _mm512_setzero_ps();
+    for(size_t i = 0; i < n; i += SIMD_BLOCK_FLOATS)
+        acc = _mm512_fmadd_ps(_mm512_load_ps(lhs + i), _mm512_load_ps(rhs + i), acc);
+
+    return _mm512_reduce_add_ps(acc);
+}
+#endif
+
+#if defined(DS_NEON_KERNELS)
+static float dot_product_neon(const float* lhs, const float* rhs, size_t n)
+{
+    float32x4_t acc_0 = vdupq_n_f32(0.f);
+    float32x4_t acc_1 = vdupq_n_f32(0.f);
+    float32x4_t acc_2 = vdupq_n_f32(0.f);
+    float32x4_t acc_3 = vdupq_n_f32(0.f);
+    for(size_t i = 0; i < n; i += SIMD_BLOCK_FLOATS)
+    {
+        acc_0 = vfmaq_f32(acc_0, vld1q_f32(lhs + i), vld1q_f32(rhs + i));
+        acc_1 = vfmaq_f32(acc_1, vld1q_f32(lhs + i + 4), vld1q_f32(rhs + i + 4));
+        acc_2 = vfmaq_f32(acc_2, vld1q_f32(lhs + i + 8), vld1q_f32(rhs + i + 8));
+        acc_3 = vfmaq_f32(acc_3, vld1q_f32(lhs + i + 12), vld1q_f32(rhs + i + 12));
+    }
+
+    return vaddvq_f32(vaddq_f32(vaddq_f32(acc_0, acc_1), vaddq_f32(acc_2, acc_3)));
+}
+#endif
+
+static DotProductKernel select_dot_product_kernel()
+{
+#if defined(DS_X86_KERNELS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return {"avx512", dot_product_avx512};
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return {"avx2", dot_product_avx2};
+#elif defined(DS_NEON_KERNELS)
+    return {"neon", dot_product_neon};
+#endif
+
+    return {"scalar", dot_product_scalar};
+}
+
+const DotProductKernel& get_dot_product_kernel()
+{
+    static const DotProductKernel kernel = select_dot_product_kernel();
+    return kernel;
+}
+} // namespace ds
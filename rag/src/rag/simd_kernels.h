@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ds
+{
+// The kernels use aligned loads and no tail handling: both buffers must be aligned to SIMD_ALIGNMENT bytes and
+// their length must be a multiple of SIMD_BLOCK_FLOATS (zero padded).
+constexpr size_t SIMD_ALIGNMENT = 64;
+constexpr size_t SIMD_BLOCK_FLOATS = 16;
+
+using DotProductFn = float (*)(const float* lhs, const float* rhs, size_t n);
+
+struct DotProductKernel
+{
+    const char* name;
+    DotProductFn dot_product;
+};
+
+// The widest kernel supported by the CPU, detected once on the first call.
+const DotProductKernel& get_dot_product_kernel();
+} // namespace ds
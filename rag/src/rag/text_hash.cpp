@@ -0,0 +1,12 @@
+#include "rag/text_hash.h"
+
+#include <xxhash.h>
+
+namespace ds
+{
+TextHash hash_text(std::string_view text)
+{
+    const auto hash = XXH3_128bits(text.data(), text.size());
+    return TextHash{hash.low64, hash.high64};
+}
+} // namespace ds
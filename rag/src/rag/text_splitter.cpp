@@ -0,0 +1,202 @@
+#include "rag/text_splitter.h"
+
+#include <deque>
+#include <fmt/format.h>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace ds
+{
+std::vector<TextSeparator> default_separators()
+{
+    return {TextSeparator{"\n\n"}, TextSeparator{"\n"}, TextSeparator{" "}, TextSeparator{""}};
+}
+
+std::vector<TextSeparator> markdown_separators()
+{
+    constexpr size_t UNBOUNDED_RUN = std::string::npos;
+    return {TextSeparator{"\n", '#', 1, 6, " "},
+            TextSeparator{"```\n"},
+            TextSeparator{"\n", '*', 3, UNBOUNDED_RUN, "\n"},
+            TextSeparator{"\n", '-', 3, UNBOUNDED_RUN, "\n"},
+            TextSeparator{"\n", '_', 3, UNBOUNDED_RUN, "\n"},
+            TextSeparator{"\n\n"},
+            TextSeparator{"\n"},
+            TextSeparator{" "},
+            TextSeparator{""}};
+}
+
+size_t utf8_length(std::string_view text)
+{
+    size_t length = 0;
+    for(const char c : text)
+        length += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    return length;
+}
+
+static size_t utf8_char_size(std::string_view text, size_t pos)
+{
+    size_t size = 1;
+    while(pos + size < text.size() && (static_cast<unsigned char>(text[pos + size]) & 0xC0) == 0x80)
+        size++;
+    return size;
+}
+
+// Returns the begin and the end of the first match at or after the position.
+static std::optional<std::pair<size_t, size_t>> find_separator(std::string_view text, const TextSeparator& separator,
+                                                               size_t pos)
+{
+    for(pos = text.find(separator.prefix, pos); pos != std::string_view::npos;
+        pos = text.find(separator.prefix, pos + 1))
+    {
+        size_t end = pos + separator.prefix.size();
+        if(separator.run_char != '\0')
+        {
+            size_t run = 0;
+            while(end < text.size() && text[end] == separator.run_char && run < separator.max_run)
+            {
+                end++;
+                run++;
+            }
+            if(run < separator.min_run)
+                continue;
+        }
+
+        if(text.substr(end).starts_with(separator.suffix))
+            return std::pair{pos, end + separator.suffix.size()};
+    }
+
+    return std::nullopt;
+}
+
+// Pieces of the text, each of them but the first one starts with the separator. The empty separator splits the text
+// into the characters.
+static std::vector<std::string_view> split_with_separator(std::string_view text, const TextSeparator& separator)
+{
+    std::vector<std::string_view> splits;
+    if(separator.prefix.empty())
+    {
+        for(size_t pos = 0; pos < text.size();)
+        {
+            const auto size = utf8_char_size(text, pos);
+            splits.push_back(text.substr(pos, size));
+            pos += size;
+        }
+        return splits;
+    }
+
+    size_t split_begin = 0;
+    for(auto match = find_separator(text, separator, 0); match; match = find_separator(text, separator, match->second))
+    {
+        if(match->first > split_begin)
+            splits.push_back(text.substr(split_begin, match->first - split_begin));
+        split_begin = match->first;
+    }
+    if(split_begin < text.size())
+        splits.push_back(text.substr(split_begin));
+
+    return splits;
+}
+
+static std::string_view strip_whitespace(std::string_view text)
+{
+    constexpr std::string_view WHITESPACE = " \t\n\r\f\v";
+    const auto begin = text.find_first_not_of(WHITESPACE);
+    if(begin == std::string_view::npos)
+        return {};
+
+    return text.substr(begin, text.find_last_not_of(WHITESPACE) - begin + 1);
+}
+
+RecursiveTextSplitter::RecursiveTextSplitter(TextSplitterParams params, std::vector<TextSeparator> separators)
+    : params_(std::move(params)), separators_(std::move(separators))
+{
+    if(params_.chunk_overlap > params_.chunk_size)
+    {
+        throw std::logic_error(fmt::format("The chunk overlap {} is larger than the chunk size {}.",
+                                           params_.chunk_overlap, params_.chunk_size));
+    }
+    if(separators_.empty())
+        throw std::logic_error("The text splitter needs at least one separator.");
+}
+
+std::vector<std::string> RecursiveTextSplitter::split(std::string_view text) const
+{
+    std::vector<std::string> chunks;
+    split_(text, 0, chunks);
+    return chunks;
+}
+
+void RecursiveTextSplitter::split_(std::string_view text, size_t first_separator,
+                                   std::vector<std::string>& chunks) const
+{
+    // The first separator found in the text, the empty one is always found.
+    size_t separator_idx = separators_.size() - 1;
+    for(size_t i = first_separator; i < separators_.size(); i++)
+    {
+        if(separators_[i].prefix.empty() || find_separator(text, separators_[i], 0))
+        {
+            separator_idx = i;
+            break;
+        }
+    }
+    const bool has_next_separators =
+        !separators_[separator_idx].prefix.empty() && separator_idx + 1 < separators_.size();
+
+    std::vector<std::string_view> fitting_splits;
+    for(const auto split : split_with_separator(text, separators_[separator_idx]))
+    {
+        if(params_.length_function(split) < params_.chunk_size)
+        {
+            fitting_splits.push_back(split);
+            continue;
+        }
+
+        merge_(fitting_splits, chunks);
+        fitting_splits.clear();
+        if(has_next_separators)
+            split_(split, separator_idx + 1, chunks);
+        else
+            chunks.emplace_back(split);
+    }
+    merge_(fitting_splits, chunks);
+}
+
+void RecursiveTextSplitter::merge_(const std::vector<std::string_view>& splits, std::vector<std::string>& chunks) const
+{
+    // The splits are consecutive pieces of the text, so the merged ones are a single view spanning them.
+    const auto add_chunk = [&chunks](const std::deque<std::string_view>& merged)
+    {
+        if(merged.empty())
+            return;
+
+        const auto* end = merged.back().data() + merged.back().size();
+        const auto chunk = strip_whitespace(std::string_view(merged.front().data(), end));
+        if(!chunk.empty())
+            chunks.emplace_back(chunk);
+    };
+
+    std::deque<std::string_view> merged;
+    size_t merged_length = 0;
+    for(const auto split : splits)
+    {
+        const size_t length = params_.length_function(split);
+        if(merged_length + length > params_.chunk_size && !merged.empty())
+        {
+            add_chunk(merged);
+            // The tail of the chunk within the overlap starts the next one, as long as the split still fits.
+            while(!merged.empty() && (merged_length > params_.chunk_overlap ||
+                                      (merged_length + length > params_.chunk_size && merged_length > 0)))
+            {
+                merged_length -= params_.length_function(merged.front());
+                merged.pop_front();
+            }
+        }
+
+        merged.push_back(split);
+        merged_length += length;
+    }
+    add_chunk(merged);
+}
+} // namespace ds
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "rag/vector_database.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace ds
+{
+// Orders by the similarity, the ties by the index as in faiss, so the stores and their segments agree on the results.
+inline bool is_better_retrieved(const RetrievedIndex& lhs, const RetrievedIndex& rhs)
+{
+    if(lhs.cosine_similarity != rhs.cosine_similarity)
+        return lhs.cosine_similarity > rhs.cosine_similarity;
+
+    return lhs.index < rhs.index;
+}
+
+// Picks the best top_k of the scored candidates in order.
+inline void keep_top_k(std::vector<RetrievedIndex>& candidates, size_t top_k)
+{
+    const size_t n_kept = std::min(candidates.size(), top_k);
+    std::partial_sort(candidates.begin(), candidates.begin() + n_kept, candidates.end(), is_better_retrieved);
+    candidates.resize(n_kept);
+}
+} // namespace ds
@@ -0,0 +1,58 @@
+#include "rag/batch_packing.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace ds
+{
+
+TEST(BatchPackingTest, CheckShortSequencesFillGaps)
+{
+    // In their order the sequences take 4 batches: {6}, {6}, {3, 3}, {2, 2, 2}.
+    const std::vector<size_t> lengths{6, 6, 3, 3, 2, 2, 2};
+    EXPECT_EQ(pack_sequences(lengths, 8, 8), std::vector<std::vector<size_t>>({{0, 4}, {1, 5}, {2, 3, 6}}));
+}
+
+TEST(BatchPackingTest, CheckSequencesLimit)
+{
+    const std::vector<size_t> lengths{1, 1, 1, 1, 1};
+    EXPECT_EQ(pack_sequences(lengths, 8, 2), std::vector<std::vector<size_t>>({{0, 1}, {2, 3}, {4}}));
+}
+
+TEST(BatchPackingTest, CheckAllSequencesPackedWithinLimits)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> length_dist(1, 512);
+    std::vector<size_t> lengths(1000);
+    std::ranges::generate(lengths, [&]() { return length_dist(gen); });
+
+    const auto batches = pack_sequences(lengths, 512, 16);
+    std::vector<size_t> packed;
+    for(const auto& batch : batches)
+    {
+        EXPECT_LE(batch.size(), 16);
+        EXPECT_LE(std::accumulate(batch.begin(), batch.end(), size_t{0},
+                                  [&lengths](size_t sum, size_t idx) { return sum + lengths[idx]; }),
+                  512);
+        packed.insert(packed.end(), batch.begin(), batch.end());
+    }
+    std::ranges::sort(packed);
+    std::vector<size_t> expected(lengths.size());
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(packed, expected);
+
+    // Best fit decreasing needs at most 11/9 of the optimum batches, which is at least the total length over 512.
+    const size_t total_length = std::accumulate(lengths.begin(), lengths.end(), size_t{0});
+    EXPECT_LE(batches.size(), (total_length + 511) / 512 * 11 / 9 + 1);
+}
+
+TEST(BatchPackingTest, CheckInvalidInputsThrow)
+{
+    EXPECT_TRUE(pack_sequences({}, 8, 8).empty());
+    EXPECT_THROW(pack_sequences({9}, 8, 8), std::logic_error);
+    EXPECT_THROW(pack_sequences({1}, 8, 0), std::logic_error);
+}
+} // namespace ds
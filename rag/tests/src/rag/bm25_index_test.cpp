@@ -0,0 +1,206 @@
+#include "rag/bm25_index.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace ds
+{
+
+class Bm25IndexTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        index_.add({"The pump is controlled by the main board.", "Replace the filter XK-2231 every six months.",
+                    "The filter housing is made of steel.", "Error 0x1f means the pump is blocked."});
+    }
+
+    Bm25Index index_;
+};
+
+static std::vector<size_t> retrieved_docs(const std::vector<RetrievedIndex>& retrieved)
+{
+    std::vector<size_t> docs;
+    std::ranges::transform(retrieved, std::back_inserter(docs), &RetrievedIndex::index);
+    return docs;
+}
+
+TEST_F(Bm25IndexTest, CheckTokenization)
+{
+    EXPECT_EQ(Bm25Index::tokenize("Error E-1042 in parse_config()!"),
+              std::vector<std::string>({"error", "e", "1042", "in", "parse_config"}));
+    EXPECT_EQ(Bm25Index::tokenize("Zażółć gęślą"), std::vector<std::string>({"zażółć", "gęślą"}));
+    EXPECT_TRUE(Bm25Index::tokenize(" ,.; ").empty());
+}
+
+TEST_F(Bm25IndexTest, CheckExactIdentifierIsFound)
+{
+    const auto retrieved = index_.retrieve("How often is xk-2231 replaced?", 2);
+
+    ASSERT_FALSE(retrieved.empty());
+    EXPECT_EQ(retrieved[0].index, 1);
+    EXPECT_GT(retrieved[0].cosine_similarity, 0.f);
+    EXPECT_TRUE(index_.retrieve("unrelated question", 2).empty());
+}
+
+TEST_F(Bm25IndexTest, CheckRarerTermsScoreHigher)
+{
+    const auto retrieved = index_.retrieve("pump filter steel", 4);
+
+    ASSERT_EQ(retrieved.size(), 4);
+    EXPECT_EQ(retrieved[0].index, 2);
+    EXPECT_TRUE(std::ranges::is_sorted(retrieved, std::ranges::greater(), &RetrievedIndex::cosine_similarity));
+}
+
+TEST_F(Bm25IndexTest, CheckTopKMatchesExhaustiveScoring)
+{
+    std::mt19937 gen(7);
+    std::geometric_distribution<int> word_dist(0.1);
+    std::uniform_int_distribution<int> length_dist(5, 40);
+    const auto random_text = [&](int length)
+    {
+        std::string text;
+        for(int i = 0; i < length; i++)
+            text += "w" + std::to_string(word_dist(gen)) + " ";
+        return text;
+    };
+
+    Bm25Index index;
+    std::vector<std::string> documents(2000);
+    std::ranges::generate(documents, [&]() { return random_text(length_dist(gen)); });
+    index.add(documents);
+
+    for(int i = 0; i < 20; i++)
+    {
+        const auto query = random_text(4);
+        // Nothing is pruned when all the documents fit in the top_k.
+        const auto exhaustive = index.retrieve(query, index.size());
+        const auto pruned = index.retrieve(query, 10);
+
+        ASSERT_EQ(pruned.size(), std::min<size_t>(10, exhaustive.size()));
+        for(size_t j = 0; j < pruned.size(); j++)
+            EXPECT_FLOAT_EQ(pruned[j].cosine_similarity, exhaustive[j].cosine_similarity);
+    }
+}
+
+TEST_F(Bm25IndexTest, CheckCopiesAddToTheirOwnSegments)
+{
+    std::mt19937 gen(11);
+    std::geometric_distribution<int> word_dist(0.1);
+    const auto random_text = [&](int length)
+    {
+        std::string text;
+        for(int i = 0; i < length; i++)
+            text += "w" + std::to_string(word_dist(gen)) + " ";
+        return text;
+    };
+
+    std::vector<std::string> documents(500);
+    std::ranges::generate(documents, [&]() { return random_text(20); });
+    Bm25Index single_segment_index;
+    single_segment_index.add(documents);
+
+    // Every addition goes to a copy of the previous version, as the retriever updates do, the versions stay intact.
+    std::vector<Bm25Index> versions{Bm25Index()};
+    for(size_t first_doc = 0; first_doc < documents.size(); first_doc += 1 + first_doc % 7)
+    {
+        auto version = versions.back();
+        const size_t last_doc = std::min(documents.size(), first_doc + 1 + first_doc % 7);
+        version.add(std::vector<std::string>(documents.begin() + first_doc, documents.begin() + last_doc));
+        versions.push_back(std::move(version));
+    }
+    EXPECT_EQ(versions[1].size(), 1);
+    const auto& segmented_index = versions.back();
+    ASSERT_EQ(segmented_index.size(), documents.size());
+
+    IndexBitmap allowed(documents.size());
+    for(size_t doc = 0; doc < documents.size(); doc += 3)
+        allowed.set(doc);
+
+    for(int i = 0; i < 20; i++)
+    {
+        const auto query = random_text(3);
+        const auto expected = single_segment_index.retrieve(query, 10);
+        const auto retrieved = segmented_index.retrieve(query, 10);
+        ASSERT_EQ(retrieved.size(), expected.size());
+        for(size_t j = 0; j < retrieved.size(); j++)
+            EXPECT_FLOAT_EQ(retrieved[j].cosine_similarity, expected[j].cosine_similarity);
+
+        const auto expected_filtered = single_segment_index.retrieve_filtered(query, 10, allowed);
+        const auto retrieved_filtered = segmented_index.retrieve_filtered(query, 10, allowed);
+        ASSERT_EQ(retrieved_filtered.size(), expected_filtered.size());
+        for(size_t j = 0; j < retrieved_filtered.size(); j++)
+            EXPECT_FLOAT_EQ(retrieved_filtered[j].cosine_similarity, expected_filtered[j].cosine_similarity);
+    }
+
+    const auto compacted = segmented_index.compacted(allowed);
+    EXPECT_EQ(compacted.get_memory_usage_bytes(), single_segment_index.compacted(allowed).get_memory_usage_bytes());
+    EXPECT_EQ(retrieved_docs(compacted.retrieve(documents[3], 1)), std::vector<size_t>({1}));
+}
+
+TEST_F(Bm25IndexTest, CheckFilteredAndCompacted)
+{
+    IndexBitmap live(index_.size());
+    live.set(0);
+    live.set(2);
+    live.set(3);
+
+    EXPECT_EQ(retrieved_docs(index_.retrieve_filtered("filter", 4, live)), std::vector<size_t>({2}));
+    EXPECT_EQ(retrieved_docs(index_.retrieve_filtered("pump", 4, live)), std::vector<size_t>({3, 0}));
+
+    const auto compacted = index_.compacted(live);
+    EXPECT_EQ(compacted.size(), 3);
+    EXPECT_TRUE(compacted.retrieve("XK-2231", 4).empty());
+    EXPECT_EQ(retrieved_docs(compacted.retrieve("steel housing", 4)), std::vector<size_t>({1}));
+    EXPECT_EQ(retrieved_docs(compacted.retrieve("blocked", 4)), std::vector<size_t>({2}));
+}
+
+TEST_F(Bm25IndexTest, CheckSaveAndLoad)
+{
+    const auto path = std::filesystem::temp_directory_path() / "bm25_index_test.index";
+    index_.save(path);
+
+    Bm25Index loaded;
+    loaded.load(path);
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(loaded.size(), index_.size());
+    EXPECT_EQ(loaded.get_memory_usage_bytes(), index_.get_memory_usage_bytes());
+    const auto expected = index_.retrieve("pump filter main board", 4);
+    const auto retrieved = loaded.retrieve("pump filter main board", 4);
+    EXPECT_EQ(retrieved_docs(retrieved), retrieved_docs(expected));
+    EXPECT_FLOAT_EQ(retrieved[0].cosine_similarity, expected[0].cosine_similarity);
+
+    EXPECT_THROW(loaded.load(path), std::runtime_error);
+}
+
+TEST_F(Bm25IndexTest, CheckCorruptedIndexIsRejected)
+{
+    const auto path = std::filesystem::temp_directory_path() / "bm25_index_corrupted_test.index";
+    index_.save(path);
+    std::string bytes(std::filesystem::file_size(path), '\0');
+    std::ifstream(path, std::ios::binary).read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+    const auto load_with = [&path, &bytes](size_t offset, uint64_t value)
+    {
+        auto corrupted = bytes;
+        std::memcpy(corrupted.data() + offset, &value, sizeof(value));
+        std::ofstream(path, std::ios::binary).write(corrupted.data(), static_cast<std::streamsize>(corrupted.size()));
+        Bm25Index loaded;
+        loaded.load(path);
+    };
+
+    // The document count past the file, fewer documents than the postings refer to, and a term past the file.
+    EXPECT_THROW(load_with(sizeof(uint64_t), uint64_t{1} << 40), std::runtime_error);
+    EXPECT_THROW(load_with(sizeof(uint64_t), 2), std::runtime_error);
+    const size_t first_postings = 3 * sizeof(uint64_t) + index_.size() * sizeof(uint32_t);
+    EXPECT_THROW(load_with(first_postings, bytes.size()), std::runtime_error);
+    EXPECT_NO_THROW(load_with(0, 0x35324d42));
+    std::filesystem::remove(path);
+}
+
+} // namespace ds
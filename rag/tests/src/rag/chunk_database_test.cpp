@@ -0,0 +1,101 @@
+#include "rag/chunk_database.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+namespace ds
+{
+
+class ChunkDatabaseTest : public ::testing::Test
+{
+  protected:
+    void TearDown() override { std::filesystem::remove(path_); }
+
+    const std::filesystem::path path_ = std::filesystem::temp_directory_path() / "chunk_database_test.bin";
+    const std::vector<DocumentChunk> chunks_{DocumentChunk{"First chunk", DocumentChunkMetadata{"a.pdf", 3}},
+                                             DocumentChunk{"", DocumentChunkMetadata{"b.pdf", 0}},
+                                             DocumentChunk{"Zażółć gęślą jaźń", DocumentChunkMetadata{"a.pdf", 4}}};
+
+    std::vector<DocumentChunkView> chunk_views_() const
+    {
+        std::vector<DocumentChunkView> views;
+        for(const auto& chunk : chunks_)
+            views.push_back(DocumentChunkView{chunk.content, chunk.metadata.source, chunk.metadata.chunk_id});
+        return views;
+    }
+};
+
+TEST_F(ChunkDatabaseTest, CheckRoundtripWithEmbeddings)
+{
+    auto vector_store = vector_store_factory(2);
+    vector_store->add(EmbeddingMatrix({1.f, 0.f, 0.f, 1.f, 0.6f, 0.8f}, 2));
+    save_chunk_database(path_, chunk_views_(), vector_store.get());
+
+    ASSERT_TRUE(MappedChunkDatabase::is_chunk_database(path_));
+    const MappedChunkDatabase database(path_);
+    ASSERT_EQ(database.size(), 3);
+    ASSERT_EQ(database.embedding_rank(), 2);
+    for(size_t i = 0; i < chunks_.size(); i++)
+    {
+        EXPECT_EQ(database.content(i), chunks_[i].content);
+        EXPECT_EQ(database.source(i), chunks_[i].metadata.source);
+        EXPECT_EQ(database.chunk_id(i), chunks_[i].metadata.chunk_id);
+    }
+
+    const auto embeddings = database.embeddings();
+    EXPECT_EQ(std::vector<float>(embeddings.begin(), embeddings.end()),
+              std::vector<float>({1.f, 0.f, 0.f, 1.f, 0.6f, 0.8f}));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(embeddings.data()) % 64, 0);
+}
+
+TEST_F(ChunkDatabaseTest, CheckChunksOnly)
+{
+    save_chunk_database(path_, chunk_views_(), nullptr);
+
+    const MappedChunkDatabase database(path_);
+    EXPECT_EQ(database.size(), 3);
+    EXPECT_EQ(database.embedding_rank(), 0);
+    EXPECT_TRUE(database.embeddings().empty());
+    EXPECT_EQ(database.content(2), "Zażółć gęślą jaźń");
+}
+
+TEST_F(ChunkDatabaseTest, CheckInvalidFilesAreRejected)
+{
+    EXPECT_THROW(save_chunk_database(path_, chunk_views_(), vector_store_factory(2).get()), std::logic_error);
+
+    {
+        std::ofstream output(path_, std::ios::out);
+        output << R"({"chunks":[]})";
+    }
+    EXPECT_FALSE(MappedChunkDatabase::is_chunk_database(path_));
+    EXPECT_THROW(MappedChunkDatabase{path_}, std::runtime_error);
+
+    save_chunk_database(path_, chunk_views_(), nullptr);
+    std::filesystem::resize_file(path_, std::filesystem::file_size(path_) - 1);
+    EXPECT_TRUE(MappedChunkDatabase::is_chunk_database(path_));
+    EXPECT_THROW(MappedChunkDatabase{path_}, std::runtime_error);
+}
+
+TEST_F(ChunkDatabaseTest, CheckOverflowingCountsAreRejected)
+{
+    const auto save_with = [this](size_t offset, uint64_t value)
+    {
+        save_chunk_database(path_, chunk_views_(), nullptr);
+        std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+
+    // n_chunks + 1 wraps to 0 and n_chunks * embedding_rank wraps to 2.
+    constexpr size_t N_CHUNKS_OFFSET = 8;
+    constexpr size_t EMBEDDING_RANK_OFFSET = 24;
+    save_with(N_CHUNKS_OFFSET, UINT64_MAX);
+    EXPECT_THROW(MappedChunkDatabase{path_}, std::runtime_error);
+    save_with(EMBEDDING_RANK_OFFSET, UINT64_MAX / 3 + 1);
+    EXPECT_THROW(MappedChunkDatabase{path_}, std::runtime_error);
+
+    save_with(EMBEDDING_RANK_OFFSET, 0);
+    EXPECT_EQ(MappedChunkDatabase{path_}.size(), chunks_.size());
+}
+} // namespace ds
@@ -0,0 +1,124 @@
+#include "rag/chunk_table.h"
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+namespace ds
+{
+
+class ChunkTableTest : public ::testing::Test
+{
+  protected:
+    void TearDown() override { std::filesystem::remove(path_); }
+
+    std::shared_ptr<const MappedChunkDatabase> save_database_(const std::vector<DocumentChunkView>& chunks) const
+    {
+        save_chunk_database(path_, chunks, nullptr);
+        return std::make_shared<const MappedChunkDatabase>(path_);
+    }
+
+    static void expect_chunk(const ChunkTable& table, size_t idx, std::string_view content, std::string_view source,
+                             uint64_t chunk_id)
+    {
+        const auto chunk = table.view(idx);
+        EXPECT_EQ(chunk.content, content);
+        EXPECT_EQ(chunk.source, source);
+        EXPECT_EQ(chunk.chunk_id, chunk_id);
+    }
+
+    const std::filesystem::path path_ = std::filesystem::temp_directory_path() / "chunk_table_test.bin";
+};
+
+TEST_F(ChunkTableTest, CheckAddedAndMappedChunks)
+{
+    const auto database = save_database_({DocumentChunkView{"Mapped 0", "m.pdf", 7},
+                                          DocumentChunkView{"Mapped 1", "m.pdf", 8},
+                                          DocumentChunkView{"Mapped 2", "n.pdf", 0}});
+
+    ChunkTable table;
+    table.add("First", "a.pdf", 0);
+    table.add("", "b.pdf", 1);
+    table.add_mapped(database, 0, 1);
+    table.add_mapped(database, 1, 3);
+    table.add("Last", "a.pdf", 2);
+
+    ASSERT_EQ(table.size(), 6);
+    expect_chunk(table, 0, "First", "a.pdf", 0);
+    expect_chunk(table, 1, "", "b.pdf", 1);
+    expect_chunk(table, 2, "Mapped 0", "m.pdf", 7);
+    expect_chunk(table, 3, "Mapped 1", "m.pdf", 8);
+    expect_chunk(table, 4, "Mapped 2", "n.pdf", 0);
+    expect_chunk(table, 5, "Last", "a.pdf", 2);
+}
+
+TEST_F(ChunkTableTest, CheckCopiesDontSeeTheLaterChunks)
+{
+    ChunkTable table;
+    table.add("Shared", "a.pdf", 0);
+    const ChunkTable copy = table;
+
+    table.add("Added", "a.pdf", 1);
+    ChunkTable other;
+    other.add("Appended", "b.pdf", 0);
+    table.append(other);
+
+    ASSERT_EQ(copy.size(), 1);
+    expect_chunk(copy, 0, "Shared", "a.pdf", 0);
+    ASSERT_EQ(table.size(), 3);
+    expect_chunk(table, 0, "Shared", "a.pdf", 0);
+    expect_chunk(table, 1, "Added", "a.pdf", 1);
+    expect_chunk(table, 2, "Appended", "b.pdf", 0);
+}
+
+TEST_F(ChunkTableTest, CheckSourceChunksOfAllSegments)
+{
+    const auto database = save_database_({DocumentChunkView{"Mapped 0", "a.pdf", 0},
+                                          DocumentChunkView{"Mapped 1", "m.pdf", 1}});
+
+    ChunkTable table;
+    table.add("First", "a.pdf", 0);
+    const ChunkTable copy = table;
+    table.add("Second", "b.pdf", 0);
+    table.add_mapped(database, 0, 2);
+    table.add("Last", "a.pdf", 1);
+
+    const auto source_chunks = [&table](std::string_view source)
+    {
+        std::vector<size_t> chunk_idxs;
+        table.for_each_source_chunk(source, [&chunk_idxs](size_t chunk_idx) { chunk_idxs.push_back(chunk_idx); });
+        return chunk_idxs;
+    };
+    EXPECT_EQ(source_chunks("a.pdf"), std::vector<size_t>({0, 2, 4}));
+    EXPECT_EQ(source_chunks("b.pdf"), std::vector<size_t>({1}));
+    EXPECT_EQ(source_chunks("m.pdf"), std::vector<size_t>({3}));
+    EXPECT_TRUE(source_chunks("c.pdf").empty());
+}
+
+TEST_F(ChunkTableTest, CheckCompactedKeepsTheOrder)
+{
+    const auto database = save_database_({DocumentChunkView{"Mapped 0", "m.pdf", 0},
+                                          DocumentChunkView{"Mapped 1", "m.pdf", 1},
+                                          DocumentChunkView{"Mapped 2", "m.pdf", 2}});
+
+    ChunkTable table;
+    table.add("Removed", "a.pdf", 0);
+    table.add("Kept", "a.pdf", 1);
+    table.add_mapped(database, 0, 3);
+    table.add("Last", "b.pdf", 0);
+
+    IndexBitmap keep(table.size());
+    keep.set(1);
+    keep.set(2);
+    keep.set(4);
+    keep.set(5);
+    const auto compacted = table.compacted(keep);
+
+    ASSERT_EQ(compacted.size(), 4);
+    expect_chunk(compacted, 0, "Kept", "a.pdf", 1);
+    expect_chunk(compacted, 1, "Mapped 0", "m.pdf", 0);
+    expect_chunk(compacted, 2, "Mapped 2", "m.pdf", 2);
+    expect_chunk(compacted, 3, "Last", "b.pdf", 0);
+    ASSERT_EQ(table.size(), 6);
+}
+
+} // namespace ds
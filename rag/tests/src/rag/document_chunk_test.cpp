@@ -0,0 +1,52 @@
+#include "rag/document_chunk.h"
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+
+namespace ds
+{
+
+static std::vector<std::vector<DocumentChunk>> read_batches(const std::string& json, size_t batch_size)
+{
+    std::istringstream input(json);
+    std::vector<std::vector<DocumentChunk>> batches;
+    read_document_chunks(input, batch_size,
+                         [&batches](std::vector<DocumentChunk>&& batch) { batches.push_back(std::move(batch)); });
+    return batches;
+}
+
+TEST(DocumentChunkTest, CheckChunksAreReadInBatches)
+{
+    // The chunk fields may come in any order, the other keys are skipped.
+    const std::string json = R"({
+        "version": {"splitter": [1, 2]},
+        "chunks": [
+            {"metadata": {"source": "a.pdf", "chunk_id": 0}, "content": "First", "embedding": [1.0, 0.5]},
+            {"content": "Second", "metadata": {"source": "a.pdf", "chunk_id": 1}, "embedding": null},
+            {"content": "Third", "metadata": {"source": "b.pdf", "chunk_id": 7, "page": 3}}
+        ],
+        "chunk_count": 3
+    })";
+
+    const auto batches = read_batches(json, 2);
+
+    ASSERT_EQ(batches.size(), 2);
+    ASSERT_EQ(batches[0].size(), 2);
+    ASSERT_EQ(batches[1].size(), 1);
+    EXPECT_EQ(batches[0][0].content, "First");
+    EXPECT_EQ(batches[0][0].metadata.source, "a.pdf");
+    EXPECT_EQ(batches[0][0].embedding, Embedding({1.f, 0.5f}));
+    EXPECT_EQ(batches[0][1].content, "Second");
+    EXPECT_FALSE(batches[0][1].embedding);
+    EXPECT_EQ(batches[1][0].content, "Third");
+    EXPECT_EQ(batches[1][0].metadata.chunk_id, 7);
+}
+
+TEST(DocumentChunkTest, CheckInvalidDocumentsAreRejected)
+{
+    EXPECT_TRUE(read_batches(R"({"chunks": []})", 2).empty());
+    EXPECT_THROW(read_batches(R"({"documents": []})", 2), std::runtime_error);
+    EXPECT_THROW(read_batches(R"({"chunks": [{"content": "First", )", 2), std::runtime_error);
+}
+} // namespace ds
@@ -4,6 +4,16 @@
 #include "rag/document_retrieval.h"
 #include "test_utils.h"
 
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+
 namespace ds
 {
 
@@ -13,6 +23,16 @@ class DocumentRetrievalTest : public ::testing::Test
     const std::filesystem::path MODEL_PATH = ASSETS_ROOT / "embeddings/gte-base/gte-base-f32.gguf";
 };
 
+class MockEmbeddingCalculator : public IEmbeddingCalculator
+{
+  public:
+    MOCK_METHOD(EmbeddingCalculationResult, calc, (const std::string& chunk), (const override));
+    MOCK_METHOD(std::vector<EmbeddingCalculationResult>, calc_batch, (const std::vector<std::string>& chunks),
+                (const override));
+
+    MOCK_METHOD(size_t, get_embedding_rank, (), (const override));
+};
+
 TEST_F(DocumentRetrievalTest, CheckCreation)
 {
     auto document_retriever = create_document_chunk_retriever(DocumentChunkRetrieverParams{
@@ -37,16 +57,6 @@ TEST_F(DocumentRetrievalTest, CheckSimpleCreate3Sentences)
 
 TEST_F(DocumentRetrievalTest, CheckLoadingDataWithPrecalculatedEmbeddings)
 {
-    class MockEmbeddingCalculator : public IEmbeddingCalculator
-    {
-      public:
-        MOCK_METHOD(EmbeddingCalculationResult, calc, (const std::string& chunk), (const override));
-        MOCK_METHOD(std::vector<EmbeddingCalculationResult>, calc_batch, (const std::vector<std::string>& chunks),
-                    (const override));
-
-        MOCK_METHOD(size_t, get_embedding_rank, (), (const override));
-    };
-
     auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
     EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
     EXPECT_CALL(*embedding_calculator, calc("Query"))
@@ -68,4 +78,878 @@ TEST_F(DocumentRetrievalTest, CheckLoadingDataWithPrecalculatedEmbeddings)
     EXPECT_EQ(result_2[1].content, "Chunk_2");
 }
 
-} // namespace ds
\ No newline at end of file
+TEST_F(DocumentRetrievalTest, CheckBatchRetrievalEmbedsQueriesInOneCall)
+{
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc(::testing::_)).Times(0);
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({"Query_1", "Query_2"})))
+        .WillOnce(::testing::Return(std::vector<EmbeddingCalculationResult>{
+            EmbeddingCalculationResult{.embedding = {0.6f, 0.1f, 0.f}},
+            EmbeddingCalculationResult{.embedding = {0.f, 0.1f, 0.6f}}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+
+    document_retriever.add_document_chunks(
+        {DocumentChunk{"Chunk_1", DocumentChunkMetadata{}, Embedding{1.0f, 0.f, 0.f}},
+         DocumentChunk{"Chunk_2", DocumentChunkMetadata{}, Embedding{0.f, 1.f, 0.f}},
+         DocumentChunk{"Chunk_3", DocumentChunkMetadata{}, Embedding{0.f, 0.f, 1.f}}});
+
+    const auto result = document_retriever.retrieve_batch({"Query_1", "Query_2"}, 1);
+    ASSERT_EQ(result.size(), 2);
+    ASSERT_EQ(result[0].size(), 1);
+    ASSERT_EQ(result[1].size(), 1);
+    EXPECT_EQ(result[0][0].content, "Chunk_1");
+    EXPECT_EQ(result[1][0].content, "Chunk_3");
+}
+
+TEST_F(DocumentRetrievalTest, CheckSnapshotRoundtripSkipsEmbedding)
+{
+    const auto snapshot_dir = std::filesystem::temp_directory_path() / "document_retrieval_snapshot_test";
+
+    {
+        auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+        EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+        EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+
+        auto document_retriever =
+            SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+        document_retriever.add_document_chunks(
+            {DocumentChunk{"Chunk_1", DocumentChunkMetadata{"a.pdf", 0}, Embedding{1.0f, 0.f, 0.f}},
+             DocumentChunk{"Chunk_2", DocumentChunkMetadata{"b.pdf", 1}, Embedding{0.f, 1.f, 0.f}}});
+        document_retriever.save_snapshot(snapshot_dir);
+    }
+
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(::testing::_)).Times(0);
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillOnce(::testing::Return(EmbeddingCalculationResult{.embedding = {0.1f, 0.6f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+    document_retriever.load_snapshot(snapshot_dir);
+
+    const auto result = document_retriever.retrieve("Query", 1);
+    ASSERT_EQ(result.size(), 1);
+    EXPECT_EQ(result[0].content, "Chunk_2");
+    EXPECT_EQ(result[0].chunk_id, 1);
+
+    std::filesystem::remove_all(snapshot_dir);
+}
+
+TEST_F(DocumentRetrievalTest, CheckMixedPrecalculatedEmbeddingsKeepChunkOrder)
+{
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({"Chunk_2"})))
+        .WillOnce(::testing::Return(
+            std::vector<EmbeddingCalculationResult>{EmbeddingCalculationResult{.embedding = {0.f, 1.f, 0.f}}}));
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillOnce(::testing::Return(EmbeddingCalculationResult{.embedding = {0.1f, 0.6f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+
+    document_retriever.add_document_chunks(
+        {DocumentChunk{"Chunk_1", DocumentChunkMetadata{.chunk_id = 1}, Embedding{1.0f, 0.f, 0.f}},
+         DocumentChunk{"Chunk_2", DocumentChunkMetadata{.chunk_id = 2}},
+         DocumentChunk{"Chunk_3", DocumentChunkMetadata{.chunk_id = 3}, Embedding{0.f, 0.f, 1.f}}});
+
+    const auto result = document_retriever.retrieve("Query", 1);
+    ASSERT_EQ(result.size(), 1);
+    EXPECT_EQ(result[0].content, "Chunk_2");
+    EXPECT_EQ(result[0].chunk_id, 2);
+}
+
+TEST_F(DocumentRetrievalTest, CheckDumpReconstructsEmbeddingsFromTheVectorStore)
+{
+    std::stringstream dumped;
+    {
+        auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+        EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+        EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+
+        auto document_retriever =
+            SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+        document_retriever.add_document_chunks(
+            {DocumentChunk{"Chunk_1", DocumentChunkMetadata{.chunk_id = 1}, Embedding{2.0f, 0.f, 0.f}},
+             DocumentChunk{"Chunk_2", DocumentChunkMetadata{.chunk_id = 2}, Embedding{0.f, 1.f, 0.f}}});
+        document_retriever.dump(dumped);
+    }
+
+    const auto dumped_chunks = nlohmann::json::parse(dumped.str()).at("chunks");
+    ASSERT_EQ(dumped_chunks.size(), 2);
+    EXPECT_EQ(dumped_chunks[0].at("content"), "Chunk_1");
+    EXPECT_EQ(dumped_chunks[0].at("embedding").get<std::vector<float>>(), std::vector<float>({1.f, 0.f, 0.f}));
+    EXPECT_EQ(dumped_chunks[1].at("embedding").get<std::vector<float>>(), std::vector<float>({0.f, 1.f, 0.f}));
+
+    // The dumped embeddings are loaded as precalculated, nothing is embedded again.
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillOnce(::testing::Return(EmbeddingCalculationResult{.embedding = {0.1f, 0.6f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+    document_retriever.load(dumped);
+
+    const auto result = document_retriever.retrieve("Query", 1);
+    ASSERT_EQ(result.size(), 1);
+    EXPECT_EQ(result[0].content, "Chunk_2");
+}
+
+TEST_F(DocumentRetrievalTest, CheckDumpOmitsCompressedEmbeddings)
+{
+    std::stringstream dumped;
+    const auto database_path = std::filesystem::temp_directory_path() / "document_retrieval_compressed_test.bin";
+    {
+        auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+        EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+        EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+
+        // Only the signs of the embeddings are stored, so they can't be dumped.
+        auto document_retriever = SimpleDocumentChunkRetriever(
+            std::move(embedding_calculator), vector_store_factory(3, {.index_type = VectorIndexType::BINARY}));
+        document_retriever.add_document_chunks(
+            {DocumentChunk{"Chunk_1", DocumentChunkMetadata{.chunk_id = 1}, Embedding{2.0f, 0.5f, 0.f}},
+             DocumentChunk{"Chunk_2", DocumentChunkMetadata{.chunk_id = 2}, Embedding{0.f, 1.f, 0.f}}});
+        document_retriever.dump(dumped);
+        document_retriever.save_binary(database_path);
+    }
+
+    const auto dumped_chunks = nlohmann::json::parse(dumped.str()).at("chunks");
+    ASSERT_EQ(dumped_chunks.size(), 2);
+    EXPECT_EQ(dumped_chunks[0].at("content"), "Chunk_1");
+    EXPECT_TRUE(dumped_chunks[0].at("embedding").is_null());
+    EXPECT_TRUE(dumped_chunks[1].at("embedding").is_null());
+
+    // The embeddings are calculated again on load.
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({"Chunk_1", "Chunk_2"})))
+        .Times(2)
+        .WillRepeatedly(::testing::Return(std::vector<EmbeddingCalculationResult>{
+            EmbeddingCalculationResult{.embedding = {1.f, 0.f, 0.f}},
+            EmbeddingCalculationResult{.embedding = {0.f, 1.f, 0.f}}}));
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillOnce(::testing::Return(EmbeddingCalculationResult{.embedding = {0.1f, 0.6f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+    document_retriever.load(dumped);
+    document_retriever.load_binary(database_path);
+    std::filesystem::remove(database_path);
+
+    const auto result = document_retriever.retrieve("Query", 4);
+    ASSERT_EQ(result.size(), 4);
+    EXPECT_EQ(result[0].content, "Chunk_2");
+    EXPECT_EQ(result[1].content, "Chunk_2");
+}
+
+TEST_F(DocumentRetrievalTest, CheckBinaryDatabaseRoundtripSkipsEmbedding)
+{
+    const auto database_path = std::filesystem::temp_directory_path() / "document_retrieval_binary_test.bin";
+    {
+        auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+        EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+        EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+
+        auto document_retriever =
+            SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+        document_retriever.add_document_chunks(
+            {DocumentChunk{"Chunk_1", DocumentChunkMetadata{"a.pdf", 1}, Embedding{1.f, 0.f, 0.f}},
+             DocumentChunk{"Chunk_2", DocumentChunkMetadata{"b.pdf", 2}, Embedding{0.f, 1.f, 0.f}},
+             DocumentChunk{"Chunk_3", DocumentChunkMetadata{"c.pdf", 3}, Embedding{0.f, 0.f, 1.f}}});
+        // The removed chunks are not saved.
+        document_retriever.remove_document("c.pdf");
+        document_retriever.save_binary(database_path);
+    }
+
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(::testing::_)).Times(0);
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillRepeatedly(::testing::Return(EmbeddingCalculationResult{.embedding = {0.1f, 0.6f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+    document_retriever.load_binary(database_path);
+    // The loaded contents are read from the mapped file, which stays valid when the file is replaced.
+    document_retriever.save_binary(database_path);
+    std::filesystem::remove(database_path);
+
+    const auto result = document_retriever.retrieve("Query", 3);
+    ASSERT_EQ(result.size(), 2);
+    EXPECT_EQ(result[0].content, "Chunk_2");
+    EXPECT_EQ(result[0].chunk_id, 2);
+    EXPECT_EQ(result[1].content, "Chunk_1");
+    EXPECT_EQ(document_retriever.retrieve_filtered("Query", 3, RetrievalFilter{.sources = {"a.pdf"}}).size(), 1);
+    EXPECT_EQ(document_retriever.retrieve_hybrid("Query", 1, HybridSearchSettings{}).size(), 1);
+}
+
+TEST_F(DocumentRetrievalTest, CheckFilteredRetrievalBySourceAndChunkId)
+{
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillRepeatedly(::testing::Return(EmbeddingCalculationResult{.embedding = {1.f, 0.f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+
+    document_retriever.add_document_chunks(
+        {DocumentChunk{"Chunk_1", DocumentChunkMetadata{"a.pdf", 0}, Embedding{1.0f, 0.f, 0.f}},
+         DocumentChunk{"Chunk_2", DocumentChunkMetadata{"a.pdf", 1}, Embedding{0.9f, 0.1f, 0.f}},
+         DocumentChunk{"Chunk_3", DocumentChunkMetadata{"b.pdf", 0}, Embedding{0.8f, 0.2f, 0.f}},
+         DocumentChunk{"Chunk_4", DocumentChunkMetadata{"c.pdf", 0}, Embedding{0.7f, 0.3f, 0.f}}});
+
+    const auto by_source = document_retriever.retrieve_filtered("Query", 3, RetrievalFilter{.sources = {"b.pdf", "c.pdf"}});
+    ASSERT_EQ(by_source.size(), 2);
+    EXPECT_EQ(by_source[0].content, "Chunk_3");
+    EXPECT_EQ(by_source[1].content, "Chunk_4");
+
+    const auto by_chunk_id =
+        document_retriever.retrieve_filtered("Query", 1, RetrievalFilter{.sources = {"a.pdf"}, .min_chunk_id = 1});
+    ASSERT_EQ(by_chunk_id.size(), 1);
+    EXPECT_EQ(by_chunk_id[0].content, "Chunk_2");
+
+    EXPECT_TRUE(document_retriever.retrieve_filtered("Query", 3, RetrievalFilter{.sources = {"d.pdf"}}).empty());
+}
+
+TEST_F(DocumentRetrievalTest, CheckRemoveAndUpsertDocumentChunks)
+{
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({}))).Times(::testing::AnyNumber());
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillRepeatedly(::testing::Return(EmbeddingCalculationResult{.embedding = {1.f, 0.f, 0.f}}));
+
+    // The compaction is disabled first, so the tombstones are exercised.
+    auto document_retriever =
+        SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3), 1.f);
+
+    document_retriever.add_document_chunks(
+        {DocumentChunk{"Chunk_1", DocumentChunkMetadata{"a.pdf", 0}, Embedding{1.0f, 0.f, 0.f}},
+         DocumentChunk{"Chunk_2", DocumentChunkMetadata{"a.pdf", 1}, Embedding{0.9f, 0.1f, 0.f}},
+         DocumentChunk{"Chunk_3", DocumentChunkMetadata{"b.pdf", 0}, Embedding{0.8f, 0.2f, 0.f}},
+         DocumentChunk{"Chunk_4", DocumentChunkMetadata{"c.pdf", 0}, Embedding{0.7f, 0.3f, 0.f}}});
+
+    EXPECT_EQ(document_retriever.remove_document("a.pdf"), 2);
+    EXPECT_EQ(document_retriever.remove_document("a.pdf"), 0);
+
+    const auto after_removal = document_retriever.retrieve("Query", 4);
+    ASSERT_EQ(after_removal.size(), 2);
+    EXPECT_EQ(after_removal[0].content, "Chunk_3");
+    EXPECT_EQ(after_removal[1].content, "Chunk_4");
+
+    document_retriever.upsert_document_chunks(
+        {DocumentChunk{"Chunk_4_updated", DocumentChunkMetadata{"c.pdf", 0}, Embedding{0.95f, 0.05f, 0.f}}});
+
+    const auto after_upsert = document_retriever.retrieve("Query", 4);
+    ASSERT_EQ(after_upsert.size(), 2);
+    EXPECT_EQ(after_upsert[0].content, "Chunk_4_updated");
+    EXPECT_EQ(after_upsert[1].content, "Chunk_3");
+
+    // The compaction keeps the results, and the removed chunks don't come back with a dump.
+    document_retriever.compact();
+    const auto after_compaction = document_retriever.retrieve("Query", 4);
+    ASSERT_EQ(after_compaction.size(), 2);
+    EXPECT_EQ(after_compaction[0].content, "Chunk_4_updated");
+    EXPECT_EQ(after_compaction[1].content, "Chunk_3");
+
+    std::stringstream dumped;
+    document_retriever.dump(dumped);
+    EXPECT_EQ(nlohmann::json::parse(dumped.str()).at("chunks").size(), 2);
+}
+
+// Every text gets a random embedding seeded with its hash, so the same text is always embedded the same way.
+class SeededEmbeddingCalculator : public IEmbeddingCalculator
+{
+  public:
+    static constexpr size_t EMBEDDING_RANK = 16;
+
+    std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+    {
+        std::vector<EmbeddingCalculationResult> results;
+        results.reserve(chunks.size());
+        for(const auto& chunk : chunks)
+        {
+            std::mt19937 gen(std::hash<std::string>{}(chunk));
+            std::normal_distribution<float> dist(0.0f, 1.0f);
+
+            Embedding embedding(EMBEDDING_RANK);
+            std::ranges::generate(embedding, [&]() { return dist(gen); });
+            results.push_back(EmbeddingCalculationResult{.embedding = std::move(embedding), .n_tokens = 1});
+        }
+
+        return results;
+    }
+
+    size_t get_embedding_rank() const override { return EMBEDDING_RANK; }
+};
+
+TEST_F(DocumentRetrievalTest, CheckConcurrentRetrievalDuringUpdates)
+{
+    constexpr size_t N_STABLE_CHUNKS = 200;
+    constexpr size_t N_READERS = 4;
+    constexpr size_t N_UPDATES = 40;
+    constexpr size_t CHUNKS_PER_UPDATE = 10;
+
+    // A low compaction threshold, so the compactions also run concurrently with the queries.
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    0.05f);
+
+    std::vector<DocumentChunk> stable_chunks;
+    for(size_t i = 0; i < N_STABLE_CHUNKS; i++)
+        stable_chunks.push_back(DocumentChunk{"Stable_" + std::to_string(i), DocumentChunkMetadata{"stable.pdf", i}});
+    document_retriever.add_document_chunks(stable_chunks);
+
+    std::atomic<bool> updating = true;
+    std::vector<std::thread> readers;
+    for(size_t reader = 0; reader < N_READERS; reader++)
+    {
+        readers.emplace_back(
+            [&document_retriever, &updating, reader]()
+            {
+                std::mt19937 gen(reader);
+                std::uniform_int_distribution<size_t> chunk_dist(0, N_STABLE_CHUNKS - 1);
+
+                // The stable chunks are never updated, so every query must find its chunk at any point of time.
+                for(size_t n_queries = 0; updating || n_queries < 100; n_queries++)
+                {
+                    const auto chunk_id = chunk_dist(gen);
+                    const auto result = document_retriever.retrieve("Stable_" + std::to_string(chunk_id), 3);
+
+                    ASSERT_EQ(result.size(), 3);
+                    EXPECT_EQ(result[0].content, "Stable_" + std::to_string(chunk_id));
+                    EXPECT_EQ(result[0].chunk_id, chunk_id);
+                    EXPECT_NEAR(result[0].score, 1.f, 0.0001f);
+                }
+            });
+    }
+
+    for(size_t update = 0; update < N_UPDATES; update++)
+    {
+        const auto source = "updated_" + std::to_string(update) + ".pdf";
+        std::vector<DocumentChunk> chunks;
+        for(size_t i = 0; i < CHUNKS_PER_UPDATE; i++)
+        {
+            chunks.push_back(DocumentChunk{"Updated_" + std::to_string(update) + "_" + std::to_string(i),
+                                           DocumentChunkMetadata{source, i}});
+        }
+
+        document_retriever.add_document_chunks(chunks);
+        document_retriever.upsert_document_chunks({chunks[0], chunks[1]});
+        if(update % 2 == 0)
+            EXPECT_EQ(document_retriever.remove_document(source), CHUNKS_PER_UPDATE);
+    }
+    updating = false;
+
+    std::ranges::for_each(readers, [](std::thread& reader) { reader.join(); });
+
+    // Only the odd updates were kept, each of them once, next to the stable chunk with the same chunk_id.
+    const auto kept = document_retriever.retrieve_filtered("Updated_1_0", N_UPDATES * CHUNKS_PER_UPDATE,
+                                                           RetrievalFilter{.min_chunk_id = 0, .max_chunk_id = 0});
+    EXPECT_EQ(kept.size(), N_UPDATES / 2 + 1);
+    EXPECT_EQ(kept[0].content, "Updated_1_0");
+    EXPECT_NE(document_retriever.retrieve("Updated_0_0", 1)[0].content, "Updated_0_0");
+}
+
+TEST_F(DocumentRetrievalTest, CheckUpdatesDuringCompactionAreKept)
+{
+    constexpr size_t N_SOURCES = 20;
+    constexpr size_t N_UPDATES = 40;
+
+    // The compactions are started explicitly only, while the updates go on.
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    1.f);
+
+    std::set<std::string> expected_contents;
+    std::vector<DocumentChunk> chunks;
+    for(size_t i = 0; i < 100 * N_SOURCES; i++)
+    {
+        chunks.push_back(DocumentChunk{"Chunk_" + std::to_string(i),
+                                       DocumentChunkMetadata{std::to_string(i % N_SOURCES) + ".pdf", i}});
+        expected_contents.insert(chunks.back().content);
+    }
+    document_retriever.add_document_chunks(chunks);
+
+    std::atomic<bool> updating = true;
+    std::thread compactor(
+        [&document_retriever, &updating]()
+        {
+            while(updating)
+                document_retriever.compact();
+        });
+
+    // Every update removes the chunks of an old source and adds a new one.
+    for(size_t update = 0; update < N_UPDATES; update++)
+    {
+        const auto removed_source = std::to_string(update % N_SOURCES) + ".pdf";
+        document_retriever.remove_document(removed_source);
+        std::erase_if(expected_contents, [&chunks, &removed_source](const std::string& content)
+                      {
+                          return content.starts_with("Chunk_") &&
+                                 chunks[std::stoul(content.substr(6))].metadata.source == removed_source;
+                      });
+
+        const auto content = "Added_" + std::to_string(update);
+        document_retriever.add_document_chunks({DocumentChunk{content, DocumentChunkMetadata{"added.pdf", update}}});
+        expected_contents.insert(content);
+        if(update % 5 == 0)
+        {
+            document_retriever.remove_document("added.pdf");
+            std::erase_if(expected_contents, [](const std::string& content) { return content.starts_with("Added_"); });
+        }
+    }
+    updating = false;
+    compactor.join();
+    document_retriever.compact();
+
+    std::stringstream dumped;
+    document_retriever.dump(dumped);
+    const auto dumped_json = nlohmann::json::parse(dumped.str());
+    std::set<std::string> dumped_contents;
+    for(const auto& chunk : dumped_json.at("chunks"))
+        dumped_contents.insert(chunk.at("content").get<std::string>());
+    EXPECT_EQ(dumped_contents, expected_contents);
+    EXPECT_EQ(document_retriever.retrieve("Added_39", 1)[0].content, "Added_39");
+}
+
+TEST_F(DocumentRetrievalTest, CheckIncrementalAddsRetrieveFromAllSegments)
+{
+    const auto snapshot_dir = std::filesystem::temp_directory_path() / "document_retrieval_segments_test";
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK));
+
+    // The small additions after the first one are kept in the delta segments of the store, some of them merged.
+    std::vector<std::string> contents;
+    for(size_t update = 0; update < 30; update++)
+    {
+        std::vector<DocumentChunk> chunks;
+        const size_t n_chunks = update == 0 ? 100 : 1 + update % 4;
+        for(size_t i = 0; i < n_chunks; i++)
+        {
+            contents.push_back("Chunk_" + std::to_string(contents.size()));
+            chunks.push_back(DocumentChunk{contents.back(), DocumentChunkMetadata{std::to_string(update) + ".pdf", i}});
+        }
+        document_retriever.add_document_chunks(chunks);
+
+        const auto result = document_retriever.retrieve(contents.back(), 1);
+        ASSERT_EQ(result.size(), 1);
+        EXPECT_EQ(result[0].content, contents.back());
+    }
+
+    const auto batch_results = document_retriever.retrieve_batch({contents[5], contents[110], contents.back()}, 1);
+    ASSERT_EQ(batch_results.size(), 3);
+    EXPECT_EQ(batch_results[0][0].content, contents[5]);
+    EXPECT_EQ(batch_results[1][0].content, contents[110]);
+    EXPECT_EQ(batch_results[2][0].content, contents.back());
+
+    const auto filtered = document_retriever.retrieve_filtered(contents[5], 3, RetrievalFilter{.sources = {"29.pdf"}});
+    ASSERT_EQ(filtered.size(), 2);
+    EXPECT_EQ(filtered[0].content.substr(0, 6), "Chunk_");
+    EXPECT_NE(filtered[0].content, contents[5]);
+
+    // The removed chunks are dropped from all the segments, the rest keep their embeddings.
+    document_retriever.remove_document("0.pdf");
+    document_retriever.compact();
+    EXPECT_EQ(document_retriever.retrieve(contents[110], 1)[0].content, contents[110]);
+
+    std::stringstream dumped;
+    document_retriever.dump(dumped);
+    const auto dumped_chunks = nlohmann::json::parse(dumped.str()).at("chunks");
+    ASSERT_EQ(dumped_chunks.size(), contents.size() - 100);
+    EXPECT_EQ(dumped_chunks.back().at("content"), contents.back());
+
+    // The snapshot saves a single merged index.
+    document_retriever.add_document_chunks({DocumentChunk{"Chunk_last", DocumentChunkMetadata{"last.pdf", 0}}});
+    document_retriever.save_snapshot(snapshot_dir);
+    SimpleDocumentChunkRetriever loaded_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                  vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK));
+    loaded_retriever.load_snapshot(snapshot_dir);
+    std::filesystem::remove_all(snapshot_dir);
+
+    EXPECT_EQ(loaded_retriever.retrieve("Chunk_last", 1)[0].content, "Chunk_last");
+    EXPECT_EQ(loaded_retriever.retrieve(contents[120], 1)[0].content, contents[120]);
+}
+
+TEST_F(DocumentRetrievalTest, CheckBulkAddPublishesAllBatchesAtOnce)
+{
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK));
+    document_retriever.add_document_chunks({DocumentChunk{"Chunk_first", DocumentChunkMetadata{"first.pdf", 0}}});
+
+    std::vector<std::string> contents;
+    document_retriever.add_document_chunks(
+        [&](const IDocumentChunkRetriever::AddChunksFn& add_chunks)
+        {
+            for(size_t batch = 0; batch < 5; batch++)
+            {
+                std::vector<DocumentChunk> chunks;
+                for(size_t i = 0; i < 7; i++)
+                {
+                    contents.push_back("Chunk_" + std::to_string(contents.size()));
+                    const DocumentChunkMetadata metadata{"bulk.pdf", contents.size()};
+                    chunks.push_back(DocumentChunk{contents.back(), metadata});
+                }
+                add_chunks(chunks);
+
+                // The added batches aren't visible until all of them are published.
+                const auto result = document_retriever.retrieve(contents.back(), 3);
+                ASSERT_EQ(result.size(), 1);
+                EXPECT_EQ(result[0].content, "Chunk_first");
+            }
+            add_chunks({});
+        });
+
+    const auto batch_results = document_retriever.retrieve_batch({contents[0], contents[20], contents.back()}, 1);
+    ASSERT_EQ(batch_results.size(), 3);
+    EXPECT_EQ(batch_results[0][0].content, contents[0]);
+    EXPECT_EQ(batch_results[1][0].content, contents[20]);
+    EXPECT_EQ(batch_results[2][0].content, contents.back());
+    EXPECT_EQ(document_retriever.retrieve_hybrid(contents[20], 1, HybridSearchSettings{})[0].content, contents[20]);
+    EXPECT_EQ(document_retriever.remove_document("bulk.pdf"), contents.size());
+}
+
+// Blocks the first embedding of the "Slow" chunk until it's released.
+class BlockingEmbeddingCalculator : public SeededEmbeddingCalculator
+{
+  public:
+    std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+    {
+        if(std::ranges::find(chunks, "Slow") != chunks.end() && !blocked.exchange(true))
+        {
+            embedding_started.set_value();
+            released.wait();
+        }
+
+        return SeededEmbeddingCalculator::calc_batch(chunks);
+    }
+
+    mutable std::atomic<bool> blocked = false;
+    mutable std::promise<void> embedding_started;
+    std::shared_future<void> released;
+};
+
+TEST_F(DocumentRetrievalTest, CheckUpdatesDontWaitForTheEmbedding)
+{
+    std::promise<void> release;
+    auto embedding_calculator = std::make_unique<BlockingEmbeddingCalculator>();
+    embedding_calculator->released = release.get_future().share();
+    auto embedding_started = embedding_calculator->embedding_started.get_future();
+    SimpleDocumentChunkRetriever document_retriever(std::move(embedding_calculator),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK));
+    document_retriever.add_document_chunks({DocumentChunk{"Old", DocumentChunkMetadata{"a.pdf", 1}}});
+
+    std::thread slow_upsert([&document_retriever]()
+                            { document_retriever.upsert_document_chunks({DocumentChunk{"Slow", {"a.pdf", 1}}}); });
+    embedding_started.wait();
+
+    // The other updates are applied while the upserted chunk is being embedded.
+    document_retriever.add_document_chunks({DocumentChunk{"Fast", DocumentChunkMetadata{"a.pdf", 1}}});
+    document_retriever.add_document_chunks({DocumentChunk{"Other", DocumentChunkMetadata{"b.pdf", 1}}});
+    EXPECT_EQ(document_retriever.retrieve("Fast", 1)[0].content, "Fast");
+
+    release.set_value();
+    slow_upsert.join();
+
+    // The upsert replaces the chunks of the state it's applied to, also the ones added during the embedding.
+    const auto retrieved = document_retriever.retrieve_filtered("Slow", 4, RetrievalFilter{.sources = {"a.pdf"}});
+    ASSERT_EQ(retrieved.size(), 1);
+    EXPECT_EQ(retrieved[0].content, "Slow");
+    EXPECT_EQ(document_retriever.retrieve("Other", 1)[0].content, "Other");
+}
+
+TEST_F(DocumentRetrievalTest, CheckLoadDoesntBlockTheUpdates)
+{
+    std::promise<void> release;
+    auto embedding_calculator = std::make_unique<BlockingEmbeddingCalculator>();
+    embedding_calculator->released = release.get_future().share();
+    auto embedding_started = embedding_calculator->embedding_started.get_future();
+    SimpleDocumentChunkRetriever document_retriever(std::move(embedding_calculator),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK));
+
+    std::stringstream input(R"({"chunks":[{"content":"Slow","metadata":{"source":"a.pdf","chunk_id":1}}]})");
+    std::thread slow_load([&document_retriever, &input]() { document_retriever.load(input); });
+    embedding_started.wait();
+
+    document_retriever.add_document_chunks({DocumentChunk{"Fast", DocumentChunkMetadata{"b.pdf", 1}}});
+    EXPECT_EQ(document_retriever.retrieve("Fast", 2).size(), 1);
+
+    release.set_value();
+    slow_load.join();
+    const auto retrieved = document_retriever.retrieve("Slow", 2);
+    ASSERT_EQ(retrieved.size(), 2);
+    EXPECT_EQ(retrieved[0].content, "Slow");
+}
+
+TEST_F(DocumentRetrievalTest, CheckPipelinedIngestionKeepsChunkOrder)
+{
+    constexpr size_t N_CHUNKS = 1000;
+
+    // Fails the blocks with the broken chunk, the other blocks are embedded as usual.
+    class FailingEmbeddingCalculator : public SeededEmbeddingCalculator
+    {
+      public:
+        std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+        {
+            if(std::ranges::find(chunks, "Broken") != chunks.end())
+                throw std::runtime_error("Embedding calculation failed.");
+
+            return SeededEmbeddingCalculator::calc_batch(chunks);
+        }
+    };
+
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<FailingEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    DEFAULT_COMPACTION_THRESHOLD, 4);
+
+    std::vector<DocumentChunk> chunks;
+    for(size_t i = 0; i < N_CHUNKS; i++)
+        chunks.push_back(DocumentChunk{"Chunk_" + std::to_string(i), DocumentChunkMetadata{"a.pdf", i}});
+    document_retriever.add_document_chunks(chunks);
+
+    for(size_t chunk_id = 0; chunk_id < N_CHUNKS; chunk_id += 37)
+    {
+        const auto result = document_retriever.retrieve("Chunk_" + std::to_string(chunk_id), 1);
+        ASSERT_EQ(result.size(), 1);
+        EXPECT_EQ(result[0].content, "Chunk_" + std::to_string(chunk_id));
+        EXPECT_EQ(result[0].chunk_id, chunk_id);
+    }
+
+    // A failed block leaves the published chunks as they were.
+    chunks.back() = DocumentChunk{"Broken", DocumentChunkMetadata{"b.pdf", 0}};
+    EXPECT_THROW(document_retriever.add_document_chunks(chunks), std::runtime_error);
+    EXPECT_EQ(document_retriever.remove_document("b.pdf"), 0);
+    EXPECT_EQ(document_retriever.retrieve_filtered("Chunk_0", N_CHUNKS * 2, RetrievalFilter{}).size(), N_CHUNKS);
+}
+
+TEST_F(DocumentRetrievalTest, CheckLoadEmbedsThroughTheIngestionPipeline)
+{
+    constexpr size_t N_CHUNKS = 3000;
+
+    // Records the largest embedded batch.
+    class RecordingEmbeddingCalculator : public SeededEmbeddingCalculator
+    {
+      public:
+        std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+        {
+            size_t max_size = max_batch_size.load();
+            while(max_size < chunks.size() && !max_batch_size.compare_exchange_weak(max_size, chunks.size()))
+            {
+            }
+            return SeededEmbeddingCalculator::calc_batch(chunks);
+        }
+
+        mutable std::atomic<size_t> max_batch_size = 0;
+    };
+
+    auto embedding_calculator = std::make_unique<RecordingEmbeddingCalculator>();
+    const auto& max_batch_size = embedding_calculator->max_batch_size;
+    SimpleDocumentChunkRetriever document_retriever(std::move(embedding_calculator),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    DEFAULT_COMPACTION_THRESHOLD, 4);
+
+    nlohmann::json chunks = nlohmann::json::array();
+    for(size_t i = 0; i < N_CHUNKS; i++)
+    {
+        chunks.push_back(
+            {{"content", "Chunk_" + std::to_string(i)}, {"metadata", {{"source", "a.pdf"}, {"chunk_id", i}}}});
+    }
+    std::stringstream input(nlohmann::json{{"chunks", std::move(chunks)}}.dump());
+    document_retriever.load(input);
+
+    // Embedded in the ingestion blocks of 128 chunks, not in the parsed batches.
+    EXPECT_LE(max_batch_size.load(), 128);
+    for(size_t chunk_id = 0; chunk_id < N_CHUNKS; chunk_id += 101)
+    {
+        const auto result = document_retriever.retrieve("Chunk_" + std::to_string(chunk_id), 1);
+        ASSERT_EQ(result.size(), 1);
+        EXPECT_EQ(result[0].chunk_id, chunk_id);
+    }
+}
+
+TEST_F(DocumentRetrievalTest, CheckDiverseRetrievalSkipsDuplicates)
+{
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({})));
+    EXPECT_CALL(*embedding_calculator, calc("Query"))
+        .WillRepeatedly(::testing::Return(EmbeddingCalculationResult{.embedding = {1.f, 0.2f, 0.f}}));
+
+    auto document_retriever = SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+    document_retriever.add_document_chunks(
+        {DocumentChunk{"Boilerplate", DocumentChunkMetadata{"a.pdf", 0}, Embedding{1.f, 0.f, 0.f}},
+         DocumentChunk{"Boilerplate copy", DocumentChunkMetadata{"b.pdf", 0}, Embedding{0.99f, 0.f, 0.01f}},
+         DocumentChunk{"Boilerplate another copy", DocumentChunkMetadata{"c.pdf", 0}, Embedding{0.98f, 0.f, 0.02f}},
+         DocumentChunk{"Related", DocumentChunkMetadata{"a.pdf", 1}, Embedding{0.7f, 0.7f, 0.f}},
+         DocumentChunk{"Other", DocumentChunkMetadata{"a.pdf", 2}, Embedding{0.f, 0.2f, 1.f}}});
+
+    const auto similar = document_retriever.retrieve("Query", 3);
+    ASSERT_EQ(similar.size(), 3);
+    EXPECT_EQ(similar[2].content.substr(0, 11), "Boilerplate");
+
+    // The copies are dropped, the remaining candidates are taken even with the lower relevance.
+    const auto diverse = document_retriever.retrieve_diverse("Query", 3, MmrSettings{.lambda = 0.5f});
+    ASSERT_EQ(diverse.size(), 3);
+    EXPECT_EQ(diverse[0].content, "Boilerplate");
+    EXPECT_EQ(diverse[1].content, "Related");
+    EXPECT_EQ(diverse[2].content, "Other");
+    EXPECT_NEAR(diverse[1].score, 0.832f, 0.001f);
+
+    // With the duplicate threshold above the copies similarity, the pure relevance ranking keeps them.
+    const auto relevant =
+        document_retriever.retrieve_diverse("Query", 3, MmrSettings{.lambda = 1.f, .duplicate_threshold = 1.1f});
+    ASSERT_EQ(relevant.size(), 3);
+    EXPECT_EQ(relevant[1].content.substr(0, 11), "Boilerplate");
+}
+
+TEST_F(DocumentRetrievalTest, CheckHybridRetrievalFindsExactIdentifiers)
+{
+    const auto create_retriever = []()
+    {
+        auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+        EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(3));
+        EXPECT_CALL(*embedding_calculator, calc_batch(::testing::_)).Times(::testing::AnyNumber());
+        EXPECT_CALL(*embedding_calculator, calc("What does E1042 mean?"))
+            .WillRepeatedly(::testing::Return(EmbeddingCalculationResult{.embedding = {1.f, 0.1f, 0.f}}));
+
+        return SimpleDocumentChunkRetriever(std::move(embedding_calculator), vector_store_factory(3));
+    };
+
+    auto document_retriever = create_retriever();
+    document_retriever.add_document_chunks(
+        {DocumentChunk{"Troubleshooting overview", DocumentChunkMetadata{"a.pdf", 0}, Embedding{1.f, 0.f, 0.f}},
+         DocumentChunk{"Status codes", DocumentChunkMetadata{"a.pdf", 1}, Embedding{0.7f, 0.7f, 0.f}},
+         DocumentChunk{"E1042: the filter is clogged", DocumentChunkMetadata{"b.pdf", 0}, Embedding{0.1f, 0.f, 1.f}}});
+
+    const auto dense = document_retriever.retrieve("What does E1042 mean?", 1);
+    ASSERT_EQ(dense.size(), 1);
+    EXPECT_EQ(dense[0].content, "Troubleshooting overview");
+
+    const auto hybrid = document_retriever.retrieve_hybrid("What does E1042 mean?", 2, HybridSearchSettings{});
+    ASSERT_EQ(hybrid.size(), 2);
+    EXPECT_EQ(hybrid[0].content, "E1042: the filter is clogged");
+    EXPECT_FLOAT_EQ(*hybrid[0].fused_score, 1.f / 61.f + 1.f / 63.f);
+    EXPECT_NEAR(hybrid[0].score, 0.1f / 1.01f, 0.0001f);
+    EXPECT_EQ(hybrid[1].content, "Troubleshooting overview");
+    EXPECT_NEAR(hybrid[1].score, 1.f / std::sqrt(1.01f), 0.0001f);
+    EXPECT_FALSE(dense[0].fused_score);
+
+    // Without the vector candidates beyond top_k, the cosine of the lexical match comes from its stored vector.
+    const auto lexical_only =
+        document_retriever.retrieve_hybrid("What does E1042 mean?", 2, HybridSearchSettings{.fetch_factor = 1});
+    ASSERT_EQ(lexical_only.size(), 2);
+    EXPECT_EQ(lexical_only[1].content, "E1042: the filter is clogged");
+    EXPECT_FLOAT_EQ(*lexical_only[1].fused_score, 1.f / 61.f);
+    EXPECT_NEAR(lexical_only[1].score, 0.1f / 1.01f, 0.0001f);
+
+    // The lexical index is saved with the snapshot and follows the removals.
+    const auto snapshot_dir = std::filesystem::temp_directory_path() / "document_retrieval_hybrid_snapshot_test";
+    document_retriever.save_snapshot(snapshot_dir);
+    EXPECT_TRUE(std::filesystem::exists(snapshot_dir / "lexical.index"));
+    document_retriever.remove_document("b.pdf");
+    EXPECT_EQ(document_retriever.retrieve_hybrid("What does E1042 mean?", 1, HybridSearchSettings{})[0].content,
+              "Troubleshooting overview");
+
+    auto loaded_retriever = create_retriever();
+    loaded_retriever.load_snapshot(snapshot_dir);
+    std::filesystem::remove_all(snapshot_dir);
+    EXPECT_EQ(loaded_retriever.retrieve_hybrid("What does E1042 mean?", 1, HybridSearchSettings{})[0].content,
+              "E1042: the filter is clogged");
+}
+
+// Counts the embedded texts.
+class CountingEmbeddingCalculator : public SeededEmbeddingCalculator
+{
+  public:
+    std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>& chunks) const override
+    {
+        n_embedded += chunks.size();
+        return SeededEmbeddingCalculator::calc_batch(chunks);
+    }
+
+    mutable std::atomic<size_t> n_embedded = 0;
+};
+
+TEST_F(DocumentRetrievalTest, CheckQueryCacheSkipsRepeatedQuestions)
+{
+    auto embedding_calculator = std::make_unique<CountingEmbeddingCalculator>();
+    const auto* calculator = embedding_calculator.get();
+    SimpleDocumentChunkRetriever document_retriever(std::move(embedding_calculator),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    DEFAULT_COMPACTION_THRESHOLD, 1, 1 << 20);
+
+    document_retriever.add_document_chunks({DocumentChunk{"Chunk_1"}, DocumentChunk{"Chunk_2"}});
+    const size_t n_ingested = calculator->n_embedded;
+
+    const auto first = document_retriever.retrieve("Chunk_1", 2);
+    const auto second = document_retriever.retrieve("Chunk_1", 2);
+    EXPECT_EQ(calculator->n_embedded, n_ingested + 1);
+    ASSERT_EQ(second.size(), 2);
+    EXPECT_EQ(second[0].content, first[0].content);
+    EXPECT_EQ(second[1].chunk_id, first[1].chunk_id);
+
+    // The same question with another top_k reuses the embedding only.
+    EXPECT_EQ(document_retriever.retrieve("Chunk_1", 1).size(), 1);
+
+    // The cached questions are not embedded again in a batch, nor searched.
+    const auto batch = document_retriever.retrieve_batch({"Chunk_1", "Chunk_2"}, 2);
+    EXPECT_EQ(calculator->n_embedded, n_ingested + 2);
+    EXPECT_EQ(batch[0][0].content, "Chunk_1");
+    EXPECT_EQ(batch[1][0].content, "Chunk_2");
+
+    const auto stats = document_retriever.query_cache_stats();
+    EXPECT_EQ(stats.embedding_hits, 3);
+    EXPECT_EQ(stats.embedding_misses, 2);
+    EXPECT_EQ(stats.result_hits, 2);
+    EXPECT_EQ(stats.result_misses, 3);
+    EXPECT_GT(stats.memory_bytes, 0);
+}
+
+TEST_F(DocumentRetrievalTest, CheckQueryCacheInvalidatedByUpdates)
+{
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    DEFAULT_COMPACTION_THRESHOLD, 1, 1 << 20);
+
+    document_retriever.add_document_chunks({DocumentChunk{"Chunk_1", DocumentChunkMetadata{"a.pdf", 0}}});
+    EXPECT_EQ(document_retriever.retrieve("Chunk_2", 1)[0].content, "Chunk_1");
+
+    document_retriever.add_document_chunks({DocumentChunk{"Chunk_2", DocumentChunkMetadata{"b.pdf", 0}}});
+    EXPECT_EQ(document_retriever.retrieve("Chunk_2", 1)[0].content, "Chunk_2");
+
+    EXPECT_EQ(document_retriever.remove_document("b.pdf"), 1);
+    EXPECT_EQ(document_retriever.retrieve("Chunk_2", 1)[0].content, "Chunk_1");
+
+    const auto stats = document_retriever.query_cache_stats();
+    EXPECT_EQ(stats.embedding_hits, 2);
+    EXPECT_EQ(stats.result_hits, 0);
+    EXPECT_EQ(stats.result_misses, 3);
+}
+
+TEST_F(DocumentRetrievalTest, CheckQueryCacheMemoryCap)
+{
+    constexpr size_t QUERY_CACHE_BYTES = 4096;
+    SimpleDocumentChunkRetriever document_retriever(std::make_unique<SeededEmbeddingCalculator>(),
+                                                    vector_store_factory(SeededEmbeddingCalculator::EMBEDDING_RANK),
+                                                    DEFAULT_COMPACTION_THRESHOLD, 1, QUERY_CACHE_BYTES);
+    document_retriever.add_document_chunks({DocumentChunk{"Chunk_1"}, DocumentChunk{"Chunk_2"}});
+
+    for(size_t i = 0; i < 100; i++)
+    {
+        document_retriever.retrieve("Question_" + std::to_string(i), 2);
+        EXPECT_LE(document_retriever.query_cache_stats().memory_bytes, QUERY_CACHE_BYTES);
+    }
+
+    // The least recently used questions were evicted, the latest one is still cached.
+    document_retriever.retrieve("Question_0", 2);
+    document_retriever.retrieve("Question_99", 2);
+    const auto stats = document_retriever.query_cache_stats();
+    EXPECT_EQ(stats.embedding_misses, 101);
+    EXPECT_EQ(stats.embedding_hits, 1);
+    EXPECT_EQ(stats.result_hits, 1);
+}
+
+} // namespace ds
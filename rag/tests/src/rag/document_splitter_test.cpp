@@ -0,0 +1,122 @@
+#include "rag/document_splitter.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+namespace ds
+{
+
+class DocumentSplitterTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        std::filesystem::create_directories(directory_ / "nested");
+        write_("b.txt", "second document\r\nwith two lines");
+        write_("a.md", "# Heading\nfirst document");
+        write_("nested/c.txt", "third");
+        write_("image.png", "not a document");
+    }
+
+    void TearDown() override { std::filesystem::remove_all(directory_); }
+
+    const std::filesystem::path directory_ = std::filesystem::temp_directory_path() / "document_splitter_test";
+
+    void write_(const std::filesystem::path& name, const std::string& content) const
+    {
+        std::ofstream(directory_ / name, std::ios::binary) << content;
+    }
+};
+
+TEST_F(DocumentSplitterTest, CheckDocumentsFoundRecursivelyInOrder)
+{
+    EXPECT_EQ(find_documents(directory_), std::vector<std::filesystem::path>({directory_ / "a.md", directory_ / "b.txt",
+                                                                               directory_ / "nested/c.txt"}));
+    EXPECT_EQ(find_documents(directory_ / "b.txt"), std::vector<std::filesystem::path>({directory_ / "b.txt"}));
+    EXPECT_THROW(find_documents(directory_ / "image.png"), std::runtime_error);
+}
+
+TEST_F(DocumentSplitterTest, CheckDocumentSplit)
+{
+    const DocumentSplitterParams params{.text_splitter_params = {.chunk_size = 16}};
+    const auto chunks = split_document(directory_ / "b.txt", params, 5);
+
+    ASSERT_EQ(chunks.size(), 2);
+    EXPECT_EQ(chunks[0].content, "second document");
+    EXPECT_EQ(chunks[1].content, "with two lines");
+    EXPECT_EQ(chunks[0].metadata.source, (directory_ / "b.txt").generic_string());
+    EXPECT_EQ(chunks[0].metadata.chunk_id, 5);
+    EXPECT_EQ(chunks[1].metadata.chunk_id, 6);
+}
+
+TEST_F(DocumentSplitterTest, CheckDocumentsSplitInOrderWithRunningChunkIds)
+{
+    const auto paths = find_documents(directory_);
+    for(const size_t n_threads : {1, 4})
+    {
+        std::vector<DocumentChunk> chunks;
+        split_documents(paths, DocumentSplitterParams{.text_splitter_params = {.chunk_size = 16}, .n_threads = n_threads},
+                        [&chunks](std::vector<DocumentChunk>&& document_chunks)
+                        { std::ranges::move(document_chunks, std::back_inserter(chunks)); });
+
+        std::vector<std::string> contents;
+        for(size_t i = 0; i < chunks.size(); i++)
+        {
+            contents.push_back(chunks[i].content);
+            EXPECT_EQ(chunks[i].metadata.chunk_id, i);
+        }
+        EXPECT_EQ(contents, std::vector<std::string>(
+                                {"# Heading", "first document", "second document", "with two lines", "third"}));
+    }
+}
+
+TEST_F(DocumentSplitterTest, CheckTokenBudgetSplit)
+{
+    // Every word is a token, the tokenized chunks are recorded.
+    class MockEmbeddingCalculator : public IEmbeddingCalculator
+    {
+      public:
+        std::vector<EmbeddingCalculationResult> calc_batch(const std::vector<std::string>&) const override
+        {
+            return {};
+        }
+        size_t get_embedding_rank() const override { return 1; }
+        size_t count_tokens(const std::string& text) const override
+        {
+            return std::ranges::count(text, ' ') + !text.empty() - text.starts_with(' ');
+        }
+        size_t tokenize_chunk(const std::string& chunk) const override
+        {
+            std::lock_guard lock(mutex_);
+            tokenized_.push_back(chunk);
+            return count_tokens(chunk);
+        }
+        size_t max_text_tokens() const override { return 3; }
+
+        mutable std::mutex mutex_;
+        mutable std::vector<std::string> tokenized_;
+    };
+
+    write_("words.txt", "one two three four five six seven");
+    const MockEmbeddingCalculator calculator;
+    const auto params = token_budget_params(calculator, 512, 0);
+    EXPECT_EQ(params.text_splitter_params.chunk_size, 3);
+
+    std::vector<std::string> contents;
+    for(const auto& chunk : split_document(directory_ / "words.txt", params))
+        contents.push_back(chunk.content);
+    EXPECT_EQ(contents, std::vector<std::string>({"one two three", "four five six", "seven"}));
+    // Only the whole chunks are tokenized, so the calculator keeps just their tokens for the embedding.
+    EXPECT_EQ(calculator.tokenized_, contents);
+}
+
+TEST_F(DocumentSplitterTest, CheckMissingDocumentThrows)
+{
+    const std::vector<std::filesystem::path> paths{directory_ / "a.md", directory_ / "missing.txt"};
+    EXPECT_THROW(split_documents(paths, {}, [](std::vector<DocumentChunk>&&) {}), std::runtime_error);
+}
+} // namespace ds
@@ -0,0 +1,190 @@
+#include "rag/embedding_cache.h"
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+namespace ds
+{
+
+class EmbeddingCacheTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override { std::filesystem::remove(path_); }
+    void TearDown() override { std::filesystem::remove(path_); }
+
+    const std::filesystem::path path_ = std::filesystem::temp_directory_path() / "embedding_cache_test.bin";
+
+    class MockEmbeddingCalculator : public IEmbeddingCalculator
+    {
+      public:
+        MOCK_METHOD(std::vector<EmbeddingCalculationResult>, calc_batch, (const std::vector<std::string>& chunks),
+                    (const override));
+        MOCK_METHOD(size_t, get_embedding_rank, (), (const override));
+    };
+};
+
+TEST_F(EmbeddingCacheTest, CheckEmbeddingsPersist)
+{
+    {
+        EmbeddingCache cache(path_, "model", 2);
+        cache.put("First chunk", Embedding{1.f, 0.f});
+        cache.put("Second chunk", Embedding{0.f, 1.f});
+        cache.put("First chunk", Embedding{0.5f, 0.5f});
+        EXPECT_EQ(cache.size(), 2);
+        EXPECT_THROW(EmbeddingCache(path_, "model", 2), std::runtime_error);
+    }
+
+    EmbeddingCache cache(path_, "model", 2);
+    Embedding embedding(2);
+    ASSERT_TRUE(cache.get("First chunk", embedding));
+    EXPECT_EQ(embedding, Embedding({1.f, 0.f}));
+    ASSERT_TRUE(cache.get("Second chunk", embedding));
+    EXPECT_EQ(embedding, Embedding({0.f, 1.f}));
+    EXPECT_FALSE(cache.get("Third chunk", embedding));
+    EXPECT_EQ(cache.hits(), 2);
+    EXPECT_EQ(cache.misses(), 1);
+    EXPECT_THROW(cache.put("Third chunk", Embedding{1.f}), std::logic_error);
+}
+
+TEST_F(EmbeddingCacheTest, CheckRecordsAreKeyedByModel)
+{
+    Embedding embedding(2);
+    {
+        EmbeddingCache cache(path_, "model", 2);
+        cache.put("Chunk", Embedding{1.f, 0.f});
+    }
+    {
+        EmbeddingCache cache(path_, "other model", 2);
+        EXPECT_FALSE(cache.get("Chunk", embedding));
+        cache.put("Chunk", Embedding{0.f, 1.f});
+    }
+
+    EmbeddingCache cache(path_, "model", 2);
+    ASSERT_TRUE(cache.get("Chunk", embedding));
+    EXPECT_EQ(embedding, Embedding({1.f, 0.f}));
+}
+
+TEST_F(EmbeddingCacheTest, CheckIncompleteRecordIsDropped)
+{
+    {
+        EmbeddingCache cache(path_, "model", 2);
+        cache.put("First chunk", Embedding{1.f, 0.f});
+        cache.put("Second chunk", Embedding{0.f, 1.f});
+    }
+    std::filesystem::resize_file(path_, std::filesystem::file_size(path_) - sizeof(float));
+
+    Embedding embedding(2);
+    {
+        EmbeddingCache cache(path_, "model", 2);
+        EXPECT_TRUE(cache.get("First chunk", embedding));
+        EXPECT_FALSE(cache.get("Second chunk", embedding));
+        cache.put("Third chunk", Embedding{0.6f, 0.8f});
+    }
+
+    EmbeddingCache cache(path_, "model", 2);
+    ASSERT_TRUE(cache.get("Third chunk", embedding));
+    EXPECT_EQ(embedding, Embedding({0.6f, 0.8f}));
+}
+
+TEST_F(EmbeddingCacheTest, CheckZeroFilledRecordIsDropped)
+{
+    {
+        EmbeddingCache cache(path_, "model", 2);
+        cache.put("First chunk", Embedding{1.f, 0.f});
+        cache.put("Second chunk", Embedding{0.f, 1.f});
+    }
+
+    // The last record keeps its header, but its embedding is zero-filled as after a crash.
+    {
+        std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(static_cast<std::streamoff>(std::filesystem::file_size(path_) - 2 * sizeof(float)));
+        const float zeros[2] = {};
+        file.write(reinterpret_cast<const char*>(zeros), sizeof(zeros));
+    }
+
+    Embedding embedding(2);
+    EmbeddingCache cache(path_, "model", 2);
+    ASSERT_TRUE(cache.get("First chunk", embedding));
+    EXPECT_EQ(embedding, Embedding({1.f, 0.f}));
+    EXPECT_FALSE(cache.get("Second chunk", embedding));
+    EXPECT_EQ(cache.size(), 1);
+}
+
+TEST_F(EmbeddingCacheTest, CheckFileContentHash)
+{
+    const auto other_path = std::filesystem::temp_directory_path() / "embedding_cache_test_copy.bin";
+    {
+        std::ofstream(path_, std::ios::out | std::ios::binary) << std::string(3 << 20, 'a');
+        std::ofstream(other_path, std::ios::out | std::ios::binary) << std::string(3 << 20, 'a');
+    }
+    EXPECT_EQ(hash_file_content(path_), hash_file_content(other_path));
+
+    std::ofstream(other_path, std::ios::out | std::ios::binary) << std::string(3 << 20, 'a') << 'b';
+    EXPECT_NE(hash_file_content(path_), hash_file_content(other_path));
+    std::filesystem::remove(other_path);
+    EXPECT_THROW(hash_file_content(other_path), std::runtime_error);
+}
+
+TEST_F(EmbeddingCacheTest, CheckModelContentHashIsKeptInTheHeader)
+{
+    const auto model_path = std::filesystem::temp_directory_path() / "embedding_cache_test_model.gguf";
+    std::ofstream(model_path, std::ios::out | std::ios::binary) << "first model";
+    const auto model_mtime = std::filesystem::last_write_time(model_path);
+    {
+        EmbeddingCache cache(path_, model_path, "512", 2);
+        cache.put("Chunk", Embedding{1.f, 0.f});
+    }
+
+    // The model with the same path, size and modification time is not hashed again.
+    std::ofstream(model_path, std::ios::out | std::ios::binary) << "other model";
+    std::filesystem::last_write_time(model_path, model_mtime);
+    Embedding embedding(2);
+    EXPECT_TRUE(EmbeddingCache(path_, model_path, "512", 2).get("Chunk", embedding));
+    EXPECT_FALSE(EmbeddingCache(path_, model_path, "256", 2).get("Chunk", embedding));
+
+    std::filesystem::last_write_time(model_path, model_mtime + std::chrono::seconds(1));
+    EXPECT_FALSE(EmbeddingCache(path_, model_path, "512", 2).get("Chunk", embedding));
+
+    std::ofstream(model_path, std::ios::out | std::ios::binary) << "first model";
+    EXPECT_TRUE(EmbeddingCache(path_, model_path, "512", 2).get("Chunk", embedding));
+    std::filesystem::remove(model_path);
+}
+
+TEST_F(EmbeddingCacheTest, CheckInvalidFileIsRejected)
+{
+    {
+        std::ofstream output(path_, std::ios::out);
+        output << R"({"chunks":[]})";
+    }
+    EXPECT_THROW(EmbeddingCache(path_, "model", 2), std::runtime_error);
+}
+
+TEST_F(EmbeddingCacheTest, CheckOnlyMissingChunksAreCalculated)
+{
+    auto embedding_calculator = std::make_unique<MockEmbeddingCalculator>();
+    EXPECT_CALL(*embedding_calculator, get_embedding_rank()).WillRepeatedly(::testing::Return(2));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({"A", "B"})))
+        .WillOnce(::testing::Return(std::vector<EmbeddingCalculationResult>{
+            EmbeddingCalculationResult{.embedding = {1.f, 0.f}}, EmbeddingCalculationResult{.embedding = {0.f, 1.f}}}));
+    EXPECT_CALL(*embedding_calculator, calc_batch(std::vector<std::string>({"C"})))
+        .WillOnce(::testing::Return(
+            std::vector<EmbeddingCalculationResult>{EmbeddingCalculationResult{.embedding = {0.6f, 0.8f}}}));
+
+    const CachingEmbeddingCalculator caching_calculator(std::move(embedding_calculator),
+                                                        std::make_unique<EmbeddingCache>(path_, "model", 2));
+
+    auto embeddings = caching_calculator.calc_batch_matrix({"A", "B", "A"});
+    EXPECT_EQ(std::vector<float>(embeddings.data(), embeddings.data() + 6),
+              std::vector<float>({1.f, 0.f, 0.f, 1.f, 1.f, 0.f}));
+
+    embeddings = caching_calculator.calc_batch_matrix({"C", "B"});
+    EXPECT_EQ(std::vector<float>(embeddings.data(), embeddings.data() + 4), std::vector<float>({0.6f, 0.8f, 0.f, 1.f}));
+    EXPECT_EQ(caching_calculator.cache().size(), 3);
+    EXPECT_EQ(caching_calculator.cache().hits(), 1);
+
+    EXPECT_TRUE(caching_calculator.calc_batch_matrix({}).empty());
+}
+} // namespace ds
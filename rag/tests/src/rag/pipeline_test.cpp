@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "rag/pipeline.h"
+
+#include <algorithm>
+
+namespace ds
+{
+
+class PipelineTest : public ::testing::Test
+{
+  public:
+    const std::vector<RetrievedDocumentChunk> CHUNKS{{"one two three", 0, 0.9f},
+                                                     {"four five", 1, 0.85f},
+                                                     {"six", 2, 0.7f},
+                                                     {"seven eight nine ten", 3, 0.5f}};
+
+    // Every word is a single token.
+    static std::size_t count_words(const std::string& text)
+    {
+        return std::ranges::count(text, ' ') + 1;
+    }
+
+    static std::vector<uint64_t> chunk_ids(const std::vector<RetrievedDocumentChunk>& chunks)
+    {
+        std::vector<uint64_t> ids;
+        std::ranges::transform(chunks, std::back_inserter(ids), &RetrievedDocumentChunk::chunk_id);
+        return ids;
+    }
+};
+
+TEST_F(PipelineTest, CheckWithoutCutoffsAllChunksAreSelected)
+{
+    const auto selected = select_context_chunks(CHUNKS, RagInferenceSettings{.top_k = 4},
+                                                [](const std::string&) -> std::size_t
+                                                {
+                                                    ADD_FAILURE() << "Tokens should not be counted without the cap.";
+                                                    return 0;
+                                                });
+
+    EXPECT_EQ(chunk_ids(selected), std::vector<uint64_t>({0, 1, 2, 3}));
+}
+
+TEST_F(PipelineTest, CheckMinScoreCutoff)
+{
+    const auto selected =
+        select_context_chunks(CHUNKS, RagInferenceSettings{.top_k = 4, .min_score = 0.7f}, count_words);
+
+    EXPECT_EQ(chunk_ids(selected), std::vector<uint64_t>({0, 1, 2}));
+}
+
+TEST_F(PipelineTest, CheckRelativeScoreGapCutoff)
+{
+    // 10% of the best score allows down to 0.81.
+    const auto selected =
+        select_context_chunks(CHUNKS, RagInferenceSettings{.top_k = 4, .max_relative_score_gap = 0.1f}, count_words);
+
+    EXPECT_EQ(chunk_ids(selected), std::vector<uint64_t>({0, 1}));
+}
+
+TEST_F(PipelineTest, CheckContextTokensCap)
+{
+    EXPECT_EQ(chunk_ids(select_context_chunks(CHUNKS, RagInferenceSettings{.top_k = 4, .max_context_tokens = 6},
+                                              count_words)),
+              std::vector<uint64_t>({0, 1, 2}));
+    EXPECT_EQ(chunk_ids(select_context_chunks(CHUNKS, RagInferenceSettings{.top_k = 4, .max_context_tokens = 5},
+                                              count_words)),
+              std::vector<uint64_t>({0, 1}));
+    EXPECT_TRUE(
+        select_context_chunks(CHUNKS, RagInferenceSettings{.top_k = 4, .max_context_tokens = 2}, count_words).empty());
+}
+
+TEST_F(PipelineTest, CheckCutoffsKeepTheUnsortedOrder)
+{
+    // The MMR selection is not sorted by the score, the gap is relative to the best chunk anywhere in the list.
+    const std::vector<RetrievedDocumentChunk> mmr_chunks{CHUNKS[1], CHUNKS[3], CHUNKS[0], CHUNKS[2]};
+    const auto selected = select_context_chunks(
+        mmr_chunks, RagInferenceSettings{.top_k = 4, .min_score = 0.6f, .max_relative_score_gap = 0.1f}, count_words);
+
+    EXPECT_EQ(chunk_ids(selected), std::vector<uint64_t>({1, 0}));
+}
+
+TEST_F(PipelineTest, CheckEmptyRetrieval)
+{
+    EXPECT_TRUE(select_context_chunks({}, RagInferenceSettings{.top_k = 4, .min_score = 0.5f}, count_words).empty());
+}
+
+} // namespace ds
@@ -0,0 +1,80 @@
+#include "rag/text_splitter.h"
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+
+namespace ds
+{
+
+TEST(TextSplitterTest, CheckWordsMergedUpToChunkSize)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 10}, default_separators());
+    EXPECT_EQ(splitter.split("aaa bbb ccc ddd"), std::vector<std::string>({"aaa bbb", "ccc ddd"}));
+}
+
+TEST(TextSplitterTest, CheckParagraphsSplitFirst)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 12}, default_separators());
+    EXPECT_EQ(splitter.split("one two\n\nthree four"), std::vector<std::string>({"one two", "three four"}));
+}
+
+TEST(TextSplitterTest, CheckLongPiecesSplitRecursively)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 8}, default_separators());
+    EXPECT_EQ(splitter.split("short\n\nmuch longer line"),
+              std::vector<std::string>({"short", "much", "longer", "line"}));
+}
+
+TEST(TextSplitterTest, CheckOverlap)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 5, .chunk_overlap = 2}, default_separators());
+    EXPECT_EQ(splitter.split("a b c d e"), std::vector<std::string>({"a b c", "c d", "d e"}));
+}
+
+TEST(TextSplitterTest, CheckCharactersCountedAsCodePoints)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 3}, default_separators());
+    EXPECT_EQ(splitter.split("zażółć"), std::vector<std::string>({"zaż", "ółć"}));
+    EXPECT_EQ(utf8_length("zażółć"), 6);
+}
+
+TEST(TextSplitterTest, CheckMarkdownHeadingsStartChunks)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 26}, markdown_separators());
+    EXPECT_EQ(splitter.split("# Title\nIntro\n## Section\nBody\n#hashtag"),
+              std::vector<std::string>({"# Title\nIntro", "## Section\nBody\n#hashtag"}));
+}
+
+TEST(TextSplitterTest, CheckMarkdownHorizontalRules)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 17}, markdown_separators());
+    EXPECT_EQ(splitter.split("first part\n---\nsecond part"),
+              std::vector<std::string>({"first part", "---\nsecond part"}));
+}
+
+TEST(TextSplitterTest, CheckCustomLengthFunction)
+{
+    const auto count_words = [](std::string_view text)
+    {
+        size_t words = 0;
+        for(size_t i = 0; i < text.size(); i++)
+            words += text[i] != ' ' && (i == 0 || text[i - 1] == ' ');
+        return words;
+    };
+    const RecursiveTextSplitter splitter({.chunk_size = 3, .length_function = count_words}, default_separators());
+    EXPECT_EQ(splitter.split("one two three four five"), std::vector<std::string>({"one two three", "four five"}));
+}
+
+TEST(TextSplitterTest, CheckWhitespaceOnlyTextHasNoChunks)
+{
+    const RecursiveTextSplitter splitter({.chunk_size = 4}, default_separators());
+    EXPECT_TRUE(splitter.split(" \n\n \n").empty());
+    EXPECT_TRUE(splitter.split("").empty());
+}
+
+TEST(TextSplitterTest, CheckInvalidParamsThrow)
+{
+    EXPECT_THROW(RecursiveTextSplitter({.chunk_size = 4, .chunk_overlap = 5}, default_separators()), std::logic_error);
+    EXPECT_THROW(RecursiveTextSplitter({.chunk_size = 4}, {}), std::logic_error);
+}
+} // namespace ds
@@ -1,6 +1,11 @@
 #include "rag/vector_database.h"
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
 namespace ds
 {
 
@@ -203,4 +208,587 @@ TEST_F(VectorDatabaseTest, CheckAddingNewVectorsAffectsResult)
 
     EXPECT_EQ(retrieved_2[0].index, 9);
 }
-} // namespace ds
\ No newline at end of file
+
+TEST_F(VectorDatabaseTest, CheckBatchRetrievalMatchesSingleQueries)
+{
+    auto db = vector_store_factory(2);
+
+    // Data for this test case was auto generated from python numpy (notebook in data_prep)
+    db->add({
+        Embedding{{0.536877, 0.857167}},
+        Embedding{{0.724262, 0.545856}},
+        Embedding{{0.174767, 0.821576}},
+        Embedding{{0.183661, 0.183714}},
+        Embedding{{0.073484, 0.596520}},
+        Embedding{{0.654126, 0.850020}},
+        Embedding{{0.516542, 0.628754}},
+        Embedding{{0.068895, 0.524529}},
+        Embedding{{0.645730, 0.757034}},
+        Embedding{{0.278235, 0.984015}},
+    });
+
+    const std::vector<Embedding> queries = {Embedding{{0.122122, 0.745582}}, Embedding{{1.f, 0.f}},
+                                            Embedding{{724.262, 545.856}}};
+    const auto retrieved = db->retrieve_batch(queries, 3);
+
+    ASSERT_EQ(queries.size(), retrieved.size());
+    for(size_t i = 0; i < queries.size(); i++)
+    {
+        const auto expected = db->retrieve(queries[i], 3);
+        ASSERT_EQ(expected.size(), retrieved[i].size());
+        for(size_t j = 0; j < expected.size(); j++)
+        {
+            EXPECT_EQ(expected[j].index, retrieved[i][j].index);
+            EXPECT_NEAR(expected[j].cosine_similarity, retrieved[i][j].cosine_similarity, 0.0001f);
+        }
+    }
+    EXPECT_EQ(retrieved[2][0].index, 1);
+}
+
+TEST_F(VectorDatabaseTest, CheckBatchRetrievalThrowsOnInvalidQuery)
+{
+    auto db = vector_store_factory(2);
+    db->add({Embedding{{1.f, 0.f}}});
+
+    EXPECT_THROW(db->retrieve_batch({Embedding{{1.f, 0.f}}, Embedding{{1.f, 0.f, 0.f}}}, 1), std::logic_error);
+}
+
+TEST_F(VectorDatabaseTest, CheckRetrievingMoreThanIndexed)
+{
+    auto db = vector_store_factory(2);
+    db->add({Embedding{{1.f, 0.f}}, Embedding{{0.f, 1.f}}});
+
+    const auto retrieved = db->retrieve(std::vector<float>({1.f, 0.f}), 5);
+
+    ASSERT_EQ(2, retrieved.size());
+    EXPECT_EQ(retrieved[0].index, 0);
+    EXPECT_EQ(retrieved[1].index, 1);
+}
+
+static std::vector<Embedding> create_random_embeddings(size_t embedding_rank, size_t n)
+{
+    std::mt19937 gen(7);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+
+    std::vector<Embedding> embeddings(n, Embedding(embedding_rank));
+    for(auto& embedding : embeddings)
+        std::ranges::generate(embedding, [&]() { return dist(gen); });
+
+    return embeddings;
+}
+
+TEST_F(VectorDatabaseTest, CheckHnswRetrievesTheExact)
+{
+    auto db = vector_store_factory(16, VectorStoreParams{.index_type = VectorIndexType::HNSW});
+    const auto embeddings = create_random_embeddings(16, 500);
+    db->add(embeddings);
+
+    for(size_t i = 0; i < embeddings.size(); i += 50)
+    {
+        const auto retrieved = db->retrieve(embeddings[i], 1);
+        ASSERT_EQ(1, retrieved.size());
+        EXPECT_EQ(retrieved[0].index, i);
+        EXPECT_NEAR(retrieved[0].cosine_similarity, 1.f, 0.0001f);
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckIvfSearchesExhaustivelyBeforeTraining)
+{
+    auto db = vector_store_factory(2, VectorStoreParams{.index_type = VectorIndexType::IVF_FLAT, .ivf_nlist = 4});
+
+    db->add({Embedding{{1.f, 0.f}}, Embedding{{.9f, .1f}}, Embedding{{.8f, .2f}}, Embedding{{.7f, .3f}},
+             Embedding{{.6f, .4f}}});
+
+    auto retrieved = db->retrieve(std::vector<float>({0.75f, 0.15f}), 1);
+
+    ASSERT_EQ(1, retrieved.size());
+    EXPECT_EQ(retrieved[0].index, 2);
+}
+
+TEST_F(VectorDatabaseTest, CheckIvfKeepsIndicesAfterTraining)
+{
+    auto db = vector_store_factory(
+        16, VectorStoreParams{.index_type = VectorIndexType::IVF_FLAT, .ivf_nlist = 4, .ivf_nprobe = 4});
+    const auto embeddings = create_random_embeddings(16, 400);
+
+    // The first batch is too small to train the index, the second one triggers the training.
+    db->add(std::vector<Embedding>(embeddings.begin(), embeddings.begin() + 100));
+    db->add(std::vector<Embedding>(embeddings.begin() + 100, embeddings.end()));
+
+    for(size_t i = 0; i < embeddings.size(); i += 40)
+    {
+        const auto retrieved = db->retrieve(embeddings[i], 1);
+        ASSERT_EQ(1, retrieved.size());
+        EXPECT_EQ(retrieved[0].index, i);
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckScalarQuantizedStoresRetrieveTheClosest)
+{
+    for(const auto index_type : {VectorIndexType::SQ8, VectorIndexType::SQ_FP16})
+    {
+        auto db = vector_store_factory(16, VectorStoreParams{.index_type = index_type});
+        const auto embeddings = create_random_embeddings(16, 2000);
+        db->add(embeddings);
+
+        ASSERT_EQ(db->size(), embeddings.size());
+        for(size_t i = 0; i < embeddings.size(); i += 200)
+        {
+            const auto retrieved = db->retrieve(embeddings[i], 1);
+            ASSERT_EQ(1, retrieved.size());
+            EXPECT_EQ(retrieved[0].index, i);
+            EXPECT_NEAR(retrieved[0].cosine_similarity, 1.f, 0.05f);
+        }
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckRefinedPqReturnsExactSimilarities)
+{
+    auto db = vector_store_factory(
+        16, VectorStoreParams{.index_type = VectorIndexType::PQ, .pq_m = 4, .refine_type = VectorRefineType::FP32});
+    const auto embeddings = create_random_embeddings(16, 10000);
+    db->add(embeddings);
+
+    for(size_t i = 0; i < embeddings.size(); i += 1000)
+    {
+        const auto retrieved = db->retrieve(embeddings[i], 1);
+        ASSERT_EQ(1, retrieved.size());
+        EXPECT_EQ(retrieved[0].index, i);
+        EXPECT_NEAR(retrieved[0].cosine_similarity, 1.f, 0.0001f);
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckCompressedStoreUsesLessMemory)
+{
+    const auto embeddings = create_random_embeddings(64, 2000);
+
+    auto flat_db = vector_store_factory(64);
+    flat_db->add(embeddings);
+    auto sq8_db = vector_store_factory(64, VectorStoreParams{.index_type = VectorIndexType::SQ8});
+    sq8_db->add(embeddings);
+
+    EXPECT_LT(sq8_db->get_memory_usage_bytes() * 3, flat_db->get_memory_usage_bytes());
+}
+
+TEST_F(VectorDatabaseTest, CheckPqThrowsOnInvalidSubQuantizers)
+{
+    EXPECT_THROW(vector_store_factory(10, VectorStoreParams{.index_type = VectorIndexType::PQ, .pq_m = 4}),
+                 std::logic_error);
+}
+
+TEST_F(VectorDatabaseTest, CheckBinaryStoreRetrievesTheExact)
+{
+    for(const auto refine_type : {VectorRefineType::NONE, VectorRefineType::FP16, VectorRefineType::FP32})
+    {
+        // The rank is deliberately not a multiple of 8 to exercise the code padding.
+        auto db = vector_store_factory(
+            60, VectorStoreParams{.index_type = VectorIndexType::BINARY, .refine_type = refine_type});
+        const auto embeddings = create_random_embeddings(60, 1000);
+        db->add(embeddings);
+
+        ASSERT_EQ(db->size(), embeddings.size());
+        for(size_t i = 0; i < embeddings.size(); i += 100)
+        {
+            const auto retrieved = db->retrieve(embeddings[i], 3);
+            ASSERT_EQ(3, retrieved.size());
+            EXPECT_EQ(retrieved[0].index, i);
+            EXPECT_NEAR(retrieved[0].cosine_similarity, 1.f, 0.001f);
+            EXPECT_GE(retrieved[0].cosine_similarity, retrieved[1].cosine_similarity);
+            EXPECT_GE(retrieved[1].cosine_similarity, retrieved[2].cosine_similarity);
+        }
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckBinaryStoreRerankReturnsCosineSimilarity)
+{
+    auto db = vector_store_factory(
+        2, VectorStoreParams{.index_type = VectorIndexType::BINARY, .refine_type = VectorRefineType::FP32});
+
+    db->add({Embedding{{1.f, 0.f}}, Embedding{{.9f, .1f}}, Embedding{{.8f, .2f}}, Embedding{{.7f, .3f}},
+             Embedding{{.6f, .4f}}});
+
+    // All the vectors share the same signs, the order comes from the re-rank only.
+    auto retrieved = db->retrieve(std::vector<float>({0.75f, 0.15f}), 1);
+
+    ASSERT_EQ(1, retrieved.size());
+    EXPECT_EQ(retrieved[0].index, 2);
+    EXPECT_GE(retrieved[0].cosine_similarity, 0.95f);
+}
+
+TEST_F(VectorDatabaseTest, CheckSaveAndLoadRestoresTheIndex)
+{
+    const auto embeddings = create_random_embeddings(16, 400);
+    const auto index_path = std::filesystem::temp_directory_path() / "vector_database_test.index";
+
+    for(const auto index_type : {VectorIndexType::FLAT, VectorIndexType::IVF_FLAT, VectorIndexType::HNSW,
+                                 VectorIndexType::BINARY, VectorIndexType::NATIVE_FLAT})
+    {
+        const auto params = VectorStoreParams{.index_type = index_type, .ivf_nlist = 4, .ivf_nprobe = 4};
+        auto db = vector_store_factory(16, params);
+        db->add(embeddings);
+        db->save(index_path);
+
+        auto loaded_db = vector_store_factory(16, params);
+        loaded_db->load(index_path);
+
+        ASSERT_EQ(loaded_db->size(), db->size());
+        for(size_t i = 0; i < embeddings.size(); i += 40)
+        {
+            const auto expected = db->retrieve(embeddings[i], 3);
+            const auto retrieved = loaded_db->retrieve(embeddings[i], 3);
+            ASSERT_EQ(expected.size(), retrieved.size());
+            for(size_t j = 0; j < expected.size(); j++)
+            {
+                EXPECT_EQ(retrieved[j].index, expected[j].index);
+                EXPECT_FLOAT_EQ(retrieved[j].cosine_similarity, expected[j].cosine_similarity);
+            }
+        }
+    }
+
+    std::filesystem::remove(index_path);
+}
+
+TEST_F(VectorDatabaseTest, CheckLoadedIvfAcceptsNewVectors)
+{
+    const auto embeddings = create_random_embeddings(16, 500);
+    const auto index_path = std::filesystem::temp_directory_path() / "vector_database_ivf_test.index";
+    const auto params = VectorStoreParams{.index_type = VectorIndexType::IVF_FLAT, .ivf_nlist = 4, .ivf_nprobe = 4};
+
+    auto db = vector_store_factory(16, params);
+    db->add(std::vector<Embedding>(embeddings.begin(), embeddings.begin() + 400));
+    db->save(index_path);
+
+    // The inverted lists are memory mapped, adding to the loaded index must not touch the file.
+    auto loaded_db = vector_store_factory(16, params);
+    loaded_db->load(index_path);
+    loaded_db->add(std::vector<Embedding>(embeddings.begin() + 400, embeddings.end()));
+
+    ASSERT_EQ(loaded_db->size(), embeddings.size());
+    EXPECT_EQ(loaded_db->retrieve(embeddings[450], 1)[0].index, 450);
+    EXPECT_EQ(loaded_db->retrieve(embeddings[50], 1)[0].index, 50);
+
+    std::filesystem::remove(index_path);
+}
+
+TEST_F(VectorDatabaseTest, CheckLoadThrowsOnRankMismatch)
+{
+    const auto index_path = std::filesystem::temp_directory_path() / "vector_database_rank_test.index";
+
+    auto db = vector_store_factory(16);
+    db->add(create_random_embeddings(16, 10));
+    db->save(index_path);
+
+    auto other_db = vector_store_factory(8);
+    EXPECT_THROW(other_db->load(index_path), std::runtime_error);
+
+    std::filesystem::remove(index_path);
+}
+
+TEST_F(VectorDatabaseTest, CheckNativeStoreLoadThrowsOnCorruptedRowCount)
+{
+    const auto index_path = std::filesystem::temp_directory_path() / "vector_database_corrupted_test.index";
+    const VectorStoreParams params{.index_type = VectorIndexType::NATIVE_FLAT};
+
+    auto db = vector_store_factory(16, params);
+    db->add(create_random_embeddings(16, 10));
+    db->save(index_path);
+
+    // The row count follows the magic and the rank in the header.
+    for(const uint64_t n_rows : {uint64_t{11}, uint64_t{1} << 62})
+    {
+        std::fstream file(index_path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(2 * sizeof(uint64_t));
+        file.write(reinterpret_cast<const char*>(&n_rows), sizeof(n_rows));
+        file.close();
+
+        auto loaded_db = vector_store_factory(16, params);
+        EXPECT_THROW(loaded_db->load(index_path), std::runtime_error);
+        EXPECT_EQ(loaded_db->size(), 0);
+    }
+
+    std::filesystem::remove(index_path);
+}
+
+TEST_F(VectorDatabaseTest, CheckNativeStoreMatchesFaissFlat)
+{
+    // The rank is deliberately not a multiple of the SIMD block to exercise the row padding.
+    const auto embeddings = create_random_embeddings(37, 1000);
+    const auto queries = create_random_embeddings(37, 20);
+
+    auto faiss_db = vector_store_factory(37);
+    faiss_db->add(embeddings);
+    auto native_db = vector_store_factory(37, VectorStoreParams{.index_type = VectorIndexType::NATIVE_FLAT});
+    native_db->add(std::vector<Embedding>(embeddings.begin(), embeddings.begin() + 500));
+    native_db->add(std::vector<Embedding>(embeddings.begin() + 500, embeddings.end()));
+
+    ASSERT_EQ(native_db->size(), faiss_db->size());
+
+    const auto expected = faiss_db->retrieve_batch(queries, 5);
+    const auto retrieved = native_db->retrieve_batch(queries, 5);
+    ASSERT_EQ(expected.size(), retrieved.size());
+    for(size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(expected[i].size(), retrieved[i].size());
+        for(size_t j = 0; j < expected[i].size(); j++)
+        {
+            EXPECT_EQ(retrieved[i][j].index, expected[i][j].index);
+            EXPECT_NEAR(retrieved[i][j].cosine_similarity, expected[i][j].cosine_similarity, 0.0001f);
+        }
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckNativeStoreEdgeCases)
+{
+    auto db = vector_store_factory(2, VectorStoreParams{.index_type = VectorIndexType::NATIVE_FLAT});
+
+    EXPECT_TRUE(db->retrieve(std::vector<float>({1.f, 0.f}), 3).empty());
+    EXPECT_THROW(db->add({Embedding{{1.0, 0.0, 1.4}}}), std::logic_error);
+    EXPECT_THROW(db->retrieve(std::vector<float>({1.f, 0.f, 0.f}), 1), std::logic_error);
+
+    db->add({Embedding{{1.f, 0.f}}, Embedding{{0.f, 2.f}}});
+    const auto retrieved = db->retrieve(std::vector<float>({0.f, 0.5f}), 5);
+
+    ASSERT_EQ(2, retrieved.size());
+    EXPECT_EQ(retrieved[0].index, 1);
+    EXPECT_NEAR(retrieved[0].cosine_similarity, 1.f, 0.0001f);
+    EXPECT_EQ(retrieved[1].index, 0);
+    EXPECT_NEAR(retrieved[1].cosine_similarity, 0.f, 0.0001f);
+}
+
+TEST_F(VectorDatabaseTest, CheckAddingMatrixMatchesAddingRows)
+{
+    const auto embeddings = create_random_embeddings(16, 100);
+
+    auto rows_db = vector_store_factory(16);
+    rows_db->add(embeddings);
+    auto matrix_db = vector_store_factory(16);
+    matrix_db->add(EmbeddingMatrix::from_rows(embeddings));
+
+    ASSERT_EQ(matrix_db->size(), rows_db->size());
+    const auto expected = rows_db->retrieve(embeddings[42], 3);
+    const auto retrieved = matrix_db->retrieve(embeddings[42], 3);
+    ASSERT_EQ(expected.size(), retrieved.size());
+    for(size_t i = 0; i < expected.size(); i++)
+        EXPECT_EQ(retrieved[i].index, expected[i].index);
+}
+
+TEST_F(VectorDatabaseTest, CheckEmbeddingMatrixValidatesRank)
+{
+    EXPECT_THROW(EmbeddingMatrix::from_rows({Embedding{{1.f, 0.f}}, Embedding{{1.f, 0.f, 0.f}}}), std::logic_error);
+    EXPECT_THROW(EmbeddingMatrix(std::vector<float>(5), 2), std::logic_error);
+
+    auto db = vector_store_factory(2);
+    EXPECT_THROW(db->add(EmbeddingMatrix(3, 4)), std::logic_error);
+    EXPECT_NO_THROW(db->add(EmbeddingMatrix()));
+    EXPECT_EQ(db->size(), 0);
+}
+
+TEST_F(VectorDatabaseTest, CheckReconstructReturnsNormalizedVectors)
+{
+    for(const auto index_type : {VectorIndexType::FLAT, VectorIndexType::IVF_FLAT, VectorIndexType::HNSW,
+                                 VectorIndexType::NATIVE_FLAT})
+    {
+        auto db = vector_store_factory(2, VectorStoreParams{.index_type = index_type, .ivf_nlist = 4});
+        db->add({Embedding{{3.f, 4.f}}, Embedding{{0.f, 2.f}}, Embedding{{1.f, 0.f}}});
+
+        const auto reconstructed = db->reconstruct(1, 2);
+        ASSERT_EQ(reconstructed.rows(), 2);
+        EXPECT_NEAR(reconstructed.row(0)[0], 0.f, 0.0001f);
+        EXPECT_NEAR(reconstructed.row(0)[1], 1.f, 0.0001f);
+        EXPECT_NEAR(reconstructed.row(1)[0], 1.f, 0.0001f);
+        EXPECT_NEAR(reconstructed.row(1)[1], 0.f, 0.0001f);
+
+        EXPECT_THROW(db->reconstruct(2, 2), std::out_of_range);
+        EXPECT_TRUE(db->reconstructs_exactly());
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckCompressedStoresReconstructExactlyWithFp32RefineOnly)
+{
+    const auto create = [](VectorIndexType index_type, VectorRefineType refine_type)
+    {
+        auto db = vector_store_factory(4, VectorStoreParams{.index_type = index_type, .pq_m = 2,
+                                                            .refine_type = refine_type});
+        db->add({Embedding{{0.3f, -0.1f, 0.5f, -2.f}}});
+        return db;
+    };
+
+    EXPECT_FALSE(create(VectorIndexType::SQ_FP16, VectorRefineType::NONE)->reconstructs_exactly());
+    EXPECT_FALSE(create(VectorIndexType::SQ_FP16, VectorRefineType::FP16)->reconstructs_exactly());
+    EXPECT_TRUE(create(VectorIndexType::SQ_FP16, VectorRefineType::FP32)->reconstructs_exactly());
+    EXPECT_FALSE(create(VectorIndexType::HNSW, VectorRefineType::FP16)->reconstructs_exactly());
+    EXPECT_FALSE(create(VectorIndexType::BINARY, VectorRefineType::NONE)->reconstructs_exactly());
+    EXPECT_TRUE(create(VectorIndexType::BINARY, VectorRefineType::FP32)->reconstructs_exactly());
+    // Until PQ is trained, the vectors are kept as they are.
+    EXPECT_TRUE(create(VectorIndexType::PQ, VectorRefineType::NONE)->reconstructs_exactly());
+}
+
+TEST_F(VectorDatabaseTest, CheckBinaryStoreReconstructsSigns)
+{
+    auto db = vector_store_factory(4, VectorStoreParams{.index_type = VectorIndexType::BINARY});
+    db->add({Embedding{{0.3f, -0.1f, 0.5f, -2.f}}});
+
+    const auto reconstructed = db->reconstruct(0, 1);
+    ASSERT_EQ(reconstructed.rows(), 1);
+    EXPECT_FLOAT_EQ(reconstructed.row(0)[0], 0.5f);
+    EXPECT_FLOAT_EQ(reconstructed.row(0)[1], -0.5f);
+    EXPECT_FLOAT_EQ(reconstructed.row(0)[2], 0.5f);
+    EXPECT_FLOAT_EQ(reconstructed.row(0)[3], -0.5f);
+}
+
+TEST_F(VectorDatabaseTest, CheckIndexBitmap)
+{
+    IndexBitmap bitmap(20);
+    bitmap.set(0);
+    bitmap.set(9);
+    bitmap.set(19);
+
+    EXPECT_EQ(bitmap.count(), 3);
+    EXPECT_TRUE(bitmap.test(9));
+    EXPECT_FALSE(bitmap.test(10));
+    EXPECT_FALSE(bitmap.test(25));
+
+    std::vector<size_t> set_indices;
+    bitmap.for_each_set([&set_indices](size_t idx) { set_indices.push_back(idx); });
+    EXPECT_EQ(set_indices, std::vector<size_t>({0, 9, 19}));
+
+    const auto sliced = bitmap.slice(9, 8);
+    EXPECT_EQ(sliced.size(), 8);
+    EXPECT_EQ(sliced.count(), 1);
+    EXPECT_TRUE(sliced.test(0));
+    EXPECT_EQ(bitmap.slice(3, 17).count(), 2);
+    EXPECT_TRUE(bitmap.slice(3, 17).test(16));
+    EXPECT_EQ(bitmap.slice(18, 10).count(), 1);
+}
+
+TEST_F(VectorDatabaseTest, CheckPagedIndexBitmapCopiesArePrivate)
+{
+    PagedIndexBitmap bitmap(70000);
+    bitmap.set(3);
+    bitmap.set(69999);
+    const auto flat = bitmap.flat();
+
+    PagedIndexBitmap copy = bitmap;
+    copy.reset(3);
+    copy.resize(140000);
+    copy.set(100000);
+
+    EXPECT_TRUE(bitmap.test(3));
+    EXPECT_FALSE(bitmap.test(100000));
+    EXPECT_EQ(bitmap.flat(), flat);
+    EXPECT_EQ(flat->size(), 70000);
+    EXPECT_EQ(flat->count(), 2);
+    EXPECT_TRUE(flat->test(69999));
+
+    std::vector<size_t> set_indices;
+    copy.for_each_set([&set_indices](size_t idx) { set_indices.push_back(idx); });
+    EXPECT_EQ(set_indices, std::vector<size_t>({69999, 100000}));
+    EXPECT_EQ(copy.flat()->count(), 2);
+    EXPECT_TRUE(copy.flat()->test(100000));
+}
+
+TEST_F(VectorDatabaseTest, CheckFilteredRetrievalReturnsSelectedOnly)
+{
+    const auto embeddings = create_random_embeddings(16, 2000);
+
+    // Every third vector passes the wide filter, every hundredth passes the selective one.
+    IndexBitmap wide_filter(embeddings.size());
+    IndexBitmap selective_filter(embeddings.size());
+    for(size_t i = 0; i < embeddings.size(); i += 3)
+        wide_filter.set(i);
+    for(size_t i = 0; i < embeddings.size(); i += 100)
+        selective_filter.set(i);
+
+    for(const auto index_type : {VectorIndexType::FLAT, VectorIndexType::IVF_FLAT, VectorIndexType::HNSW,
+                                 VectorIndexType::SQ8, VectorIndexType::BINARY, VectorIndexType::NATIVE_FLAT})
+    {
+        // The compressed indices are refined, so the query is guaranteed to be scored first.
+        const bool compressed = index_type == VectorIndexType::SQ8 || index_type == VectorIndexType::BINARY;
+        auto db = vector_store_factory(
+            16, VectorStoreParams{.index_type = index_type, .ivf_nlist = 8, .ivf_nprobe = 8,
+                                  .refine_type = compressed ? VectorRefineType::FP32 : VectorRefineType::NONE});
+        db->add(embeddings);
+
+        for(const auto* filter : {&wide_filter, &selective_filter})
+        {
+            // The query is one of the selected vectors, it must be found first.
+            const auto retrieved = db->retrieve_filtered(embeddings[300], 5, *filter);
+            ASSERT_EQ(5, retrieved.size());
+            EXPECT_EQ(retrieved[0].index, 300);
+            EXPECT_TRUE(std::ranges::all_of(retrieved, [filter](const RetrievedIndex& retrieved_index)
+                                            { return filter->test(retrieved_index.index); }));
+        }
+
+        EXPECT_TRUE(db->retrieve_filtered(embeddings[0], 5, IndexBitmap(embeddings.size())).empty());
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckCompactedStoreKeepsSelectedVectorsInOrder)
+{
+    const auto embeddings = create_random_embeddings(16, 600);
+    IndexBitmap keep(embeddings.size());
+    std::vector<size_t> kept_indices;
+    for(size_t i = 0; i < embeddings.size(); i++)
+    {
+        if(i % 4 != 0)
+        {
+            keep.set(i);
+            kept_indices.push_back(i);
+        }
+    }
+
+    for(const auto index_type : {VectorIndexType::FLAT, VectorIndexType::IVF_FLAT, VectorIndexType::HNSW,
+                                 VectorIndexType::SQ_FP16, VectorIndexType::BINARY, VectorIndexType::NATIVE_FLAT})
+    {
+        auto db = vector_store_factory(
+            16, VectorStoreParams{.index_type = index_type, .ivf_nlist = 4, .ivf_nprobe = 4,
+                                  .refine_type = VectorRefineType::FP32});
+        db->add(embeddings);
+
+        const auto compacted_db = db->compacted(keep);
+        ASSERT_EQ(compacted_db->size(), kept_indices.size());
+        EXPECT_EQ(db->size(), embeddings.size());
+
+        for(size_t i = 0; i < kept_indices.size(); i += 50)
+        {
+            const auto retrieved = compacted_db->retrieve(embeddings[kept_indices[i]], 1);
+            ASSERT_EQ(1, retrieved.size());
+            EXPECT_EQ(retrieved[0].index, i);
+        }
+
+        EXPECT_THROW(db->compacted(IndexBitmap(10)), std::logic_error);
+    }
+}
+
+TEST_F(VectorDatabaseTest, CheckCloneIsIndependentOfTheSource)
+{
+    const auto embeddings = create_random_embeddings(16, 500);
+    const auto index_path = std::filesystem::temp_directory_path() / "vector_database_clone_test.index";
+
+    for(const auto index_type : {VectorIndexType::FLAT, VectorIndexType::IVF_FLAT, VectorIndexType::HNSW,
+                                 VectorIndexType::PQ, VectorIndexType::BINARY, VectorIndexType::NATIVE_FLAT})
+    {
+        const auto params = VectorStoreParams{.index_type = index_type, .ivf_nlist = 4, .ivf_nprobe = 4, .pq_m = 4,
+                                              .refine_type = VectorRefineType::FP32};
+        auto db = vector_store_factory(16, params);
+        db->add(std::vector<Embedding>(embeddings.begin(), embeddings.begin() + 400));
+
+        // The loaded IVF index has memory mapped inverted lists, they are copied to the clone.
+        db->save(index_path);
+        auto loaded_db = db->empty_like();
+        EXPECT_EQ(loaded_db->size(), 0);
+        loaded_db->load(index_path);
+
+        auto cloned_db = loaded_db->clone();
+        cloned_db->add(std::vector<Embedding>(embeddings.begin() + 400, embeddings.end()));
+
+        EXPECT_EQ(loaded_db->size(), 400);
+        ASSERT_EQ(cloned_db->size(), embeddings.size());
+        EXPECT_EQ(cloned_db->retrieve(embeddings[450], 1)[0].index, 450);
+        EXPECT_EQ(cloned_db->retrieve(embeddings[50], 1)[0].index, 50);
+        EXPECT_EQ(loaded_db->retrieve(embeddings[50], 1)[0].index, 50);
+    }
+
+    std::filesystem::remove(index_path);
+}
+} // namespace ds